@@ -0,0 +1,401 @@
+/*
+ * Benchmark harness: results, measurement, loopback peers and profiles, see ``bench.h''
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <bench.h>
+
+#include <netinet/in.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/*
+ * Interval at which peers run tox_do(), in milliseconds
+ */
+#define BENCH_PEER_INTERVAL 5
+
+static FILE* g_OUTPUT = NULL;
+
+// Results ------------------------------------------------------------------------------------------------------------
+
+static FILE* getOutput(void) {
+    return (g_OUTPUT != NULL) ? g_OUTPUT : stdout;
+}
+
+gboolean Bench_openOutput(const char* path) {
+    g_OUTPUT = fopen(path, "w");
+    if (g_OUTPUT == NULL) {
+        fprintf(stderr, "could not open %s for writing\n", path);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+void Bench_closeOutput(void) {
+    if (g_OUTPUT != NULL) {
+        fclose(g_OUTPUT);
+        g_OUTPUT = NULL;
+    }
+}
+
+void Bench_begin(const char* benchmark) {
+    GDateTime* now = g_date_time_new_now_utc();
+    gchar* timestamp = g_date_time_format(now, "%Y-%m-%dT%H:%M:%SZ");
+
+    fprintf(getOutput(), "{\"benchmark\": \"%s\", \"version\": \"%s\", \"started\": \"%s\"}\n",
+            benchmark, VERSION, timestamp);
+    fflush(getOutput());
+
+    g_free(timestamp);
+    g_date_time_unref(now);
+}
+
+void Bench_parameter(const char* benchmark, const char* name, gint64 value) {
+    fprintf(getOutput(), "{\"benchmark\": \"%s\", \"parameter\": \"%s\", \"value\": %" G_GINT64_FORMAT "}\n",
+            benchmark, name, value);
+    fflush(getOutput());
+}
+
+void Bench_result(const char* benchmark, const char* metric, const char* unit, gdouble value) {
+    fprintf(getOutput(), "{\"benchmark\": \"%s\", \"metric\": \"%s\", \"unit\": \"%s\", \"value\": %.3f}\n",
+            benchmark, metric, unit, value);
+    fflush(getOutput());
+}
+
+void Bench_failure(const char* benchmark, const char* reason) {
+    fprintf(getOutput(), "{\"benchmark\": \"%s\", \"error\": \"%s\"}\n", benchmark, reason);
+    fflush(getOutput());
+    fprintf(stderr, "%s: %s\n", benchmark, reason);
+}
+
+void Bench_Series_init(Bench_Series* series) {
+    series->samples = g_array_new(FALSE, FALSE, sizeof(gdouble));
+}
+
+void Bench_Series_clear(Bench_Series* series) {
+    g_array_free(series->samples, TRUE);
+    series->samples = NULL;
+}
+
+void Bench_Series_add(Bench_Series* series, gdouble sample) {
+    g_array_append_val(series->samples, sample);
+}
+
+static gint compareSamples(gconstpointer a, gconstpointer b) {
+    gdouble left = *(const gdouble*) a;
+    gdouble right = *(const gdouble*) b;
+    return (left > right) - (left < right);
+}
+
+/*
+ * Nearest rank percentile of sorted samples
+ */
+static gdouble getPercentile(GArray* sorted, gdouble percentile) {
+    guint rank = (guint) (percentile / 100.0 * sorted->len + 0.5);
+    rank = CLAMP(rank, 1, sorted->len);
+    return g_array_index(sorted, gdouble, rank - 1);
+}
+
+void Bench_Series_report(Bench_Series* series, const char* benchmark, const char* metric, const char* unit) {
+    GArray* samples = series->samples;
+    if (samples->len == 0) {
+        Bench_failure(benchmark, "no samples");
+        return;
+    }
+
+    g_array_sort(samples, compareSamples);
+
+    gdouble sum = 0;
+    guint i;
+    for (i = 0; i < samples->len; i++) {
+        sum += g_array_index(samples, gdouble, i);
+    }
+
+    fprintf(getOutput(), "{\"benchmark\": \"%s\", \"metric\": \"%s\", \"unit\": \"%s\", \"samples\": %u, "
+                    "\"min\": %.3f, \"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f}\n",
+            benchmark, metric, unit, samples->len,
+            g_array_index(samples, gdouble, 0), sum / samples->len,
+            getPercentile(samples, 50), getPercentile(samples, 90), getPercentile(samples, 99),
+            g_array_index(samples, gdouble, samples->len - 1));
+    fflush(getOutput());
+}
+
+// Measurement --------------------------------------------------------------------------------------------------------
+
+glong Bench_peakRss(void) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return -1;
+    }
+    return usage.ru_maxrss; // KiB on Linux
+}
+
+gint64 Bench_cpuTime(void) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return -1;
+    }
+    return ((gint64) usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * G_USEC_PER_SEC +
+           usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+/*
+ * Keeps the main loop from blocking for long when nothing else is scheduled
+ */
+static gboolean onWakeUp(gpointer data) {
+    return TRUE;
+}
+
+gboolean Bench_runUntil(gboolean (*done)(gpointer), gpointer data, guint timeout) {
+    gint64 deadline = Bench_now() + (gint64) timeout * 1000;
+    guint wakeUp = g_timeout_add(10, onWakeUp, NULL);
+    gboolean finished = FALSE;
+
+    while (!(finished = (done != NULL) && done(data)) && (Bench_now() < deadline)) {
+        g_main_context_iteration(NULL, TRUE);
+    }
+
+    g_source_remove(wakeUp);
+    return finished;
+}
+
+void Bench_runFor(guint duration) {
+    Bench_runUntil(NULL, NULL, duration);
+}
+
+// Loopback peers -----------------------------------------------------------------------------------------------------
+
+/*
+ * UDP ports bound by this process.
+ *
+ * Tox binds the first free port from 33445 upwards and does not say which one it got,
+ * so a peer's port is found by looking for the socket that appeared while it was created.
+ */
+static GHashTable* getUdpPorts(void) {
+    GHashTable* ports = g_hash_table_new(g_direct_hash, g_direct_equal);
+    long max = MIN(sysconf(_SC_OPEN_MAX), 4096);
+
+    int fd;
+    for (fd = 0; fd < max; fd++) {
+        int type;
+        socklen_t length = sizeof(type);
+        if ((getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &length) != 0) || (type != SOCK_DGRAM)) {
+            continue;
+        }
+
+        struct sockaddr_storage address;
+        length = sizeof(address);
+        if (getsockname(fd, (struct sockaddr*) &address, &length) != 0) {
+            continue;
+        }
+
+        uint16_t port = 0;
+        if (address.ss_family == AF_INET) {
+            port = ntohs(((struct sockaddr_in*) &address)->sin_port);
+        }
+        else if (address.ss_family == AF_INET6) {
+            port = ntohs(((struct sockaddr_in6*) &address)->sin6_port);
+        }
+
+        if (port != 0) {
+            g_hash_table_insert(ports, GUINT_TO_POINTER(port), GUINT_TO_POINTER(port));
+        }
+    }
+    return ports;
+}
+
+static void onPeerMessage(Tox* tox, int32_t friend_number, const uint8_t* message, uint16_t length, void* data) {
+    Bench_Peer* peer = data;
+    peer->messages++;
+
+    if (peer->echo) {
+        tox_send_message(tox, friend_number, message, length);
+    }
+}
+
+static void onPeerFileRequest(Tox* tox, int32_t friend_number, uint8_t file_number, uint64_t size,
+                              const uint8_t* name, uint16_t length, void* data) {
+    Bench_Peer* peer = data;
+    peer->file_bytes = 0;
+    peer->file_started = Bench_now();
+    peer->file_finished = 0;
+    tox_file_send_control(tox, friend_number, 1, file_number, TOX_FILECONTROL_ACCEPT, NULL, 0);
+}
+
+static void onPeerFileData(Tox* tox, int32_t friend_number, uint8_t file_number, const uint8_t* bytes,
+                           uint16_t length, void* data) {
+    Bench_Peer* peer = data;
+    peer->file_bytes += length;
+}
+
+static void onPeerFileControl(Tox* tox, int32_t friend_number, uint8_t receive_send, uint8_t file_number,
+                              uint8_t control, const uint8_t* bytes, uint16_t length, void* data) {
+    Bench_Peer* peer = data;
+
+    if ((receive_send == 0) && (control == TOX_FILECONTROL_FINISHED)) {
+        peer->file_finished = Bench_now();
+        tox_file_send_control(tox, friend_number, 1, file_number, TOX_FILECONTROL_FINISHED, NULL, 0);
+    }
+    else if ((receive_send == 1) && (control == TOX_FILECONTROL_ACCEPT) && (file_number == peer->file_number)) {
+        peer->file_started = Bench_now();
+    }
+    else if ((receive_send == 1) && (control == TOX_FILECONTROL_KILL) && (file_number == peer->file_number)) {
+        peer->file_remaining = 0;
+        peer->file_number = -1;
+    }
+}
+
+static void sendPendingFileData(Bench_Peer* peer) {
+    static uint8_t chunk[65536];
+
+    while (peer->file_remaining > 0) {
+        int size = tox_file_data_size(peer->tox, peer->file_friend);
+        if (size <= 0) {
+            return;
+        }
+
+        uint16_t length = (uint16_t) MIN((guint64) MIN(size, (int) sizeof(chunk)), peer->file_remaining);
+        if (tox_file_send_data(peer->tox, peer->file_friend, (uint8_t) peer->file_number, chunk, length) != 0) {
+            return; // congested, retry on the next tick
+        }
+        peer->file_remaining -= length;
+    }
+
+    tox_file_send_control(peer->tox, peer->file_friend, 0, (uint8_t) peer->file_number,
+                          TOX_FILECONTROL_FINISHED, NULL, 0);
+    peer->file_number = -1;
+}
+
+static gboolean onPeerTick(gpointer data) {
+    Bench_Peer* peer = data;
+    tox_do(peer->tox);
+
+    while (peer->burst > 0) {
+        gchar message[32];
+        g_snprintf(message, sizeof(message), "burst %u", peer->burst);
+        if (tox_send_message(peer->tox, peer->burst_friend, (uint8_t*) message, strlen(message)) == 0) {
+            break; // congested, retry on the next tick
+        }
+        peer->burst--;
+    }
+
+    if ((peer->file_number >= 0) && (peer->file_started != 0)) {
+        sendPendingFileData(peer);
+    }
+    return TRUE;
+}
+
+Bench_Peer* Bench_Peer_new(const Bench_Peer* bootstrap) {
+    GHashTable* before = getUdpPorts();
+
+    Tox* tox = tox_new(NULL);
+    if (tox == NULL) {
+        g_hash_table_destroy(before);
+        return NULL;
+    }
+
+    Bench_Peer* peer = g_new0(Bench_Peer, 1);
+    peer->tox = tox;
+    peer->file_number = -1;
+    tox_get_address(tox, peer->address);
+    peer->key = ToxPRPL_toxClientIdToString(peer->address);
+
+    GHashTable* after = getUdpPorts();
+    GHashTableIter iterator;
+    gpointer port;
+    g_hash_table_iter_init(&iterator, after);
+    while (g_hash_table_iter_next(&iterator, &port, NULL)) {
+        if (!g_hash_table_contains(before, port)) {
+            peer->port = (uint16_t) GPOINTER_TO_UINT(port);
+            break;
+        }
+    }
+    g_hash_table_destroy(before);
+    g_hash_table_destroy(after);
+
+    tox_set_name(tox, (const uint8_t*) "bench peer", strlen("bench peer"));
+
+    tox_callback_friend_message(tox, onPeerMessage, peer);
+    tox_callback_file_send_request(tox, onPeerFileRequest, peer);
+    tox_callback_file_data(tox, onPeerFileData, peer);
+    tox_callback_file_control(tox, onPeerFileControl, peer);
+
+    // the DHT key is the long term key in this Tox version
+    if (bootstrap != NULL) {
+        tox_bootstrap_from_address(tox, "127.0.0.1", bootstrap->port, bootstrap->address);
+    }
+
+    peer->timer = g_timeout_add(BENCH_PEER_INTERVAL, onPeerTick, peer);
+    return peer;
+}
+
+void Bench_Peer_free(Bench_Peer* peer) {
+    toxprpl_return_if_fail(peer != NULL);
+
+    g_source_remove(peer->timer);
+    tox_kill(peer->tox);
+    g_free(peer->key);
+    g_free(peer);
+}
+
+int32_t Bench_Peer_addFriend(Bench_Peer* peer, const uint8_t* client_id) {
+    return tox_add_friend_norequest(peer->tox, client_id);
+}
+
+void Bench_Peer_sendBurst(Bench_Peer* peer, int32_t friend_number, guint count) {
+    peer->burst_friend = friend_number;
+    peer->burst += count;
+}
+
+gboolean Bench_Peer_sendFile(Bench_Peer* peer, int32_t friend_number, guint64 size) {
+    const char* name = "bench.bin";
+    int file_number = tox_new_file_sender(peer->tox, friend_number, size, (const uint8_t*) name, strlen(name) + 1);
+    if (file_number < 0) {
+        return FALSE;
+    }
+
+    peer->file_number = file_number;
+    peer->file_friend = friend_number;
+    peer->file_remaining = size;
+    peer->file_started = 0;
+    return TRUE;
+}
+
+// Profiles -----------------------------------------------------------------------------------------------------------
+
+gchar* Bench_makeProfile(Bench_Peer** peers, guint peer_count, guint friends, uint8_t* address) {
+    Tox* tox = tox_new(NULL);
+    toxprpl_return_val_if_fail(tox != NULL, NULL);
+
+    guint i;
+    for (i = 0; i < peer_count; i++) {
+        tox_add_friend_norequest(tox, peers[i]->address);
+    }
+
+    for (i = peer_count; i < friends; i++) {
+        uint8_t client_id[TOX_CLIENT_ID_SIZE];
+        guint byte;
+        for (byte = 0; byte < sizeof(client_id); byte++) {
+            client_id[byte] = (uint8_t) g_random_int_range(0, 256);
+        }
+
+        if (tox_add_friend_norequest(tox, client_id) < 0) {
+            i--; // the very unlikely duplicate, try another one
+        }
+    }
+
+    tox_get_address(tox, address);
+
+    uint32_t size = tox_size(tox);
+    uint8_t* data = g_malloc(size);
+    tox_save(tox, data);
+    gchar* profile = g_base64_encode(data, size);
+
+    g_free(data);
+    tox_kill(tox);
+    return profile;
+}
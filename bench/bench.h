@@ -0,0 +1,244 @@
+/*
+ * Benchmark harness.
+ *
+ * The benchmarks link the plugin sources against ``purple_stub.c'', a minimal in-process stand-in for
+ * libpurple (accounts, buddy list, conversations, transfers and a GLib main loop instead of a UI),
+ * so that the real prpl entry points can be driven without Pidgin or a display.
+ *
+ * The other end of every conversation is a loopback peer: a plain Tox instance living in the same
+ * process, bootstrapped over localhost. No network access beyond the loopback interface is needed.
+ *
+ * Results are printed as one JSON object per line, e.g.
+ *
+ *  {"benchmark": "messaging", "metric": "round_trip", "unit": "ms", "samples": 200, "min": 80.1, ...}
+ *
+ * so that runs of different releases can be diffed or fed into a spreadsheet.
+ */
+#pragma once
+
+#include <toxprpl.h>
+
+// Results ------------------------------------------------------------------------------------------------------------
+
+/*
+ * Write results to `path' instead of stdout. Must be called before the first result.
+ */
+gboolean Bench_openOutput(const char* path);
+
+void Bench_closeOutput(void);
+
+/*
+ * Emit the header of a run, with the plugin version and start time
+ */
+void Bench_begin(const char* benchmark);
+
+/*
+ * Emit a parameter of a run, e.g. the number of friends
+ */
+void Bench_parameter(const char* benchmark, const char* name, gint64 value);
+
+/*
+ * Emit a single value
+ */
+void Bench_result(const char* benchmark, const char* metric, const char* unit, gdouble value);
+
+/*
+ * Emit a benchmark failure, e.g. a timeout
+ */
+void Bench_failure(const char* benchmark, const char* reason);
+
+/*
+ * A series of samples, reported as min / mean / percentiles / max
+ */
+typedef struct _bench_series {
+    GArray* samples;
+} Bench_Series;
+
+void Bench_Series_init(Bench_Series*);
+
+void Bench_Series_clear(Bench_Series*);
+
+void Bench_Series_add(Bench_Series*, gdouble);
+
+void Bench_Series_report(Bench_Series*, const char* benchmark, const char* metric, const char* unit);
+
+// Measurement --------------------------------------------------------------------------------------------------------
+
+/*
+ * Monotonic time in microseconds
+ */
+#define Bench_now() g_get_monotonic_time()
+
+#define BENCH_MS(from, to) ((gdouble) ((to) - (from)) / 1000.0)
+
+/*
+ * Peak resident set size of the process so far, in KiB
+ */
+glong Bench_peakRss(void);
+
+/*
+ * CPU time spent by the process so far, in microseconds
+ */
+gint64 Bench_cpuTime(void);
+
+/*
+ * Iterate the main loop until `done' returns TRUE, or `timeout' milliseconds have passed.
+ * Returns FALSE on timeout.
+ */
+gboolean Bench_runUntil(gboolean (*done)(gpointer), gpointer data, guint timeout);
+
+/*
+ * Iterate the main loop for `duration' milliseconds
+ */
+void Bench_runFor(guint duration);
+
+// Loopback peers -----------------------------------------------------------------------------------------------------
+
+typedef struct _bench_peer {
+
+    Tox* tox;
+
+    /*
+     * Local UDP port and Tox address of the peer
+     */
+    uint16_t port;
+    uint8_t address[TOX_FRIEND_ADDRESS_SIZE];
+
+    /*
+     * Client id of the peer, as used for buddy names
+     */
+    gchar* key;
+
+    guint timer;
+
+    /*
+     * Send every message straight back
+     */
+    gboolean echo;
+
+    /*
+     * Received traffic
+     */
+    guint messages;
+    guint64 file_bytes;
+    gint64 file_started;
+    gint64 file_finished;
+
+    /*
+     * Outgoing message burst: messages left to send, and the friend to send them to
+     */
+    guint burst;
+    int32_t burst_friend;
+
+    /*
+     * Outgoing file: bytes left to send, file number, and the friend to send it to
+     */
+    guint64 file_remaining;
+    int file_number;
+    int32_t file_friend;
+
+} Bench_Peer;
+
+/*
+ * Start a peer, bootstrapped from `bootstrap' unless that is NULL
+ */
+Bench_Peer* Bench_Peer_new(const Bench_Peer* bootstrap);
+
+void Bench_Peer_free(Bench_Peer*);
+
+/*
+ * Add a friend by client id, without a friend request. Returns the friend number.
+ */
+int32_t Bench_Peer_addFriend(Bench_Peer*, const uint8_t* client_id);
+
+/*
+ * Send `count' messages to a friend, as fast as Tox accepts them
+ */
+void Bench_Peer_sendBurst(Bench_Peer*, int32_t friend_number, guint count);
+
+/*
+ * Send `size' bytes of file data to a friend
+ */
+gboolean Bench_Peer_sendFile(Bench_Peer*, int32_t friend_number, guint64 size);
+
+// Profiles -----------------------------------------------------------------------------------------------------------
+
+/*
+ * Fabricate a base64 encoded Tox profile (as stored in the ``messenger'' account setting) with the given peers
+ * as friends, followed by random friends up to `friends' in total. `address' receives the profile's Tox address.
+ */
+gchar* Bench_makeProfile(Bench_Peer** peers, guint peer_count, guint friends, uint8_t* address);
+
+// LibPurple stub -----------------------------------------------------------------------------------------------------
+
+/*
+ * Events of interest to the benchmarks. Every hook is optional.
+ */
+typedef struct _bench_purple_hooks {
+
+    void (*connection_state)(PurpleConnection*, PurpleConnectionState, gpointer);
+
+    void (*connection_error)(PurpleConnection*, const char*, gpointer);
+
+    void (*user_status)(PurpleAccount*, const char* who, const char* status, gpointer);
+
+    void (*got_im)(PurpleConnection*, const char* who, const char* message, gpointer);
+
+    void (*chat_write)(PurpleConversation*, const char* who, const char* message, gpointer);
+
+    void (*xfer_end)(PurpleXfer*, gboolean completed, gpointer);
+
+    gpointer data;
+
+} Bench_PurpleHooks;
+
+/*
+ * Set up the stub (with a temporary user directory) and register the plugin with it
+ */
+void Bench_Purple_init(gboolean verbose);
+
+/*
+ * Remove the temporary user directory
+ */
+void Bench_Purple_shutdown(void);
+
+PurplePluginProtocolInfo* Bench_Purple_getPrpl(void);
+
+void Bench_Purple_setHooks(const Bench_PurpleHooks*);
+
+/*
+ * Create an account bootstrapping from `bootstrap' only, with rate limiting disabled
+ */
+PurpleAccount* Bench_Purple_newAccount(const char* profile, const Bench_Peer* bootstrap);
+
+/*
+ * Free an account, along with its buddies
+ */
+void Bench_Purple_freeAccount(PurpleAccount*);
+
+/*
+ * Create a connection for the account and call the prpl's login
+ */
+PurpleConnection* Bench_Purple_login(PurpleAccount*);
+
+/*
+ * Call the prpl's close and free the connection. Buddies stay in the list, as they would in libpurple.
+ */
+void Bench_Purple_logout(PurpleConnection*);
+
+/*
+ * Number of buddies of an account, and the status last reported for one of them, or NULL
+ */
+guint Bench_Purple_countBuddies(PurpleAccount*);
+
+const char* Bench_Purple_getBuddyStatus(PurpleAccount*, const char* who);
+
+/*
+ * Close a conversation, as if the user closed its window
+ */
+void Bench_Purple_destroyConversation(PurpleConversation*);
+
+/*
+ * Number of users in a chat's user list
+ */
+guint Bench_Purple_countChatUsers(PurpleConversation*);
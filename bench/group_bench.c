@@ -0,0 +1,396 @@
+/*
+ * Group chat load generator.
+ *
+ * Creates a local group and fills it with synthetic peers, which join, talk, rename themselves and
+ * leave again. Every event is fed through the plugin's Tox callbacks, ToxPRPL_Tox_onGroupNamelistChange
+ * and ToxPRPL_Tox_onGroupMessage, exactly as tox_do would deliver it, one after the other on the main thread.
+ *
+ * A real group with hundreds of members would need as many Tox instances, and would mostly measure Tox.
+ * Instead, the peers only exist in this file: the Tox getters the plugin uses to look them up
+ * (tox_group_number_peers, tox_group_peername and tox_group_peernumber_is_ours) are defined below,
+ * and take precedence over libtoxcore's when linking this executable.
+ *
+ * For every group size and phase, reported are the latency of each event (the time spent in the callback),
+ * and the wall clock and CPU time of the whole phase.
+ *
+ * e.g.: toxprpl_group_bench --peers 50,500 --messages 20000
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <bench.h>
+#include <toxprpl/group_chat.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static gchar* g_SIZES = NULL;
+static gint g_MESSAGES = 10000;
+static gint g_RENAMES = 3;
+static gchar* g_OUTPUT = NULL;
+static gboolean g_VERBOSE = FALSE;
+
+static GOptionEntry g_OPTIONS[] = {
+        { "peers",    'p', 0, G_OPTION_ARG_STRING,   &g_SIZES,    "Comma separated group sizes (default 50,100,250,500)", "N,..." },
+        { "messages", 'm', 0, G_OPTION_ARG_INT,      &g_MESSAGES, "Messages per group (default 10000)",   "N" },
+        { "renames",  'r', 0, G_OPTION_ARG_INT,      &g_RENAMES,  "Renames per peer (default 3)",          "N" },
+        { "output",   'o', 0, G_OPTION_ARG_FILENAME, &g_OUTPUT,   "Write results to FILE",                 "FILE" },
+        { "verbose",  'v', 0, G_OPTION_ARG_NONE,     &g_VERBOSE,  "Print the plugin's debug output",       NULL },
+        { NULL }
+};
+
+// Synthetic peers ----------------------------------------------------------------------------------------------------
+
+/*
+ * Names of the synthetic peers, indexed by peer number. Peer 0 is us.
+ */
+static GPtrArray* g_PEER_NAMES = NULL;
+
+static void setPeerName(int peerNumber, gchar* name) {
+    if ((guint) peerNumber >= g_PEER_NAMES->len) {
+        g_ptr_array_set_size(g_PEER_NAMES, peerNumber + 1);
+    }
+    g_free(g_ptr_array_index(g_PEER_NAMES, peerNumber));
+    g_ptr_array_index(g_PEER_NAMES, peerNumber) = name;
+}
+
+int tox_group_number_peers(const Tox* tox, int groupNumber) {
+    return (int) g_PEER_NAMES->len;
+}
+
+int tox_group_peername(const Tox* tox, int groupNumber, int peerNumber, uint8_t* name) {
+    if ((peerNumber < 0) || ((guint) peerNumber >= g_PEER_NAMES->len) ||
+        (g_ptr_array_index(g_PEER_NAMES, peerNumber) == NULL)) {
+        return -1;
+    }
+
+    const char* peerName = g_ptr_array_index(g_PEER_NAMES, peerNumber);
+    size_t length = MIN(strlen(peerName), TOX_MAX_NAME_LENGTH);
+    memcpy(name, peerName, length);
+    return (int) length;
+}
+
+unsigned int tox_group_peernumber_is_ours(const Tox* tox, int groupNumber, int peerNumber) {
+    return peerNumber == 0;
+}
+
+// Benchmarks ---------------------------------------------------------------------------------------------------------
+
+typedef struct _group_bench {
+
+    /*
+     * Benchmark name, e.g. ``group_500''
+     */
+    gchar* name;
+    guint size;
+
+    PurpleConnection* gc;
+    Tox* tox;
+    PurpleConversation* conversation;
+    int groupNumber;
+
+    guint written;
+
+} Group_Bench;
+
+typedef struct _group_phase {
+    Bench_Series latency;
+    gint64 started;
+    gint64 cpu;
+} Group_Phase;
+
+static void onChatWrite(PurpleConversation* conversation, const char* who, const char* message, gpointer data) {
+    Group_Bench* bench = data;
+    bench->written++;
+}
+
+static void beginPhase(Group_Phase* phase) {
+    Bench_Series_init(&phase->latency);
+    phase->cpu = Bench_cpuTime();
+    phase->started = Bench_now();
+}
+
+static void endPhase(Group_Bench* bench, Group_Phase* phase, const char* name) {
+    gint64 finished = Bench_now();
+    gint64 cpu = Bench_cpuTime() - phase->cpu;
+
+    gchar* metric = g_strdup_printf("%s_event", name);
+    Bench_Series_report(&phase->latency, bench->name, metric, "us");
+    g_free(metric);
+
+    metric = g_strdup_printf("%s_total", name);
+    Bench_result(bench->name, metric, "ms", BENCH_MS(phase->started, finished));
+    g_free(metric);
+
+    metric = g_strdup_printf("%s_cpu", name);
+    Bench_result(bench->name, metric, "ms", cpu / 1000.0);
+    g_free(metric);
+
+    Bench_Series_clear(&phase->latency);
+}
+
+static void namelistChange(Group_Bench* bench, Group_Phase* phase, int peerNumber, TOX_CHAT_CHANGE change) {
+    gint64 started = Bench_now();
+    ToxPRPL_Tox_onGroupNamelistChange(bench->tox, bench->groupNumber, peerNumber, change, bench->gc);
+    Bench_Series_add(&phase->latency, (gdouble) (Bench_now() - started));
+}
+
+static gboolean openGroup(Group_Bench* bench) {
+    setPeerName(0, g_strdup("bench"));
+
+    GHashTable* components = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, g_free);
+    g_hash_table_insert(components, (gpointer) TOXPRPL_CHAT_TITLE, g_strdup(bench->name));
+    Bench_Purple_getPrpl()->join_chat(bench->gc, components);
+    g_hash_table_destroy(components);
+
+    if (bench->gc->buddy_chats == NULL) {
+        Bench_failure(bench->name, "could not create group");
+        return FALSE;
+    }
+
+    bench->conversation = g_slist_last(bench->gc->buddy_chats)->data;
+    bench->groupNumber = purple_conv_chat_get_id(purple_conversation_get_chat_data(bench->conversation));
+    return TRUE;
+}
+
+static void closeGroup(Group_Bench* bench) {
+    Bench_Purple_getPrpl()->chat_leave(bench->gc, bench->groupNumber);
+    Bench_Purple_destroyConversation(bench->conversation);
+
+    g_ptr_array_set_size(g_PEER_NAMES, 0);
+}
+
+static gboolean benchJoins(Group_Bench* bench) {
+    Group_Phase phase;
+    beginPhase(&phase);
+
+    guint peerNumber;
+    for (peerNumber = 1; peerNumber <= bench->size; peerNumber++) {
+        setPeerName(peerNumber, g_strdup_printf("peer %u", peerNumber));
+        namelistChange(bench, &phase, peerNumber, TOX_CHAT_CHANGE_PEER_ADD);
+    }
+
+    endPhase(bench, &phase, "join");
+
+    if (Bench_Purple_countChatUsers(bench->conversation) != bench->size + 1) {
+        Bench_failure(bench->name, "chat user list does not match the group");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static gboolean benchMessages(Group_Bench* bench) {
+    Group_Phase phase;
+    bench->written = 0;
+    beginPhase(&phase);
+
+    gint i;
+    for (i = 0; i < g_MESSAGES; i++) {
+        gchar* message = g_strdup_printf("message %d of a storm of %d", i, g_MESSAGES);
+        int peerNumber = 1 + (i % bench->size);
+
+        gint64 started = Bench_now();
+        ToxPRPL_Tox_onGroupMessage(bench->tox, bench->groupNumber, peerNumber, (const uint8_t*) message,
+                                   (uint16_t) strlen(message), bench->gc);
+        Bench_Series_add(&phase.latency, (gdouble) (Bench_now() - started));
+        g_free(message);
+    }
+
+    gdouble total = BENCH_MS(phase.started, Bench_now());
+    endPhase(bench, &phase, "message");
+    Bench_result(bench->name, "message_rate", "msg/s", g_MESSAGES / (total / 1000.0));
+
+    if (bench->written != (guint) g_MESSAGES) {
+        Bench_failure(bench->name, "not every message was written");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static gboolean benchRenames(Group_Bench* bench) {
+    Group_Phase phase;
+    beginPhase(&phase);
+
+    gint round;
+    guint peerNumber;
+    for (round = 1; round <= g_RENAMES; round++) {
+        for (peerNumber = 1; peerNumber <= bench->size; peerNumber++) {
+            setPeerName(peerNumber, g_strdup_printf("peer %u (%d)", peerNumber, round));
+            namelistChange(bench, &phase, peerNumber, TOX_CHAT_CHANGE_PEER_NAME);
+        }
+    }
+
+    endPhase(bench, &phase, "rename");
+
+    if (Bench_Purple_countChatUsers(bench->conversation) != bench->size + 1) {
+        Bench_failure(bench->name, "chat user list does not match the group after renames");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static gboolean benchLeaves(Group_Bench* bench) {
+    Group_Phase phase;
+    beginPhase(&phase);
+
+    // from the end, so that no peer numbers move
+    guint peerNumber;
+    for (peerNumber = bench->size; peerNumber > 0; peerNumber--) {
+        namelistChange(bench, &phase, peerNumber, TOX_CHAT_CHANGE_PEER_DEL);
+        setPeerName(peerNumber, NULL);
+    }
+    g_ptr_array_set_size(g_PEER_NAMES, 1);
+
+    endPhase(bench, &phase, "leave");
+
+    if (Bench_Purple_countChatUsers(bench->conversation) != 1) {
+        Bench_failure(bench->name, "chat user list not empty after leaves");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * Not timed: two peers with the same (default) name share no chat buddy.
+ * One of them leaves, Tox moves the other in to its peer number, and that one renames itself.
+ */
+static gboolean checkDuplicateNames(Group_Bench* bench) {
+    Group_Phase phase;
+    beginPhase(&phase);
+
+    PurpleConvChat* chat = purple_conversation_get_chat_data(bench->conversation);
+
+    setPeerName(1, g_strdup("ToxedPidgin"));
+    namelistChange(bench, &phase, 1, TOX_CHAT_CHANGE_PEER_ADD);
+    setPeerName(2, g_strdup("ToxedPidgin"));
+    namelistChange(bench, &phase, 2, TOX_CHAT_CHANGE_PEER_ADD);
+
+    gboolean ok = Bench_Purple_countChatUsers(bench->conversation) == 3;
+
+    namelistChange(bench, &phase, 1, TOX_CHAT_CHANGE_PEER_DEL);
+    setPeerName(1, g_strdup("ToxedPidgin"));
+    g_ptr_array_set_size(g_PEER_NAMES, 2);
+
+    ok = ok && (Bench_Purple_countChatUsers(bench->conversation) == 2);
+
+    setPeerName(1, g_strdup("renamed"));
+    namelistChange(bench, &phase, 1, TOX_CHAT_CHANGE_PEER_NAME);
+
+    ok = ok && (Bench_Purple_countChatUsers(bench->conversation) == 2) &&
+         (purple_conv_chat_cb_find(chat, "renamed") != NULL) &&
+         (purple_conv_chat_cb_find(chat, "ToxedPidgin") == NULL);
+
+    namelistChange(bench, &phase, 1, TOX_CHAT_CHANGE_PEER_DEL);
+    g_ptr_array_set_size(g_PEER_NAMES, 1);
+
+    ok = ok && (Bench_Purple_countChatUsers(bench->conversation) == 1);
+    Bench_Series_clear(&phase.latency);
+
+    if (!ok) {
+        Bench_failure(bench->name, "chat user list wrong for peers sharing a name");
+    }
+    return ok;
+}
+
+static gboolean benchGroup(PurpleConnection* gc, guint size) {
+    ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(gc);
+
+    Group_Bench bench;
+    memset(&bench, 0, sizeof(bench));
+    bench.name = g_strdup_printf("group_%u", size);
+    bench.size = size;
+    bench.gc = gc;
+    bench.tox = plugin->tox;
+
+    Bench_begin(bench.name);
+    Bench_parameter(bench.name, "peers", size);
+    Bench_parameter(bench.name, "messages", g_MESSAGES);
+    Bench_parameter(bench.name, "renames", g_RENAMES);
+
+    Bench_PurpleHooks hooks = {
+            .chat_write = onChatWrite,
+            .data = &bench
+    };
+    Bench_Purple_setHooks(&hooks);
+
+    gboolean ok = openGroup(&bench);
+    if (ok) {
+        ok = benchJoins(&bench) &&
+             benchMessages(&bench) &&
+             benchRenames(&bench) &&
+             benchLeaves(&bench) &&
+             checkDuplicateNames(&bench);
+        closeGroup(&bench);
+    }
+
+    Bench_result(bench.name, "peak_rss", "KiB", Bench_peakRss());
+
+    Bench_Purple_setHooks(NULL);
+    g_free(bench.name);
+    return ok;
+}
+
+// Main ---------------------------------------------------------------------------------------------------------------
+
+int main(int argc, char** argv) {
+    GError* error = NULL;
+    GOptionContext* context = g_option_context_new("- benchmark the Tox prpl with busy group chats");
+    g_option_context_add_main_entries(context, g_OPTIONS, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        fprintf(stderr, "%s\n", error->message);
+        g_error_free(error);
+        return 2;
+    }
+    g_option_context_free(context);
+
+    g_MESSAGES = MAX(g_MESSAGES, 1);
+    g_RENAMES = MAX(g_RENAMES, 0);
+
+    gchar** sizes = g_strsplit((g_SIZES != NULL) ? g_SIZES : "50,100,250,500", ",", 0);
+
+    if ((g_OUTPUT != NULL) && !Bench_openOutput(g_OUTPUT)) {
+        g_strfreev(sizes);
+        return 2;
+    }
+
+    g_PEER_NAMES = g_ptr_array_new_with_free_func(g_free);
+    Bench_Purple_init(g_VERBOSE);
+
+    // the account never needs to get online, the peer only keeps the bootstrap off the network
+    gboolean ok = TRUE;
+    Bench_Peer* bootstrap = Bench_Peer_new(NULL);
+    uint8_t address[TOX_FRIEND_ADDRESS_SIZE];
+    gchar* profile = Bench_makeProfile(NULL, 0, 0, address);
+    PurpleAccount* account = Bench_Purple_newAccount(profile, bootstrap);
+    PurpleConnection* gc = Bench_Purple_login(account);
+    g_free(profile);
+
+    if (purple_connection_get_protocol_data(gc) == NULL) {
+        Bench_failure("group", "login failed");
+        ok = FALSE;
+    }
+
+    guint i;
+    for (i = 0; ok && (sizes[i] != NULL); i++) {
+        gint size = atoi(sizes[i]);
+        if (size > 0) {
+            ok = benchGroup(gc, (guint) size);
+        }
+    }
+
+    Bench_Purple_logout(gc);
+    Bench_Purple_freeAccount(account);
+    if (bootstrap != NULL) {
+        Bench_Peer_free(bootstrap);
+    }
+
+    Bench_Purple_shutdown();
+    Bench_closeOutput();
+    g_ptr_array_free(g_PEER_NAMES, TRUE);
+    g_strfreev(sizes);
+    g_free(g_SIZES);
+    g_free(g_OUTPUT);
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,185 @@
+/*
+ * Hex codec microbenchmark: the Base 16 conversions every Tox ID goes through, see ``util.c''.
+ *
+ * For client IDs and full addresses, timed per conversion are:
+ *
+ *  - encode_string:  ToxPRPL_binToHexString, allocating the result
+ *  - encode_buffer:  ToxPRPL_binToHex, in to a caller buffer
+ *  - decode_string:  ToxPRPL_hexStringToBin, allocating the result
+ *  - decode_buffer:  ToxPRPL_hexToBin, in to a caller buffer
+ *  - decode_strchr:  the former decoder, a strchr() over the hex digits per nibble, for reference
+ *
+ * Before timing, every variant is checked to round trip random IDs and to reject malformed ones.
+ *
+ * e.g.: toxprpl_hex_bench --iterations 1000000
+ */
+
+#include <bench.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static gint g_ITERATIONS = 1000000;
+static gchar* g_OUTPUT = NULL;
+
+static GOptionEntry g_OPTIONS[] = {
+        { "iterations", 'i', 0, G_OPTION_ARG_INT,      &g_ITERATIONS, "Conversions per measurement (default 1000000)", "N" },
+        { "output",     'o', 0, G_OPTION_ARG_FILENAME, &g_OUTPUT,     "Write results to FILE",                         "FILE" },
+        { NULL }
+};
+
+/*
+ * Number of distinct IDs cycled through, so that the branch predictor can not learn a single one
+ */
+#define HEX_BENCH_IDS 64
+
+/*
+ * The decoder as it was before the lookup table, kept to compare against
+ */
+static void decodeStrchr(const char* s, size_t len, unsigned char* out) {
+    static const char* hexChars = "0123456789abcdef";
+    size_t i;
+    for (i = 0; i < len; i += 2) {
+        const char* chi = strchr(hexChars, g_ascii_tolower(s[i]));
+        const char* clo = strchr(hexChars, g_ascii_tolower(s[i + 1]));
+        int hi = chi ? (int) (chi - hexChars) : 0;
+        int lo = clo ? (int) (clo - hexChars) : 0;
+        out[i / 2] = (unsigned char) (hi << 4 | lo);
+    }
+}
+
+/*
+ * Keeps the compiler from dropping conversions whose result is never used
+ */
+static volatile guint g_SINK;
+
+static gboolean checkCodec(const char* name, guint8 ids[][TOX_FRIEND_ADDRESS_SIZE], size_t size) {
+    char hex[TOX_FRIEND_ADDRESS_SIZE * 2 + 1];
+    unsigned char bin[TOX_FRIEND_ADDRESS_SIZE];
+    guint i;
+
+    for (i = 0; i < HEX_BENCH_IDS; i++) {
+        char* string = ToxPRPL_binToHexString(ids[i], size);
+        unsigned char* decoded = (string != NULL) ? ToxPRPL_hexStringToBin(string) : NULL;
+        gboolean ok = (decoded != NULL) && (memcmp(decoded, ids[i], size) == 0)
+                      && ToxPRPL_binToHex(ids[i], size, hex, sizeof(hex)) && (strcmp(hex, string) == 0)
+                      && ToxPRPL_hexToBin(hex, size * 2, bin, sizeof(bin)) && (memcmp(bin, ids[i], size) == 0);
+        free(decoded);
+        free(string);
+
+        if (!ok) {
+            Bench_failure(name, "conversion does not round trip");
+            return FALSE;
+        }
+    }
+
+    // upper case is accepted, anything else that is not a hex digit is not
+    ToxPRPL_binToHex(ids[0], size, hex, sizeof(hex));
+    hex[0] = g_ascii_toupper(hex[0]);
+    gboolean ok = ToxPRPL_hexToBin(hex, size * 2, bin, sizeof(bin));
+
+    ok = ok && !ToxPRPL_hexToBin(hex, size * 2 - 1, bin, sizeof(bin));
+    ok = ok && !ToxPRPL_hexToBin(hex, size * 2, bin, size - 1);
+    ok = ok && !ToxPRPL_binToHex(ids[0], size, hex, size * 2);
+
+    hex[size] = 'g';
+    ok = ok && !ToxPRPL_hexToBin(hex, size * 2, bin, sizeof(bin));
+
+    hex[size * 2 - 1] = '\0';
+    ok = ok && (ToxPRPL_hexStringToBin(hex) == NULL);
+
+    if (!ok) {
+        Bench_failure(name, "malformed input not rejected");
+    }
+    return ok;
+}
+
+static void benchCodec(const char* name, size_t size) {
+    guint8 ids[HEX_BENCH_IDS][TOX_FRIEND_ADDRESS_SIZE];
+    char hexIds[HEX_BENCH_IDS][TOX_FRIEND_ADDRESS_SIZE * 2 + 1];
+    char hex[TOX_FRIEND_ADDRESS_SIZE * 2 + 1];
+    unsigned char bin[TOX_FRIEND_ADDRESS_SIZE];
+    guint i, j;
+
+    for (i = 0; i < HEX_BENCH_IDS; i++) {
+        for (j = 0; j < size; j++) {
+            ids[i][j] = (guint8) g_random_int_range(0, 256);
+        }
+        ToxPRPL_binToHex(ids[i], size, hexIds[i], sizeof(hexIds[i]));
+    }
+
+    Bench_begin(name);
+    Bench_parameter(name, "bytes", (gint64) size);
+    Bench_parameter(name, "iterations", g_ITERATIONS);
+
+    if (!checkCodec(name, ids, size)) {
+        return;
+    }
+
+    gdouble perOp = 1e6 / g_ITERATIONS; // milliseconds to nanoseconds per conversion
+    gint n;
+
+    gint64 started = Bench_now();
+    for (n = 0; n < g_ITERATIONS; n++) {
+        char* string = ToxPRPL_binToHexString(ids[n % HEX_BENCH_IDS], size);
+        g_SINK += (guint) string[0];
+        free(string);
+    }
+    Bench_result(name, "encode_string", "ns", BENCH_MS(started, Bench_now()) * perOp);
+
+    started = Bench_now();
+    for (n = 0; n < g_ITERATIONS; n++) {
+        ToxPRPL_binToHex(ids[n % HEX_BENCH_IDS], size, hex, sizeof(hex));
+        g_SINK += (guint) hex[0];
+    }
+    Bench_result(name, "encode_buffer", "ns", BENCH_MS(started, Bench_now()) * perOp);
+
+    started = Bench_now();
+    for (n = 0; n < g_ITERATIONS; n++) {
+        unsigned char* decoded = ToxPRPL_hexStringToBin(hexIds[n % HEX_BENCH_IDS]);
+        g_SINK += decoded[0];
+        free(decoded);
+    }
+    Bench_result(name, "decode_string", "ns", BENCH_MS(started, Bench_now()) * perOp);
+
+    started = Bench_now();
+    for (n = 0; n < g_ITERATIONS; n++) {
+        ToxPRPL_hexToBin(hexIds[n % HEX_BENCH_IDS], size * 2, bin, sizeof(bin));
+        g_SINK += bin[0];
+    }
+    Bench_result(name, "decode_buffer", "ns", BENCH_MS(started, Bench_now()) * perOp);
+
+    started = Bench_now();
+    for (n = 0; n < g_ITERATIONS; n++) {
+        decodeStrchr(hexIds[n % HEX_BENCH_IDS], size * 2, bin);
+        g_SINK += bin[0];
+    }
+    Bench_result(name, "decode_strchr", "ns", BENCH_MS(started, Bench_now()) * perOp);
+}
+
+int main(int argc, char** argv) {
+    GError* error = NULL;
+    GOptionContext* context = g_option_context_new("- benchmark the Tox prpl's hex codec");
+    g_option_context_add_main_entries(context, g_OPTIONS, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        fprintf(stderr, "%s\n", error->message);
+        g_error_free(error);
+        return 2;
+    }
+    g_option_context_free(context);
+
+    g_ITERATIONS = MAX(g_ITERATIONS, 1);
+
+    if ((g_OUTPUT != NULL) && !Bench_openOutput(g_OUTPUT)) {
+        return 2;
+    }
+
+    benchCodec("hex_client_id", TOX_CLIENT_ID_SIZE);
+    benchCodec("hex_address", TOX_FRIEND_ADDRESS_SIZE);
+
+    Bench_closeOutput();
+    g_free(g_OUTPUT);
+
+    return 0;
+}
@@ -0,0 +1,1175 @@
+/*
+ * Minimal in-process libpurple for the benchmarks, see ``bench.h''
+ *
+ * Only what the plugin calls is implemented, and only as far as the plugin relies on it.
+ * Where it matters for the cost of a code path (the buddy list and chat user lists), the data
+ * structures mirror libpurple's own: hash tables keyed by name, plus the chat's `in_room' list.
+ * There is no UI: requests are answered the way a user clicking ``Accept'' would, and
+ * notifications are only printed in verbose mode.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <bench.h>
+#include <toxprpl/bootstrap.h>
+#include <toxprpl/ratelimit.h>
+
+#include <glib/gstdio.h>
+#include <proxy.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Defined by PURPLE_INIT_PLUGIN in ``toxprpl.c''
+ */
+gboolean purple_init_plugin(PurplePlugin*);
+
+/*
+ * A buddy, along with the status last reported for it
+ */
+typedef struct _bench_buddy {
+    PurpleBuddy buddy;
+    gchar* status;
+} Bench_Buddy;
+
+typedef struct _bench_signal_handler {
+    void* instance;
+    gchar* signal;
+    void* handle;
+    PurpleCallback callback;
+    void* data;
+} Bench_SignalHandler;
+
+static PurplePlugin g_PLUGIN;
+static gchar* g_USER_DIR = NULL;
+static gboolean g_VERBOSE = FALSE;
+static Bench_PurpleHooks g_HOOKS;
+
+/*
+ * Buddies by account, then by name
+ */
+static GHashTable* g_BUDDIES = NULL;
+
+static GHashTable* g_PREFS = NULL;
+static GList* g_SIGNAL_HANDLERS = NULL;
+static GList* g_XFERS = NULL;
+static guint g_XFER_COUNT = 0;
+static PurpleCmdId g_NEXT_COMMAND = 1;
+static guint g_NEXT_PREF_CALLBACK = 1;
+
+static int g_CONVERSATIONS_HANDLE;
+static int g_NETWORK_HANDLE;
+
+#define BENCH_CHAT_USERS "bench-users"
+
+// Harness ------------------------------------------------------------------------------------------------------------
+
+void Bench_Purple_init(gboolean verbose) {
+    g_VERBOSE = verbose;
+    g_USER_DIR = g_dir_make_tmp("toxprpl-bench-XXXXXX", NULL);
+    g_BUDDIES = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify) g_hash_table_destroy);
+    g_PREFS = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+    purple_init_plugin(&g_PLUGIN);
+}
+
+static void removeTree(const char* path) {
+    GDir* dir = g_dir_open(path, 0, NULL);
+    if (dir != NULL) {
+        const char* name;
+        while ((name = g_dir_read_name(dir)) != NULL) {
+            gchar* child = g_build_filename(path, name, NULL);
+            removeTree(child);
+            g_free(child);
+        }
+        g_dir_close(dir);
+    }
+    g_remove(path);
+}
+
+void Bench_Purple_shutdown(void) {
+    removeTree(g_USER_DIR);
+    g_free(g_USER_DIR);
+    g_USER_DIR = NULL;
+
+    g_hash_table_destroy(g_BUDDIES);
+    g_hash_table_destroy(g_PREFS);
+}
+
+PurplePluginProtocolInfo* Bench_Purple_getPrpl(void) {
+    return (PurplePluginProtocolInfo*) g_PLUGIN.info->extra_info;
+}
+
+void Bench_Purple_setHooks(const Bench_PurpleHooks* hooks) {
+    if (hooks != NULL) {
+        g_HOOKS = *hooks;
+    }
+    else {
+        memset(&g_HOOKS, 0, sizeof(g_HOOKS));
+    }
+}
+
+static GHashTable* getBuddies(PurpleAccount* account) {
+    GHashTable* buddies = g_hash_table_lookup(g_BUDDIES, account);
+    if (buddies == NULL) {
+        buddies = g_hash_table_new(g_str_hash, g_str_equal);
+        g_hash_table_insert(g_BUDDIES, account, buddies);
+    }
+    return buddies;
+}
+
+PurpleAccount* Bench_Purple_newAccount(const char* profile, const Bench_Peer* bootstrap) {
+    PurpleAccount* account = g_new0(PurpleAccount, 1);
+    account->username = g_strdup("bench");
+    account->alias = g_strdup("bench");
+    account->protocol_id = g_strdup(TOXPRPL_ID);
+    account->settings = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+    purple_account_set_string(account, "messenger", profile);
+    purple_account_set_string(account, "nickname", "bench");
+
+    if (bootstrap != NULL) {
+        gchar* port = g_strdup_printf("%u", bootstrap->port);
+        purple_account_set_string(account, "dht_server", "127.0.0.1");
+        purple_account_set_string(account, "dht_server_port", port);
+        purple_account_set_string(account, "dht_server_key", bootstrap->key);
+        g_free(port);
+    }
+    purple_account_set_string(account, TOXPRPL_OPT_BOOTSTRAP_NODES, "");
+
+    // measure the plugin, not the configured limits
+    purple_account_set_string(account, TOXPRPL_OPT_SEND_RATE_ACCOUNT, "0");
+    purple_account_set_string(account, TOXPRPL_OPT_SEND_RATE_FRIEND, "0");
+    purple_account_set_string(account, TOXPRPL_OPT_SEND_QUEUE_SIZE, "1000000");
+
+    getBuddies(account);
+    return account;
+}
+
+void Bench_Purple_freeAccount(PurpleAccount* account) {
+    toxprpl_return_if_fail(account != NULL);
+
+    GSList* buddies = purple_find_buddies(account, NULL);
+    GSList* link;
+    for (link = buddies; link != NULL; link = link->next) {
+        purple_blist_remove_buddy(link->data);
+    }
+    g_slist_free(buddies);
+    g_hash_table_remove(g_BUDDIES, account);
+
+    g_hash_table_destroy(account->settings);
+    g_free(account->username);
+    g_free(account->alias);
+    g_free(account->protocol_id);
+    g_free(account);
+}
+
+PurpleConnection* Bench_Purple_login(PurpleAccount* account) {
+    PurpleConnection* gc = g_new0(PurpleConnection, 1);
+    gc->prpl = &g_PLUGIN;
+    gc->account = account;
+    gc->state = PURPLE_CONNECTING;
+    account->gc = gc;
+
+    Bench_Purple_getPrpl()->login(account);
+    return gc;
+}
+
+void Bench_Purple_logout(PurpleConnection* gc) {
+    toxprpl_return_if_fail(gc != NULL);
+
+    // like libpurple, leave the chats before the prpl goes away, but keep the conversations around
+    GSList* chats = gc->buddy_chats;
+    gc->buddy_chats = NULL;
+
+    Bench_Purple_getPrpl()->close(gc);
+
+    while (chats != NULL) {
+        Bench_Purple_destroyConversation(chats->data);
+        chats = g_slist_delete_link(chats, chats);
+    }
+
+    gc->account->gc = NULL;
+    g_free(gc->display_name);
+    g_free(gc);
+}
+
+guint Bench_Purple_countBuddies(PurpleAccount* account) {
+    return g_hash_table_size(getBuddies(account));
+}
+
+const char* Bench_Purple_getBuddyStatus(PurpleAccount* account, const char* who) {
+    Bench_Buddy* buddy = (Bench_Buddy*) purple_find_buddy(account, who);
+    return (buddy != NULL) ? buddy->status : NULL;
+}
+
+// Accounts -----------------------------------------------------------------------------------------------------------
+
+const char* purple_account_get_string(const PurpleAccount* account, const char* name, const char* default_value) {
+    const char* value = g_hash_table_lookup(account->settings, name);
+    return (value != NULL) ? value : default_value;
+}
+
+int purple_account_get_int(const PurpleAccount* account, const char* name, int default_value) {
+    const char* value = g_hash_table_lookup(account->settings, name);
+    return (value != NULL) ? atoi(value) : default_value;
+}
+
+gboolean purple_account_get_bool(const PurpleAccount* account, const char* name, gboolean default_value) {
+    const char* value = g_hash_table_lookup(account->settings, name);
+    return (value != NULL) ? (atoi(value) != 0) : default_value;
+}
+
+void purple_account_set_string(PurpleAccount* account, const char* name, const char* value) {
+    if (value != NULL) {
+        g_hash_table_replace(account->settings, g_strdup(name), g_strdup(value));
+    }
+    else {
+        g_hash_table_remove(account->settings, name);
+    }
+}
+
+PurpleConnection* purple_account_get_connection(const PurpleAccount* account) {
+    return account->gc;
+}
+
+const char* purple_account_get_username(const PurpleAccount* account) {
+    return account->username;
+}
+
+const char* purple_account_get_alias(const PurpleAccount* account) {
+    return account->alias;
+}
+
+PurpleStatus* purple_account_get_active_status(const PurpleAccount* account) {
+    return NULL;
+}
+
+/*
+ * Options are only shown by account editors, the plugin always passes its own defaults
+ */
+
+PurpleAccountOption* purple_account_option_string_new(const char* text, const char* name, const char* value) {
+    return NULL;
+}
+
+PurpleAccountOption* purple_account_option_int_new(const char* text, const char* name, int value) {
+    return NULL;
+}
+
+PurpleAccountOption* purple_account_option_bool_new(const char* text, const char* name, gboolean value) {
+    return NULL;
+}
+
+PurpleAccountOption* purple_account_option_list_new(const char* text, const char* name, GList* list) {
+    return NULL;
+}
+
+PurpleProxyInfo* purple_proxy_get_setup(PurpleAccount* account) {
+    return NULL;
+}
+
+PurpleProxyType purple_proxy_info_get_type(const PurpleProxyInfo* info) {
+    return PURPLE_PROXY_NONE;
+}
+
+const char* purple_proxy_info_get_host(const PurpleProxyInfo* info) {
+    return NULL;
+}
+
+int purple_proxy_info_get_port(const PurpleProxyInfo* info) {
+    return 0;
+}
+
+// Buddy List ---------------------------------------------------------------------------------------------------------
+
+PurpleBuddy* purple_buddy_new(PurpleAccount* account, const char* name, const char* alias) {
+    Bench_Buddy* buddy = g_new0(Bench_Buddy, 1);
+    buddy->buddy.account = account;
+    buddy->buddy.name = g_strdup(name);
+    buddy->buddy.alias = g_strdup(alias);
+    return &buddy->buddy;
+}
+
+gpointer purple_buddy_get_protocol_data(const PurpleBuddy* buddy) {
+    return buddy->proto_data;
+}
+
+void purple_buddy_set_protocol_data(PurpleBuddy* buddy, gpointer data) {
+    buddy->proto_data = data;
+}
+
+void purple_blist_add_buddy(PurpleBuddy* buddy, PurpleContact* contact, PurpleGroup* group, PurpleBlistNode* node) {
+    g_hash_table_replace(getBuddies(buddy->account), buddy->name, buddy);
+}
+
+void purple_blist_remove_buddy(PurpleBuddy* buddy) {
+    GHashTable* buddies = getBuddies(buddy->account);
+    if (g_hash_table_lookup(buddies, buddy->name) == buddy) {
+        g_hash_table_remove(buddies, buddy->name);
+    }
+
+    if (Bench_Purple_getPrpl()->buddy_free != NULL) {
+        Bench_Purple_getPrpl()->buddy_free(buddy);
+    }
+
+    Bench_Buddy* data = (Bench_Buddy*) buddy;
+    g_free(data->status);
+    g_free(buddy->name);
+    g_free(buddy->alias);
+    g_free(buddy->server_alias);
+    g_free(data);
+}
+
+/*
+ * Groups are not modelled, every buddy is in the one table of its account
+ */
+
+static int g_GROUP_DUMMY;
+
+PurpleGroup* purple_find_group(const char* name) {
+    return (PurpleGroup*) &g_GROUP_DUMMY;
+}
+
+PurpleGroup* purple_group_new(const char* name) {
+    return (PurpleGroup*) &g_GROUP_DUMMY;
+}
+
+void purple_blist_add_group(PurpleGroup* group, PurpleBlistNode* node) {
+}
+
+void purple_blist_alias_buddy(PurpleBuddy* buddy, const char* alias) {
+    g_free(buddy->alias);
+    buddy->alias = g_strdup(alias);
+}
+
+void purple_blist_rename_buddy(PurpleBuddy* buddy, const char* name) {
+    GHashTable* buddies = getBuddies(buddy->account);
+    if (g_hash_table_lookup(buddies, buddy->name) == buddy) {
+        g_hash_table_remove(buddies, buddy->name);
+    }
+
+    g_free(buddy->name);
+    buddy->name = g_strdup(name);
+    g_hash_table_replace(buddies, buddy->name, buddy);
+}
+
+PurpleBuddy* purple_find_buddy(PurpleAccount* account, const char* name) {
+    return g_hash_table_lookup(getBuddies(account), name);
+}
+
+GSList* purple_find_buddies(PurpleAccount* account, const char* name) {
+    if (name != NULL) {
+        PurpleBuddy* buddy = purple_find_buddy(account, name);
+        return (buddy != NULL) ? g_slist_prepend(NULL, buddy) : NULL;
+    }
+
+    GSList* list = NULL;
+    GHashTableIter iterator;
+    gpointer buddy;
+    g_hash_table_iter_init(&iterator, getBuddies(account));
+    while (g_hash_table_iter_next(&iterator, NULL, &buddy)) {
+        list = g_slist_prepend(list, buddy);
+    }
+    return list;
+}
+
+void purple_prpl_got_user_status(PurpleAccount* account, const char* name, const char* status_id, ...) {
+    Bench_Buddy* buddy = (Bench_Buddy*) purple_find_buddy(account, name);
+    if (buddy != NULL) {
+        g_free(buddy->status);
+        buddy->status = g_strdup(status_id);
+    }
+
+    if (g_HOOKS.user_status != NULL) {
+        g_HOOKS.user_status(account, name, status_id, g_HOOKS.data);
+    }
+}
+
+/*
+ * The benchmarks have no images, icons are dropped and accounts have none
+ */
+void purple_buddy_icons_set_for_user(PurpleAccount* account, const char* name, void* data, size_t size,
+                                     const char* checksum) {
+    g_free(data);
+}
+
+const char* purple_buddy_icons_get_checksum_for_user(PurpleBuddy* buddy) {
+    return NULL;
+}
+
+PurpleStoredImage* purple_buddy_icons_find_account_icon(PurpleAccount* account) {
+    return NULL;
+}
+
+gconstpointer purple_imgstore_get_data(PurpleStoredImage* image) {
+    return NULL;
+}
+
+size_t purple_imgstore_get_size(PurpleStoredImage* image) {
+    return 0;
+}
+
+PurpleStoredImage* purple_imgstore_unref(PurpleStoredImage* image) {
+    return NULL;
+}
+
+// Connections --------------------------------------------------------------------------------------------------------
+
+PurpleAccount* purple_connection_get_account(const PurpleConnection* gc) {
+    return gc->account;
+}
+
+void* purple_connection_get_protocol_data(const PurpleConnection* gc) {
+    return gc->proto_data;
+}
+
+void purple_connection_set_protocol_data(PurpleConnection* gc, void* data) {
+    gc->proto_data = data;
+}
+
+void purple_connection_set_state(PurpleConnection* gc, PurpleConnectionState state) {
+    gc->state = state;
+
+    if (g_HOOKS.connection_state != NULL) {
+        g_HOOKS.connection_state(gc, state, g_HOOKS.data);
+    }
+}
+
+void purple_connection_error_reason(PurpleConnection* gc, PurpleConnectionError reason, const char* description) {
+    fprintf(stderr, "connection error: %s\n", description);
+
+    if (g_HOOKS.connection_error != NULL) {
+        g_HOOKS.connection_error(gc, description, g_HOOKS.data);
+    }
+}
+
+void purple_connection_update_progress(PurpleConnection* gc, const char* text, size_t step, size_t count) {
+}
+
+void purple_connection_notice(PurpleConnection* gc, const char* text) {
+    if (g_VERBOSE) {
+        fprintf(stderr, "notice: %s\n", text);
+    }
+}
+
+void purple_connection_set_display_name(PurpleConnection* gc, const char* name) {
+    g_free(gc->display_name);
+    gc->display_name = g_strdup(name);
+}
+
+const char* purple_connection_get_display_name(const PurpleConnection* gc) {
+    return gc->display_name;
+}
+
+void serv_got_im(PurpleConnection* gc, const char* who, const char* message, PurpleMessageFlags flags,
+                 time_t mtime) {
+    if (g_HOOKS.got_im != NULL) {
+        g_HOOKS.got_im(gc, who, message, g_HOOKS.data);
+    }
+}
+
+void serv_got_typing(PurpleConnection* gc, const char* name, int timeout, PurpleTypingState state) {
+}
+
+void serv_got_typing_stopped(PurpleConnection* gc, const char* name) {
+}
+
+// Conversations ------------------------------------------------------------------------------------------------------
+
+static GHashTable* getChatUsers(PurpleConvChat* chat) {
+    return purple_conversation_get_data(chat->conv, BENCH_CHAT_USERS);
+}
+
+PurpleConversation* serv_got_joined_chat(PurpleConnection* gc, int id, const char* name) {
+    PurpleConversation* conversation = g_new0(PurpleConversation, 1);
+    conversation->type = PURPLE_CONV_TYPE_CHAT;
+    conversation->account = gc->account;
+    conversation->name = g_strdup(name);
+    conversation->title = g_strdup(name);
+    conversation->data = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+    PurpleConvChat* chat = g_new0(PurpleConvChat, 1);
+    chat->conv = conversation;
+    chat->id = id;
+    conversation->u.chat = chat;
+
+    purple_conversation_set_data(conversation, BENCH_CHAT_USERS,
+                                 g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL));
+
+    gc->buddy_chats = g_slist_append(gc->buddy_chats, conversation);
+    return conversation;
+}
+
+/*
+ * There is nobody to ask, so every invitation is accepted
+ */
+void serv_got_chat_invite(PurpleConnection* gc, const char* name, const char* who, const char* message,
+                          GHashTable* data) {
+    Bench_Purple_getPrpl()->join_chat(gc, data);
+    g_hash_table_destroy(data);
+}
+
+void Bench_Purple_destroyConversation(PurpleConversation* conversation) {
+    toxprpl_return_if_fail(conversation != NULL);
+
+    GList* link;
+    for (link = g_SIGNAL_HANDLERS; link != NULL; link = link->next) {
+        Bench_SignalHandler* handler = link->data;
+        if ((handler->instance == &g_CONVERSATIONS_HANDLE) && (strcmp(handler->signal, "deleting-conversation") == 0)) {
+            ((void (*)(PurpleConversation*, void*)) handler->callback)(conversation, handler->data);
+        }
+    }
+
+    PurpleConnection* gc = purple_conversation_get_gc(conversation);
+    if (gc != NULL) {
+        gc->buddy_chats = g_slist_remove(gc->buddy_chats, conversation);
+    }
+
+    if (conversation->type == PURPLE_CONV_TYPE_CHAT) {
+        PurpleConvChat* chat = conversation->u.chat;
+        purple_conv_chat_clear_users(chat);
+        g_hash_table_destroy(getChatUsers(chat));
+        g_free(chat->nick);
+        g_free(chat);
+    }
+
+    g_hash_table_destroy(conversation->data);
+    g_free(conversation->name);
+    g_free(conversation->title);
+    g_free(conversation);
+}
+
+guint Bench_Purple_countChatUsers(PurpleConversation* conversation) {
+    return g_hash_table_size(getChatUsers(conversation->u.chat));
+}
+
+PurpleConvChat* purple_conversation_get_chat_data(const PurpleConversation* conversation) {
+    return (conversation->type == PURPLE_CONV_TYPE_CHAT) ? conversation->u.chat : NULL;
+}
+
+PurpleConversationType purple_conversation_get_type(const PurpleConversation* conversation) {
+    return conversation->type;
+}
+
+PurpleConnection* purple_conversation_get_gc(const PurpleConversation* conversation) {
+    return purple_account_get_connection(conversation->account);
+}
+
+void purple_conversation_set_data(PurpleConversation* conversation, const char* key, gpointer data) {
+    g_hash_table_replace(conversation->data, g_strdup(key), data);
+}
+
+gpointer purple_conversation_get_data(PurpleConversation* conversation, const char* key) {
+    return g_hash_table_lookup(conversation->data, key);
+}
+
+void purple_conversation_set_features(PurpleConversation* conversation, PurpleConnectionFlags features) {
+    conversation->features = features;
+}
+
+void purple_conversation_set_title(PurpleConversation* conversation, const char* title) {
+    g_free(conversation->title);
+    conversation->title = g_strdup(title);
+}
+
+void purple_conversation_present(PurpleConversation* conversation) {
+}
+
+void purple_conversation_write(PurpleConversation* conversation, const char* who, const char* message,
+                               PurpleMessageFlags flags, time_t mtime) {
+    if (g_HOOKS.chat_write != NULL) {
+        g_HOOKS.chat_write(conversation, who, message, g_HOOKS.data);
+    }
+}
+
+gboolean purple_conv_present_error(const char* who, PurpleAccount* account, const char* what) {
+    if (g_VERBOSE) {
+        fprintf(stderr, "error for %s: %s\n", who, what);
+    }
+    return FALSE;
+}
+
+void* purple_conversations_get_handle(void) {
+    return &g_CONVERSATIONS_HANDLE;
+}
+
+int purple_conv_chat_get_id(const PurpleConvChat* chat) {
+    return chat->id;
+}
+
+void purple_conv_chat_set_nick(PurpleConvChat* chat, const char* nick) {
+    g_free(chat->nick);
+    chat->nick = g_strdup(nick);
+}
+
+void purple_conv_chat_write(PurpleConvChat* chat, const char* who, const char* message, PurpleMessageFlags flags,
+                            time_t mtime) {
+    purple_conversation_write(chat->conv, who, message, flags, mtime);
+}
+
+PurpleConvChatBuddy* purple_conv_chat_cb_new(const char* name, const char* alias, PurpleConvChatBuddyFlags flags) {
+    PurpleConvChatBuddy* buddy = g_new0(PurpleConvChatBuddy, 1);
+    buddy->name = g_strdup(name);
+    buddy->alias = g_strdup(alias);
+    buddy->flags = flags;
+    return buddy;
+}
+
+static void freeChatBuddy(PurpleConvChatBuddy* buddy) {
+    g_free(buddy->name);
+    g_free(buddy->alias);
+    g_free(buddy);
+}
+
+PurpleConvChatBuddy* purple_conv_chat_cb_find(PurpleConvChat* chat, const char* name) {
+    return g_hash_table_lookup(getChatUsers(chat), name);
+}
+
+void purple_conv_chat_add_users(PurpleConvChat* chat, GList* users, GList* extra_msgs, GList* flags,
+                                gboolean new_arrivals) {
+    GHashTable* table = getChatUsers(chat);
+
+    GList* user;
+    GList* flag = flags;
+    for (user = users; user != NULL; user = user->next) {
+        PurpleConvChatBuddyFlags buddyFlags = (flag != NULL) ? GPOINTER_TO_INT(flag->data) : PURPLE_CBFLAGS_NONE;
+        PurpleConvChatBuddy* buddy = purple_conv_chat_cb_new(user->data, NULL, buddyFlags);
+
+        chat->in_room = g_list_prepend(chat->in_room, buddy);
+        g_hash_table_replace(table, g_strdup(buddy->name), buddy);
+
+        flag = (flag != NULL) ? flag->next : NULL;
+    }
+}
+
+void purple_conv_chat_add_user(PurpleConvChat* chat, const char* user, const char* extra_msg,
+                               PurpleConvChatBuddyFlags flags, gboolean new_arrival) {
+    GList users = { (gpointer) user, NULL, NULL };
+    GList flagList = { GINT_TO_POINTER(flags), NULL, NULL };
+    purple_conv_chat_add_users(chat, &users, NULL, &flagList, new_arrival);
+}
+
+void purple_conv_chat_remove_user(PurpleConvChat* chat, const char* user, const char* reason) {
+    PurpleConvChatBuddy* buddy = purple_conv_chat_cb_find(chat, user);
+    toxprpl_return_if_fail(buddy != NULL);
+
+    chat->in_room = g_list_remove(chat->in_room, buddy);
+    g_hash_table_remove(getChatUsers(chat), user);
+    freeChatBuddy(buddy);
+}
+
+void purple_conv_chat_rename_user(PurpleConvChat* chat, const char* old_user, const char* new_user) {
+    PurpleConvChatBuddy* old = purple_conv_chat_cb_find(chat, old_user);
+    toxprpl_return_if_fail(old != NULL);
+    toxprpl_return_if_fail(strcmp(old_user, new_user) != 0);
+
+    PurpleConvChatBuddy* buddy = purple_conv_chat_cb_new(new_user, NULL, old->flags);
+    chat->in_room = g_list_prepend(chat->in_room, buddy);
+    g_hash_table_replace(getChatUsers(chat), g_strdup(buddy->name), buddy);
+
+    purple_conv_chat_remove_user(chat, old_user, NULL);
+}
+
+void purple_conv_chat_clear_users(PurpleConvChat* chat) {
+    g_hash_table_remove_all(getChatUsers(chat));
+    g_list_free_full(chat->in_room, (GDestroyNotify) freeChatBuddy);
+    chat->in_room = NULL;
+}
+
+// Signals ------------------------------------------------------------------------------------------------------------
+
+gulong purple_signal_connect(void* instance, const char* signal, void* handle, PurpleCallback callback, void* data) {
+    Bench_SignalHandler* handler = g_new0(Bench_SignalHandler, 1);
+    handler->instance = instance;
+    handler->signal = g_strdup(signal);
+    handler->handle = handle;
+    handler->callback = callback;
+    handler->data = data;
+
+    g_SIGNAL_HANDLERS = g_list_append(g_SIGNAL_HANDLERS, handler);
+    return g_list_length(g_SIGNAL_HANDLERS);
+}
+
+void purple_signals_disconnect_by_handle(void* handle) {
+    GList* link = g_SIGNAL_HANDLERS;
+    while (link != NULL) {
+        GList* next = link->next;
+        Bench_SignalHandler* handler = link->data;
+        if (handler->handle == handle) {
+            g_free(handler->signal);
+            g_free(handler);
+            g_SIGNAL_HANDLERS = g_list_delete_link(g_SIGNAL_HANDLERS, link);
+        }
+        link = next;
+    }
+}
+
+void* purple_network_get_handle(void) {
+    return &g_NETWORK_HANDLE;
+}
+
+// File Transfers -----------------------------------------------------------------------------------------------------
+
+PurpleXfer* purple_xfer_new(PurpleAccount* account, PurpleXferType type, const char* who) {
+    PurpleXfer* xfer = g_new0(PurpleXfer, 1);
+    xfer->ref = 1;
+    xfer->type = type;
+    xfer->account = account;
+    xfer->who = g_strdup(who);
+    xfer->fd = -1;
+    xfer->status = PURPLE_XFER_STATUS_NOT_STARTED;
+
+    g_XFERS = g_list_prepend(g_XFERS, xfer);
+    return xfer;
+}
+
+GList* purple_xfers_get_all(void) {
+    return g_XFERS;
+}
+
+static void finishXfer(PurpleXfer* xfer, gboolean completed) {
+    if (g_HOOKS.xfer_end != NULL) {
+        g_HOOKS.xfer_end(xfer, completed, g_HOOKS.data);
+    }
+
+    if (xfer->dest_fp != NULL) {
+        fclose(xfer->dest_fp);
+    }
+
+    g_XFERS = g_list_remove(g_XFERS, xfer);
+    g_free(xfer->who);
+    g_free(xfer->filename);
+    g_free(xfer->local_filename);
+    g_free(xfer);
+}
+
+PurpleXferType purple_xfer_get_type(const PurpleXfer* xfer) {
+    return xfer->type;
+}
+
+PurpleAccount* purple_xfer_get_account(const PurpleXfer* xfer) {
+    return xfer->account;
+}
+
+const char* purple_xfer_get_remote_user(const PurpleXfer* xfer) {
+    return xfer->who;
+}
+
+const char* purple_xfer_get_filename(const PurpleXfer* xfer) {
+    return xfer->filename;
+}
+
+void purple_xfer_set_filename(PurpleXfer* xfer, const char* filename) {
+    g_free(xfer->filename);
+    xfer->filename = g_strdup(filename);
+}
+
+size_t purple_xfer_get_size(const PurpleXfer* xfer) {
+    return xfer->size;
+}
+
+void purple_xfer_set_size(PurpleXfer* xfer, size_t size) {
+    xfer->size = size;
+    xfer->bytes_remaining = size - xfer->bytes_sent;
+}
+
+size_t purple_xfer_get_bytes_remaining(const PurpleXfer* xfer) {
+    return xfer->bytes_remaining;
+}
+
+void purple_xfer_set_bytes_sent(PurpleXfer* xfer, size_t bytes_sent) {
+    xfer->bytes_sent = bytes_sent;
+    xfer->bytes_remaining = xfer->size - bytes_sent;
+}
+
+gboolean purple_xfer_is_canceled(const PurpleXfer* xfer) {
+    return (xfer->status == PURPLE_XFER_STATUS_CANCEL_LOCAL) || (xfer->status == PURPLE_XFER_STATUS_CANCEL_REMOTE);
+}
+
+void purple_xfer_set_completed(PurpleXfer* xfer, gboolean completed) {
+    if (completed) {
+        xfer->status = PURPLE_XFER_STATUS_DONE;
+    }
+}
+
+void purple_xfer_update_progress(PurpleXfer* xfer) {
+}
+
+void purple_xfer_set_init_fnc(PurpleXfer* xfer, void (*fnc)(PurpleXfer*)) {
+    xfer->ops.init = fnc;
+}
+
+void purple_xfer_set_start_fnc(PurpleXfer* xfer, void (*fnc)(PurpleXfer*)) {
+    xfer->ops.start = fnc;
+}
+
+void purple_xfer_set_end_fnc(PurpleXfer* xfer, void (*fnc)(PurpleXfer*)) {
+    xfer->ops.end = fnc;
+}
+
+void purple_xfer_set_cancel_send_fnc(PurpleXfer* xfer, void (*fnc)(PurpleXfer*)) {
+    xfer->ops.cancel_send = fnc;
+}
+
+void purple_xfer_set_cancel_recv_fnc(PurpleXfer* xfer, void (*fnc)(PurpleXfer*)) {
+    xfer->ops.cancel_recv = fnc;
+}
+
+void purple_xfer_set_request_denied_fnc(PurpleXfer* xfer, void (*fnc)(PurpleXfer*)) {
+    xfer->ops.request_denied = fnc;
+}
+
+void purple_xfer_set_write_fnc(PurpleXfer* xfer, gssize (*fnc)(const guchar*, size_t, PurpleXfer*)) {
+    xfer->ops.write = fnc;
+}
+
+void purple_xfer_set_read_fnc(PurpleXfer* xfer, gssize (*fnc)(guchar**, PurpleXfer*)) {
+    xfer->ops.read = fnc;
+}
+
+void purple_xfer_request_accepted(PurpleXfer* xfer, const char* filename) {
+    if (xfer->type == PURPLE_XFER_SEND) {
+        GStatBuf info;
+        if (g_stat(filename, &info) != 0) {
+            purple_xfer_cancel_local(xfer);
+            return;
+        }
+
+        gchar* base = g_path_get_basename(filename);
+        purple_xfer_set_filename(xfer, base);
+        purple_xfer_set_size(xfer, (size_t) info.st_size);
+        g_free(base);
+    }
+
+    g_free(xfer->local_filename);
+    xfer->local_filename = g_strdup(filename);
+    xfer->status = PURPLE_XFER_STATUS_ACCEPTED;
+
+    if (xfer->ops.init != NULL) {
+        xfer->ops.init(xfer);
+    }
+}
+
+/*
+ * Incoming files are accepted into the temporary user directory, outgoing ones need a file name
+ */
+void purple_xfer_request(PurpleXfer* xfer) {
+    if (xfer->type != PURPLE_XFER_RECEIVE) {
+        purple_xfer_cancel_local(xfer);
+        return;
+    }
+
+    gchar* name = g_strdup_printf("xfer-%u", ++g_XFER_COUNT);
+    gchar* path = g_build_filename(g_USER_DIR, name, NULL);
+    purple_xfer_request_accepted(xfer, path);
+    g_free(path);
+    g_free(name);
+}
+
+void purple_xfer_start(PurpleXfer* xfer, int fd, const char* ip, unsigned int port) {
+    xfer->dest_fp = g_fopen(xfer->local_filename, (xfer->type == PURPLE_XFER_RECEIVE) ? "wb" : "rb");
+    if (xfer->dest_fp == NULL) {
+        purple_xfer_cancel_local(xfer);
+        return;
+    }
+
+    xfer->status = PURPLE_XFER_STATUS_STARTED;
+    xfer->start_time = time(NULL);
+
+    if (xfer->ops.start != NULL) {
+        xfer->ops.start(xfer);
+    }
+}
+
+gssize purple_xfer_write(PurpleXfer* xfer, const guchar* buffer, gsize size) {
+    toxprpl_return_val_if_fail(xfer->ops.write != NULL, -1);
+
+    gssize written = xfer->ops.write(buffer, MIN(purple_xfer_get_bytes_remaining(xfer), size), xfer);
+    if ((written >= 0) && (xfer->bytes_sent + written >= xfer->size)) {
+        purple_xfer_set_completed(xfer, TRUE);
+    }
+    return written;
+}
+
+void purple_xfer_cancel_local(PurpleXfer* xfer) {
+    xfer->status = PURPLE_XFER_STATUS_CANCEL_LOCAL;
+
+    void (*cancel)(PurpleXfer*) = (xfer->type == PURPLE_XFER_SEND) ? xfer->ops.cancel_send : xfer->ops.cancel_recv;
+    if (cancel != NULL) {
+        cancel(xfer);
+    }
+    finishXfer(xfer, FALSE);
+}
+
+void purple_xfer_cancel_remote(PurpleXfer* xfer) {
+    xfer->status = PURPLE_XFER_STATUS_CANCEL_REMOTE;
+
+    void (*cancel)(PurpleXfer*) = (xfer->type == PURPLE_XFER_SEND) ? xfer->ops.cancel_send : xfer->ops.cancel_recv;
+    if (cancel != NULL) {
+        cancel(xfer);
+    }
+    finishXfer(xfer, FALSE);
+}
+
+void purple_xfer_end(PurpleXfer* xfer) {
+    if (xfer->status != PURPLE_XFER_STATUS_DONE) {
+        purple_xfer_cancel_remote(xfer);
+        return;
+    }
+
+    xfer->end_time = time(NULL);
+    if (xfer->ops.end != NULL) {
+        xfer->ops.end(xfer);
+    }
+    finishXfer(xfer, TRUE);
+}
+
+// User Interaction ---------------------------------------------------------------------------------------------------
+
+void* purple_request_action(void* handle, const char* title, const char* primary, const char* secondary,
+                            int default_action, PurpleAccount* account, const char* who,
+                            PurpleConversation* conversation, void* user_data, size_t action_count, ...) {
+    if (g_VERBOSE) {
+        fprintf(stderr, "unanswered request: %s\n", title);
+    }
+    return NULL;
+}
+
+void* purple_request_file(void* handle, const char* title, const char* filename, gboolean savedialog,
+                          GCallback ok_cb, GCallback cancel_cb, PurpleAccount* account, const char* who,
+                          PurpleConversation* conversation, void* user_data) {
+    if (g_VERBOSE) {
+        fprintf(stderr, "unanswered request: %s\n", title);
+    }
+    return NULL;
+}
+
+void* purple_request_input(void* handle, const char* title, const char* primary, const char* secondary,
+                           const char* default_value, gboolean multiline, gboolean masked, gchar* hint,
+                           const char* ok_text, GCallback ok_cb, const char* cancel_text, GCallback cancel_cb,
+                           PurpleAccount* account, const char* who, PurpleConversation* conversation,
+                           void* user_data) {
+    if (g_VERBOSE) {
+        fprintf(stderr, "unanswered request: %s\n", title);
+    }
+    return NULL;
+}
+
+/*
+ * Request fields are never shown, so the builders only need to hand out something non-NULL
+ */
+
+static int g_REQUEST_FIELD_DUMMY;
+
+PurpleRequestFields* purple_request_fields_new(void) {
+    return (PurpleRequestFields*) &g_REQUEST_FIELD_DUMMY;
+}
+
+void purple_request_fields_add_group(PurpleRequestFields* fields, PurpleRequestFieldGroup* group) {
+}
+
+PurpleRequestField* purple_request_fields_get_field(const PurpleRequestFields* fields, const char* id) {
+    return (PurpleRequestField*) &g_REQUEST_FIELD_DUMMY;
+}
+
+PurpleRequestFieldGroup* purple_request_field_group_new(const char* title) {
+    return (PurpleRequestFieldGroup*) &g_REQUEST_FIELD_DUMMY;
+}
+
+void purple_request_field_group_add_field(PurpleRequestFieldGroup* group, PurpleRequestField* field) {
+}
+
+PurpleRequestField* purple_request_field_list_new(const char* id, const char* text) {
+    return (PurpleRequestField*) &g_REQUEST_FIELD_DUMMY;
+}
+
+void purple_request_field_list_set_multi_select(PurpleRequestField* field, gboolean multi_select) {
+}
+
+void purple_request_field_list_add_icon(PurpleRequestField* field, const char* item, const char* icon_path,
+                                        void* data) {
+}
+
+GList* purple_request_field_list_get_items(const PurpleRequestField* field) {
+    return NULL;
+}
+
+void* purple_request_field_list_get_data(const PurpleRequestField* field, const char* text) {
+    return NULL;
+}
+
+gboolean purple_request_field_list_is_selected(const PurpleRequestField* field, const char* item) {
+    return FALSE;
+}
+
+void* purple_request_fields(void* handle, const char* title, const char* primary, const char* secondary,
+                            PurpleRequestFields* fields, const char* ok_text, GCallback ok_cb,
+                            const char* cancel_text, GCallback cancel_cb, PurpleAccount* account, const char* who,
+                            PurpleConversation* conversation, void* user_data) {
+    if (g_VERBOSE) {
+        fprintf(stderr, "unanswered request: %s: %s\n", title, primary);
+    }
+    return NULL;
+}
+
+void purple_request_close(PurpleRequestType type, void* ui_handle) {
+}
+
+void* purple_notify_message(void* handle, PurpleNotifyMsgType type, const char* title, const char* primary,
+                            const char* secondary, PurpleNotifyCloseCallback cb, gpointer user_data) {
+    if (g_VERBOSE) {
+        fprintf(stderr, "notification: %s: %s\n", title, primary);
+    }
+    return NULL;
+}
+
+void purple_notify_user_info_add_pair(PurpleNotifyUserInfo* user_info, const char* label, const char* value) {
+}
+
+PurpleCmdId purple_cmd_register(const gchar* command, const gchar* args, PurpleCmdPriority priority,
+                                PurpleCmdFlag flags, const gchar* prpl_id, PurpleCmdFunc callback,
+                                const gchar* help, void* data) {
+    return g_NEXT_COMMAND++;
+}
+
+void purple_cmd_unregister(PurpleCmdId id) {
+}
+
+PurplePluginAction* purple_plugin_action_new(const char* label, void (*callback)(PurplePluginAction*)) {
+    PurplePluginAction* action = g_new0(PurplePluginAction, 1);
+    action->label = g_strdup(label);
+    action->callback = callback;
+    return action;
+}
+
+gboolean purple_plugin_register(PurplePlugin* plugin) {
+    return TRUE;
+}
+
+/*
+ * Status types are only listed by the UI
+ */
+
+PurpleStatusType* purple_status_type_new_with_attrs(PurpleStatusPrimitive primitive, const char* id,
+                                                    const char* name, gboolean saveable, gboolean user_settable,
+                                                    gboolean independent, const char* attr_id,
+                                                    const char* attr_name, PurpleValue* attr_value, ...) {
+    return NULL;
+}
+
+PurpleValue* purple_value_new(PurpleType type, ...) {
+    return NULL;
+}
+
+const char* purple_status_get_id(const PurpleStatus* status) {
+    return NULL;
+}
+
+const char* purple_status_get_attr_string(const PurpleStatus* status, const char* id) {
+    return NULL;
+}
+
+// Preferences and Debugging ------------------------------------------------------------------------------------------
+
+void purple_prefs_add_none(const char* name) {
+}
+
+void purple_prefs_add_int(const char* name, int value) {
+    if (!g_hash_table_contains(g_PREFS, name)) {
+        g_hash_table_insert(g_PREFS, g_strdup(name), GINT_TO_POINTER(value));
+    }
+}
+
+int purple_prefs_get_int(const char* name) {
+    return GPOINTER_TO_INT(g_hash_table_lookup(g_PREFS, name));
+}
+
+guint purple_prefs_connect_callback(void* handle, const char* name, PurplePrefCallback callback, gpointer data) {
+    return g_NEXT_PREF_CALLBACK++;
+}
+
+gboolean purple_debug_is_enabled(void) {
+    return g_VERBOSE;
+}
+
+PurpleDebugUiOps* purple_debug_get_ui_ops(void) {
+    return NULL;
+}
+
+void purple_debug(PurpleDebugLevel level, const char* category, const char* format, ...) {
+    if (!g_VERBOSE) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "%s: ", category);
+    vfprintf(stderr, format, args);
+    va_end(args);
+}
+
+// Event Loop and Utilities -------------------------------------------------------------------------------------------
+
+guint purple_timeout_add(guint interval, GSourceFunc function, gpointer data) {
+    return g_timeout_add(interval, function, data);
+}
+
+guint purple_timeout_add_seconds(guint interval, GSourceFunc function, gpointer data) {
+    return g_timeout_add_seconds(interval, function, data);
+}
+
+gboolean purple_timeout_remove(guint handle) {
+    return g_source_remove(handle);
+}
+
+const char* purple_user_dir(void) {
+    return g_USER_DIR;
+}
+
+int purple_build_dir(const char* path, int mode) {
+    return g_mkdir_with_parents(path, mode);
+}
+
+const char* purple_escape_filename(const char* name) {
+    static gchar* escaped = NULL;
+    g_free(escaped);
+    escaped = g_uri_escape_string(name, "@", FALSE);
+    return escaped;
+}
+
+gboolean purple_util_write_data_to_file_absolute(const char* path, const char* data, gssize size) {
+    return g_file_set_contents(path, data, size, NULL);
+}
+
+gchar* purple_strreplace(const char* string, const char* delimiter, const char* replacement) {
+    gchar** parts = g_strsplit(string, delimiter, 0);
+    gchar* replaced = g_strjoinv(replacement, parts);
+    g_strfreev(parts);
+    return replaced;
+}
+
+char* purple_str_seconds_to_string(guint seconds) {
+    return g_strdup_printf("%u seconds", seconds);
+}
+
+/*
+ * The benchmarks only send plain text
+ */
+char* purple_markup_strip_html(const char* markup) {
+    return g_strdup(markup);
+}
+
+gboolean purple_message_meify(char* message, gssize length) {
+    if (length == -1) {
+        length = strlen(message);
+    }
+
+    if ((length >= 4) && (g_ascii_strncasecmp(message, "/me ", 4) == 0)) {
+        memmove(message, message + 4, length - 3);
+        return TRUE;
+    }
+    return FALSE;
+}
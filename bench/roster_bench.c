@@ -0,0 +1,371 @@
+/*
+ * Large roster benchmark: how login and presence handling scale with the number of friends.
+ *
+ * For every roster size, a profile with that many (offline, random) friends is fabricated, and timed are:
+ *
+ *  - friend_table:   loading the friend table from the profile, see ``toxprpl/friend_table.h''
+ *  - sync_new:       ToxPRPL_synchronizeBuddyList against an empty buddy list (first login)
+ *  - sync_existing:  ToxPRPL_synchronizeBuddyList against a matching buddy list (every later login)
+ *  - login_call:     the whole prpl login call, which includes loading the profile and the sync
+ *  - info_sweep:     the buddy refresh ToxPRPL_updateClientStatus starts once the DHT is connected,
+ *                    from start to finish, and per main loop iteration (the longest the UI is blocked)
+ *  - status_storm:   every friend changing status, through ToxPRPL_Tox_onFriendChangeStatus
+ *  - online_storm:   every friend going online and offline, through ToxPRPL_Tox_onUserConnectionStatusChange
+ *  - *_flush:        applying what a storm left pending, see ``toxprpl/presence.h''
+ *  - import:         ToxPRPL_Purple_importBuddies with a file of as many new friends, see ``toxprpl/buddy_import.h''
+ *
+ * Sizes are run in ascending order, so the peak RSS reported after each size is the peak for that size.
+ *
+ * e.g.: toxprpl_roster_bench --sizes 100,1000,10000 --rounds 3
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <bench.h>
+#include <toxprpl.h>
+#include <toxprpl/presence.h>
+#include <toxprpl/buddy_import.h>
+#include <toxprpl/pool.h>
+#include <toxprpl/friend_table.h>
+#include <toxprpl/callbacks.h>
+
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static gchar* g_SIZES = NULL;
+static gint g_ROUNDS = 3;
+static gint g_TIMEOUT = 60;
+static gchar* g_OUTPUT = NULL;
+static gboolean g_VERBOSE = FALSE;
+
+static GOptionEntry g_OPTIONS[] = {
+        { "sizes",   's', 0, G_OPTION_ARG_STRING,   &g_SIZES,   "Comma separated roster sizes (default 100,1000,10000)", "N,..." },
+        { "rounds",  'r', 0, G_OPTION_ARG_INT,      &g_ROUNDS,  "Presence storms per size (default 3)",        "N" },
+        { "timeout", 't', 0, G_OPTION_ARG_INT,      &g_TIMEOUT, "DHT connection timeout in seconds (default 60)", "S" },
+        { "output",  'o', 0, G_OPTION_ARG_FILENAME, &g_OUTPUT,  "Write results to FILE",                       "FILE" },
+        { "verbose", 'v', 0, G_OPTION_ARG_NONE,     &g_VERBOSE, "Print the plugin's debug output",             NULL },
+        { NULL }
+};
+
+typedef struct _roster_bench {
+
+    /*
+     * Benchmark name, e.g. ``roster_1000''
+     */
+    gchar* name;
+    guint size;
+
+    PurpleAccount* account;
+    PurpleConnection* gc;
+    gboolean failed;
+
+} Roster_Bench;
+
+static void onConnectionError(PurpleConnection* gc, const char* error, gpointer data) {
+    Roster_Bench* bench = data;
+    bench->failed = TRUE;
+}
+
+static gboolean isDhtConnected(gpointer data) {
+    Roster_Bench* bench = data;
+    ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(bench->gc);
+    return bench->failed || ((plugin != NULL) && tox_isconnected(plugin->tox));
+}
+
+/*
+ * A Tox instance with the account's profile loaded, as the plugin has it right before the sync
+ */
+static Tox* loadProfile(PurpleAccount* account) {
+    Tox* tox = tox_new(NULL);
+    toxprpl_return_val_if_fail(tox != NULL, NULL);
+
+    gsize size;
+    guchar* data = g_base64_decode(purple_account_get_string(account, "messenger", ""), &size);
+    int ret = tox_load(tox, data, (uint32_t) size);
+    g_free(data);
+
+    if (ret != 0) {
+        tox_kill(tox);
+        return NULL;
+    }
+    return tox;
+}
+
+/*
+ * Drop the plugin data of every buddy, as it is when the buddy list is loaded from disk
+ */
+static void resetBuddies(PurpleAccount* account, ToxPRPL_Pools* pools) {
+    GSList* buddies = purple_find_buddies(account, NULL);
+    GSList* link;
+    for (link = buddies; link != NULL; link = link->next) {
+        PurpleBuddy* buddy = link->data;
+        ToxPRPL_Pools_release(pools, TOXPRPL_POOL_BUDDY_DATA, purple_buddy_get_protocol_data(buddy));
+        purple_buddy_set_protocol_data(buddy, NULL);
+    }
+    g_slist_free(buddies);
+}
+
+static gboolean benchSync(Roster_Bench* bench) {
+    Tox* tox = loadProfile(bench->account);
+    if (tox == NULL) {
+        Bench_failure(bench->name, "could not load profile");
+        return FALSE;
+    }
+
+    ToxPRPL_Pools* pools = ToxPRPL_Pools_new();
+    gint64 started = Bench_now();
+    ToxPRPL_FriendTable* friends = ToxPRPL_FriendTable_new(tox);
+    Bench_result(bench->name, "friend_table", "ms", BENCH_MS(started, Bench_now()));
+
+    started = Bench_now();
+    ToxPRPL_synchronizeBuddyList(bench->account, friends, pools);
+    Bench_result(bench->name, "sync_new", "ms", BENCH_MS(started, Bench_now()));
+
+    if (Bench_Purple_countBuddies(bench->account) != bench->size) {
+        Bench_failure(bench->name, "buddy list does not match the profile");
+        resetBuddies(bench->account, pools);
+        ToxPRPL_FriendTable_free(friends);
+        ToxPRPL_Pools_free(pools);
+        tox_kill(tox);
+        return FALSE;
+    }
+
+    resetBuddies(bench->account, pools);
+    started = Bench_now();
+    ToxPRPL_synchronizeBuddyList(bench->account, friends, pools);
+    Bench_result(bench->name, "sync_existing", "ms", BENCH_MS(started, Bench_now()));
+
+    resetBuddies(bench->account, pools);
+    ToxPRPL_FriendTable_free(friends);
+    ToxPRPL_Pools_free(pools);
+    tox_kill(tox);
+    return TRUE;
+}
+
+static gboolean benchLogin(Roster_Bench* bench) {
+    gint64 started = Bench_now();
+    bench->gc = Bench_Purple_login(bench->account);
+    Bench_result(bench->name, "login_call", "ms", BENCH_MS(started, Bench_now()));
+
+    if (bench->failed || (purple_connection_get_protocol_data(bench->gc) == NULL)) {
+        Bench_failure(bench->name, "login failed");
+        return FALSE;
+    }
+
+    if (!Bench_runUntil(isDhtConnected, bench, g_TIMEOUT * 1000) || bench->failed) {
+        Bench_failure(bench->name, "DHT not connected");
+        return FALSE;
+    }
+
+    // the connection timer may have swept already; time a sweep of our own
+    ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(bench->gc);
+    plugin->connected = 0;
+
+    Bench_Series iterations;
+    Bench_Series_init(&iterations);
+
+    started = Bench_now();
+    ToxPRPL_updateClientStatus(bench->gc);
+    Bench_Series_add(&iterations, BENCH_MS(started, Bench_now()));
+
+    while (plugin->buddy_refresh != NULL) {
+        gint64 iteration = Bench_now();
+        g_main_context_iteration(NULL, TRUE);
+        Bench_Series_add(&iterations, BENCH_MS(iteration, Bench_now()));
+    }
+
+    Bench_result(bench->name, "info_sweep", "ms", BENCH_MS(started, Bench_now()));
+    Bench_Series_report(&iterations, bench->name, "info_sweep_iteration", "ms");
+    Bench_Series_clear(&iterations);
+    return TRUE;
+}
+
+static void benchPresenceStorms(Roster_Bench* bench) {
+    ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(bench->gc);
+    Bench_Series status;
+    Bench_Series online;
+    Bench_Series statusFlush;
+    Bench_Series onlineFlush;
+    Bench_Series_init(&status);
+    Bench_Series_init(&online);
+    Bench_Series_init(&statusFlush);
+    Bench_Series_init(&onlineFlush);
+
+    guint32 count = tox_count_friendlist(plugin->tox);
+    int32_t* friends = g_new0(int32_t, MAX(count, 1));
+    count = tox_get_friendlist(plugin->tox, friends, count);
+
+    gint round;
+    guint32 i;
+    for (round = 0; round < g_ROUNDS; round++) {
+        gint64 started = Bench_now();
+        for (i = 0; i < count; i++) {
+            ToxPRPL_Tox_onFriendChangeStatus(plugin->tox, friends[i], (uint8_t) ((round + i) % TOX_USERSTATUS_INVALID),
+                                             bench->gc);
+        }
+        Bench_Series_add(&status, BENCH_MS(started, Bench_now()));
+
+        started = Bench_now();
+        ToxPRPL_Presence_flush(plugin->presence);
+        Bench_Series_add(&statusFlush, BENCH_MS(started, Bench_now()));
+
+        started = Bench_now();
+        for (i = 0; i < count; i++) {
+            ToxPRPL_Tox_onUserConnectionStatusChange(plugin->tox, friends[i], 1, bench->gc);
+        }
+        for (i = 0; i < count; i++) {
+            ToxPRPL_Tox_onUserConnectionStatusChange(plugin->tox, friends[i], 0, bench->gc);
+        }
+        Bench_Series_add(&online, BENCH_MS(started, Bench_now()));
+
+        started = Bench_now();
+        ToxPRPL_Presence_flush(plugin->presence);
+        Bench_Series_add(&onlineFlush, BENCH_MS(started, Bench_now()));
+    }
+
+    Bench_Series_report(&status, bench->name, "status_storm", "ms");
+    Bench_Series_report(&statusFlush, bench->name, "status_flush", "ms");
+    Bench_Series_report(&online, bench->name, "online_storm", "ms");
+    Bench_Series_report(&onlineFlush, bench->name, "online_flush", "ms");
+    Bench_Series_clear(&status);
+    Bench_Series_clear(&online);
+    Bench_Series_clear(&statusFlush);
+    Bench_Series_clear(&onlineFlush);
+    g_free(friends);
+}
+
+static gboolean benchImport(Roster_Bench* bench) {
+    GString* list = g_string_new("# generated by toxprpl_roster_bench\n");
+    guint i, j;
+    for (i = 0; i < bench->size; i++) {
+        for (j = 0; j < TOX_CLIENT_ID_SIZE / sizeof(guint32); j++) {
+            g_string_append_printf(list, "%08x", g_random_int());
+        }
+        g_string_append_printf(list, "\timported %u\tImported\n", i);
+    }
+
+    gchar* filename = NULL;
+    gint fd = g_file_open_tmp("toxprpl-import-XXXXXX", &filename, NULL);
+    gboolean ok = (fd != -1) && g_file_set_contents(filename, list->str, (gssize) list->len, NULL);
+    if (fd != -1) {
+        close(fd);
+    }
+    g_string_free(list, TRUE);
+
+    if (!ok) {
+        Bench_failure(bench->name, "could not write import file");
+        g_free(filename);
+        return FALSE;
+    }
+
+    guint before = Bench_Purple_countBuddies(bench->account);
+    gint64 started = Bench_now();
+    ToxPRPL_Purple_importBuddies(bench->gc, filename);
+    Bench_result(bench->name, "import", "ms", BENCH_MS(started, Bench_now()));
+
+    g_unlink(filename);
+    g_free(filename);
+
+    if (Bench_Purple_countBuddies(bench->account) != before + bench->size) {
+        Bench_failure(bench->name, "not every buddy was imported");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static gboolean benchRoster(guint size, Bench_Peer* bootstrap) {
+    Roster_Bench bench;
+    memset(&bench, 0, sizeof(bench));
+    bench.name = g_strdup_printf("roster_%u", size);
+    bench.size = size;
+
+    Bench_begin(bench.name);
+    Bench_parameter(bench.name, "friends", size);
+    Bench_parameter(bench.name, "rounds", g_ROUNDS);
+
+    uint8_t address[TOX_FRIEND_ADDRESS_SIZE];
+    gint64 started = Bench_now();
+    gchar* profile = Bench_makeProfile(NULL, 0, size, address);
+    Bench_result(bench.name, "make_profile", "ms", BENCH_MS(started, Bench_now()));
+    Bench_result(bench.name, "profile_size", "KiB", strlen(profile) * 3 / 4 / 1024.0);
+
+    bench.account = Bench_Purple_newAccount(profile, bootstrap);
+    g_free(profile);
+
+    Bench_PurpleHooks hooks = {
+            .connection_error = onConnectionError,
+            .data = &bench
+    };
+    Bench_Purple_setHooks(&hooks);
+
+    gint64 cpu = Bench_cpuTime();
+    gboolean ok = benchSync(&bench) && benchLogin(&bench);
+    if (ok) {
+        benchPresenceStorms(&bench);
+        ok = benchImport(&bench);
+    }
+
+    Bench_result(bench.name, "cpu_time", "ms", (Bench_cpuTime() - cpu) / 1000.0);
+    Bench_result(bench.name, "peak_rss", "KiB", Bench_peakRss());
+
+    if (bench.gc != NULL) {
+        Bench_Purple_logout(bench.gc);
+    }
+    Bench_Purple_setHooks(NULL);
+    Bench_Purple_freeAccount(bench.account);
+    g_free(bench.name);
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    GError* error = NULL;
+    GOptionContext* context = g_option_context_new("- benchmark the Tox prpl with large rosters");
+    g_option_context_add_main_entries(context, g_OPTIONS, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        fprintf(stderr, "%s\n", error->message);
+        g_error_free(error);
+        return 2;
+    }
+    g_option_context_free(context);
+
+    g_ROUNDS = MAX(g_ROUNDS, 1);
+
+    gchar** sizes = g_strsplit((g_SIZES != NULL) ? g_SIZES : "100,1000,10000", ",", 0);
+
+    if ((g_OUTPUT != NULL) && !Bench_openOutput(g_OUTPUT)) {
+        g_strfreev(sizes);
+        return 2;
+    }
+
+    Bench_Purple_init(g_VERBOSE);
+
+    gboolean ok = TRUE;
+    Bench_Peer* bootstrap = Bench_Peer_new(NULL);
+    if ((bootstrap == NULL) || (bootstrap->port == 0)) {
+        Bench_failure("roster", "could not start peer");
+        ok = FALSE;
+    }
+
+    guint i;
+    for (i = 0; ok && (sizes[i] != NULL); i++) {
+        gint size = atoi(sizes[i]);
+        if (size > 0) {
+            ok = benchRoster((guint) size, bootstrap);
+        }
+    }
+
+    if (bootstrap != NULL) {
+        Bench_Peer_free(bootstrap);
+    }
+
+    Bench_Purple_shutdown();
+    Bench_closeOutput();
+    g_strfreev(sizes);
+    g_free(g_SIZES);
+    g_free(g_OUTPUT);
+
+    return ok ? 0 : 1;
+}
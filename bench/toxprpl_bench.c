@@ -0,0 +1,429 @@
+/*
+ * End to end benchmark: one plugin account talking to loopback peers.
+ *
+ * Measures, in this order:
+ *
+ *  - login:      the prpl login call (loading the profile and syncing N friends into the buddy list),
+ *                and the time until the DHT, the connection and all peers are online
+ *  - messaging:  message round trip latency through an echoing peer,
+ *                and messages per second in both directions
+ *  - xfer:       file transfer throughput in both directions
+ *
+ * e.g.: toxprpl_bench --friends 1000 --peers 4 --output results.json
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <bench.h>
+#include <toxprpl/metrics.h>
+
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+static gint g_FRIENDS = 100;
+static gint g_PEERS = 2;
+static gint g_ROUND_TRIPS = 200;
+static gint g_MESSAGES = 1000;
+static gint g_FILE_SIZE = 4096;
+static gint g_TIMEOUT = 60;
+static gchar* g_OUTPUT = NULL;
+static gboolean g_VERBOSE = FALSE;
+
+static GOptionEntry g_OPTIONS[] = {
+        { "friends",     'f', 0, G_OPTION_ARG_INT,      &g_FRIENDS,     "Friends in the profile (default 100)",  "N" },
+        { "peers",       'p', 0, G_OPTION_ARG_INT,      &g_PEERS,       "Loopback peers (default 2)",            "N" },
+        { "round-trips", 'r', 0, G_OPTION_ARG_INT,      &g_ROUND_TRIPS, "Round trips to time (default 200)",     "N" },
+        { "messages",    'm', 0, G_OPTION_ARG_INT,      &g_MESSAGES,    "Messages per direction (default 1000)", "N" },
+        { "file-size",   's', 0, G_OPTION_ARG_INT,      &g_FILE_SIZE,   "File size in KiB (default 4096)",       "KIB" },
+        { "timeout",     't', 0, G_OPTION_ARG_INT,      &g_TIMEOUT,     "Timeout per step in seconds (default 60)", "S" },
+        { "output",      'o', 0, G_OPTION_ARG_FILENAME, &g_OUTPUT,      "Write results to FILE",                 "FILE" },
+        { "verbose",     'v', 0, G_OPTION_ARG_NONE,     &g_VERBOSE,     "Print the plugin's debug output",       NULL },
+        { NULL }
+};
+
+typedef struct _bench_state {
+
+    PurpleAccount* account;
+    PurpleConnection* gc;
+
+    Bench_Peer** peers;
+    guint peer_count;
+
+    /*
+     * Friend number of the plugin account in every peer
+     */
+    int32_t* friend_numbers;
+
+    gint64 connected_at;
+    gboolean failed;
+
+    guint messages;
+    gboolean xfer_done;
+    gint64 xfer_finished;
+
+} Bench_State;
+
+// Hooks --------------------------------------------------------------------------------------------------------------
+
+static void onConnectionState(PurpleConnection* gc, PurpleConnectionState state, gpointer data) {
+    Bench_State* bench = data;
+    if ((state == PURPLE_CONNECTED) && (bench->connected_at == 0)) {
+        bench->connected_at = Bench_now();
+    }
+}
+
+static void onConnectionError(PurpleConnection* gc, const char* error, gpointer data) {
+    Bench_State* bench = data;
+    bench->failed = TRUE;
+}
+
+static void onGotIm(PurpleConnection* gc, const char* who, const char* message, gpointer data) {
+    Bench_State* bench = data;
+    bench->messages++;
+}
+
+static void onXferEnd(PurpleXfer* xfer, gboolean completed, gpointer data) {
+    Bench_State* bench = data;
+    if (purple_xfer_get_type(xfer) == PURPLE_XFER_RECEIVE) {
+        bench->xfer_done = TRUE;
+        bench->xfer_finished = completed ? Bench_now() : 0;
+    }
+}
+
+// Conditions ---------------------------------------------------------------------------------------------------------
+
+static gboolean isDhtConnected(gpointer data) {
+    Bench_State* bench = data;
+    ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(bench->gc);
+    return bench->failed || ((plugin != NULL) && tox_isconnected(plugin->tox));
+}
+
+static gboolean isConnected(gpointer data) {
+    Bench_State* bench = data;
+    return bench->failed || (bench->connected_at != 0);
+}
+
+static gboolean arePeersOnline(gpointer data) {
+    Bench_State* bench = data;
+    const char* offline = ToxPRPL_ToxStatuses[TOXPRPL_STATUS_OFFLINE].id;
+
+    guint i;
+    for (i = 0; i < bench->peer_count; i++) {
+        const char* status = Bench_Purple_getBuddyStatus(bench->account, bench->peers[i]->key);
+        if ((status == NULL) || (strcmp(status, offline) == 0)) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+typedef struct _bench_count {
+    guint* counter;
+    guint target;
+} Bench_Count;
+
+static gboolean isCountReached(gpointer data) {
+    Bench_Count* count = data;
+    return *count->counter >= count->target;
+}
+
+static guint countPeerMessages(Bench_State* bench) {
+    guint messages = 0;
+    guint i;
+    for (i = 0; i < bench->peer_count; i++) {
+        messages += bench->peers[i]->messages;
+    }
+    return messages;
+}
+
+static gboolean arePeerMessagesReceived(gpointer data) {
+    Bench_State* bench = data;
+    return countPeerMessages(bench) >= (guint) g_MESSAGES;
+}
+
+static gboolean isPeerFileReceived(gpointer data) {
+    Bench_Peer* peer = data;
+    return peer->file_finished != 0;
+}
+
+static gboolean isXferDone(gpointer data) {
+    Bench_State* bench = data;
+    return bench->xfer_done;
+}
+
+// Benchmarks ---------------------------------------------------------------------------------------------------------
+
+static gboolean benchLogin(Bench_State* bench) {
+    gint64 started = Bench_now();
+    bench->gc = Bench_Purple_login(bench->account);
+    gint64 returned = Bench_now();
+
+    if (bench->failed || (purple_connection_get_protocol_data(bench->gc) == NULL)) {
+        Bench_failure("login", "login failed");
+        return FALSE;
+    }
+
+    Bench_result("login", "login_call", "ms", BENCH_MS(started, returned));
+    Bench_result("login", "buddies", "count", Bench_Purple_countBuddies(bench->account));
+
+    if (!Bench_runUntil(isDhtConnected, bench, g_TIMEOUT * 1000) || bench->failed) {
+        Bench_failure("login", "DHT not connected");
+        return FALSE;
+    }
+    Bench_result("login", "dht_connected", "ms", BENCH_MS(started, Bench_now()));
+
+    if (!Bench_runUntil(isConnected, bench, g_TIMEOUT * 1000) || bench->failed) {
+        Bench_failure("login", "connection not established");
+        return FALSE;
+    }
+    Bench_result("login", "connected", "ms", BENCH_MS(started, bench->connected_at));
+
+    if (!Bench_runUntil(arePeersOnline, bench, g_TIMEOUT * 1000)) {
+        Bench_failure("login", "peers not online");
+        return FALSE;
+    }
+    Bench_result("login", "peers_online", "ms", BENCH_MS(started, Bench_now()));
+    return TRUE;
+}
+
+static gboolean benchRoundTrips(Bench_State* bench) {
+    PurplePluginProtocolInfo* prpl = Bench_Purple_getPrpl();
+    Bench_Peer* peer = bench->peers[0];
+    Bench_Series series;
+    Bench_Series_init(&series);
+
+    peer->echo = TRUE;
+
+    gint i;
+    for (i = 0; i < g_ROUND_TRIPS; i++) {
+        gchar* message = g_strdup_printf("ping %d", i);
+        Bench_Count count = { &bench->messages, bench->messages + 1 };
+
+        gint64 sent = Bench_now();
+        prpl->send_im(bench->gc, peer->key, message, 0);
+        gboolean received = Bench_runUntil(isCountReached, &count, g_TIMEOUT * 1000);
+        g_free(message);
+
+        if (!received) {
+            Bench_failure("messaging", "round trip timed out");
+            Bench_Series_clear(&series);
+            return FALSE;
+        }
+        Bench_Series_add(&series, BENCH_MS(sent, Bench_now()));
+    }
+
+    peer->echo = FALSE;
+
+    Bench_Series_report(&series, "messaging", "round_trip", "ms");
+    Bench_Series_clear(&series);
+    return TRUE;
+}
+
+static gboolean benchOutgoingMessages(Bench_State* bench) {
+    PurplePluginProtocolInfo* prpl = Bench_Purple_getPrpl();
+
+    guint i;
+    for (i = 0; i < bench->peer_count; i++) {
+        bench->peers[i]->messages = 0;
+    }
+
+    gint64 started = Bench_now();
+    gint sent;
+    for (sent = 0; sent < g_MESSAGES; sent++) {
+        gchar* message = g_strdup_printf("message %d", sent);
+        prpl->send_im(bench->gc, bench->peers[sent % bench->peer_count]->key, message, 0);
+        g_free(message);
+    }
+    gint64 queued = Bench_now();
+
+    if (!Bench_runUntil(arePeerMessagesReceived, bench, g_TIMEOUT * 1000)) {
+        Bench_failure("messaging", "outgoing messages timed out");
+        return FALSE;
+    }
+
+    gint64 finished = Bench_now();
+    Bench_result("messaging", "send_im_call", "us", (gdouble) (queued - started) / g_MESSAGES);
+    Bench_result("messaging", "outgoing_rate", "msg/s", g_MESSAGES / (BENCH_MS(started, finished) / 1000.0));
+    return TRUE;
+}
+
+static gboolean benchIncomingMessages(Bench_State* bench) {
+    Bench_Count count = { &bench->messages, bench->messages + g_MESSAGES };
+
+    gint64 started = Bench_now();
+    guint i;
+    for (i = 0; i < bench->peer_count; i++) {
+        guint share = g_MESSAGES / bench->peer_count + ((i < g_MESSAGES % bench->peer_count) ? 1 : 0);
+        Bench_Peer_sendBurst(bench->peers[i], bench->friend_numbers[i], share);
+    }
+
+    if (!Bench_runUntil(isCountReached, &count, g_TIMEOUT * 1000)) {
+        Bench_failure("messaging", "incoming messages timed out");
+        return FALSE;
+    }
+
+    Bench_result("messaging", "incoming_rate", "msg/s", g_MESSAGES / (BENCH_MS(started, Bench_now()) / 1000.0));
+    return TRUE;
+}
+
+static gchar* makeFile(guint64 size) {
+    gchar* path = NULL;
+    int fd = g_file_open_tmp("toxprpl-bench-XXXXXX", &path, NULL);
+    toxprpl_return_val_if_fail(fd >= 0, NULL);
+    close(fd);
+
+    gchar* data = g_malloc(size);
+    guint64 i;
+    for (i = 0; i < size; i++) {
+        data[i] = (gchar) g_random_int();
+    }
+    g_file_set_contents(path, data, size, NULL);
+    g_free(data);
+    return path;
+}
+
+static gboolean benchSendFile(Bench_State* bench) {
+    Bench_Peer* peer = bench->peers[0];
+    guint64 size = (guint64) g_FILE_SIZE * 1024;
+    gchar* path = makeFile(size);
+    toxprpl_return_val_if_fail(path != NULL, FALSE);
+
+    peer->file_started = 0;
+    peer->file_finished = 0;
+
+    gint64 requested = Bench_now();
+    Bench_Purple_getPrpl()->send_file(bench->gc, peer->key, path);
+    gboolean received = Bench_runUntil(isPeerFileReceived, peer, g_TIMEOUT * 1000);
+
+    g_remove(path);
+    g_free(path);
+
+    if (!received || (peer->file_bytes != size)) {
+        Bench_failure("xfer", "outgoing transfer did not complete");
+        return FALSE;
+    }
+
+    Bench_result("xfer", "send_total", "ms", BENCH_MS(requested, peer->file_finished));
+    Bench_result("xfer", "send_rate", "KiB/s", (size / 1024.0) / (BENCH_MS(peer->file_started, peer->file_finished) / 1000.0));
+    return TRUE;
+}
+
+static gboolean benchReceiveFile(Bench_State* bench) {
+    Bench_Peer* peer = bench->peers[0];
+    guint64 size = (guint64) g_FILE_SIZE * 1024;
+
+    bench->xfer_done = FALSE;
+    gint64 requested = Bench_now();
+    if (!Bench_Peer_sendFile(peer, bench->friend_numbers[0], size) ||
+        !Bench_runUntil(isXferDone, bench, g_TIMEOUT * 1000) || (bench->xfer_finished == 0)) {
+        Bench_failure("xfer", "incoming transfer did not complete");
+        return FALSE;
+    }
+
+    Bench_result("xfer", "receive_total", "ms", BENCH_MS(requested, bench->xfer_finished));
+    Bench_result("xfer", "receive_rate", "KiB/s", (size / 1024.0) / (BENCH_MS(peer->file_started, bench->xfer_finished) / 1000.0));
+    return TRUE;
+}
+
+// Main ---------------------------------------------------------------------------------------------------------------
+
+int main(int argc, char** argv) {
+    GError* error = NULL;
+    GOptionContext* context = g_option_context_new("- benchmark the Tox prpl against loopback peers");
+    g_option_context_add_main_entries(context, g_OPTIONS, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        fprintf(stderr, "%s\n", error->message);
+        g_error_free(error);
+        return 2;
+    }
+    g_option_context_free(context);
+
+    g_PEERS = MAX(g_PEERS, 1);
+    g_FRIENDS = MAX(g_FRIENDS, g_PEERS);
+    g_ROUND_TRIPS = MAX(g_ROUND_TRIPS, 1);
+    g_MESSAGES = MAX(g_MESSAGES, 1);
+    g_FILE_SIZE = MAX(g_FILE_SIZE, 1);
+
+    if ((g_OUTPUT != NULL) && !Bench_openOutput(g_OUTPUT)) {
+        return 2;
+    }
+
+    Bench_begin("toxprpl_bench");
+    Bench_parameter("toxprpl_bench", "friends", g_FRIENDS);
+    Bench_parameter("toxprpl_bench", "peers", g_PEERS);
+    Bench_parameter("toxprpl_bench", "round_trips", g_ROUND_TRIPS);
+    Bench_parameter("toxprpl_bench", "messages", g_MESSAGES);
+    Bench_parameter("toxprpl_bench", "file_size_kib", g_FILE_SIZE);
+
+    Bench_Purple_init(g_VERBOSE);
+
+    Bench_State bench;
+    memset(&bench, 0, sizeof(bench));
+    bench.peer_count = (guint) g_PEERS;
+    bench.peers = g_new0(Bench_Peer*, bench.peer_count);
+    bench.friend_numbers = g_new0(int32_t, bench.peer_count);
+
+    guint i;
+    for (i = 0; i < bench.peer_count; i++) {
+        bench.peers[i] = Bench_Peer_new((i > 0) ? bench.peers[0] : NULL);
+        if ((bench.peers[i] == NULL) || (bench.peers[i]->port == 0)) {
+            Bench_failure("toxprpl_bench", "could not start peer");
+            return 1;
+        }
+    }
+
+    uint8_t address[TOX_FRIEND_ADDRESS_SIZE];
+    gchar* profile = Bench_makeProfile(bench.peers, bench.peer_count, (guint) g_FRIENDS, address);
+    for (i = 0; i < bench.peer_count; i++) {
+        bench.friend_numbers[i] = Bench_Peer_addFriend(bench.peers[i], address);
+    }
+
+    bench.account = Bench_Purple_newAccount(profile, bench.peers[0]);
+    g_free(profile);
+
+    Bench_PurpleHooks hooks = {
+            .connection_state = onConnectionState,
+            .connection_error = onConnectionError,
+            .got_im = onGotIm,
+            .xfer_end = onXferEnd,
+            .data = &bench
+    };
+    Bench_Purple_setHooks(&hooks);
+
+    gint64 cpu = Bench_cpuTime();
+    gboolean ok = benchLogin(&bench) &&
+                  benchRoundTrips(&bench) &&
+                  benchOutgoingMessages(&bench) &&
+                  benchIncomingMessages(&bench) &&
+                  benchSendFile(&bench) &&
+                  benchReceiveFile(&bench);
+
+    Bench_result("toxprpl_bench", "cpu_time", "ms", (Bench_cpuTime() - cpu) / 1000.0);
+    Bench_result("toxprpl_bench", "peak_rss", "KiB", Bench_peakRss());
+
+    if (g_VERBOSE && (bench.gc != NULL) && (purple_connection_get_protocol_data(bench.gc) != NULL)) {
+        gchar* report = ToxPRPL_Metrics_format(bench.gc);
+        fprintf(stderr, "%s", report);
+        g_free(report);
+    }
+
+    if (bench.gc != NULL) {
+        Bench_Purple_logout(bench.gc);
+    }
+    Bench_Purple_setHooks(NULL);
+    Bench_Purple_freeAccount(bench.account);
+
+    for (i = 0; i < bench.peer_count; i++) {
+        Bench_Peer_free(bench.peers[i]);
+    }
+    g_free(bench.peers);
+    g_free(bench.friend_numbers);
+
+    Bench_Purple_shutdown();
+    Bench_closeOutput();
+    g_free(g_OUTPUT);
+
+    return ok ? 0 : 1;
+}
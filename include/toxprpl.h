@@ -30,6 +30,9 @@
 
 #define DEFAULT_REQUEST_MESSAGE _("Please allow me to add you as a friend!")
 
+// Buffer size for a client ID in Base 16, including the terminating NUL
+#define TOXPRPL_CLIENT_ID_HEX_SIZE  (TOX_CLIENT_ID_SIZE * 2 + 1)
+
 // TODO -> enum
 #define TOXPRPL_MAX_STATUS          4
 #define TOXPRPL_STATUS_ONLINE       0
@@ -60,6 +63,7 @@
 #include <connection.h>
 #include <debug.h>
 #include <notify.h>
+#include <prefs.h>
 #include <privacy.h>
 #include <prpl.h>
 #include <roomlist.h>
@@ -72,6 +76,8 @@
 
 #include <toxprpl_data.h>
 
+#include <toxprpl/log.h>
+
 // util.c start --------------------------------------------------------------------------------------------------------
 
 extern const ToxPRPL_Status ToxPRPL_ToxStatuses[];
@@ -80,16 +86,43 @@ extern const ToxPRPL_Status ToxPRPL_ToxStatuses[];
  * Kitchen sink
  */
 
+// Base 16 conversion; NULL for invalid input or without memory, release the result with free()
 char* ToxPRPL_binToHexString(const unsigned char*, const size_t);
 unsigned char* ToxPRPL_hexStringToBin(const char*);
 int ToxPRPL_getStatusTypeIndex(Tox*, int, TOX_USERSTATUS);
 TOX_USERSTATUS ToxPRPL_getStatusTypeById(const char*);
 
+/*
+ * Base 16 conversion in to caller buffers. Both fail, without touching more than `out_size' bytes,
+ * when the buffer is too small; decoding also fails on odd lengths and anything but hex digits.
+ * Encoding writes lower case and a terminating NUL.
+ */
+gboolean ToxPRPL_binToHex(const unsigned char*, size_t, char*, size_t);
+gboolean ToxPRPL_hexToBin(const char*, size_t, unsigned char*, size_t);
+
 /*
  * Tox helpers
  */
 
 gchar* ToxPRPL_toxClientIdToString(const uint8_t*);
+void ToxPRPL_toxClientIdToHex(const uint8_t*, char*);
 gchar* ToxPRPL_toxFriendIdToString(uint8_t*);
 
-// util.c end ----------------------------------------------------------------------------------------------------------
\ No newline at end of file
+/*
+ * Logging, see ``toxprpl/log.h''
+ */
+
+void ToxPRPL_initLogging(PurplePlugin*);
+
+// util.c end ----------------------------------------------------------------------------------------------------------
+
+// toxprpl.c start -----------------------------------------------------------------------------------------------------
+
+/*
+ * Not static, so that ``bench/roster_bench.c'' can time them on their own
+ */
+
+void ToxPRPL_synchronizeBuddyList(PurpleAccount*, struct _toxprpl_friend_table*, struct _toxprpl_pools*);
+gboolean ToxPRPL_updateClientStatus(gpointer);
+
+// toxprpl.c end -------------------------------------------------------------------------------------------------------
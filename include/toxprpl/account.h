@@ -16,4 +16,5 @@ void ToxPRPL_showSitNicknameDialog(PurplePluginAction*);
 GList* ToxPRPL_Purple_getAccountActions(PurplePlugin*, gpointer);
 void ToxPRPL_Purple_onSetNickname(PurpleConnection*, const char*);
 void ToxPRPL_Purple_onSetStatus(PurpleAccount*, PurpleStatus*);
+void ToxPRPL_Purple_onSetBuddyIcon(PurpleConnection*, PurpleStoredImage*);
 
@@ -0,0 +1,76 @@
+/*
+ * Avatars.
+ *
+ * Tox tells us a friend's avatar as a hash first (the avatar info), and sends the image itself only when
+ * asked to. Received images are kept in a content-addressed cache, one file per hash
+ * (``tox/avatars/<hash>.png'' in the purple user directory), shared by all friends and accounts.
+ *
+ * When the advertised hash is the one purple already shows for the buddy, nothing happens; purple keeps
+ * that hash in the buddy list, so this holds across restarts. When the cache has the image, it is taken
+ * from there. Only otherwise is the image transferred, once per hash and friend. So reconnecting, or many
+ * friends using the same avatar, does not cost a transfer per friend.
+ *
+ * Our own avatar is the account's buddy icon, which the UI scales to the icon spec once, when it is set.
+ */
+#pragma once
+
+#include <toxprpl.h>
+
+/*
+ * Icon spec limits, in pixels; images are PNG and at most TOX_AVATAR_MAX_DATA_LENGTH bytes
+ */
+#define TOXPRPL_AVATAR_MIN_SIZE     16
+#define TOXPRPL_AVATAR_MAX_SIZE     64
+
+#define TOXPRPL_AVATAR_HASH_HEX_SIZE (TOX_HASH_LENGTH * 2 + 1)
+
+typedef struct _toxprpl_avatars {
+
+    PurpleConnection* gc;
+    Tox* tox;
+    struct _toxprpl_friend_table* friends;
+    struct _toxprpl_buddy_keys* keys;
+    struct _toxprpl_metrics* metrics;
+
+    gchar* cache_dir;
+
+    /*
+     * Hash of our own avatar, all zero while there is none
+     */
+    uint8_t own_hash[TOX_HASH_LENGTH];
+
+    /*
+     * friend number -> hash (Base 16) of the image requested from that friend
+     */
+    GHashTable* requested;
+
+} ToxPRPL_Avatars;
+
+/*
+ * Defined in ``common/avatars.c''
+ */
+
+ToxPRPL_Avatars* ToxPRPL_Avatars_new(PurpleConnection*, Tox*, struct _toxprpl_friend_table*,
+                                     struct _toxprpl_buddy_keys*, struct _toxprpl_metrics*);
+
+void ToxPRPL_Avatars_free(ToxPRPL_Avatars*);
+
+/*
+ * Take in a friend's avatar hash, as received by the avatar info callback
+ */
+void ToxPRPL_Avatars_onInfo(ToxPRPL_Avatars*, int, uint8_t, const uint8_t*);
+
+/*
+ * Take in a friend's avatar, as received by the avatar data callback
+ */
+void ToxPRPL_Avatars_onData(ToxPRPL_Avatars*, int, uint8_t, const uint8_t*, const uint8_t*, uint32_t);
+
+/*
+ * Set our own avatar from PNG data, or remove it when there is none
+ */
+void ToxPRPL_Avatars_setOwn(ToxPRPL_Avatars*, const guint8*, size_t);
+
+/*
+ * Drop all state kept for a friend
+ */
+void ToxPRPL_Avatars_forgetFriend(ToxPRPL_Avatars*, int);
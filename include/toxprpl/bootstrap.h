@@ -0,0 +1,160 @@
+/*
+ * DHT bootstrapping.
+ *
+ * Instead of a single DHT node, every login bootstraps against a list of nodes:
+ * the node from the ``Server'' options, followed by the nodes from the ``Bootstrap nodes'' option.
+ * Nodes are tried in waves of TOXPRPL_BOOTSTRAP_WAVE_SIZE, best ranked first, and a new wave is started
+ * every TOXPRPL_BOOTSTRAP_WAVE_TIMEOUT milliseconds until the DHT is connected.
+ *
+ * Tox does not tell which node answered, so the time it took to get connected is credited
+ * to every node of the wave that was running at that point, and the nodes of earlier waves
+ * are marked as failed. These measurements are used to rank the nodes on the next login.
+ *
+ * Nodes that got us connected are remembered in a small per account cache file
+ * (``tox/<account>.nodes'' in the purple user directory), so that the next login
+ * starts from nodes that are known to be good, even if they are no longer configured.
+ *
+ * When the DHT connection is lost, the best nodes are bootstrapped again right away. Further attempts
+ * follow with exponential backoff (plus jitter, so that a whole network of clients does not retry in
+ * lock step), and every attempt doubles the number of nodes used. A change in the network configuration
+ * (e.g. resuming from suspend, or switching networks) triggers an attempt immediately.
+ */
+#pragma once
+
+#include <toxprpl.h>
+
+/*
+ * Account option names
+ */
+#define TOXPRPL_OPT_BOOTSTRAP_NODES     "dht_nodes"
+#define TOXPRPL_OPT_TCP_RELAYS          "tcp_relays"
+#define TOXPRPL_OPT_IPV6                "ipv6_enabled"
+#define TOXPRPL_OPT_UDP                 "udp_enabled"
+
+#define DEFAULT_IPV6    TRUE
+#define DEFAULT_UDP     TRUE
+
+/*
+ * Additional well known nodes, as a list of ``host:port:key'' entries
+ * separated by white space or commas. TCP relays are configured the same way.
+ */
+#define DEFAULT_BOOTSTRAP_NODES \
+    "144.76.60.215:33445:04119E835DF3E78BACF0F84235B300546AF8B936F035185E2A8E9E0A67C8924F " \
+    "23.226.230.47:33445:A09162D68618E742FFBCA1C2C70385E6679604B2D80EA6E84AD0996A1AC8A074 " \
+    "37.187.46.132:33445:A9D98212B3F972BD11DA52BEB0658C326FCCC1BFD49F347F9C2D3D8B61E1B927"
+
+#define TOXPRPL_BOOTSTRAP_WAVE_SIZE     4
+#define TOXPRPL_BOOTSTRAP_WAVE_TIMEOUT  5000 // milliseconds
+#define TOXPRPL_BOOTSTRAP_POLL_INTERVAL 250  // milliseconds
+
+/*
+ * Delay before the second reconnect attempt, doubled for each further attempt up to the maximum.
+ * Every delay is randomly spread by up to TOXPRPL_RECONNECT_JITTER percent in either direction.
+ */
+#define TOXPRPL_RECONNECT_DELAY_MIN     2000   // milliseconds
+#define TOXPRPL_RECONNECT_DELAY_MAX     120000 // milliseconds
+#define TOXPRPL_RECONNECT_JITTER        25     // percent
+
+/*
+ * Node cache bounds: entries not seen connecting for longer than the maximum age are dropped,
+ * and at most TOXPRPL_NODE_CACHE_SIZE of the best ranked nodes are kept.
+ */
+#define TOXPRPL_NODE_CACHE_SIZE         32
+#define TOXPRPL_NODE_CACHE_MAX_AGE      (14 * 24 * 60 * 60) // seconds
+
+typedef struct _toxprpl_bootstrap_node {
+
+    gchar* address;
+    uint16_t port;
+    gchar* key;
+
+    /*
+     * Smoothed time from bootstrapping this node to being connected, in milliseconds, or -1 if unknown
+     */
+    gint rtt;
+
+    /*
+     * Number of consecutive logins in which this node's wave did not get us connected
+     */
+    guint failures;
+
+    /*
+     * Wall clock time at which this node last got us connected, in seconds, or 0 if never
+     */
+    gint64 last_seen;
+
+} ToxPRPL_BootstrapNode;
+
+typedef struct _toxprpl_bootstrap {
+
+    Tox* tox;
+    PurpleAccount* account;
+
+    /*
+     * Absolute path of the node cache file
+     */
+    gchar* cache_file;
+
+    /*
+     * ToxPRPL_BootstrapNode entries, best ranked first
+     */
+    GPtrArray* nodes;
+
+    /*
+     * Index of the next node to bootstrap, and the first node of the current wave
+     */
+    guint next;
+    guint wave;
+
+    /*
+     * Monotonic time at which the current wave (and the whole bootstrap) was started, in microseconds
+     */
+    gint64 wave_started;
+    gint64 started;
+
+    guint timer;
+
+    /*
+     * Whether we are recovering from a lost connection, rather than bootstrapping for the first time,
+     * the number of reconnect attempts so far, and the monotonic time of the next attempt
+     */
+    gboolean reconnecting;
+    guint attempts;
+    gint64 next_attempt;
+
+    /*
+     * Monotonic time at which the DHT was last connected and disconnected, in microseconds, or 0
+     */
+    gint64 connected_at;
+    gint64 disconnected_at;
+
+} ToxPRPL_Bootstrap;
+
+/*
+ * Defined in ``common/bootstrap.c''
+ */
+
+/*
+ * Fill Tox_Options from the account's transport options and proxy settings
+ */
+void ToxPRPL_getToxOptions(PurpleAccount*, Tox_Options*);
+
+/*
+ * Register the account's TCP relays with Tox
+ */
+void ToxPRPL_addTcpRelays(PurpleAccount*, Tox*);
+
+ToxPRPL_Bootstrap* ToxPRPL_Bootstrap_new(PurpleAccount*, Tox*);
+
+void ToxPRPL_Bootstrap_free(ToxPRPL_Bootstrap*);
+
+/*
+ * Bootstrap the first wave of nodes, and keep bootstrapping further waves until connected.
+ * Returns FALSE if not a single node could be bootstrapped.
+ */
+gboolean ToxPRPL_Bootstrap_start(ToxPRPL_Bootstrap*);
+
+/*
+ * Start reconnecting after the DHT connection was lost
+ */
+void ToxPRPL_Bootstrap_onDisconnected(ToxPRPL_Bootstrap*);
@@ -1,18 +1,62 @@
 #pragma once
 #include <toxprpl.h>
 
+const char* ToxPRPL_getAddFriendError(int);
+
 int ToxPRPL_Purple_addFriend(Tox*, PurpleConnection*, const char*, gboolean, const char*);
 
+/*
+ * Attach Tox friend `friend_number' to a buddy, keeping the buddy's data if it has some already
+ */
+ToxPRPL_BuddyData* ToxPRPL_Purple_setBuddyData(struct _toxprpl_pools*, PurpleBuddy*, int);
+
+/*
+ * Detach the data of all buddies of an account, and hand it back to the pools it came from,
+ * before those are freed
+ */
+void ToxPRPL_Purple_clearBuddyData(struct _toxprpl_pools*, PurpleAccount*);
+
 void ToxPRPL_Purple_getBuddyInfo(gpointer, gpointer);
 
+/*
+ * Friend numbers refreshed per main loop iteration by ``ToxPRPL_Purple_refreshBuddies''
+ */
+#define TOXPRPL_BUDDY_REFRESH_CHUNK 200
+
+/*
+ * A refresh of every buddy's status and alias, spread over several main loop iterations
+ */
+typedef struct _toxprpl_buddy_refresh {
+
+    PurpleConnection* gc;
+
+    /*
+     * Friend table size when the refresh started, and the next friend number to refresh
+     */
+    guint count;
+    guint next;
+
+    guint timer;
+
+} ToxPRPL_BuddyRefresh;
+
+/*
+ * Refresh all buddies from Tox, in chunks. Restarts a refresh that is still running.
+ */
+void ToxPRPL_Purple_refreshBuddies(PurpleConnection*);
+
+void ToxPRPL_Purple_cancelBuddyRefresh(PurpleConnection*);
+
 void ToxPRPL_Purple_removeBuddy(PurpleConnection* gc, PurpleBuddy* buddy, PurpleGroup* group);
 
 void ToxPRPL_Purple_addBuddy(PurpleConnection*, PurpleBuddy*, PurpleGroup*, const char*);
 
 void ToxPRPL_Action_acceptFriendRequest(ToxPRPL_FriendAcceptData*);
 
-void ToxPRPL_Action_rejectFriendRequest(ToxPRPL_FriendAcceptData*);
-
 const char* ToxPRPL_Purple_getListIconForUser(PurpleAccount*, PurpleBuddy*);
 
+char* ToxPRPL_Purple_getStatusText(PurpleBuddy*);
+
+void ToxPRPL_Purple_getTooltipText(PurpleBuddy*, PurpleNotifyUserInfo*, gboolean);
+
 
@@ -0,0 +1,40 @@
+/*
+ * Bulk buddy import.
+ *
+ * Reads a text file with one friend per line, as
+ *
+ *     <Tox ID>[<TAB><alias>[<TAB><group>]]
+ *
+ * Blank lines and lines starting with `#' are skipped. A full Tox ID (76 characters) sends a friend request,
+ * a bare public key (64 characters) adds the friend without one, for contacts that already have us.
+ *
+ * All lines are validated before anything is added; then every friend is added to Tox, the buddies are
+ * created in one pass, and the account is saved once, with a single summary at the end.
+ */
+#pragma once
+
+#include <toxprpl.h>
+
+/*
+ * Largest import file accepted, in bytes
+ */
+#define TOXPRPL_BUDDY_IMPORT_MAX_SIZE   (16 * 1024 * 1024)
+
+/*
+ * How many rejected lines the summary lists, the others are only counted
+ */
+#define TOXPRPL_BUDDY_IMPORT_MAX_ERRORS 20
+
+/*
+ * Defined in ``purple/buddy_import.c''
+ */
+
+/*
+ * Import the buddies listed in `filename'
+ */
+void ToxPRPL_Purple_importBuddies(PurpleConnection*, const char*);
+
+/*
+ * Account action asking for a file to import buddies from
+ */
+void ToxPRPL_showImportBuddiesDialog(PurplePluginAction*);
@@ -0,0 +1,52 @@
+/*
+ * Interned buddy keys.
+ *
+ * Every Tox callback names the friend by number, purple wants the Base 16 client ID. Rather than
+ * converting (and allocating) that string for every message, typing notification or transfer,
+ * each connection keeps one canonical key string per client ID. Callbacks borrow it; it stays
+ * valid until the friend is forgotten or the connection is closed.
+ */
+#pragma once
+
+#include <toxprpl.h>
+
+typedef struct _toxprpl_buddy_keys {
+
+    struct _toxprpl_friend_table* friends;
+
+    /*
+     * client ID (TOX_CLIENT_ID_SIZE bytes) -> ToxPRPL_BuddyKey, which also holds the client ID
+     */
+    GHashTable* keys;
+
+} ToxPRPL_BuddyKeys;
+
+typedef struct _toxprpl_buddy_key {
+
+    uint8_t client_id[TOX_CLIENT_ID_SIZE];
+    char name[TOXPRPL_CLIENT_ID_HEX_SIZE];
+
+} ToxPRPL_BuddyKey;
+
+/*
+ * Defined in ``common/buddy_keys.c''
+ */
+
+ToxPRPL_BuddyKeys* ToxPRPL_BuddyKeys_new(struct _toxprpl_friend_table*);
+
+void ToxPRPL_BuddyKeys_free(ToxPRPL_BuddyKeys*);
+
+/*
+ * The canonical key string for a client ID
+ */
+const char* ToxPRPL_BuddyKeys_intern(ToxPRPL_BuddyKeys*, const uint8_t*);
+
+/*
+ * The canonical key string of a friend, or NULL if there is no such friend
+ */
+const char* ToxPRPL_BuddyKeys_forFriend(ToxPRPL_BuddyKeys*, int);
+
+/*
+ * Drop a friend's key, before the friend is removed from the friend table
+ */
+void ToxPRPL_BuddyKeys_forgetFriend(ToxPRPL_BuddyKeys*, int);
@@ -0,0 +1,37 @@
+/*
+ * Tox callbacks for friends and one-to-one chat.
+ *
+ * These are registered with Tox in ``toxprpl.c'', and wrapped for tracing in ``tox/trace.c''.
+ * Group chat and file transfer callbacks are declared in ``toxprpl/group_chat.h'' and ``toxprpl/xfers.h''.
+ */
+#pragma once
+
+#include <toxprpl.h>
+
+/*
+ * Defined in ``tox/buddy.c''
+ */
+
+void ToxPRPL_Tox_onUserConnectionStatusChange(Tox*, int32_t, uint8_t, void*);
+
+void ToxPRPL_Tox_onFriendRequest(struct Tox*, uint8_t const *, uint8_t const *, uint16_t, void*);
+
+void ToxPRPL_Tox_onFriendAction(Tox*, int32_t, uint8_t const *, uint16_t, void*);
+
+void ToxPRPL_Tox_onFriendChangeNickname(Tox*, int32_t, uint8_t const *, uint16_t, void*);
+
+void ToxPRPL_Tox_onFriendChangeStatus(struct Tox*, int32_t, uint8_t, void*);
+
+void ToxPRPL_Tox_onFriendChangeStatusMessage(Tox*, int32_t, uint8_t const *, uint16_t, void*);
+
+void ToxPRPL_Tox_onAvatarInfo(Tox*, int32_t, uint8_t, uint8_t*, void*);
+
+void ToxPRPL_Tox_onAvatarData(Tox*, int32_t, uint8_t, uint8_t*, uint8_t*, uint32_t, void*);
+
+/*
+ * Defined in ``tox/chat.c''
+ */
+
+void ToxPRPL_Tox_onMessageReceived(Tox*, int32_t, uint8_t const *, uint16_t, void*);
+
+void ToxPRPL_Tox_onUserTypingChange(Tox*, int32_t, uint8_t, void*);
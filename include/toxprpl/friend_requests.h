@@ -0,0 +1,112 @@
+/*
+ * Incoming friend request intake.
+ *
+ * Every connection owns one intake. Requests are deduplicated by key in a bounded queue and
+ * presented together, in a single dialog, a moment after the first one arrives; requests that
+ * come in while the dialog is open wait for the next one. Keys whose request was rejected are
+ * ignored for a while, so that a sender can not simply keep asking. Depending on the account's
+ * policy, requests can also be rejected right away, or accepted in batches without asking.
+ */
+#pragma once
+
+#include <toxprpl.h>
+
+/*
+ * Account option names and defaults
+ */
+#define TOXPRPL_OPT_FRIEND_REQUEST_POLICY   "friend_request_policy"
+#define TOXPRPL_OPT_FRIEND_REQUEST_QUEUE    "friend_request_queue"
+
+#define TOXPRPL_FRIEND_REQUEST_POLICY_ASK       "ask"
+#define TOXPRPL_FRIEND_REQUEST_POLICY_ACCEPT    "accept"
+#define TOXPRPL_FRIEND_REQUEST_POLICY_REJECT    "reject"
+
+#define DEFAULT_FRIEND_REQUEST_POLICY   TOXPRPL_FRIEND_REQUEST_POLICY_ASK
+#define DEFAULT_FRIEND_REQUEST_QUEUE    100 // pending requests, further ones are dropped
+
+/*
+ * How long to wait for more requests before showing the dialog, in milliseconds
+ */
+#define TOXPRPL_FRIEND_REQUEST_BATCH_DELAY  2000
+
+/*
+ * How long requests from a rejected key are ignored, in seconds,
+ * and how many such keys are remembered at most
+ */
+#define TOXPRPL_FRIEND_REQUEST_COOLDOWN     3600
+#define TOXPRPL_FRIEND_REQUEST_COOLDOWN_MAX 1024
+
+typedef enum {
+    TOXPRPL_FRIEND_REQUESTS_ASK,
+    TOXPRPL_FRIEND_REQUESTS_ACCEPT,
+    TOXPRPL_FRIEND_REQUESTS_REJECT
+} ToxPRPL_FriendRequestPolicy;
+
+typedef struct _toxprpl_friend_request {
+
+    gchar* buddy_key;
+
+    /*
+     * Latest request message, or NULL
+     */
+    gchar* message;
+
+    /*
+     * How often the request was received while pending
+     */
+    guint count;
+
+} ToxPRPL_FriendRequest;
+
+typedef struct _toxprpl_friend_requests {
+
+    PurpleConnection* gc;
+    struct _toxprpl_metrics* metrics;
+
+    ToxPRPL_FriendRequestPolicy policy;
+    guint queue_limit;
+
+    /*
+     * buddy key -> ToxPRPL_FriendRequest, and the same requests oldest first
+     */
+    GHashTable* pending;
+    GQueue order;
+
+    /*
+     * buddy key -> monotonic time (gint64*, in microseconds) until which its requests are ignored
+     */
+    GHashTable* cooldown;
+
+    guint present_timer;
+
+    /*
+     * The batch dialog, while it is open
+     */
+    gboolean dialog_open;
+    void* dialog;
+
+} ToxPRPL_FriendRequests;
+
+/*
+ * Defined in ``common/friend_requests.c''
+ */
+
+ToxPRPL_FriendRequests* ToxPRPL_FriendRequests_new(PurpleConnection*, struct _toxprpl_metrics*);
+
+void ToxPRPL_FriendRequests_free(ToxPRPL_FriendRequests*);
+
+/*
+ * Take in a request, as received by the friend request callback
+ */
+void ToxPRPL_FriendRequests_add(ToxPRPL_FriendRequests*, const char*, const char*);
+
+/*
+ * Show the batch dialog for all pending requests now, if there are any and it is not open yet.
+ * With the ``accept'' policy, the pending requests are accepted instead.
+ */
+void ToxPRPL_FriendRequests_present(ToxPRPL_FriendRequests*);
+
+/*
+ * Account action showing the pending requests
+ */
+void ToxPRPL_showFriendRequestsDialog(PurplePluginAction*);
@@ -0,0 +1,106 @@
+/*
+ * Dense per-friend state.
+ *
+ * Tox numbers its friends from 0 up, reusing the numbers of deleted friends, so the state the plugin keeps
+ * for every friend lives in arrays indexed by friend number, one array per field. A pass over all friends
+ * that needs only one or two fields, like the login sync or the buddy refresh, reads those arrays front to
+ * back, instead of asking Tox friend by friend or chasing buddy data and hash table entries.
+ *
+ * Every connection loads its table from Tox once, at login; after that the Tox callbacks keep it current.
+ * Friends added or deleted by the plugin have to be loaded or removed explicitly.
+ */
+#pragma once
+
+#include <toxprpl.h>
+
+/*
+ * Smallest number of friends a table has room for
+ */
+#define TOXPRPL_FRIEND_TABLE_MIN_CAPACITY 64
+
+typedef struct _toxprpl_friend_table {
+
+    Tox* tox;
+
+    /*
+     * Friends there is room for, one past the highest friend number in use, and the friends in the table
+     */
+    guint capacity;
+    guint size;
+    guint count;
+
+    /*
+     * Indexed by friend number; numbers Tox has no friend for are not `used', and zeroed
+     */
+    guint8* used;
+    uint8_t* client_ids;    // TOX_CLIENT_ID_SIZE bytes per friend
+    gchar** names;          // as the friend set it, NULL if empty
+    gchar** status_messages;
+    guint8* user_status;    // TOX_USERSTATUS
+    guint8* online;
+    gint64* last_seen;      // UNIX time of the last connection change, or as saved by Tox, 0 if never seen
+    guint8* typing;
+
+} ToxPRPL_FriendTable;
+
+/*
+ * Defined in ``common/friend_table.c''
+ */
+
+/*
+ * A table with every friend Tox has right now
+ */
+ToxPRPL_FriendTable* ToxPRPL_FriendTable_new(Tox*);
+
+void ToxPRPL_FriendTable_free(ToxPRPL_FriendTable*);
+
+/*
+ * (Re)read a friend from Tox, after it was added
+ */
+void ToxPRPL_FriendTable_load(ToxPRPL_FriendTable*, int);
+
+/*
+ * Drop a friend, after it was deleted from Tox
+ */
+void ToxPRPL_FriendTable_remove(ToxPRPL_FriendTable*, int);
+
+gboolean ToxPRPL_FriendTable_has(const ToxPRPL_FriendTable*, int);
+
+/*
+ * A friend's client ID, or NULL if there is no such friend
+ */
+const uint8_t* ToxPRPL_FriendTable_getClientId(const ToxPRPL_FriendTable*, int);
+
+/*
+ * A friend's name, or NULL if there is no such friend or the name is empty
+ */
+const char* ToxPRPL_FriendTable_getName(const ToxPRPL_FriendTable*, int);
+
+/*
+ * A friend's status message, or NULL if there is no such friend or the message is empty
+ */
+const char* ToxPRPL_FriendTable_getStatusMessage(const ToxPRPL_FriendTable*, int);
+
+/*
+ * Status to show for a friend, as an index in to ToxPRPL_ToxStatuses
+ */
+int ToxPRPL_FriendTable_getStatusIndex(const ToxPRPL_FriendTable*, int);
+
+/*
+ * Hand a friend's status and status message to purple, for the buddy named `buddy_key'
+ */
+void ToxPRPL_FriendTable_showStatus(const ToxPRPL_FriendTable*, PurpleAccount*, const char*, int);
+
+/*
+ * Record what the friend callbacks report; changes to friends not in the table are ignored.
+ * Those returning a gboolean tell whether the value actually changed.
+ */
+gboolean ToxPRPL_FriendTable_setName(ToxPRPL_FriendTable*, int, const uint8_t*, uint16_t);
+
+gboolean ToxPRPL_FriendTable_setStatusMessage(ToxPRPL_FriendTable*, int, const uint8_t*, uint16_t);
+
+void ToxPRPL_FriendTable_setStatus(ToxPRPL_FriendTable*, int, TOX_USERSTATUS);
+
+gboolean ToxPRPL_FriendTable_setOnline(ToxPRPL_FriendTable*, int, gboolean);
+
+void ToxPRPL_FriendTable_setTyping(ToxPRPL_FriendTable*, int, gboolean);
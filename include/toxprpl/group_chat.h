@@ -2,6 +2,33 @@
 
 #include <toxprpl.h>
 
+/*
+ * How long after joining a group peer additions are batched up, in milliseconds.
+ * Tox announces the existing members of a group one by one right after joining.
+ */
+#define TOXPRPL_GROUP_ROSTER_SETTLE 1500
+
+typedef struct _ToxPRPL_GroupPeer {
+
+    /*
+     * Current name of the peer
+     */
+    gchar* name;
+
+    /*
+     * Whether the peer is in the group's conversation, and the name purple knows it by there.
+     * Purple keys chat buddies by name, which Tox peers need not have unique, see ``purple/group_chat.c''
+     */
+    gboolean inRoom;
+    gchar* nick;
+
+    /*
+     * Whether this peer is us, so that echoed messages can be told apart
+     */
+    gboolean isOurs;
+
+} ToxPRPL_GroupPeer;
+
 typedef struct _ToxPRPL_GroupChat {
 
     /*
@@ -14,16 +41,118 @@ typedef struct _ToxPRPL_GroupChat {
      */
     uint8_t groupType;
 
+    /*
+     * Cached group title, kept up to date by the title change callback
+     */
+    gchar* title;
+
+    /*
+     * Peer table, an array of ToxPRPL_GroupPeer indexed by Tox peer number
+     * Kept in sync by the namelist change callback.
+     */
+    GArray* peers;
+
+    /*
+     * The group's conversation, or NULL if none is open
+     * Set when the conversation is opened, and cleared when it is destroyed.
+     */
+    PurpleConversation* conversation;
+
+    /*
+     * Pending roster flush while the group settles after joining, or 0
+     * Peers that join in the meantime are only cached, and added to the conversation in one go.
+     */
+    guint rosterTimer;
+
+    /*
+     * The connection's pools, which the chat was allocated from
+     */
+    struct _toxprpl_pools* pools;
+
 } ToxPRPL_GroupChat;
 
+/*
+ * Chat component names, as used by `chat_info`, `join_chat` and `serv_got_chat_invite`
+ */
+
+extern const char* TOXPRPL_CHAT_TITLE;
+extern const char* TOXPRPL_CHAT_GROUP_NUMBER;
+extern const char* TOXPRPL_CHAT_INVITE_FRIEND;
+extern const char* TOXPRPL_CHAT_INVITE_DATA;
+
+/*
+ * Group table
+ * Defined in ``common/group_chat.c''
+ *
+ * Each connection keeps a table of the groups it is a member of, keyed by Tox group number
+ */
+
+GHashTable* ToxPRPL_GroupTable_new(void);
+
+ToxPRPL_GroupChat* ToxPRPL_GroupTable_add(GHashTable*, struct _toxprpl_pools*, int, uint8_t);
+
+ToxPRPL_GroupChat* ToxPRPL_GroupTable_find(GHashTable*, int);
+
+void ToxPRPL_GroupTable_remove(GHashTable*, int);
+
+/*
+ * Cache maintenance, defined in ``common/group_chat.c''
+ */
+
+void ToxPRPL_GroupChat_setTitle(ToxPRPL_GroupChat*, const uint8_t*, int);
+
+ToxPRPL_GroupPeer* ToxPRPL_GroupChat_setPeerName(ToxPRPL_GroupChat*, int, const uint8_t*, int);
+
+ToxPRPL_GroupPeer* ToxPRPL_GroupChat_getPeer(ToxPRPL_GroupChat*, int);
+
+void ToxPRPL_GroupChat_removePeer(ToxPRPL_GroupChat*, int);
+
+void ToxPRPL_GroupChat_refresh(ToxPRPL_GroupChat*, Tox*);
+
+gchar* ToxPRPL_GroupChat_getConversationName(int);
+
+gboolean ToxPRPL_GroupChat_parseConversationName(const char*, int*);
+
 /*
  * Purple API
+ * Defined in ``purple/group_chat.c''
  */
 
-extern const char* TOXPRPL_CONV_DATA_KEY;
-extern const char* TOXPRPL_BUDDY_PEERID;
+PurpleConversation* ToxPRPL_Purple_openGroupConversation(PurpleConnection*, ToxPRPL_GroupChat*);
+
+/*
+ * Add all cached peers that are not in the group's conversation yet, in a single batch
+ */
+void ToxPRPL_Purple_flushGroupRoster(ToxPRPL_GroupChat*);
+
+/*
+ * Keep a peer's chat buddy in the group's conversation in sync with the peer table
+ */
+void ToxPRPL_Purple_addGroupPeer(ToxPRPL_GroupChat*, int);
+
+void ToxPRPL_Purple_removeGroupPeer(ToxPRPL_GroupChat*, int);
+
+void ToxPRPL_Purple_renameGroupPeer(ToxPRPL_GroupChat*, int);
+
+/*
+ * Keep ToxPRPL_GroupChat::conversation from dangling once purple destroys a conversation
+ * Must be called once the connection's plugin data is set, and before it is freed.
+ */
+void ToxPRPL_Purple_watchGroupConversations(PurpleConnection*);
+
+void ToxPRPL_Purple_unwatchGroupConversations(PurpleConnection*);
+
+GList* ToxPRPL_Purple_getChatInfo(PurpleConnection*);
+
+GHashTable* ToxPRPL_Purple_getChatInfoDefaults(PurpleConnection*, const char*);
+
+char* ToxPRPL_Purple_getChatName(GHashTable*);
+
+void ToxPRPL_Purple_joinChat(PurpleConnection*, GHashTable*);
+
+void ToxPRPL_Purple_leaveChat(PurpleConnection*, int);
 
-GList* ToxPRPL_Purple_findByPeerId(PurpleConvChat*, int);
+int ToxPRPL_Purple_sendChatMessage(PurpleConnection*, int, const char*, PurpleMessageFlags);
 
 
 /*
@@ -53,4 +182,4 @@ void ToxPRPL_Tox_onGroupChangeTitle(Tox*, int, int, const uint8_t*, uint8_t, voi
 /*
  * Handle buddylist change notifications
  */
-void ToxPRPL_Tox_onGroupNamelistChange(Tox*, int, int, TOX_CHAT_CHANGE, void*);
\ No newline at end of file
+void ToxPRPL_Tox_onGroupNamelistChange(Tox*, int, int, TOX_CHAT_CHANGE, void*);
@@ -0,0 +1,41 @@
+/*
+ * Logging.
+ *
+ * Thin wrappers around purple_debug() that are filtered twice before any argument is evaluated:
+ *  - at compile time, against TOXPRPL_LOG_MIN_LEVEL (see the TOXPRPL_LOG_LEVEL CMake option),
+ *    so that disabled levels are compiled out entirely
+ *  - at runtime, against the ``/plugins/prpl/tox/log_level'' preference, and against whether
+ *    purple would show the message at all (debug output enabled, or a debug window open)
+ *
+ * Per message and per packet chatter belongs in toxprpl_log_misc(), which default builds compile out.
+ */
+#pragma once
+
+#include <debug.h>
+
+/*
+ * One of the PurpleDebugLevel values, as a plain number so that the build system can set it
+ */
+#ifndef TOXPRPL_LOG_MIN_LEVEL
+    #define TOXPRPL_LOG_MIN_LEVEL 2 // PURPLE_DEBUG_INFO
+#endif
+
+#define TOXPRPL_PREFS_ROOT          "/plugins/prpl/tox"
+#define TOXPRPL_PREF_LOG_LEVEL      TOXPRPL_PREFS_ROOT "/log_level"
+
+/*
+ * Defined in ``util.c''
+ */
+gboolean ToxPRPL_isLogEnabled(PurpleDebugLevel);
+
+#define toxprpl_log(level, ...)                                                 \
+    do {                                                                        \
+        if (((level) >= TOXPRPL_LOG_MIN_LEVEL) && ToxPRPL_isLogEnabled(level)) { \
+            purple_debug((level), "toxprpl", __VA_ARGS__);                      \
+        }                                                                       \
+    } while (0)
+
+#define toxprpl_log_misc(...)       toxprpl_log(PURPLE_DEBUG_MISC, __VA_ARGS__)
+#define toxprpl_log_info(...)       toxprpl_log(PURPLE_DEBUG_INFO, __VA_ARGS__)
+#define toxprpl_log_warning(...)    toxprpl_log(PURPLE_DEBUG_WARNING, __VA_ARGS__)
+#define toxprpl_log_error(...)      toxprpl_log(PURPLE_DEBUG_ERROR, __VA_ARGS__)
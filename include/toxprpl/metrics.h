@@ -0,0 +1,128 @@
+/*
+ * Plugin metrics.
+ *
+ * Every connection owns a small registry of counters and histograms, which is cheap enough to be
+ * updated on every Tox callback. The registry can be inspected with the /toxstats command.
+ */
+#pragma once
+
+#include <toxprpl.h>
+
+typedef enum {
+
+    /*
+     * Tox callbacks, by type
+     */
+    TOXPRPL_COUNTER_CB_CONNECTION_STATUS,
+    TOXPRPL_COUNTER_CB_FRIEND_REQUEST,
+    TOXPRPL_COUNTER_CB_FRIEND_MESSAGE,
+    TOXPRPL_COUNTER_CB_FRIEND_ACTION,
+    TOXPRPL_COUNTER_CB_NAME_CHANGE,
+    TOXPRPL_COUNTER_CB_USER_STATUS,
+    TOXPRPL_COUNTER_CB_STATUS_MESSAGE,
+    TOXPRPL_COUNTER_CB_TYPING_CHANGE,
+    TOXPRPL_COUNTER_CB_AVATAR_INFO,
+    TOXPRPL_COUNTER_CB_AVATAR_DATA,
+    TOXPRPL_COUNTER_CB_GROUP_INVITE,
+    TOXPRPL_COUNTER_CB_GROUP_MESSAGE,
+    TOXPRPL_COUNTER_CB_GROUP_ACTION,
+    TOXPRPL_COUNTER_CB_GROUP_TITLE,
+    TOXPRPL_COUNTER_CB_GROUP_NAMELIST,
+    TOXPRPL_COUNTER_CB_FILE_REQUEST,
+    TOXPRPL_COUNTER_CB_FILE_CONTROL,
+    TOXPRPL_COUNTER_CB_FILE_DATA,
+
+    /*
+     * Traffic
+     */
+    TOXPRPL_COUNTER_MESSAGES_IN,
+    TOXPRPL_COUNTER_MESSAGES_OUT,
+    TOXPRPL_COUNTER_MESSAGES_QUEUED,
+    TOXPRPL_COUNTER_SEND_FAILURES,
+    TOXPRPL_COUNTER_GROUP_MESSAGES_OUT,
+    TOXPRPL_COUNTER_XFER_BYTES_IN,
+    TOXPRPL_COUNTER_XFER_BYTES_OUT,
+
+    /*
+     * Presence, see ``toxprpl/presence.h''
+     */
+    TOXPRPL_COUNTER_PRESENCE_CHANGES,   // reported by Tox
+    TOXPRPL_COUNTER_PRESENCE_APPLIED,   // handed to purple
+    TOXPRPL_COUNTER_PRESENCE_DAMPED,    // held back while a friend was flapping
+
+    /*
+     * Friend requests, see ``toxprpl/friend_requests.h''
+     */
+    TOXPRPL_COUNTER_FRIEND_REQUESTS_DROPPED, // duplicates, rejected keys, and a full queue
+
+    /*
+     * Avatars, see ``toxprpl/avatars.h''
+     */
+    TOXPRPL_COUNTER_AVATARS_UNCHANGED,  // advertised avatar already shown
+    TOXPRPL_COUNTER_AVATARS_CACHED,     // taken from the cache instead of transferred
+    TOXPRPL_COUNTER_AVATARS_TRANSFERS,  // requested from friends
+
+    TOXPRPL_COUNTER_COUNT
+
+} ToxPRPL_Counter;
+
+typedef enum {
+
+    TOXPRPL_HISTOGRAM_TOX_DO,           // microseconds
+    TOXPRPL_HISTOGRAM_SAVE,             // microseconds
+    TOXPRPL_HISTOGRAM_SEND_QUEUE_DEPTH, // messages waiting per friend, sampled when queueing
+
+    TOXPRPL_HISTOGRAM_COUNT
+
+} ToxPRPL_HistogramId;
+
+/*
+ * Bucket `n' of a histogram counts values in [2^(n-1), 2^n), bucket 0 counts zeroes
+ */
+#define TOXPRPL_HISTOGRAM_BUCKETS 32
+
+typedef struct _toxprpl_histogram {
+    guint64 buckets[TOXPRPL_HISTOGRAM_BUCKETS];
+    guint64 count;
+    guint64 sum;
+    guint64 max;
+} ToxPRPL_Histogram;
+
+typedef struct _toxprpl_metrics {
+
+    /*
+     * Monotonic time at which the registry was created, in microseconds
+     */
+    gint64 started;
+
+    guint64 counters[TOXPRPL_COUNTER_COUNT];
+    ToxPRPL_Histogram histograms[TOXPRPL_HISTOGRAM_COUNT];
+
+} ToxPRPL_Metrics;
+
+/*
+ * Defined in ``common/metrics.c''
+ *
+ * All update functions accept a NULL registry, so that callers do not have to care
+ * whether the connection is fully set up yet.
+ */
+
+ToxPRPL_Metrics* ToxPRPL_Metrics_new(void);
+
+void ToxPRPL_Metrics_free(ToxPRPL_Metrics*);
+
+/*
+ * Returns the registry of a connection, or NULL
+ */
+ToxPRPL_Metrics* ToxPRPL_Metrics_get(PurpleConnection*);
+
+void ToxPRPL_Metrics_count(ToxPRPL_Metrics*, ToxPRPL_Counter, guint64);
+
+void ToxPRPL_Metrics_record(ToxPRPL_Metrics*, ToxPRPL_HistogramId, guint64);
+
+/*
+ * Returns a plain text report of all metrics of a connection, including live queue depths
+ */
+gchar* ToxPRPL_Metrics_format(PurpleConnection*);
+
+#define TOXPRPL_COUNT(gc, counter) ToxPRPL_Metrics_count(ToxPRPL_Metrics_get(gc), (counter), 1)
@@ -0,0 +1,81 @@
+/*
+ * Per-connection pools for the plugin's small fixed-size structs.
+ *
+ * Slots are carved out of slabs and recycled through a free list, so that buddies, accepted friend
+ * requests and group chats coming and going do not each cost a trip to the allocator. Slabs are only
+ * given back when the connection closes, all at once; what a connection uses is the number of slabs
+ * its pools hold, which ``/toxstats'' shows.
+ *
+ * Unless built with NDEBUG, pools also count the slots in use, report them in ``/toxstats'', and log
+ * the ones still in use when the connection closes.
+ */
+#pragma once
+
+#include <toxprpl.h>
+
+/*
+ * Slots per slab
+ */
+#define TOXPRPL_POOL_SLAB_SLOTS 64
+
+typedef enum {
+    TOXPRPL_POOL_BUDDY_DATA,        // ToxPRPL_BuddyData
+    TOXPRPL_POOL_FRIEND_ACCEPT,     // ToxPRPL_FriendAcceptData
+    TOXPRPL_POOL_GROUP_CHAT,        // ToxPRPL_GroupChat
+
+    TOXPRPL_POOL_COUNT
+} ToxPRPL_PoolId;
+
+typedef struct _toxprpl_pool {
+
+    /*
+     * Slot size, rounded up to keep slots aligned
+     */
+    gsize size;
+
+    GSList* slabs;
+    guint slab_count;
+
+    /*
+     * Free slots, linked through their first pointer
+     */
+    gpointer free_slots;
+
+#ifndef NDEBUG
+    guint live;
+    guint peak;
+#endif
+
+} ToxPRPL_Pool;
+
+typedef struct _toxprpl_pools {
+
+    ToxPRPL_Pool pools[TOXPRPL_POOL_COUNT];
+
+} ToxPRPL_Pools;
+
+/*
+ * Defined in ``common/pool.c''
+ */
+
+ToxPRPL_Pools* ToxPRPL_Pools_new(void);
+
+/*
+ * Free all slabs, including any slots still in use
+ */
+void ToxPRPL_Pools_free(ToxPRPL_Pools*);
+
+/*
+ * A zeroed slot from pool `id'
+ */
+gpointer ToxPRPL_Pools_alloc(ToxPRPL_Pools*, ToxPRPL_PoolId);
+
+/*
+ * Give a slot back to the pool it came from
+ */
+void ToxPRPL_Pools_release(ToxPRPL_Pools*, ToxPRPL_PoolId, gpointer);
+
+/*
+ * Append a line per pool to a ``/toxstats'' report
+ */
+void ToxPRPL_Pools_format(ToxPRPL_Pools*, GString*);
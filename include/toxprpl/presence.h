@@ -0,0 +1,124 @@
+/*
+ * Presence coalescing and flap damping.
+ *
+ * Tox reports every connection and status change of a friend as it happens, and handing each of
+ * them straight to purple means a buddy list update (plus sounds and notifications) per change.
+ * Instead, changes are recorded in the friend table and applied once per window, and only if the net
+ * state differs from what purple already shows. A friend bouncing offline and online within the window
+ * never reaches purple at all.
+ *
+ * Friends whose connection keeps flapping accumulate a penalty, which decays with a half-life.
+ * Above the suppress threshold, the friend's presence is frozen at what was last applied, until
+ * the penalty has decayed below the reuse threshold; then the net state is applied once.
+ */
+#pragma once
+
+#include <toxprpl.h>
+
+/*
+ * Account option names and defaults
+ */
+#define TOXPRPL_OPT_PRESENCE_WINDOW     "presence_window"
+#define TOXPRPL_OPT_PRESENCE_DAMPING    "presence_damping"
+
+#define DEFAULT_PRESENCE_WINDOW     500   // milliseconds, 0 applies every change immediately
+#define DEFAULT_PRESENCE_DAMPING    TRUE
+
+/*
+ * Flap damping parameters. Every connection change adds one penalty unit.
+ */
+#define TOXPRPL_PRESENCE_PENALTY    1000
+#define TOXPRPL_PRESENCE_SUPPRESS   4000  // about four flaps in quick succession
+#define TOXPRPL_PRESENCE_REUSE      1000
+#define TOXPRPL_PRESENCE_HALF_LIFE  30    // seconds
+
+typedef struct _toxprpl_friend_presence {
+
+    int friend_number;
+
+    /*
+     * Index in to ToxPRPL_ToxStatuses of the status last handed to purple, or -1 if it has to be handed over again
+     */
+    int applied;
+
+    /*
+     * Flap penalty, as of `penalty_time' (monotonic, in microseconds)
+     */
+    gdouble penalty;
+    gint64 penalty_time;
+
+    /*
+     * Whether this friend is waiting in the pending queue
+     */
+    gboolean pending;
+
+    /*
+     * Whether changes are currently held back because the friend is flapping
+     */
+    gboolean suppressed;
+
+} ToxPRPL_FriendPresence;
+
+typedef struct _toxprpl_presence {
+
+    PurpleAccount* account;
+    struct _toxprpl_friend_table* table;
+    struct _toxprpl_buddy_keys* keys;
+    struct _toxprpl_metrics* metrics;
+
+    guint window;
+    gboolean damping;
+
+    /*
+     * friend number -> ToxPRPL_FriendPresence, for friends whose presence changed since login
+     */
+    GHashTable* friends;
+
+    /*
+     * Friends with changes not applied yet, in the order they changed
+     */
+    GQueue pending;
+
+    guint flush_timer;
+
+} ToxPRPL_Presence;
+
+/*
+ * Defined in ``common/presence.c''
+ */
+
+ToxPRPL_Presence* ToxPRPL_Presence_new(PurpleAccount*, struct _toxprpl_friend_table*, struct _toxprpl_buddy_keys*,
+                                       struct _toxprpl_metrics*);
+
+void ToxPRPL_Presence_free(ToxPRPL_Presence*);
+
+/*
+ * Record a connection change in the friend table, as reported by the connection status callback
+ */
+void ToxPRPL_Presence_setOnline(ToxPRPL_Presence*, int, gboolean);
+
+/*
+ * Record a status change in the friend table, as reported by the user status callback
+ */
+void ToxPRPL_Presence_setStatus(ToxPRPL_Presence*, int, TOX_USERSTATUS);
+
+/*
+ * Record a status message change in the friend table, as reported by the status message callback.
+ * A message that did not change is dropped right away.
+ */
+void ToxPRPL_Presence_setStatusMessage(ToxPRPL_Presence*, int, const uint8_t*, uint16_t);
+
+/*
+ * Apply a friend's state as the friend table has it right away, unless the friend is suppressed
+ */
+void ToxPRPL_Presence_refresh(ToxPRPL_Presence*, int);
+
+/*
+ * Apply all pending changes now, except those of suppressed friends
+ */
+void ToxPRPL_Presence_flush(ToxPRPL_Presence*);
+
+/*
+ * Drop all state kept for a friend
+ */
+void ToxPRPL_Presence_forgetFriend(ToxPRPL_Presence*, int);
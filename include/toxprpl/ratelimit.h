@@ -0,0 +1,119 @@
+/*
+ * Outgoing message rate limiting.
+ *
+ * Every connection owns one limiter, which holds an account-wide token bucket
+ * and one token bucket (plus a bounded backlog queue) per friend.
+ * A message is only handed to Tox when both the friend bucket and the account bucket
+ * have a token available. Otherwise it is queued and drained by a timer, and once the
+ * friend's queue is full, the caller is told to back off with -EAGAIN.
+ */
+#pragma once
+
+#include <toxprpl.h>
+
+/*
+ * Account option names and defaults
+ * A rate of zero disables the corresponding bucket.
+ */
+#define TOXPRPL_OPT_SEND_RATE_ACCOUNT   "send_rate_account"
+#define TOXPRPL_OPT_SEND_RATE_FRIEND    "send_rate_friend"
+#define TOXPRPL_OPT_SEND_BURST          "send_burst"
+#define TOXPRPL_OPT_SEND_QUEUE_SIZE     "send_queue_size"
+
+#define DEFAULT_SEND_RATE_ACCOUNT   50  // messages per second, all friends combined
+#define DEFAULT_SEND_RATE_FRIEND    10  // messages per second, per friend
+#define DEFAULT_SEND_BURST          20  // bucket capacity, in messages
+#define DEFAULT_SEND_QUEUE_SIZE     256 // queued messages per friend before -EAGAIN
+
+/*
+ * Interval at which queued messages are drained, in milliseconds
+ */
+#define TOXPRPL_SEND_DRAIN_INTERVAL 50
+
+typedef struct _toxprpl_token_bucket {
+
+    /*
+     * Tokens currently available, and the capacity of the bucket
+     */
+    gdouble tokens;
+    gdouble capacity;
+
+    /*
+     * Refill rate in tokens per second. Zero means unlimited.
+     */
+    gdouble rate;
+
+    /*
+     * Monotonic time of the last refill, in microseconds
+     */
+    gint64 last_refill;
+
+} ToxPRPL_TokenBucket;
+
+typedef struct _toxprpl_friend_send_queue {
+
+    int friend_number;
+
+    ToxPRPL_TokenBucket bucket;
+
+    /*
+     * Pending ToxPRPL_QueuedMessage entries, oldest first
+     */
+    GQueue messages;
+
+    /*
+     * Whether this queue is currently linked in to the limiter's active ring
+     */
+    gboolean active;
+
+} ToxPRPL_FriendSendQueue;
+
+typedef struct _toxprpl_rate_limiter {
+
+    Tox* tox;
+    PurpleAccount* account;
+    struct _toxprpl_metrics* metrics;
+
+    ToxPRPL_TokenBucket account_bucket;
+
+    /*
+     * Per-friend settings, read from the account when the limiter is created
+     */
+    gdouble friend_rate;
+    gdouble burst;
+    guint queue_limit;
+
+    /*
+     * friend number -> ToxPRPL_FriendSendQueue
+     */
+    GHashTable* friends;
+
+    /*
+     * Friend queues that have pending messages, drained round-robin
+     */
+    GQueue active;
+
+    guint drain_timer;
+
+} ToxPRPL_RateLimiter;
+
+/*
+ * Defined in ``common/ratelimit.c''
+ */
+
+ToxPRPL_RateLimiter* ToxPRPL_RateLimiter_new(PurpleAccount*, Tox*, struct _toxprpl_metrics*);
+
+void ToxPRPL_RateLimiter_free(ToxPRPL_RateLimiter*);
+
+/*
+ * Send, or queue, a message to a friend.
+ * Returns a value suitable to be handed back from the `send_im` prpl callback:
+ * 1 if the message was sent or queued, -EAGAIN if the friend's queue is full,
+ * and -999 if Tox refused the message.
+ */
+int ToxPRPL_RateLimiter_send(ToxPRPL_RateLimiter*, const char*, int, const char*, gboolean);
+
+/*
+ * Drop all state (including queued messages) kept for a friend
+ */
+void ToxPRPL_RateLimiter_forgetFriend(ToxPRPL_RateLimiter*, int);
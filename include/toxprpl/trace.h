@@ -0,0 +1,92 @@
+/*
+ * Static tracing probes.
+ *
+ * When built with -DTOXPRPL_TRACING=ON (which requires <sys/sdt.h>, e.g. from systemtap-sdt-dev),
+ * the plugin carries USDT probes that perf, bpftrace or systemtap can attach to at runtime:
+ *
+ *  toxprpl:tox_do__entry()
+ *  toxprpl:tox_do__return()
+ *  toxprpl:callback__entry(const char* name, int32 friendNumber, int32 groupNumber, uint32 size)
+ *  toxprpl:callback__return(const char* name, int32 friendNumber, int32 groupNumber, uint32 size)
+ *
+ * `name' is the Tox callback type (e.g. "group_message"), friend and group numbers are -1 where they
+ * do not apply, and `size' is the length of the callback's payload.
+ *
+ * Callbacks are traced by registering the wrappers from ``tox/trace.c'' with Tox instead of the
+ * callbacks themselves, so without TOXPRPL_TRACING there is not a single extra instruction.
+ *
+ * e.g.: bpftrace -e 'usdt:libtoxprpl.so:toxprpl:callback__entry { @[str(arg0)] = count(); }'
+ */
+#pragma once
+
+#include <toxprpl.h>
+
+#ifdef TOXPRPL_TRACING
+
+#include <sys/sdt.h>
+
+#define TOXPRPL_TRACE_TOX_DO_ENTRY()    DTRACE_PROBE(toxprpl, tox_do__entry)
+#define TOXPRPL_TRACE_TOX_DO_RETURN()   DTRACE_PROBE(toxprpl, tox_do__return)
+
+#define TOXPRPL_TRACE_CALLBACK_ENTRY(name, friendNumber, groupNumber, size) \
+    DTRACE_PROBE4(toxprpl, callback__entry, name, (int32_t) (friendNumber), (int32_t) (groupNumber), (uint32_t) (size))
+
+#define TOXPRPL_TRACE_CALLBACK_RETURN(name, friendNumber, groupNumber, size) \
+    DTRACE_PROBE4(toxprpl, callback__return, name, (int32_t) (friendNumber), (int32_t) (groupNumber), (uint32_t) (size))
+
+/*
+ * Name of the callback to register with Tox for `callback'
+ */
+#define TOXPRPL_TRACED(callback) ToxPRPL_Trace_##callback
+
+/*
+ * Tracing wrappers, defined in ``tox/trace.c''
+ */
+
+void ToxPRPL_Trace_ToxPRPL_Tox_onUserConnectionStatusChange(Tox*, int32_t, uint8_t, void*);
+
+void ToxPRPL_Trace_ToxPRPL_Tox_onFriendRequest(Tox*, uint8_t const *, uint8_t const *, uint16_t, void*);
+
+void ToxPRPL_Trace_ToxPRPL_Tox_onFriendAction(Tox*, int32_t, uint8_t const *, uint16_t, void*);
+
+void ToxPRPL_Trace_ToxPRPL_Tox_onMessageReceived(Tox*, int32_t, uint8_t const *, uint16_t, void*);
+
+void ToxPRPL_Trace_ToxPRPL_Tox_onFriendChangeNickname(Tox*, int32_t, uint8_t const *, uint16_t, void*);
+
+void ToxPRPL_Trace_ToxPRPL_Tox_onFriendChangeStatus(Tox*, int32_t, uint8_t, void*);
+
+void ToxPRPL_Trace_ToxPRPL_Tox_onFriendChangeStatusMessage(Tox*, int32_t, uint8_t const *, uint16_t, void*);
+
+void ToxPRPL_Trace_ToxPRPL_Tox_onUserTypingChange(Tox*, int32_t, uint8_t, void*);
+
+void ToxPRPL_Trace_ToxPRPL_Tox_onAvatarInfo(Tox*, int32_t, uint8_t, uint8_t*, void*);
+
+void ToxPRPL_Trace_ToxPRPL_Tox_onAvatarData(Tox*, int32_t, uint8_t, uint8_t*, uint8_t*, uint32_t, void*);
+
+void ToxPRPL_Trace_ToxPRPL_Tox_onGroupInvite(Tox*, int32_t, uint8_t, const uint8_t*, uint16_t, void*);
+
+void ToxPRPL_Trace_ToxPRPL_Tox_onGroupMessage(Tox*, int, int, const uint8_t*, uint16_t, void*);
+
+void ToxPRPL_Trace_ToxPRPL_Tox_onGroupAction(Tox*, int, int, const uint8_t*, uint16_t, void*);
+
+void ToxPRPL_Trace_ToxPRPL_Tox_onGroupChangeTitle(Tox*, int, int, const uint8_t*, uint8_t, void*);
+
+void ToxPRPL_Trace_ToxPRPL_Tox_onGroupNamelistChange(Tox*, int, int, TOX_CHAT_CHANGE, void*);
+
+void ToxPRPL_Trace_ToxPRPL_Tox_onFileRequest(Tox*, int32_t, uint8_t, uint64_t, uint8_t const *, uint16_t, void*);
+
+void ToxPRPL_Trace_ToxPRPL_Tox_onFileControl(Tox*, int32_t, uint8_t, uint8_t, uint8_t, uint8_t const *, uint16_t,
+                                             void*);
+
+void ToxPRPL_Trace_ToxPRPL_Tox_onFileDataReceive(Tox*, int32_t, uint8_t, uint8_t const *, uint16_t, void*);
+
+#else
+
+#define TOXPRPL_TRACE_TOX_DO_ENTRY()                                            do { } while (0)
+#define TOXPRPL_TRACE_TOX_DO_RETURN()                                           do { } while (0)
+#define TOXPRPL_TRACE_CALLBACK_ENTRY(name, friendNumber, groupNumber, size)     do { } while (0)
+#define TOXPRPL_TRACE_CALLBACK_RETURN(name, friendNumber, groupNumber, size)    do { } while (0)
+
+#define TOXPRPL_TRACED(callback) callback
+
+#endif
@@ -23,6 +23,18 @@ typedef struct _toxprpl_plugin_data {
     guint connected;
     PurpleCmdId myid_command_id;
     PurpleCmdId nick_command_id;
+    PurpleCmdId stats_command_id;
+    struct _toxprpl_metrics* metrics;
+    struct _toxprpl_pools* pools;
+    struct _toxprpl_friend_table* friends;
+    struct _toxprpl_buddy_keys* buddy_keys;
+    struct _toxprpl_bootstrap* bootstrap;
+    struct _toxprpl_rate_limiter* rate_limiter;
+    struct _toxprpl_presence* presence;
+    struct _toxprpl_avatars* avatars;
+    struct _toxprpl_buddy_refresh* buddy_refresh; // NULL unless a refresh is running
+    struct _toxprpl_friend_requests* friend_requests;
+    GHashTable* groups; // group number -> ToxPRPL_GroupChat
 } ToxPRPL_PluginData;
 
 typedef struct _toxprpl_idle_write_data {
@@ -0,0 +1,225 @@
+/*
+ * Avatars, see ``toxprpl/avatars.h''
+ */
+
+#include <toxprpl.h>
+#include <toxprpl/avatars.h>
+#include <toxprpl/buddy_keys.h>
+#include <toxprpl/friend_table.h>
+#include <toxprpl/metrics.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+static const uint8_t NO_HASH[TOX_HASH_LENGTH] = { 0 };
+
+static gboolean isHashOf(const uint8_t* hash, const guint8* data, size_t size) {
+    uint8_t actual[TOX_HASH_LENGTH];
+    return (tox_hash(actual, data, (uint32_t) size) == 0) && (memcmp(actual, hash, TOX_HASH_LENGTH) == 0);
+}
+
+/*
+ * The buddy of a friend, or NULL if it has none
+ */
+static PurpleBuddy* getBuddy(ToxPRPL_Avatars* avatars, int friend_number) {
+    const char* buddy_key = ToxPRPL_BuddyKeys_forFriend(avatars->keys, friend_number);
+    if (buddy_key == NULL) {
+        return NULL;
+    }
+    return purple_find_buddy(purple_connection_get_account(avatars->gc), buddy_key);
+}
+
+/*
+ * Hand an image to purple, which takes over `data'
+ */
+static void showAvatar(ToxPRPL_Avatars* avatars, PurpleBuddy* buddy, guint8* data, size_t size, const char* hash) {
+    purple_buddy_icons_set_for_user(purple_connection_get_account(avatars->gc), buddy->name, data, size, hash);
+}
+
+// Cache ----------------------------------------------------------------------------------------------------------
+
+static gchar* getCacheFile(ToxPRPL_Avatars* avatars, const char* hash) {
+    gchar* name = g_strdup_printf("%s.png", hash);
+    gchar* path = g_build_filename(avatars->cache_dir, name, NULL);
+    g_free(name);
+    return path;
+}
+
+/*
+ * The cached image with this hash, or NULL. Files that do not match their hash are removed.
+ */
+static guint8* loadCached(ToxPRPL_Avatars* avatars, const uint8_t* hash, const char* hex, size_t* size) {
+    gchar* path = getCacheFile(avatars, hex);
+    gchar* data = NULL;
+    gsize length = 0;
+
+    if (g_file_get_contents(path, &data, &length, NULL) && !isHashOf(hash, (const guint8*) data, length)) {
+        toxprpl_log_warning("removing corrupt avatar %s\n", path);
+        g_unlink(path);
+        g_free(data);
+        data = NULL;
+    }
+
+    g_free(path);
+    *size = length;
+    return (guint8*) data;
+}
+
+static void storeCached(ToxPRPL_Avatars* avatars, const char* hex, const guint8* data, size_t size) {
+    if (purple_build_dir(avatars->cache_dir, S_IRUSR | S_IWUSR | S_IXUSR) != 0) {
+        toxprpl_log_warning("could not create avatar cache %s\n", avatars->cache_dir);
+        return;
+    }
+
+    gchar* path = getCacheFile(avatars, hex);
+    purple_util_write_data_to_file_absolute(path, (const char*) data, (gssize) size);
+    g_free(path);
+}
+
+// Public API -----------------------------------------------------------------------------------------------------
+
+ToxPRPL_Avatars* ToxPRPL_Avatars_new(PurpleConnection* gc, Tox* tox, ToxPRPL_FriendTable* friends,
+                                     ToxPRPL_BuddyKeys* keys, ToxPRPL_Metrics* metrics) {
+    ToxPRPL_Avatars* avatars = g_new0(ToxPRPL_Avatars, 1);
+
+    avatars->gc = gc;
+    avatars->tox = tox;
+    avatars->friends = friends;
+    avatars->keys = keys;
+    avatars->metrics = metrics;
+    avatars->cache_dir = g_build_filename(purple_user_dir(), "tox", "avatars", NULL);
+    avatars->requested = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+
+    return avatars;
+}
+
+void ToxPRPL_Avatars_free(ToxPRPL_Avatars* avatars) {
+    toxprpl_return_if_fail(avatars != NULL);
+
+    g_hash_table_destroy(avatars->requested);
+    g_free(avatars->cache_dir);
+    g_free(avatars);
+}
+
+void ToxPRPL_Avatars_onInfo(ToxPRPL_Avatars* avatars, int friend_number, uint8_t format, const uint8_t* hash) {
+    toxprpl_return_if_fail(avatars != NULL);
+
+    PurpleBuddy* buddy = getBuddy(avatars, friend_number);
+    if (buddy == NULL) {
+        return;
+    }
+
+    if ((format == TOX_AVATAR_FORMAT_NONE) || (memcmp(hash, NO_HASH, TOX_HASH_LENGTH) == 0)) {
+        g_hash_table_remove(avatars->requested, GINT_TO_POINTER(friend_number));
+        if (purple_buddy_icons_get_checksum_for_user(buddy) != NULL) {
+            showAvatar(avatars, buddy, NULL, 0, NULL);
+        }
+        return;
+    }
+
+    char hex[TOXPRPL_AVATAR_HASH_HEX_SIZE];
+    ToxPRPL_binToHex(hash, TOX_HASH_LENGTH, hex, sizeof(hex));
+
+    if (g_strcmp0(purple_buddy_icons_get_checksum_for_user(buddy), hex) == 0) {
+        ToxPRPL_Metrics_count(avatars->metrics, TOXPRPL_COUNTER_AVATARS_UNCHANGED, 1);
+        return;
+    }
+
+    size_t size;
+    guint8* data = loadCached(avatars, hash, hex, &size);
+    if (data != NULL) {
+        toxprpl_log_misc("avatar %s of friend %d is cached\n", hex, friend_number);
+        ToxPRPL_Metrics_count(avatars->metrics, TOXPRPL_COUNTER_AVATARS_CACHED, 1);
+        g_hash_table_remove(avatars->requested, GINT_TO_POINTER(friend_number));
+        showAvatar(avatars, buddy, data, size, hex);
+        return;
+    }
+
+    // Tox repeats the info, the image is asked for once
+    if (g_strcmp0(g_hash_table_lookup(avatars->requested, GINT_TO_POINTER(friend_number)), hex) == 0) {
+        return;
+    }
+
+    if (tox_request_avatar_data(avatars->tox, friend_number) == 0) {
+        toxprpl_log_misc("requesting avatar %s of friend %d\n", hex, friend_number);
+        ToxPRPL_Metrics_count(avatars->metrics, TOXPRPL_COUNTER_AVATARS_TRANSFERS, 1);
+        g_hash_table_replace(avatars->requested, GINT_TO_POINTER(friend_number), g_strdup(hex));
+    }
+}
+
+void ToxPRPL_Avatars_onData(ToxPRPL_Avatars* avatars, int friend_number, uint8_t format, const uint8_t* hash,
+                            const uint8_t* data, uint32_t size) {
+    toxprpl_return_if_fail(avatars != NULL);
+
+    g_hash_table_remove(avatars->requested, GINT_TO_POINTER(friend_number));
+
+    PurpleBuddy* buddy = getBuddy(avatars, friend_number);
+    if (buddy == NULL) {
+        return;
+    }
+
+    if ((format == TOX_AVATAR_FORMAT_NONE) || (size == 0)) {
+        showAvatar(avatars, buddy, NULL, 0, NULL);
+        return;
+    }
+
+    if ((format != TOX_AVATAR_FORMAT_PNG) || (size > TOX_AVATAR_MAX_DATA_LENGTH) || !isHashOf(hash, data, size)) {
+        toxprpl_log_warning("ignoring invalid avatar of friend %d\n", friend_number);
+        return;
+    }
+
+    char hex[TOXPRPL_AVATAR_HASH_HEX_SIZE];
+    ToxPRPL_binToHex(hash, TOX_HASH_LENGTH, hex, sizeof(hex));
+    toxprpl_log_misc("received avatar %s of friend %d\n", hex, friend_number);
+
+    storeCached(avatars, hex, data, size);
+
+    // purple takes over the image, Tox keeps its own buffer
+    guint8* copy = g_malloc(size);
+    memcpy(copy, data, size);
+    showAvatar(avatars, buddy, copy, size, hex);
+}
+
+void ToxPRPL_Avatars_setOwn(ToxPRPL_Avatars* avatars, const guint8* data, size_t size) {
+    toxprpl_return_if_fail(avatars != NULL);
+
+    uint8_t hash[TOX_HASH_LENGTH];
+    memset(hash, 0, sizeof(hash));
+
+    if ((data != NULL) && (size > 0)) {
+        if (size > TOX_AVATAR_MAX_DATA_LENGTH) {
+            toxprpl_log_warning("avatar of %" G_GSIZE_FORMAT " bytes is too large, Tox takes at most %d\n",
+                                size, TOX_AVATAR_MAX_DATA_LENGTH);
+            return;
+        }
+        tox_hash(hash, data, (uint32_t) size);
+    }
+
+    // every change is announced to every friend online, setting the same avatar again is not one
+    if (memcmp(hash, avatars->own_hash, TOX_HASH_LENGTH) == 0) {
+        return;
+    }
+
+    int ret = (memcmp(hash, NO_HASH, TOX_HASH_LENGTH) == 0)
+              ? tox_unset_avatar(avatars->tox)
+              : tox_set_avatar(avatars->tox, TOX_AVATAR_FORMAT_PNG, data, (uint32_t) size);
+    if (ret != 0) {
+        toxprpl_log_warning("could not set avatar (%d)\n", ret);
+        return;
+    }
+    memcpy(avatars->own_hash, hash, TOX_HASH_LENGTH);
+
+    // friends online now are told right away, the others when they connect
+    ToxPRPL_FriendTable* friends = avatars->friends;
+    guint i;
+    for (i = 0; i < friends->size; i++) {
+        if (friends->used[i] && friends->online[i]) {
+            tox_send_avatar_info(avatars->tox, (int32_t) i);
+        }
+    }
+}
+
+void ToxPRPL_Avatars_forgetFriend(ToxPRPL_Avatars* avatars, int friend_number) {
+    toxprpl_return_if_fail(avatars != NULL);
+    g_hash_table_remove(avatars->requested, GINT_TO_POINTER(friend_number));
+}
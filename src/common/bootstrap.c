@@ -0,0 +1,580 @@
+/*
+ * Multi node DHT bootstrapping, see ``toxprpl/bootstrap.h''
+ */
+
+#include <toxprpl.h>
+#include <toxprpl/bootstrap.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <proxy.h>
+
+// Node List ------------------------------------------------------------------------------------------------------
+
+static void freeNode(gpointer data) {
+    ToxPRPL_BootstrapNode* node = data;
+    g_free(node->address);
+    g_free(node->key);
+    g_free(node);
+}
+
+static ToxPRPL_BootstrapNode* findNode(ToxPRPL_Bootstrap* bootstrap, const char* address, uint16_t port) {
+    guint i;
+    for (i = 0; i < bootstrap->nodes->len; i++) {
+        ToxPRPL_BootstrapNode* node = g_ptr_array_index(bootstrap->nodes, i);
+        if ((node->port == port) && (g_ascii_strcasecmp(node->address, address) == 0)) {
+            return node;
+        }
+    }
+    return NULL;
+}
+
+static void addNode(ToxPRPL_Bootstrap* bootstrap, const char* address, uint16_t port, const char* key) {
+    uint8_t bin_key[TOX_CLIENT_ID_SIZE];
+    if ((strlen(address) == 0) || (port == 0) || (strlen(key) != TOX_CLIENT_ID_SIZE * 2)
+        || !ToxPRPL_hexToBin(key, TOX_CLIENT_ID_SIZE * 2, bin_key, sizeof(bin_key))) {
+        toxprpl_log_warning("ignoring invalid bootstrap node %s:%u\n", address, port);
+        return;
+    }
+
+    if (findNode(bootstrap, address, port) != NULL) {
+        return;
+    }
+
+    ToxPRPL_BootstrapNode* node = g_new0(ToxPRPL_BootstrapNode, 1);
+    node->address = g_strdup(address);
+    node->port = port;
+    node->key = g_strdup(key);
+    node->rtt = -1;
+    g_ptr_array_add(bootstrap->nodes, node);
+}
+
+/*
+ * Split a ``host:port:key'' entry in place.
+ * The host is whatever is left of the last two colons, so IPv6 addresses work as well.
+ */
+static gboolean parseNodeEntry(gchar* entry, gchar** address, uint16_t* port, gchar** key) {
+    *key = strrchr(entry, ':');
+    if (*key == NULL) {
+        return FALSE;
+    }
+    *(*key)++ = '\0';
+
+    gchar* portString = strrchr(entry, ':');
+    if (portString == NULL) {
+        return FALSE;
+    }
+    *portString++ = '\0';
+
+    *address = entry;
+    *port = (uint16_t) atoi(portString);
+    return TRUE;
+}
+
+/*
+ * Parse a list of ``host:port:key'' entries, separated by white space or commas
+ */
+static void addNodeList(ToxPRPL_Bootstrap* bootstrap, const char* list) {
+    if (list == NULL) {
+        return;
+    }
+
+    gchar** entries = g_strsplit_set(list, " \t\r\n,;", -1);
+    gchar** entry;
+    for (entry = entries; *entry != NULL; entry++) {
+        gchar* address;
+        uint16_t port;
+        gchar* key;
+
+        if (strlen(*entry) == 0) {
+            continue;
+        }
+
+        if (!parseNodeEntry(*entry, &address, &port, &key)) {
+            toxprpl_log_warning("ignoring malformed bootstrap node '%s'\n", *entry);
+            continue;
+        }
+
+        addNode(bootstrap, address, port, key);
+    }
+    g_strfreev(entries);
+}
+
+// Ranking --------------------------------------------------------------------------------------------------------
+
+/*
+ * Nodes that recently failed go last, then nodes are ordered by how quickly they got us connected.
+ * Nodes we know nothing about yet go between the measured and the failed ones.
+ */
+static gint compareNodes(gconstpointer a, gconstpointer b) {
+    const ToxPRPL_BootstrapNode* left = *(ToxPRPL_BootstrapNode* const*) a;
+    const ToxPRPL_BootstrapNode* right = *(ToxPRPL_BootstrapNode* const*) b;
+
+    if (left->failures != right->failures) {
+        return (left->failures < right->failures) ? -1 : 1;
+    }
+    if ((left->rtt < 0) != (right->rtt < 0)) {
+        return (left->rtt < 0) ? 1 : -1;
+    }
+    return left->rtt - right->rtt;
+}
+
+// Node Cache -----------------------------------------------------------------------------------------------------
+
+/*
+ * The cache file is a header followed by a list of entries, all integers in network byte order:
+ *
+ *  header: magic (4) | version (1) | entry count (2)
+ *  entry:  key (TOX_CLIENT_ID_SIZE) | port (2) | rtt (4) | failures (2) | last seen (8) | address length (1) | address
+ */
+static const char NODE_CACHE_MAGIC[4] = { 'T', 'X', 'N', 'C' };
+#define NODE_CACHE_VERSION 1
+
+static gchar* getCacheFile(PurpleAccount* account) {
+    gchar* name = g_strdup_printf("%s.nodes", purple_escape_filename(purple_account_get_username(account)));
+    gchar* path = g_build_filename(purple_user_dir(), "tox", name, NULL);
+    g_free(name);
+    return path;
+}
+
+static gboolean isStale(const ToxPRPL_BootstrapNode* node, gint64 now) {
+    return (node->last_seen == 0) || (now - node->last_seen > TOXPRPL_NODE_CACHE_MAX_AGE);
+}
+
+static guint64 readInt(const guchar** p, guint size) {
+    guint64 value = 0;
+    guint i;
+    for (i = 0; i < size; i++) {
+        value = (value << 8) | *(*p)++;
+    }
+    return value;
+}
+
+static void writeInt(GByteArray* buffer, guint64 value, guint size) {
+    while (size-- > 0) {
+        guint8 byte = (guint8) (value >> (size * 8));
+        g_byte_array_append(buffer, &byte, 1);
+    }
+}
+
+static void loadCache(ToxPRPL_Bootstrap* bootstrap) {
+    gchar* contents;
+    gsize length;
+
+    if (!g_file_get_contents(bootstrap->cache_file, &contents, &length, NULL)) {
+        return;
+    }
+
+    const guchar* p = (const guchar*) contents;
+    const guchar* end = p + length;
+    gint64 now = time(NULL);
+
+    if ((length < 7) || (memcmp(p, NODE_CACHE_MAGIC, 4) != 0) || (p[4] != NODE_CACHE_VERSION)) {
+        toxprpl_log_warning("ignoring unknown node cache %s\n", bootstrap->cache_file);
+        g_free(contents);
+        return;
+    }
+    p += 5;
+
+    guint count = (guint) readInt(&p, 2);
+    guint loaded = 0;
+
+    while ((count-- > 0) && (end - p >= TOX_CLIENT_ID_SIZE + 17)) {
+        char key[TOXPRPL_CLIENT_ID_HEX_SIZE];
+        ToxPRPL_toxClientIdToHex(p, key);
+        p += TOX_CLIENT_ID_SIZE;
+
+        uint16_t port = (uint16_t) readInt(&p, 2);
+        gint rtt = (gint32) readInt(&p, 4);
+        guint failures = (guint) readInt(&p, 2);
+        gint64 lastSeen = (gint64) readInt(&p, 8);
+        guint addressLength = (guint) readInt(&p, 1);
+
+        if (end - p < addressLength) {
+            break;
+        }
+
+        gchar* address = g_strndup((const gchar*) p, addressLength);
+        p += addressLength;
+
+        if (now - lastSeen <= TOXPRPL_NODE_CACHE_MAX_AGE) {
+            ToxPRPL_BootstrapNode* node = findNode(bootstrap, address, port);
+            if (node == NULL) {
+                addNode(bootstrap, address, port, key);
+                node = findNode(bootstrap, address, port);
+            }
+
+            if (node != NULL) {
+                node->rtt = rtt;
+                node->failures = failures;
+                node->last_seen = lastSeen;
+                loaded++;
+            }
+        }
+
+        g_free(address);
+    }
+
+    toxprpl_log_info("loaded %u nodes from %s\n", loaded, bootstrap->cache_file);
+    g_free(contents);
+}
+
+/*
+ * Write the best ranked nodes that recently got us connected to the cache file
+ */
+static void saveCache(ToxPRPL_Bootstrap* bootstrap) {
+    GByteArray* buffer = g_byte_array_new();
+    gint64 now = time(NULL);
+
+    GPtrArray* ranked = g_ptr_array_sized_new(bootstrap->nodes->len);
+    guint i;
+    for (i = 0; i < bootstrap->nodes->len; i++) {
+        g_ptr_array_add(ranked, g_ptr_array_index(bootstrap->nodes, i));
+    }
+    g_ptr_array_sort(ranked, compareNodes);
+
+    guint count = 0;
+    for (i = 0; (i < ranked->len) && (count < TOXPRPL_NODE_CACHE_SIZE); i++) {
+        if (!isStale(g_ptr_array_index(ranked, i), now)) {
+            count++;
+        }
+    }
+
+    g_byte_array_append(buffer, (const guint8*) NODE_CACHE_MAGIC, 4);
+    writeInt(buffer, NODE_CACHE_VERSION, 1);
+    writeInt(buffer, count, 2);
+
+    for (i = 0; (i < ranked->len) && (count > 0); i++) {
+        ToxPRPL_BootstrapNode* node = g_ptr_array_index(ranked, i);
+        if (isStale(node, now)) {
+            continue;
+        }
+
+        // keys were checked by addNode()
+        uint8_t key[TOX_CLIENT_ID_SIZE];
+        ToxPRPL_hexToBin(node->key, TOX_CLIENT_ID_SIZE * 2, key, sizeof(key));
+        g_byte_array_append(buffer, key, TOX_CLIENT_ID_SIZE);
+
+        guint addressLength = MIN(strlen(node->address), G_MAXUINT8);
+        writeInt(buffer, node->port, 2);
+        writeInt(buffer, (guint32) node->rtt, 4);
+        writeInt(buffer, MIN(node->failures, G_MAXUINT16), 2);
+        writeInt(buffer, (guint64) node->last_seen, 8);
+        writeInt(buffer, addressLength, 1);
+        g_byte_array_append(buffer, (const guint8*) node->address, addressLength);
+        count--;
+    }
+
+    gchar* dir = g_path_get_dirname(bootstrap->cache_file);
+    if (purple_build_dir(dir, S_IRUSR | S_IWUSR | S_IXUSR) == 0) {
+        purple_util_write_data_to_file_absolute(bootstrap->cache_file, (const char*) buffer->data,
+                                                (gssize) buffer->len);
+    }
+    g_free(dir);
+
+    g_ptr_array_free(ranked, TRUE);
+    g_byte_array_free(buffer, TRUE);
+}
+
+// Waves ----------------------------------------------------------------------------------------------------------
+
+static gboolean bootstrapNode(Tox* tox, ToxPRPL_BootstrapNode* node) {
+    uint8_t publicKey[TOX_CLIENT_ID_SIZE];
+    ToxPRPL_hexToBin(node->key, TOX_CLIENT_ID_SIZE * 2, publicKey, sizeof(publicKey));
+    int ret = tox_bootstrap_from_address(tox, node->address, node->port, publicKey);
+
+    toxprpl_log_info("bootstrapping from %s:%u (%s)%s\n", node->address, node->port, node->key,
+                     ret ? "" : " failed");
+    return ret != 0;
+}
+
+/*
+ * Start the next wave. The wave is extended until at least one node could be bootstrapped
+ * (e.g. when host names do not resolve). Once all nodes were tried, start over from the best one.
+ * Returns the number of nodes that were bootstrapped.
+ */
+static guint startWave(ToxPRPL_Bootstrap* bootstrap) {
+    if (bootstrap->next >= bootstrap->nodes->len) {
+        bootstrap->next = 0;
+    }
+
+    bootstrap->wave = bootstrap->next;
+    bootstrap->wave_started = g_get_monotonic_time();
+
+    guint bootstrapped = 0;
+    while ((bootstrap->next < bootstrap->nodes->len) && (bootstrapped < TOXPRPL_BOOTSTRAP_WAVE_SIZE)) {
+        if (bootstrapNode(bootstrap->tox, g_ptr_array_index(bootstrap->nodes, bootstrap->next))) {
+            bootstrapped++;
+        }
+        bootstrap->next++;
+    }
+
+    return bootstrapped;
+}
+
+static void onWaveFailed(ToxPRPL_Bootstrap* bootstrap) {
+    guint i;
+    for (i = bootstrap->wave; i < bootstrap->next; i++) {
+        ToxPRPL_BootstrapNode* node = g_ptr_array_index(bootstrap->nodes, i);
+        node->failures++;
+    }
+}
+
+static void onConnected(ToxPRPL_Bootstrap* bootstrap) {
+    gint64 now = g_get_monotonic_time();
+    bootstrap->connected_at = now;
+
+    if (bootstrap->reconnecting) {
+        // with ever growing node sets, there is nothing meaningful to credit here
+        toxprpl_log_info("DHT reconnected after %" G_GINT64_FORMAT " ms and %u attempts\n",
+                         (now - bootstrap->disconnected_at) / 1000, bootstrap->attempts);
+        bootstrap->reconnecting = FALSE;
+        return;
+    }
+
+    gint rtt = (gint) ((now - bootstrap->wave_started) / 1000);
+
+    guint i;
+    for (i = bootstrap->wave; i < bootstrap->next; i++) {
+        ToxPRPL_BootstrapNode* node = g_ptr_array_index(bootstrap->nodes, i);
+        node->rtt = (node->rtt < 0) ? rtt : ((node->rtt * 3) + rtt) / 4;
+        node->failures = 0;
+        node->last_seen = time(NULL);
+    }
+
+    toxprpl_log_info("DHT connected after %" G_GINT64_FORMAT " ms, in wave starting at node %u\n",
+                     (now - bootstrap->started) / 1000, bootstrap->wave);
+
+    saveCache(bootstrap);
+}
+
+// Reconnecting ---------------------------------------------------------------------------------------------------
+
+/*
+ * Delay after reconnect attempt number `attempt', in microseconds
+ */
+static gint64 getReconnectDelay(guint attempt) {
+    gint64 delay = TOXPRPL_RECONNECT_DELAY_MIN;
+    while ((attempt-- > 1) && (delay < TOXPRPL_RECONNECT_DELAY_MAX)) {
+        delay *= 2;
+    }
+    delay = MIN(delay, TOXPRPL_RECONNECT_DELAY_MAX);
+
+    gint64 jitter = delay * TOXPRPL_RECONNECT_JITTER / 100;
+    delay += g_random_int_range((gint32) -jitter, (gint32) jitter + 1);
+
+    return delay * 1000;
+}
+
+/*
+ * Bootstrap the best nodes again. The first attempt uses a single wave worth of nodes,
+ * and each further attempt doubles that, until all known nodes are used.
+ */
+static void attemptReconnect(ToxPRPL_Bootstrap* bootstrap) {
+    guint count = TOXPRPL_BOOTSTRAP_WAVE_SIZE;
+    guint i;
+    for (i = 0; (i < bootstrap->attempts) && (count < bootstrap->nodes->len); i++) {
+        count *= 2;
+    }
+    count = MIN(count, bootstrap->nodes->len);
+
+    bootstrap->attempts++;
+    toxprpl_log_info("reconnect attempt %u, bootstrapping %u nodes\n", bootstrap->attempts, count);
+
+    for (i = 0; i < count; i++) {
+        bootstrapNode(bootstrap->tox, g_ptr_array_index(bootstrap->nodes, i));
+    }
+
+    bootstrap->next_attempt = g_get_monotonic_time() + getReconnectDelay(bootstrap->attempts);
+}
+
+static gboolean pollBootstrap(gpointer data) {
+    ToxPRPL_Bootstrap* bootstrap = data;
+
+    if (tox_isconnected(bootstrap->tox)) {
+        onConnected(bootstrap);
+        bootstrap->timer = 0;
+        return FALSE;
+    }
+
+    gint64 now = g_get_monotonic_time();
+
+    if (bootstrap->reconnecting) {
+        if (now >= bootstrap->next_attempt) {
+            attemptReconnect(bootstrap);
+        }
+    }
+    else if (now - bootstrap->wave_started >= TOXPRPL_BOOTSTRAP_WAVE_TIMEOUT * 1000) {
+        onWaveFailed(bootstrap);
+        startWave(bootstrap);
+    }
+
+    return TRUE;
+}
+
+static void startPolling(ToxPRPL_Bootstrap* bootstrap) {
+    if (bootstrap->timer == 0) {
+        bootstrap->timer = purple_timeout_add(TOXPRPL_BOOTSTRAP_POLL_INTERVAL, pollBootstrap, bootstrap);
+    }
+}
+
+/*
+ * The network changed under us, so whatever backoff we were in is no longer meaningful.
+ * Even if Tox still believes it is connected, its DHT peers may no longer be reachable,
+ * so the best nodes are bootstrapped right away.
+ */
+static void onNetworkChanged(gpointer data) {
+    ToxPRPL_Bootstrap* bootstrap = data;
+
+    toxprpl_log_info("network configuration changed, bootstrapping again\n");
+
+    if (bootstrap->reconnecting) {
+        bootstrap->attempts = 0;
+        attemptReconnect(bootstrap);
+        return;
+    }
+
+    guint i;
+    for (i = 0; i < MIN(TOXPRPL_BOOTSTRAP_WAVE_SIZE, bootstrap->nodes->len); i++) {
+        bootstrapNode(bootstrap->tox, g_ptr_array_index(bootstrap->nodes, i));
+    }
+}
+
+// Transport Options --------------------------------------------------------------------------------------------
+
+/*
+ * Tox can only tunnel through a SOCKS5 proxy, any other proxy type from the account is ignored.
+ *
+ * There is no switch for LAN discovery in this version of the Tox API: it is always active while
+ * UDP is enabled, in which case peers on the same network find each other without going through the DHT.
+ */
+void ToxPRPL_getToxOptions(PurpleAccount* account, Tox_Options* options) {
+    memset(options, 0, sizeof(Tox_Options));
+
+    options->ipv6enabled = purple_account_get_bool(account, TOXPRPL_OPT_IPV6, DEFAULT_IPV6) ? 1 : 0;
+    options->udp_disabled = purple_account_get_bool(account, TOXPRPL_OPT_UDP, DEFAULT_UDP) ? 0 : 1;
+
+    PurpleProxyInfo* proxy = purple_proxy_get_setup(account);
+    if ((proxy != NULL) && (purple_proxy_info_get_type(proxy) == PURPLE_PROXY_SOCKS5)) {
+        const char* host = purple_proxy_info_get_host(proxy);
+        if ((host != NULL) && (strlen(host) > 0) && (strlen(host) < sizeof(options->proxy_address))) {
+            options->proxy_enabled = 1;
+            g_strlcpy(options->proxy_address, host, sizeof(options->proxy_address));
+            options->proxy_port = (uint16_t) purple_proxy_info_get_port(proxy);
+        }
+    }
+
+    toxprpl_log_info("transport: IPv6 %s, UDP %s, proxy %s:%u\n",
+                     options->ipv6enabled ? "on" : "off", options->udp_disabled ? "off" : "on",
+                     options->proxy_enabled ? options->proxy_address : "none", options->proxy_port);
+}
+
+void ToxPRPL_addTcpRelays(PurpleAccount* account, Tox* tox) {
+    const char* list = purple_account_get_string(account, TOXPRPL_OPT_TCP_RELAYS, NULL);
+    if (list == NULL) {
+        return;
+    }
+
+    gchar** entries = g_strsplit_set(list, " \t\r\n,;", -1);
+    gchar** entry;
+    for (entry = entries; *entry != NULL; entry++) {
+        gchar* address;
+        uint16_t port;
+        gchar* key;
+
+        if (strlen(*entry) == 0) {
+            continue;
+        }
+
+        uint8_t publicKey[TOX_CLIENT_ID_SIZE];
+        if (!parseNodeEntry(*entry, &address, &port, &key) || (strlen(key) != TOX_CLIENT_ID_SIZE * 2)
+            || !ToxPRPL_hexToBin(key, TOX_CLIENT_ID_SIZE * 2, publicKey, sizeof(publicKey))) {
+            toxprpl_log_warning("ignoring malformed TCP relay '%s'\n", *entry);
+            continue;
+        }
+
+        int ret = tox_add_tcp_relay(tox, address, port, publicKey);
+
+        toxprpl_log_info("added TCP relay %s:%u%s\n", address, port, ret ? "" : " (failed)");
+    }
+    g_strfreev(entries);
+}
+
+// Public API -----------------------------------------------------------------------------------------------------
+
+ToxPRPL_Bootstrap* ToxPRPL_Bootstrap_new(PurpleAccount* account, Tox* tox) {
+    ToxPRPL_Bootstrap* bootstrap = g_new0(ToxPRPL_Bootstrap, 1);
+    bootstrap->tox = tox;
+    bootstrap->account = account;
+    bootstrap->nodes = g_ptr_array_new_with_free_func(freeNode);
+
+    /// \todo add limits check to make sure the user did not enter something
+    /// invalid
+    addNode(bootstrap,
+            purple_account_get_string(account, "dht_server", DEFAULT_SERVER_IP),
+            (uint16_t) purple_account_get_int(account, "dht_server_port", DEFAULT_SERVER_PORT),
+            purple_account_get_string(account, "dht_server_key", DEFAULT_SERVER_KEY));
+    addNodeList(bootstrap, purple_account_get_string(account, TOXPRPL_OPT_BOOTSTRAP_NODES, DEFAULT_BOOTSTRAP_NODES));
+
+    bootstrap->cache_file = getCacheFile(account);
+    loadCache(bootstrap);
+    g_ptr_array_sort(bootstrap->nodes, compareNodes);
+
+    purple_signal_connect(purple_network_get_handle(), "network-configuration-changed", bootstrap,
+                          PURPLE_CALLBACK(onNetworkChanged), bootstrap);
+
+    return bootstrap;
+}
+
+void ToxPRPL_Bootstrap_free(ToxPRPL_Bootstrap* bootstrap) {
+    toxprpl_return_if_fail(bootstrap != NULL);
+
+    purple_signals_disconnect_by_handle(bootstrap);
+
+    if (bootstrap->timer != 0) {
+        purple_timeout_remove(bootstrap->timer);
+    }
+
+    g_ptr_array_free(bootstrap->nodes, TRUE);
+    g_free(bootstrap->cache_file);
+    g_free(bootstrap);
+}
+
+gboolean ToxPRPL_Bootstrap_start(ToxPRPL_Bootstrap* bootstrap) {
+    bootstrap->next = 0;
+    bootstrap->started = g_get_monotonic_time();
+
+    guint bootstrapped = 0;
+    while ((bootstrapped == 0) && (bootstrap->next < bootstrap->nodes->len)) {
+        bootstrapped = startWave(bootstrap);
+    }
+
+    if (bootstrapped == 0) {
+        return FALSE;
+    }
+
+    startPolling(bootstrap);
+
+    return TRUE;
+}
+
+void ToxPRPL_Bootstrap_onDisconnected(ToxPRPL_Bootstrap* bootstrap) {
+    toxprpl_return_if_fail(bootstrap != NULL);
+
+    bootstrap->disconnected_at = g_get_monotonic_time();
+    if (bootstrap->connected_at != 0) {
+        toxprpl_log_info("DHT connection lost after %" G_GINT64_FORMAT " s\n",
+                         (bootstrap->disconnected_at - bootstrap->connected_at) / G_USEC_PER_SEC);
+    }
+
+    // a lost connection during the first bootstrap is handled by the waves
+    if (bootstrap->timer != 0 && !bootstrap->reconnecting) {
+        return;
+    }
+
+    bootstrap->reconnecting = TRUE;
+    bootstrap->attempts = 0;
+    attemptReconnect(bootstrap);
+    startPolling(bootstrap);
+}
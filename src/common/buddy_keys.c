@@ -0,0 +1,69 @@
+/*
+ * Interned buddy keys, see ``toxprpl/buddy_keys.h''
+ */
+
+#include <toxprpl.h>
+#include <toxprpl/buddy_keys.h>
+#include <toxprpl/friend_table.h>
+#include <string.h>
+
+/*
+ * Client IDs are public keys, so any four of their bytes are as good a hash as any
+ */
+static guint hashClientId(gconstpointer key) {
+    guint hash;
+    memcpy(&hash, key, sizeof(hash));
+    return hash;
+}
+
+static gboolean equalClientId(gconstpointer a, gconstpointer b) {
+    return memcmp(a, b, TOX_CLIENT_ID_SIZE) == 0;
+}
+
+// Public API -----------------------------------------------------------------------------------------------------
+
+ToxPRPL_BuddyKeys* ToxPRPL_BuddyKeys_new(ToxPRPL_FriendTable* friends) {
+    ToxPRPL_BuddyKeys* keys = g_new0(ToxPRPL_BuddyKeys, 1);
+    keys->friends = friends;
+    keys->keys = g_hash_table_new_full(hashClientId, equalClientId, NULL, g_free);
+    return keys;
+}
+
+void ToxPRPL_BuddyKeys_free(ToxPRPL_BuddyKeys* keys) {
+    toxprpl_return_if_fail(keys != NULL);
+
+    g_hash_table_destroy(keys->keys);
+    g_free(keys);
+}
+
+const char* ToxPRPL_BuddyKeys_intern(ToxPRPL_BuddyKeys* keys, const uint8_t* client_id) {
+    toxprpl_return_val_if_fail(keys != NULL, NULL);
+
+    ToxPRPL_BuddyKey* key = g_hash_table_lookup(keys->keys, client_id);
+    if (key == NULL) {
+        key = g_new(ToxPRPL_BuddyKey, 1);
+        memcpy(key->client_id, client_id, TOX_CLIENT_ID_SIZE);
+        ToxPRPL_toxClientIdToHex(client_id, key->name);
+        g_hash_table_insert(keys->keys, key->client_id, key);
+    }
+    return key->name;
+}
+
+const char* ToxPRPL_BuddyKeys_forFriend(ToxPRPL_BuddyKeys* keys, int friend_number) {
+    toxprpl_return_val_if_fail(keys != NULL, NULL);
+
+    const uint8_t* client_id = ToxPRPL_FriendTable_getClientId(keys->friends, friend_number);
+    if (client_id == NULL) {
+        return NULL;
+    }
+    return ToxPRPL_BuddyKeys_intern(keys, client_id);
+}
+
+void ToxPRPL_BuddyKeys_forgetFriend(ToxPRPL_BuddyKeys* keys, int friend_number) {
+    toxprpl_return_if_fail(keys != NULL);
+
+    const uint8_t* client_id = ToxPRPL_FriendTable_getClientId(keys->friends, friend_number);
+    if (client_id != NULL) {
+        g_hash_table_remove(keys->keys, client_id);
+    }
+}
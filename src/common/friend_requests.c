@@ -0,0 +1,304 @@
+/*
+ * Incoming friend request intake, see ``toxprpl/friend_requests.h''
+ */
+
+#include <toxprpl.h>
+#include <toxprpl/friend_requests.h>
+#include <toxprpl/buddy.h>
+#include <toxprpl/metrics.h>
+#include <toxprpl/pool.h>
+#include <string.h>
+
+#define REQUEST_LIST_FIELD "requests"
+
+static void freeRequest(gpointer data) {
+    ToxPRPL_FriendRequest* request = data;
+    g_free(request->buddy_key);
+    g_free(request->message);
+    g_free(request);
+}
+
+// Decisions ------------------------------------------------------------------------------------------------------
+
+static gboolean isCoolingDown(ToxPRPL_FriendRequests* intake, const char* buddy_key, gint64 now) {
+    gint64* until = g_hash_table_lookup(intake->cooldown, buddy_key);
+    if (until == NULL) {
+        return FALSE;
+    }
+
+    if (*until > now) {
+        return TRUE;
+    }
+
+    g_hash_table_remove(intake->cooldown, buddy_key);
+    return FALSE;
+}
+
+static void startCooldown(ToxPRPL_FriendRequests* intake, const char* buddy_key) {
+    gint64 now = g_get_monotonic_time();
+
+    if (g_hash_table_size(intake->cooldown) >= TOXPRPL_FRIEND_REQUEST_COOLDOWN_MAX) {
+        GHashTableIter iterator;
+        gpointer until;
+        g_hash_table_iter_init(&iterator, intake->cooldown);
+        while (g_hash_table_iter_next(&iterator, NULL, &until)) {
+            if (*(gint64*) until <= now) {
+                g_hash_table_iter_remove(&iterator);
+            }
+        }
+
+        if (g_hash_table_size(intake->cooldown) >= TOXPRPL_FRIEND_REQUEST_COOLDOWN_MAX) {
+            return;
+        }
+    }
+
+    gint64* until = g_new(gint64, 1);
+    *until = now + (gint64) TOXPRPL_FRIEND_REQUEST_COOLDOWN * G_USEC_PER_SEC;
+    g_hash_table_replace(intake->cooldown, g_strdup(buddy_key), until);
+}
+
+static void acceptRequest(ToxPRPL_FriendRequests* intake, const char* buddy_key) {
+    toxprpl_log_info("accepting friend request from %s\n", buddy_key);
+
+    ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(intake->gc);
+    ToxPRPL_FriendAcceptData* data = ToxPRPL_Pools_alloc(plugin->pools, TOXPRPL_POOL_FRIEND_ACCEPT);
+    data->gc = intake->gc;
+    data->buddy_key = g_strdup(buddy_key);
+    ToxPRPL_Action_acceptFriendRequest(data);
+}
+
+static void rejectRequest(ToxPRPL_FriendRequests* intake, const char* buddy_key) {
+    toxprpl_log_info("rejecting friend request from %s\n", buddy_key);
+    startCooldown(intake, buddy_key);
+}
+
+/*
+ * Remove a request from the queue, without freeing it
+ */
+static void takeRequest(ToxPRPL_FriendRequests* intake, ToxPRPL_FriendRequest* request) {
+    g_queue_remove(&intake->order, request);
+    g_hash_table_steal(intake->pending, request->buddy_key);
+}
+
+// Batch Dialog ---------------------------------------------------------------------------------------------------
+
+static void schedulePresent(ToxPRPL_FriendRequests* intake);
+
+static void onDialogApply(ToxPRPL_FriendRequests* intake, PurpleRequestFields* fields) {
+    PurpleRequestField* field = purple_request_fields_get_field(fields, REQUEST_LIST_FIELD);
+
+    GList* item;
+    for (item = purple_request_field_list_get_items(field); item != NULL; item = item->next) {
+        ToxPRPL_FriendRequest* request = purple_request_field_list_get_data(field, item->data);
+        takeRequest(intake, request);
+
+        if (purple_request_field_list_is_selected(field, item->data)) {
+            acceptRequest(intake, request->buddy_key);
+        }
+        else {
+            rejectRequest(intake, request->buddy_key);
+        }
+        freeRequest(request);
+    }
+
+    intake->dialog_open = FALSE;
+    intake->dialog = NULL;
+
+    // requests that came in while the dialog was open get a dialog of their own
+    if (!g_queue_is_empty(&intake->order)) {
+        schedulePresent(intake);
+    }
+}
+
+/*
+ * ``Later'' keeps the requests, they can be looked at again from the account's actions
+ */
+static void onDialogLater(ToxPRPL_FriendRequests* intake, PurpleRequestFields* fields) {
+    intake->dialog_open = FALSE;
+    intake->dialog = NULL;
+}
+
+static gboolean onPresentTimer(gpointer data) {
+    ToxPRPL_FriendRequests* intake = data;
+    intake->present_timer = 0;
+    ToxPRPL_FriendRequests_present(intake);
+    return FALSE;
+}
+
+static void schedulePresent(ToxPRPL_FriendRequests* intake) {
+    if ((intake->present_timer == 0) && !intake->dialog_open) {
+        intake->present_timer = purple_timeout_add(TOXPRPL_FRIEND_REQUEST_BATCH_DELAY, onPresentTimer, intake);
+    }
+}
+
+void ToxPRPL_FriendRequests_present(ToxPRPL_FriendRequests* intake) {
+    toxprpl_return_if_fail(intake != NULL);
+
+    if (intake->dialog_open || g_queue_is_empty(&intake->order)) {
+        return;
+    }
+
+    if (intake->present_timer != 0) {
+        purple_timeout_remove(intake->present_timer);
+        intake->present_timer = 0;
+    }
+
+    if (intake->policy == TOXPRPL_FRIEND_REQUESTS_ACCEPT) {
+        while (!g_queue_is_empty(&intake->order)) {
+            ToxPRPL_FriendRequest* request = g_queue_peek_head(&intake->order);
+            takeRequest(intake, request);
+            acceptRequest(intake, request->buddy_key);
+            freeRequest(request);
+        }
+        return;
+    }
+
+    PurpleRequestFields* fields = purple_request_fields_new();
+    PurpleRequestFieldGroup* group = purple_request_field_group_new(NULL);
+    purple_request_fields_add_group(fields, group);
+
+    PurpleRequestField* field = purple_request_field_list_new(REQUEST_LIST_FIELD, _("Requests to accept"));
+    purple_request_field_list_set_multi_select(field, TRUE);
+
+    GList* link;
+    for (link = intake->order.head; link != NULL; link = link->next) {
+        ToxPRPL_FriendRequest* request = link->data;
+        gchar* label;
+        if (request->count > 1) {
+            label = g_strdup_printf("%s: %s (%u times)", request->buddy_key,
+                                    request->message ? request->message : "", request->count);
+        }
+        else {
+            label = g_strdup_printf("%s: %s", request->buddy_key, request->message ? request->message : "");
+        }
+        purple_request_field_list_add_icon(field, label, NULL, request);
+        g_free(label);
+    }
+    purple_request_field_group_add_field(group, field);
+
+    guint count = g_queue_get_length(&intake->order);
+    gchar* primary = g_strdup_printf(_("%u pending friend requests"), count);
+
+    PurpleAccount* account = purple_connection_get_account(intake->gc);
+
+    // the dialog may be answered before purple_request_fields() returns
+    intake->dialog_open = TRUE;
+    void* dialog = purple_request_fields(intake->gc, _("Friend requests"), primary,
+                                         _("Select the requests to accept, all others will be rejected."),
+                                         fields,
+                                         _("_Apply"), G_CALLBACK(onDialogApply),
+                                         _("_Later"), G_CALLBACK(onDialogLater),
+                                         account, NULL, NULL, intake);
+    g_free(primary);
+
+    if (dialog == NULL) {
+        // no UI to ask, the requests stay queued
+        intake->dialog_open = FALSE;
+    }
+    else if (intake->dialog_open) {
+        intake->dialog = dialog;
+    }
+}
+
+// Public API -----------------------------------------------------------------------------------------------------
+
+ToxPRPL_FriendRequests* ToxPRPL_FriendRequests_new(PurpleConnection* gc, ToxPRPL_Metrics* metrics) {
+    ToxPRPL_FriendRequests* intake = g_new0(ToxPRPL_FriendRequests, 1);
+    PurpleAccount* account = purple_connection_get_account(gc);
+
+    intake->gc = gc;
+    intake->metrics = metrics;
+
+    const char* policy = purple_account_get_string(account, TOXPRPL_OPT_FRIEND_REQUEST_POLICY,
+                                                   DEFAULT_FRIEND_REQUEST_POLICY);
+    if (g_strcmp0(policy, TOXPRPL_FRIEND_REQUEST_POLICY_ACCEPT) == 0) {
+        intake->policy = TOXPRPL_FRIEND_REQUESTS_ACCEPT;
+    }
+    else if (g_strcmp0(policy, TOXPRPL_FRIEND_REQUEST_POLICY_REJECT) == 0) {
+        intake->policy = TOXPRPL_FRIEND_REQUESTS_REJECT;
+    }
+    else {
+        intake->policy = TOXPRPL_FRIEND_REQUESTS_ASK;
+    }
+
+    intake->queue_limit = (guint) MAX(1, purple_account_get_int(account, TOXPRPL_OPT_FRIEND_REQUEST_QUEUE,
+                                                                DEFAULT_FRIEND_REQUEST_QUEUE));
+
+    intake->pending = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, freeRequest);
+    g_queue_init(&intake->order);
+    intake->cooldown = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+    return intake;
+}
+
+void ToxPRPL_FriendRequests_free(ToxPRPL_FriendRequests* intake) {
+    toxprpl_return_if_fail(intake != NULL);
+
+    if (intake->present_timer != 0) {
+        purple_timeout_remove(intake->present_timer);
+    }
+
+    if (intake->dialog != NULL) {
+        purple_request_close(PURPLE_REQUEST_FIELDS, intake->dialog);
+    }
+
+    g_queue_clear(&intake->order);
+    g_hash_table_destroy(intake->pending);
+    g_hash_table_destroy(intake->cooldown);
+    g_free(intake);
+}
+
+void ToxPRPL_FriendRequests_add(ToxPRPL_FriendRequests* intake, const char* buddy_key, const char* message) {
+    toxprpl_return_if_fail(intake != NULL);
+
+    if (intake->policy == TOXPRPL_FRIEND_REQUESTS_REJECT) {
+        toxprpl_log_info("ignoring friend request from %s, as configured\n", buddy_key);
+        ToxPRPL_Metrics_count(intake->metrics, TOXPRPL_COUNTER_FRIEND_REQUESTS_DROPPED, 1);
+        return;
+    }
+
+    if (isCoolingDown(intake, buddy_key, g_get_monotonic_time())) {
+        toxprpl_log_misc("ignoring repeated friend request from %s\n", buddy_key);
+        ToxPRPL_Metrics_count(intake->metrics, TOXPRPL_COUNTER_FRIEND_REQUESTS_DROPPED, 1);
+        return;
+    }
+
+    ToxPRPL_FriendRequest* request = g_hash_table_lookup(intake->pending, buddy_key);
+    if (request != NULL) {
+        request->count++;
+        g_free(request->message);
+        request->message = g_strdup(message);
+        ToxPRPL_Metrics_count(intake->metrics, TOXPRPL_COUNTER_FRIEND_REQUESTS_DROPPED, 1);
+        return;
+    }
+
+    if (g_hash_table_size(intake->pending) >= intake->queue_limit) {
+        toxprpl_log_warning("friend request queue is full, dropping request from %s\n", buddy_key);
+        ToxPRPL_Metrics_count(intake->metrics, TOXPRPL_COUNTER_FRIEND_REQUESTS_DROPPED, 1);
+        return;
+    }
+
+    request = g_new0(ToxPRPL_FriendRequest, 1);
+    request->buddy_key = g_strdup(buddy_key);
+    request->message = g_strdup(message);
+    request->count = 1;
+    g_hash_table_insert(intake->pending, request->buddy_key, request);
+    g_queue_push_tail(&intake->order, request);
+
+    schedulePresent(intake);
+}
+
+void ToxPRPL_showFriendRequestsDialog(PurplePluginAction* action) {
+    PurpleConnection* gc = (PurpleConnection*) action->context;
+    ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(gc);
+    if ((plugin == NULL) || (plugin->friend_requests == NULL)) {
+        return;
+    }
+
+    if (g_queue_is_empty(&plugin->friend_requests->order)) {
+        purple_notify_info(gc, _("Friend requests"), _("There are no pending friend requests."), NULL);
+        return;
+    }
+
+    ToxPRPL_FriendRequests_present(plugin->friend_requests);
+}
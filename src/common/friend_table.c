@@ -0,0 +1,298 @@
+/*
+ * Dense per-friend state, see ``toxprpl/friend_table.h''
+ */
+
+#include <toxprpl.h>
+#include <toxprpl/friend_table.h>
+#include <string.h>
+
+static gboolean isFriend(const ToxPRPL_FriendTable* table, int friend_number) {
+    return (friend_number >= 0) && ((guint) friend_number < table->size) && table->used[friend_number];
+}
+
+/*
+ * Make room for friend numbers up to `size' - 1, new slots are zeroed
+ */
+static void reserve(ToxPRPL_FriendTable* table, guint size) {
+    if (size <= table->capacity) {
+        return;
+    }
+
+    guint capacity = MAX(table->capacity, TOXPRPL_FRIEND_TABLE_MIN_CAPACITY);
+    while (capacity < size) {
+        capacity *= 2;
+    }
+    guint added = capacity - table->capacity;
+
+    table->used = g_renew(guint8, table->used, capacity);
+    table->client_ids = g_renew(uint8_t, table->client_ids, (gsize) capacity * TOX_CLIENT_ID_SIZE);
+    table->names = g_renew(gchar*, table->names, capacity);
+    table->status_messages = g_renew(gchar*, table->status_messages, capacity);
+    table->user_status = g_renew(guint8, table->user_status, capacity);
+    table->online = g_renew(guint8, table->online, capacity);
+    table->last_seen = g_renew(gint64, table->last_seen, capacity);
+    table->typing = g_renew(guint8, table->typing, capacity);
+
+    memset(table->used + table->capacity, 0, added * sizeof(*table->used));
+    memset(table->client_ids + (gsize) table->capacity * TOX_CLIENT_ID_SIZE, 0, (gsize) added * TOX_CLIENT_ID_SIZE);
+    memset(table->names + table->capacity, 0, added * sizeof(*table->names));
+    memset(table->status_messages + table->capacity, 0, added * sizeof(*table->status_messages));
+    memset(table->user_status + table->capacity, 0, added * sizeof(*table->user_status));
+    memset(table->online + table->capacity, 0, added * sizeof(*table->online));
+    memset(table->last_seen + table->capacity, 0, added * sizeof(*table->last_seen));
+    memset(table->typing + table->capacity, 0, added * sizeof(*table->typing));
+
+    table->capacity = capacity;
+}
+
+/*
+ * Replace a cached string with `length' bytes of `value', returns whether it changed.
+ * Tox may count a terminating NUL in the length, an empty value is stored as NULL.
+ */
+static gboolean replaceString(gchar** slot, const uint8_t* value, uint16_t length) {
+    gchar* string = (length > 0) ? g_strndup((const gchar*) value, length) : NULL;
+    if ((string != NULL) && (*string == '\0')) {
+        g_free(string);
+        string = NULL;
+    }
+
+    if (g_strcmp0(*slot, string) == 0) {
+        g_free(string);
+        return FALSE;
+    }
+
+    g_free(*slot);
+    *slot = string;
+    return TRUE;
+}
+
+static void clearSlot(ToxPRPL_FriendTable* table, int friend_number) {
+    g_free(table->names[friend_number]);
+    table->names[friend_number] = NULL;
+    g_free(table->status_messages[friend_number]);
+    table->status_messages[friend_number] = NULL;
+    table->used[friend_number] = FALSE;
+    table->user_status[friend_number] = TOX_USERSTATUS_NONE;
+    table->online[friend_number] = FALSE;
+    table->last_seen[friend_number] = 0;
+    table->typing[friend_number] = FALSE;
+}
+
+// Public API -----------------------------------------------------------------------------------------------------
+
+ToxPRPL_FriendTable* ToxPRPL_FriendTable_new(Tox* tox) {
+    ToxPRPL_FriendTable* table = g_new0(ToxPRPL_FriendTable, 1);
+    table->tox = tox;
+
+    guint32 count = tox_count_friendlist(tox);
+    int32_t* friends = g_new0(int32_t, MAX(count, 1));
+    count = tox_get_friendlist(tox, friends, count);
+
+    // friend numbers are dense, sizing for the highest one avoids growing while loading
+    guint size = 0;
+    guint32 i;
+    for (i = 0; i < count; i++) {
+        size = MAX(size, (guint) friends[i] + 1);
+    }
+    reserve(table, size);
+
+    for (i = 0; i < count; i++) {
+        ToxPRPL_FriendTable_load(table, friends[i]);
+    }
+    g_free(friends);
+
+    toxprpl_log_info("loaded %u friends in to the friend table\n", table->count);
+    return table;
+}
+
+void ToxPRPL_FriendTable_free(ToxPRPL_FriendTable* table) {
+    toxprpl_return_if_fail(table != NULL);
+
+    guint i;
+    for (i = 0; i < table->size; i++) {
+        g_free(table->names[i]);
+        g_free(table->status_messages[i]);
+    }
+
+    g_free(table->used);
+    g_free(table->client_ids);
+    g_free(table->names);
+    g_free(table->status_messages);
+    g_free(table->user_status);
+    g_free(table->online);
+    g_free(table->last_seen);
+    g_free(table->typing);
+    g_free(table);
+}
+
+void ToxPRPL_FriendTable_load(ToxPRPL_FriendTable* table, int friend_number) {
+    toxprpl_return_if_fail(table != NULL);
+    toxprpl_return_if_fail(friend_number >= 0);
+
+    uint8_t client_id[TOX_CLIENT_ID_SIZE];
+    if (tox_get_client_id(table->tox, friend_number, client_id) < 0) {
+        ToxPRPL_FriendTable_remove(table, friend_number);
+        return;
+    }
+
+    reserve(table, (guint) friend_number + 1);
+    if (!table->used[friend_number]) {
+        table->used[friend_number] = TRUE;
+        table->count++;
+    }
+    table->size = MAX(table->size, (guint) friend_number + 1);
+
+    memcpy(table->client_ids + (gsize) friend_number * TOX_CLIENT_ID_SIZE, client_id, TOX_CLIENT_ID_SIZE);
+
+    uint8_t name[TOX_MAX_NAME_LENGTH];
+    int length = tox_get_name(table->tox, friend_number, name);
+    replaceString(&table->names[friend_number], name, (uint16_t) CLAMP(length, 0, TOX_MAX_NAME_LENGTH));
+
+    uint8_t message[TOX_MAX_STATUSMESSAGE_LENGTH];
+    length = tox_get_status_message(table->tox, friend_number, message, sizeof(message));
+    replaceString(&table->status_messages[friend_number], message,
+                  (uint16_t) CLAMP(length, 0, TOX_MAX_STATUSMESSAGE_LENGTH));
+
+    table->user_status[friend_number] = tox_get_user_status(table->tox, friend_number);
+    table->online[friend_number] = tox_get_friend_connection_status(table->tox, friend_number) == 1;
+    table->typing[friend_number] = tox_get_is_typing(table->tox, friend_number) != 0;
+
+    if (table->online[friend_number]) {
+        table->last_seen[friend_number] = (gint64) time(NULL);
+    }
+    else {
+        uint64_t last_online = tox_get_last_online(table->tox, friend_number);
+        table->last_seen[friend_number] = (last_online == UINT64_MAX) ? 0 : (gint64) last_online;
+    }
+}
+
+void ToxPRPL_FriendTable_remove(ToxPRPL_FriendTable* table, int friend_number) {
+    toxprpl_return_if_fail(table != NULL);
+
+    if (!isFriend(table, friend_number)) {
+        return;
+    }
+
+    clearSlot(table, friend_number);
+    table->count--;
+
+    while ((table->size > 0) && !table->used[table->size - 1]) {
+        table->size--;
+    }
+}
+
+gboolean ToxPRPL_FriendTable_has(const ToxPRPL_FriendTable* table, int friend_number) {
+    toxprpl_return_val_if_fail(table != NULL, FALSE);
+    return isFriend(table, friend_number);
+}
+
+const uint8_t* ToxPRPL_FriendTable_getClientId(const ToxPRPL_FriendTable* table, int friend_number) {
+    toxprpl_return_val_if_fail(table != NULL, NULL);
+
+    if (!isFriend(table, friend_number)) {
+        return NULL;
+    }
+    return table->client_ids + (gsize) friend_number * TOX_CLIENT_ID_SIZE;
+}
+
+const char* ToxPRPL_FriendTable_getName(const ToxPRPL_FriendTable* table, int friend_number) {
+    toxprpl_return_val_if_fail(table != NULL, NULL);
+
+    if (!isFriend(table, friend_number)) {
+        return NULL;
+    }
+    return table->names[friend_number];
+}
+
+const char* ToxPRPL_FriendTable_getStatusMessage(const ToxPRPL_FriendTable* table, int friend_number) {
+    toxprpl_return_val_if_fail(table != NULL, NULL);
+
+    if (!isFriend(table, friend_number)) {
+        return NULL;
+    }
+    return table->status_messages[friend_number];
+}
+
+int ToxPRPL_FriendTable_getStatusIndex(const ToxPRPL_FriendTable* table, int friend_number) {
+    toxprpl_return_val_if_fail(table != NULL, TOXPRPL_STATUS_OFFLINE);
+
+    if (!isFriend(table, friend_number) || !table->online[friend_number]) {
+        return TOXPRPL_STATUS_OFFLINE;
+    }
+
+    switch (table->user_status[friend_number]) {
+        case TOX_USERSTATUS_AWAY:
+            return TOXPRPL_STATUS_AWAY;
+        case TOX_USERSTATUS_BUSY:
+            return TOXPRPL_STATUS_BUSY;
+        default:
+            return TOXPRPL_STATUS_ONLINE;
+    }
+}
+
+void ToxPRPL_FriendTable_showStatus(const ToxPRPL_FriendTable* table, PurpleAccount* account, const char* buddy_key,
+                                    int friend_number) {
+    toxprpl_return_if_fail(table != NULL);
+
+    const char* status_id = ToxPRPL_ToxStatuses[ToxPRPL_FriendTable_getStatusIndex(table, friend_number)].id;
+    const char* message = ToxPRPL_FriendTable_getStatusMessage(table, friend_number);
+
+    // attributes left out are reset, so the message goes along with every status
+    if (message != NULL) {
+        purple_prpl_got_user_status(account, buddy_key, status_id, "message", message, NULL);
+    }
+    else {
+        purple_prpl_got_user_status(account, buddy_key, status_id, NULL);
+    }
+}
+
+gboolean ToxPRPL_FriendTable_setName(ToxPRPL_FriendTable* table, int friend_number, const uint8_t* name,
+                                     uint16_t length) {
+    toxprpl_return_val_if_fail(table != NULL, FALSE);
+
+    if (!isFriend(table, friend_number)) {
+        return FALSE;
+    }
+    return replaceString(&table->names[friend_number], name, length);
+}
+
+gboolean ToxPRPL_FriendTable_setStatusMessage(ToxPRPL_FriendTable* table, int friend_number, const uint8_t* message,
+                                              uint16_t length) {
+    toxprpl_return_val_if_fail(table != NULL, FALSE);
+
+    if (!isFriend(table, friend_number)) {
+        return FALSE;
+    }
+    return replaceString(&table->status_messages[friend_number], message, length);
+}
+
+void ToxPRPL_FriendTable_setStatus(ToxPRPL_FriendTable* table, int friend_number, TOX_USERSTATUS user_status) {
+    toxprpl_return_if_fail(table != NULL);
+
+    if (isFriend(table, friend_number)) {
+        table->user_status[friend_number] = (guint8) user_status;
+    }
+}
+
+gboolean ToxPRPL_FriendTable_setOnline(ToxPRPL_FriendTable* table, int friend_number, gboolean online) {
+    toxprpl_return_val_if_fail(table != NULL, FALSE);
+
+    if (!isFriend(table, friend_number) || (table->online[friend_number] == (online != FALSE))) {
+        return FALSE;
+    }
+
+    table->online[friend_number] = (online != FALSE);
+    table->last_seen[friend_number] = (gint64) time(NULL);
+    if (!online) {
+        table->typing[friend_number] = FALSE;
+    }
+    return TRUE;
+}
+
+void ToxPRPL_FriendTable_setTyping(ToxPRPL_FriendTable* table, int friend_number, gboolean typing) {
+    toxprpl_return_if_fail(table != NULL);
+
+    if (isFriend(table, friend_number)) {
+        table->typing[friend_number] = (typing != FALSE);
+    }
+}
@@ -1,46 +1,175 @@
 #include <toxprpl/group_chat.h>
+#include <toxprpl/pool.h>
 #include <conversation.h>
+#include <stdio.h>
 
-const char* TOXPRPL_BUDDY_PEERID = "tox.peer_id";
+#define CONVERSATION_NAME_FORMAT "tox-group-%d"
 
-static gint compareByPeerId(gconstpointer a, gconstpointer b) {
+const char* TOXPRPL_CHAT_TITLE = "title";
+const char* TOXPRPL_CHAT_GROUP_NUMBER = "groupNumber";
+const char* TOXPRPL_CHAT_INVITE_FRIEND = "inviteFriend";
+const char* TOXPRPL_CHAT_INVITE_DATA = "inviteData";
 
-    PurpleConvChatBuddy* firstBuddy  = (PurpleConvChatBuddy*) a;
-    PurpleConvChatBuddy* secondBuddy = (PurpleConvChatBuddy*) b;
+// Group Table ------------------------------------------------------------------------------------
 
-    if(!firstBuddy || !secondBuddy) {
-        return -1;
+static void clearPeers(ToxPRPL_GroupChat* chat) {
+
+    guint peerNumber;
+    for (peerNumber = 0; peerNumber < chat->peers->len; peerNumber++) {
+        ToxPRPL_GroupPeer* peer = &g_array_index(chat->peers, ToxPRPL_GroupPeer, peerNumber);
+        g_free(peer->name);
+        g_free(peer->nick);
+    }
+
+    g_array_set_size(chat->peers, 0);
+}
+
+static void freeGroupChat(gpointer data) {
+
+    ToxPRPL_GroupChat* chat = (ToxPRPL_GroupChat*) data;
+
+    if (chat->rosterTimer != 0) {
+        purple_timeout_remove(chat->rosterTimer);
     }
 
-    const char* firstId = purple_conv_chat_cb_get_attribute(firstBuddy, TOXPRPL_BUDDY_PEERID);
-    const char* secondId = purple_conv_chat_cb_get_attribute(secondBuddy, TOXPRPL_BUDDY_PEERID);
+    clearPeers(chat);
+    g_array_free(chat->peers, TRUE);
+    g_free(chat->title);
+    ToxPRPL_Pools_release(chat->pools, TOXPRPL_POOL_GROUP_CHAT, chat);
+}
+
+GHashTable* ToxPRPL_GroupTable_new(void) {
+    return g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, freeGroupChat);
+}
+
+/*
+ * Add group `groupNumber` to the table, replacing any stale entry that used the same number
+ */
+ToxPRPL_GroupChat* ToxPRPL_GroupTable_add(GHashTable* table, ToxPRPL_Pools* pools, int groupNumber,
+                                          uint8_t groupType) {
+
+    ToxPRPL_GroupChat* chat = ToxPRPL_Pools_alloc(pools, TOXPRPL_POOL_GROUP_CHAT);
+    chat->pools = pools;
+    chat->groupNumber = groupNumber;
+    chat->groupType = groupType;
+    chat->peers = g_array_new(FALSE, TRUE, sizeof(ToxPRPL_GroupPeer));
+
+    g_hash_table_replace(table, GINT_TO_POINTER(groupNumber), chat);
+
+    return chat;
+}
 
-    return g_strcmp0(firstId, secondId);
+ToxPRPL_GroupChat* ToxPRPL_GroupTable_find(GHashTable* table, int groupNumber) {
+    return (ToxPRPL_GroupChat*) g_hash_table_lookup(table, GINT_TO_POINTER(groupNumber));
 }
 
-GList* ToxPRPL_Purple_findByPeerId(PurpleConvChat* chat, int peerId) {
+void ToxPRPL_GroupTable_remove(GHashTable* table, int groupNumber) {
+    g_hash_table_remove(table, GINT_TO_POINTER(groupNumber));
+}
 
-    GList* users = purple_conv_chat_get_users(chat);
+// Group Cache ------------------------------------------------------------------------------------
 
-    // Create a dummy chat buddy that has the peerId attribute we want
+void ToxPRPL_GroupChat_setTitle(ToxPRPL_GroupChat* chat, const uint8_t* title, int length) {
 
-    char* peerIdString = g_strdup_printf("%i", peerId);
+    g_free(chat->title);
+    chat->title = (length > 0) ? g_strndup((const char*) title, (gsize) length) : NULL;
+}
 
-    PurpleConvChatBuddy* idealBuddy =
-            purple_conv_chat_cb_new("nobody", "nobody", PURPLE_CBFLAGS_NONE);
-    purple_conv_chat_cb_set_attribute(NULL, idealBuddy, TOXPRPL_BUDDY_PEERID, peerIdString);
+/*
+ * Cache the name of peer `peerNumber`, growing the peer table if needed.
+ * Peers without a name get a placeholder, as purple can not handle nameless chat buddies.
+ */
+ToxPRPL_GroupPeer* ToxPRPL_GroupChat_setPeerName(ToxPRPL_GroupChat* chat, int peerNumber, const uint8_t* name,
+                                                 int length) {
 
-    g_free(peerIdString);
+    toxprpl_return_val_if_fail(peerNumber >= 0, NULL);
 
-    // Create the list of chat buddies that match
+    if ((guint) peerNumber >= chat->peers->len) {
+        // the array clears new elements, so new slots start out without name, and outside the conversation
+        g_array_set_size(chat->peers, (guint) peerNumber + 1);
+    }
 
-    GList* matchingUsers = g_list_find_custom(users, NULL, compareByPeerId);
+    ToxPRPL_GroupPeer* peer = &g_array_index(chat->peers, ToxPRPL_GroupPeer, peerNumber);
 
-    // Clean up the dummy user
+    g_free(peer->name);
+    if (length > 0) {
+        peer->name = g_strndup((const char*) name, (gsize) length);
+    } else {
+        peer->name = g_strdup_printf(_("Tox User %i"), peerNumber);
+    }
 
-    purple_conv_chat_cb_destroy(idealBuddy);
+    return peer;
+}
 
-    // Return matching users
+ToxPRPL_GroupPeer* ToxPRPL_GroupChat_getPeer(ToxPRPL_GroupChat* chat, int peerNumber) {
 
-    return matchingUsers;
-}
\ No newline at end of file
+    if (peerNumber < 0 || (guint) peerNumber >= chat->peers->len) {
+        return NULL;
+    }
+
+    ToxPRPL_GroupPeer* peer = &g_array_index(chat->peers, ToxPRPL_GroupPeer, peerNumber);
+
+    return peer->name ? peer : NULL;
+}
+
+/*
+ * Forget peer `peerNumber`.
+ * Tox fills the gap left by a departing peer with the last peer in the group,
+ * which is exactly what removing the index `fast' does.
+ */
+void ToxPRPL_GroupChat_removePeer(ToxPRPL_GroupChat* chat, int peerNumber) {
+
+    if (peerNumber < 0 || (guint) peerNumber >= chat->peers->len) {
+        return;
+    }
+
+    ToxPRPL_GroupPeer* peer = &g_array_index(chat->peers, ToxPRPL_GroupPeer, peerNumber);
+    g_free(peer->name);
+    g_free(peer->nick);
+    g_array_remove_index_fast(chat->peers, (guint) peerNumber);
+}
+
+/*
+ * Reload title and roster from Tox.
+ * This is only needed when (re)joining, callbacks keep the cache current afterwards.
+ */
+void ToxPRPL_GroupChat_refresh(ToxPRPL_GroupChat* chat, Tox* tox) {
+
+    uint8_t title[TOX_MAX_NAME_LENGTH];
+    int titleLength = tox_group_get_title(tox, chat->groupNumber, title, TOX_MAX_NAME_LENGTH);
+    ToxPRPL_GroupChat_setTitle(chat, title, titleLength);
+
+    int peerCount = tox_group_number_peers(tox, chat->groupNumber);
+    clearPeers(chat);
+
+    int peerNumber;
+    for (peerNumber = 0; peerNumber < peerCount; peerNumber++) {
+        uint8_t name[TOX_MAX_NAME_LENGTH];
+        int nameLength = tox_group_peername(tox, chat->groupNumber, peerNumber, name);
+        ToxPRPL_GroupPeer* peer = ToxPRPL_GroupChat_setPeerName(chat, peerNumber, name, nameLength);
+        peer->isOurs = tox_group_peernumber_is_ours(tox, chat->groupNumber, peerNumber) != 0;
+    }
+}
+
+/*
+ * Returns the (unique) purple conversation name used for a group.
+ * Tox groups do not have unique titles, so the title is only used for display.
+ */
+gchar* ToxPRPL_GroupChat_getConversationName(int groupNumber) {
+    return g_strdup_printf(CONVERSATION_NAME_FORMAT, groupNumber);
+}
+
+/*
+ * The reverse of ``ToxPRPL_GroupChat_getConversationName'', FALSE if `name` is not a group's conversation name
+ */
+gboolean ToxPRPL_GroupChat_parseConversationName(const char* name, int* groupNumber) {
+
+    int number;
+    char rest;
+    if (name == NULL || sscanf(name, CONVERSATION_NAME_FORMAT "%c", &number, &rest) != 1 || number < 0) {
+        return FALSE;
+    }
+
+    *groupNumber = number;
+    return TRUE;
+}
@@ -0,0 +1,182 @@
+/*
+ * Plugin metrics registry, see ``toxprpl/metrics.h''
+ */
+
+#include <toxprpl.h>
+#include <toxprpl/metrics.h>
+#include <toxprpl/ratelimit.h>
+#include <toxprpl/bootstrap.h>
+#include <toxprpl/pool.h>
+
+static const char* COUNTER_NAMES[TOXPRPL_COUNTER_COUNT] = {
+        "callback.connection_status",
+        "callback.friend_request",
+        "callback.friend_message",
+        "callback.friend_action",
+        "callback.name_change",
+        "callback.user_status",
+        "callback.status_message",
+        "callback.typing_change",
+        "callback.avatar_info",
+        "callback.avatar_data",
+        "callback.group_invite",
+        "callback.group_message",
+        "callback.group_action",
+        "callback.group_title",
+        "callback.group_namelist",
+        "callback.file_request",
+        "callback.file_control",
+        "callback.file_data",
+        "messages.in",
+        "messages.out",
+        "messages.queued",
+        "messages.send_failures",
+        "group_messages.out",
+        "xfer.bytes_in",
+        "xfer.bytes_out",
+        "presence.changes",
+        "presence.applied",
+        "presence.damped",
+        "friend_requests.dropped",
+        "avatars.unchanged",
+        "avatars.cached",
+        "avatars.transfers"
+};
+
+static const char* HISTOGRAM_NAMES[TOXPRPL_HISTOGRAM_COUNT] = {
+        "tox_do (us)",
+        "save (us)",
+        "send_queue_depth"
+};
+
+// Registry -------------------------------------------------------------------------------------------------------
+
+ToxPRPL_Metrics* ToxPRPL_Metrics_new(void) {
+    ToxPRPL_Metrics* metrics = g_new0(ToxPRPL_Metrics, 1);
+    metrics->started = g_get_monotonic_time();
+    return metrics;
+}
+
+void ToxPRPL_Metrics_free(ToxPRPL_Metrics* metrics) {
+    g_free(metrics);
+}
+
+ToxPRPL_Metrics* ToxPRPL_Metrics_get(PurpleConnection* gc) {
+    toxprpl_return_val_if_fail(gc != NULL, NULL);
+
+    ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(gc);
+    return (plugin != NULL) ? plugin->metrics : NULL;
+}
+
+void ToxPRPL_Metrics_count(ToxPRPL_Metrics* metrics, ToxPRPL_Counter counter, guint64 amount) {
+    toxprpl_return_if_fail(metrics != NULL);
+
+    metrics->counters[counter] += amount;
+}
+
+void ToxPRPL_Metrics_record(ToxPRPL_Metrics* metrics, ToxPRPL_HistogramId id, guint64 value) {
+    toxprpl_return_if_fail(metrics != NULL);
+
+    ToxPRPL_Histogram* histogram = &metrics->histograms[id];
+    guint bucket = (value == 0) ? 0 : MIN(g_bit_storage(value), TOXPRPL_HISTOGRAM_BUCKETS - 1);
+
+    histogram->buckets[bucket]++;
+    histogram->count++;
+    histogram->sum += value;
+    histogram->max = MAX(histogram->max, value);
+}
+
+// Report ---------------------------------------------------------------------------------------------------------
+
+/*
+ * Upper bound of the bucket holding the given quantile
+ */
+static guint64 getQuantile(const ToxPRPL_Histogram* histogram, gdouble quantile) {
+    guint64 rank = (guint64) (histogram->count * quantile);
+    guint64 seen = 0;
+
+    guint bucket;
+    for (bucket = 0; bucket < TOXPRPL_HISTOGRAM_BUCKETS; bucket++) {
+        seen += histogram->buckets[bucket];
+        if (seen > rank) {
+            return (bucket == 0) ? 0 : MIN((G_GUINT64_CONSTANT(1) << bucket) - 1, histogram->max);
+        }
+    }
+    return histogram->max;
+}
+
+static void formatQueueDepths(GString* report, ToxPRPL_RateLimiter* limiter) {
+    guint queued = 0;
+    guint deepest = 0;
+
+    GList* link;
+    for (link = limiter->active.head; link != NULL; link = link->next) {
+        ToxPRPL_FriendSendQueue* queue = link->data;
+        guint depth = g_queue_get_length(&queue->messages);
+        queued += depth;
+        deepest = MAX(deepest, depth);
+    }
+
+    g_string_append_printf(report, "send queues: %u friends waiting, %u messages, deepest %u\n",
+                           g_queue_get_length(&limiter->active), queued, deepest);
+}
+
+gchar* ToxPRPL_Metrics_format(PurpleConnection* gc) {
+    ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(gc);
+    toxprpl_return_val_if_fail(plugin != NULL && plugin->metrics != NULL, NULL);
+
+    ToxPRPL_Metrics* metrics = plugin->metrics;
+    GString* report = g_string_new(NULL);
+    gint64 now = g_get_monotonic_time();
+    gdouble uptime = MAX((gdouble) (now - metrics->started) / G_USEC_PER_SEC, 1.0);
+
+    g_string_append_printf(report, "uptime: %.0f s\n", uptime);
+
+    if (plugin->bootstrap != NULL) {
+        ToxPRPL_Bootstrap* bootstrap = plugin->bootstrap;
+        if (plugin->connected && (bootstrap->connected_at != 0)) {
+            g_string_append_printf(report, "DHT: connected for %" G_GINT64_FORMAT " s\n",
+                                   (now - bootstrap->connected_at) / G_USEC_PER_SEC);
+        }
+        else {
+            g_string_append_printf(report, "DHT: not connected, %u reconnect attempts\n", bootstrap->attempts);
+        }
+    }
+
+    if (plugin->rate_limiter != NULL) {
+        formatQueueDepths(report, plugin->rate_limiter);
+    }
+
+    if (plugin->groups != NULL) {
+        g_string_append_printf(report, "groups: %u\n", g_hash_table_size(plugin->groups));
+    }
+
+    if (plugin->pools != NULL) {
+        ToxPRPL_Pools_format(plugin->pools, report);
+    }
+
+    guint i;
+    for (i = 0; i < TOXPRPL_COUNTER_COUNT; i++) {
+        if (metrics->counters[i] > 0) {
+            g_string_append_printf(report, "%s: %" G_GUINT64_FORMAT "\n", COUNTER_NAMES[i], metrics->counters[i]);
+        }
+    }
+
+    g_string_append_printf(report, "xfer.rate_in: %.1f KiB/s\nxfer.rate_out: %.1f KiB/s\n",
+                           metrics->counters[TOXPRPL_COUNTER_XFER_BYTES_IN] / uptime / 1024,
+                           metrics->counters[TOXPRPL_COUNTER_XFER_BYTES_OUT] / uptime / 1024);
+
+    for (i = 0; i < TOXPRPL_HISTOGRAM_COUNT; i++) {
+        const ToxPRPL_Histogram* histogram = &metrics->histograms[i];
+        if (histogram->count == 0) {
+            continue;
+        }
+
+        g_string_append_printf(report, "%s: n=%" G_GUINT64_FORMAT " mean=%.1f p50<=%" G_GUINT64_FORMAT
+                                       " p99<=%" G_GUINT64_FORMAT " max=%" G_GUINT64_FORMAT "\n",
+                               HISTOGRAM_NAMES[i], histogram->count, (gdouble) histogram->sum / histogram->count,
+                               getQuantile(histogram, 0.5), getQuantile(histogram, 0.99), histogram->max);
+    }
+
+    return g_string_free(report, FALSE);
+}
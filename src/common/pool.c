@@ -0,0 +1,114 @@
+/*
+ * Per-connection struct pools, see ``toxprpl/pool.h''
+ */
+
+#include <toxprpl.h>
+#include <toxprpl/pool.h>
+#include <toxprpl/group_chat.h>
+#include <string.h>
+
+static const char* POOL_NAMES[TOXPRPL_POOL_COUNT] = {
+        [TOXPRPL_POOL_BUDDY_DATA]       = "buddy_data",
+        [TOXPRPL_POOL_FRIEND_ACCEPT]    = "friend_accept",
+        [TOXPRPL_POOL_GROUP_CHAT]       = "group_chat",
+};
+
+static const gsize POOL_SIZES[TOXPRPL_POOL_COUNT] = {
+        [TOXPRPL_POOL_BUDDY_DATA]       = sizeof(ToxPRPL_BuddyData),
+        [TOXPRPL_POOL_FRIEND_ACCEPT]    = sizeof(ToxPRPL_FriendAcceptData),
+        [TOXPRPL_POOL_GROUP_CHAT]       = sizeof(ToxPRPL_GroupChat),
+};
+
+static void addSlab(ToxPRPL_Pool* pool) {
+    guint8* slab = g_malloc(pool->size * TOXPRPL_POOL_SLAB_SLOTS);
+    pool->slabs = g_slist_prepend(pool->slabs, slab);
+    pool->slab_count++;
+
+    // thread the new slots on to the free list, the first slot ending up in front
+    guint i;
+    for (i = TOXPRPL_POOL_SLAB_SLOTS; i > 0; i--) {
+        gpointer slot = slab + (i - 1) * pool->size;
+        *(gpointer*) slot = pool->free_slots;
+        pool->free_slots = slot;
+    }
+}
+
+// Public API -----------------------------------------------------------------------------------------------------
+
+ToxPRPL_Pools* ToxPRPL_Pools_new(void) {
+    ToxPRPL_Pools* pools = g_new0(ToxPRPL_Pools, 1);
+
+    guint i;
+    for (i = 0; i < TOXPRPL_POOL_COUNT; i++) {
+        gsize size = MAX(POOL_SIZES[i], sizeof(gpointer));
+        pools->pools[i].size = (size + G_MEM_ALIGN - 1) / G_MEM_ALIGN * G_MEM_ALIGN;
+    }
+    return pools;
+}
+
+void ToxPRPL_Pools_free(ToxPRPL_Pools* pools) {
+    toxprpl_return_if_fail(pools != NULL);
+
+    guint i;
+    for (i = 0; i < TOXPRPL_POOL_COUNT; i++) {
+        ToxPRPL_Pool* pool = &pools->pools[i];
+#ifndef NDEBUG
+        if (pool->live > 0) {
+            toxprpl_log_warning("pool %s: %u slots still in use\n", POOL_NAMES[i], pool->live);
+        }
+#endif
+        g_slist_free_full(pool->slabs, g_free);
+    }
+    g_free(pools);
+}
+
+gpointer ToxPRPL_Pools_alloc(ToxPRPL_Pools* pools, ToxPRPL_PoolId id) {
+    toxprpl_return_val_if_fail(pools != NULL, NULL);
+
+    ToxPRPL_Pool* pool = &pools->pools[id];
+    if (pool->free_slots == NULL) {
+        addSlab(pool);
+    }
+
+    gpointer slot = pool->free_slots;
+    pool->free_slots = *(gpointer*) slot;
+    memset(slot, 0, pool->size);
+
+#ifndef NDEBUG
+    pool->live++;
+    pool->peak = MAX(pool->peak, pool->live);
+#endif
+    return slot;
+}
+
+void ToxPRPL_Pools_release(ToxPRPL_Pools* pools, ToxPRPL_PoolId id, gpointer slot) {
+    toxprpl_return_if_fail(pools != NULL);
+    toxprpl_return_if_fail(slot != NULL);
+
+    ToxPRPL_Pool* pool = &pools->pools[id];
+    *(gpointer*) slot = pool->free_slots;
+    pool->free_slots = slot;
+
+#ifndef NDEBUG
+    pool->live--;
+#endif
+}
+
+void ToxPRPL_Pools_format(ToxPRPL_Pools* pools, GString* report) {
+    toxprpl_return_if_fail(pools != NULL);
+
+    guint i;
+    for (i = 0; i < TOXPRPL_POOL_COUNT; i++) {
+        const ToxPRPL_Pool* pool = &pools->pools[i];
+        if (pool->slab_count == 0) {
+            continue;
+        }
+
+        g_string_append_printf(report, "pool.%s: %u slabs, %.1f KiB", POOL_NAMES[i], pool->slab_count,
+                               (gdouble) (pool->slab_count * TOXPRPL_POOL_SLAB_SLOTS * pool->size) / 1024);
+#ifndef NDEBUG
+        g_string_append_printf(report, ", %u in use, peak %u", pool->live, pool->peak);
+#endif
+        g_string_append_c(report, '\n');
+    }
+}
@@ -0,0 +1,237 @@
+/*
+ * Presence coalescing and flap damping, see ``toxprpl/presence.h''
+ */
+
+#include <toxprpl.h>
+#include <toxprpl/presence.h>
+#include <toxprpl/buddy_keys.h>
+#include <toxprpl/friend_table.h>
+#include <toxprpl/metrics.h>
+
+// Friend State ---------------------------------------------------------------------------------------------------
+
+static ToxPRPL_FriendPresence* getFriend(ToxPRPL_Presence* presence, int friend_number) {
+    ToxPRPL_FriendPresence* friend = g_hash_table_lookup(presence->friends, GINT_TO_POINTER(friend_number));
+    if (friend == NULL) {
+        friend = g_new0(ToxPRPL_FriendPresence, 1);
+        friend->friend_number = friend_number;
+        friend->applied = -1;
+        friend->penalty_time = g_get_monotonic_time();
+        g_hash_table_insert(presence->friends, GINT_TO_POINTER(friend_number), friend);
+    }
+    return friend;
+}
+
+/*
+ * Decay the flap penalty up to `now'.
+ * Whole half-lives halve the penalty, the remainder is interpolated linearly,
+ * which is close enough for damping and keeps libm out of the plugin.
+ */
+static void decayPenalty(ToxPRPL_FriendPresence* friend, gint64 now) {
+    gdouble halfLives = (gdouble) (now - friend->penalty_time) / (TOXPRPL_PRESENCE_HALF_LIFE * G_USEC_PER_SEC);
+    friend->penalty_time = now;
+
+    while ((halfLives >= 1.0) && (friend->penalty > 0.5)) {
+        friend->penalty /= 2;
+        halfLives -= 1.0;
+    }
+
+    if (friend->penalty <= 0.5) {
+        friend->penalty = 0;
+        return;
+    }
+
+    if (halfLives > 0) {
+        friend->penalty *= 1.0 - (halfLives / 2);
+    }
+}
+
+/*
+ * Hand the friend's net status to purple, unless purple already shows it
+ */
+static void applyFriend(ToxPRPL_Presence* presence, ToxPRPL_FriendPresence* friend) {
+    int status = ToxPRPL_FriendTable_getStatusIndex(presence->table, friend->friend_number);
+    if (status == friend->applied) {
+        return;
+    }
+
+    const char* buddy_key = ToxPRPL_BuddyKeys_forFriend(presence->keys, friend->friend_number);
+    if (buddy_key == NULL) {
+        toxprpl_log_info("Could not get id of friend #%d\n", friend->friend_number);
+        return;
+    }
+
+    toxprpl_log_misc("Setting user status for user %s to %s\n", buddy_key, ToxPRPL_ToxStatuses[status].id);
+    ToxPRPL_FriendTable_showStatus(presence->table, presence->account, buddy_key, friend->friend_number);
+
+    friend->applied = status;
+    ToxPRPL_Metrics_count(presence->metrics, TOXPRPL_COUNTER_PRESENCE_APPLIED, 1);
+}
+
+// Pending Queue --------------------------------------------------------------------------------------------------
+
+static gboolean onFlushTimer(gpointer data) {
+    ToxPRPL_Presence* presence = data;
+    ToxPRPL_Presence_flush(presence);
+
+    // suppressed friends stay queued, and are checked for reuse on every tick
+    if (g_queue_is_empty(&presence->pending)) {
+        presence->flush_timer = 0;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static void scheduleFriend(ToxPRPL_Presence* presence, ToxPRPL_FriendPresence* friend) {
+    if (friend->suppressed) {
+        ToxPRPL_Metrics_count(presence->metrics, TOXPRPL_COUNTER_PRESENCE_DAMPED, 1);
+    }
+    else if (presence->window == 0) {
+        applyFriend(presence, friend);
+        return;
+    }
+
+    if (!friend->pending) {
+        friend->pending = TRUE;
+        g_queue_push_tail(&presence->pending, friend);
+    }
+
+    if (presence->flush_timer == 0) {
+        // without a window, only suppressed friends are queued, which do not need to be checked that often
+        guint interval = (presence->window > 0) ? presence->window : 1000;
+        presence->flush_timer = purple_timeout_add(interval, onFlushTimer, presence);
+    }
+}
+
+// Public API -----------------------------------------------------------------------------------------------------
+
+ToxPRPL_Presence* ToxPRPL_Presence_new(PurpleAccount* account, ToxPRPL_FriendTable* table, ToxPRPL_BuddyKeys* keys,
+                                       ToxPRPL_Metrics* metrics) {
+    ToxPRPL_Presence* presence = g_new0(ToxPRPL_Presence, 1);
+
+    presence->account = account;
+    presence->table = table;
+    presence->keys = keys;
+    presence->metrics = metrics;
+
+    presence->window = (guint) MAX(0, purple_account_get_int(account, TOXPRPL_OPT_PRESENCE_WINDOW,
+                                                             DEFAULT_PRESENCE_WINDOW));
+    presence->damping = purple_account_get_bool(account, TOXPRPL_OPT_PRESENCE_DAMPING, DEFAULT_PRESENCE_DAMPING);
+
+    presence->friends = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+    g_queue_init(&presence->pending);
+
+    toxprpl_log_info("presence changes are applied every %u ms, flap damping %s\n",
+                     presence->window, presence->damping ? "on" : "off");
+
+    return presence;
+}
+
+void ToxPRPL_Presence_free(ToxPRPL_Presence* presence) {
+    toxprpl_return_if_fail(presence != NULL);
+
+    if (presence->flush_timer != 0) {
+        purple_timeout_remove(presence->flush_timer);
+    }
+
+    g_queue_clear(&presence->pending);
+    g_hash_table_destroy(presence->friends);
+    g_free(presence);
+}
+
+void ToxPRPL_Presence_setOnline(ToxPRPL_Presence* presence, int friend_number, gboolean online) {
+    toxprpl_return_if_fail(presence != NULL);
+
+    ToxPRPL_Metrics_count(presence->metrics, TOXPRPL_COUNTER_PRESENCE_CHANGES, 1);
+    ToxPRPL_FriendPresence* friend = getFriend(presence, friend_number);
+
+    if (ToxPRPL_FriendTable_setOnline(presence->table, friend_number, online)) {
+        if (presence->damping) {
+            decayPenalty(friend, g_get_monotonic_time());
+            friend->penalty += TOXPRPL_PRESENCE_PENALTY;
+
+            if (!friend->suppressed && (friend->penalty > TOXPRPL_PRESENCE_SUPPRESS)) {
+                toxprpl_log_info("friend %d is flapping, holding back its presence\n", friend_number);
+                friend->suppressed = TRUE;
+            }
+        }
+    }
+
+    // even without a change, Tox may have told us before purple was told
+    scheduleFriend(presence, friend);
+}
+
+void ToxPRPL_Presence_setStatus(ToxPRPL_Presence* presence, int friend_number, TOX_USERSTATUS user_status) {
+    toxprpl_return_if_fail(presence != NULL);
+
+    ToxPRPL_Metrics_count(presence->metrics, TOXPRPL_COUNTER_PRESENCE_CHANGES, 1);
+    ToxPRPL_FriendPresence* friend = getFriend(presence, friend_number);
+    ToxPRPL_FriendTable_setStatus(presence->table, friend_number, user_status);
+
+    scheduleFriend(presence, friend);
+}
+
+void ToxPRPL_Presence_setStatusMessage(ToxPRPL_Presence* presence, int friend_number, const uint8_t* message,
+                                      uint16_t length) {
+    toxprpl_return_if_fail(presence != NULL);
+
+    ToxPRPL_Metrics_count(presence->metrics, TOXPRPL_COUNTER_PRESENCE_CHANGES, 1);
+    if (!ToxPRPL_FriendTable_setStatusMessage(presence->table, friend_number, message, length)) {
+        return;
+    }
+
+    // the message goes to purple along with the status, which has to be handed over again
+    ToxPRPL_FriendPresence* friend = getFriend(presence, friend_number);
+    friend->applied = -1;
+    scheduleFriend(presence, friend);
+}
+
+void ToxPRPL_Presence_refresh(ToxPRPL_Presence* presence, int friend_number) {
+    toxprpl_return_if_fail(presence != NULL);
+
+    ToxPRPL_FriendPresence* friend = getFriend(presence, friend_number);
+    if (!friend->suppressed) {
+        applyFriend(presence, friend);
+    }
+}
+
+void ToxPRPL_Presence_flush(ToxPRPL_Presence* presence) {
+    toxprpl_return_if_fail(presence != NULL);
+
+    gint64 now = g_get_monotonic_time();
+
+    // only visit the friends queued right now, suppressed ones go back to the end
+    guint count = g_queue_get_length(&presence->pending);
+    while (count-- > 0) {
+        ToxPRPL_FriendPresence* friend = g_queue_pop_head(&presence->pending);
+        friend->pending = FALSE;
+
+        if (friend->suppressed) {
+            decayPenalty(friend, now);
+            if (friend->penalty >= TOXPRPL_PRESENCE_REUSE) {
+                friend->pending = TRUE;
+                g_queue_push_tail(&presence->pending, friend);
+                continue;
+            }
+
+            toxprpl_log_info("friend %d settled down, applying its presence\n", friend->friend_number);
+            friend->suppressed = FALSE;
+        }
+
+        applyFriend(presence, friend);
+    }
+}
+
+void ToxPRPL_Presence_forgetFriend(ToxPRPL_Presence* presence, int friend_number) {
+    toxprpl_return_if_fail(presence != NULL);
+
+    ToxPRPL_FriendPresence* friend = g_hash_table_lookup(presence->friends, GINT_TO_POINTER(friend_number));
+    if (friend == NULL) {
+        return;
+    }
+
+    if (friend->pending) {
+        g_queue_remove(&presence->pending, friend);
+    }
+    g_hash_table_remove(presence->friends, GINT_TO_POINTER(friend_number));
+}
@@ -0,0 +1,306 @@
+/*
+ * Token bucket rate limiting for outgoing instant messages
+ */
+
+#include <toxprpl.h>
+#include <toxprpl/ratelimit.h>
+#include <toxprpl/metrics.h>
+#include <errno.h>
+#include <string.h>
+
+/*
+ * Transactional data type holding a message waiting for tokens
+ */
+typedef struct _toxprpl_queued_message {
+    gchar* who;
+    gchar* message;
+    gboolean action;
+} ToxPRPL_QueuedMessage;
+
+static void freeQueuedMessage(gpointer data) {
+    ToxPRPL_QueuedMessage* queued = data;
+    g_free(queued->who);
+    g_free(queued->message);
+    g_free(queued);
+}
+
+// Token Bucket ---------------------------------------------------------------------------------------------------
+
+static void bucketInit(ToxPRPL_TokenBucket* bucket, gdouble rate, gdouble capacity) {
+    bucket->rate = rate;
+    bucket->capacity = MAX(capacity, 1.0);
+    bucket->tokens = bucket->capacity;
+    bucket->last_refill = g_get_monotonic_time();
+}
+
+static void bucketRefill(ToxPRPL_TokenBucket* bucket, gint64 now) {
+    if (bucket->rate <= 0) {
+        return;
+    }
+
+    gdouble elapsed = (gdouble) (now - bucket->last_refill) / G_USEC_PER_SEC;
+    bucket->tokens = MIN(bucket->capacity, bucket->tokens + (elapsed * bucket->rate));
+    bucket->last_refill = now;
+}
+
+static gboolean bucketHasToken(const ToxPRPL_TokenBucket* bucket) {
+    return (bucket->rate <= 0) || (bucket->tokens >= 1.0);
+}
+
+static void bucketTakeToken(ToxPRPL_TokenBucket* bucket) {
+    if (bucket->rate > 0) {
+        bucket->tokens -= 1.0;
+    }
+}
+
+// Friend Queues --------------------------------------------------------------------------------------------------
+
+static void freeFriendQueue(gpointer data) {
+    ToxPRPL_FriendSendQueue* queue = data;
+    while (!g_queue_is_empty(&queue->messages)) {
+        freeQueuedMessage(g_queue_pop_head(&queue->messages));
+    }
+    g_free(queue);
+}
+
+static ToxPRPL_FriendSendQueue* getFriendQueue(ToxPRPL_RateLimiter* limiter, int friend_number) {
+    ToxPRPL_FriendSendQueue* queue = g_hash_table_lookup(limiter->friends, GINT_TO_POINTER(friend_number));
+    if (queue == NULL) {
+        queue = g_new0(ToxPRPL_FriendSendQueue, 1);
+        queue->friend_number = friend_number;
+        bucketInit(&queue->bucket, limiter->friend_rate, limiter->burst);
+        g_queue_init(&queue->messages);
+        g_hash_table_insert(limiter->friends, GINT_TO_POINTER(friend_number), queue);
+    }
+    return queue;
+}
+
+static gboolean sendToTox(ToxPRPL_RateLimiter* limiter, int friend_number, const char* message, gboolean action) {
+    uint32_t ret;
+    if (action) {
+        ret = tox_send_action(limiter->tox, friend_number, (uint8_t*) message, strlen(message));
+    }
+    else {
+        ret = tox_send_message(limiter->tox, friend_number, (uint8_t*) message, strlen(message));
+    }
+
+    ToxPRPL_Metrics_count(limiter->metrics, (ret != 0) ? TOXPRPL_COUNTER_MESSAGES_OUT : TOXPRPL_COUNTER_SEND_FAILURES, 1);
+    return ret != 0;
+}
+
+/*
+ * Tox refuses messages both when the friend is offline, and when its own send queue is full.
+ * Only the latter is worth retrying.
+ */
+static gboolean isFriendOnline(Tox* tox, int friend_number) {
+    return tox_get_friend_connection_status(tox, friend_number) == 1;
+}
+
+/*
+ * Flush a friend's queue because the friend went offline,
+ * letting the user know that the messages were never delivered
+ */
+static void dropFriendQueue(ToxPRPL_RateLimiter* limiter, ToxPRPL_FriendSendQueue* queue) {
+    guint dropped = g_queue_get_length(&queue->messages);
+    ToxPRPL_QueuedMessage* head = g_queue_peek_head(&queue->messages);
+
+    toxprpl_log_warning("friend %d went offline, dropping %u queued messages\n",
+                        queue->friend_number, dropped);
+
+    gchar* error = g_strdup_printf(_("%u queued messages could not be delivered because the contact went offline."),
+                                   dropped);
+    purple_conv_present_error(head->who, limiter->account, error);
+    g_free(error);
+
+    while (!g_queue_is_empty(&queue->messages)) {
+        freeQueuedMessage(g_queue_pop_head(&queue->messages));
+    }
+}
+
+/*
+ * Tell the user about every message still queued when the connection closes.
+ * Purple was told these were sent, so without this they would be lost silently.
+ */
+static void reportUnsentQueues(ToxPRPL_RateLimiter* limiter) {
+    guint total = 0;
+
+    GHashTableIter iterator;
+    gpointer data;
+    g_hash_table_iter_init(&iterator, limiter->friends);
+    while (g_hash_table_iter_next(&iterator, NULL, &data)) {
+        ToxPRPL_FriendSendQueue* queue = data;
+        guint dropped = g_queue_get_length(&queue->messages);
+        if (dropped == 0) {
+            continue;
+        }
+
+        ToxPRPL_QueuedMessage* head = g_queue_peek_head(&queue->messages);
+        gchar* error = g_strdup_printf(_("%u queued messages were not sent because the connection was closed."),
+                                       dropped);
+        purple_conv_present_error(head->who, limiter->account, error);
+        g_free(error);
+
+        total += dropped;
+    }
+
+    if (total > 0) {
+        toxprpl_log_warning("connection closed, dropping %u queued messages\n", total);
+    }
+}
+
+/*
+ * Timer callback that hands queued messages to Tox as tokens become available.
+ * Friends with pending messages are visited round-robin so that a single busy
+ * friend can not starve the others of account tokens.
+ */
+static gboolean drainQueues(gpointer data) {
+    ToxPRPL_RateLimiter* limiter = data;
+    gint64 now = g_get_monotonic_time();
+    bucketRefill(&limiter->account_bucket, now);
+
+    guint visits = g_queue_get_length(&limiter->active);
+    while (visits-- > 0 && bucketHasToken(&limiter->account_bucket)) {
+        ToxPRPL_FriendSendQueue* queue = g_queue_pop_head(&limiter->active);
+        bucketRefill(&queue->bucket, now);
+
+        while (!g_queue_is_empty(&queue->messages) &&
+               bucketHasToken(&queue->bucket) &&
+               bucketHasToken(&limiter->account_bucket)) {
+            ToxPRPL_QueuedMessage* queued = g_queue_peek_head(&queue->messages);
+
+            if (sendToTox(limiter, queue->friend_number, queued->message, queued->action)) {
+                bucketTakeToken(&queue->bucket);
+                bucketTakeToken(&limiter->account_bucket);
+                freeQueuedMessage(g_queue_pop_head(&queue->messages));
+            }
+            else if (!isFriendOnline(limiter->tox, queue->friend_number)) {
+                dropFriendQueue(limiter, queue);
+            }
+            else {
+                // Tox is congested, leave the message in place and retry on the next tick
+                break;
+            }
+        }
+
+        if (g_queue_is_empty(&queue->messages)) {
+            queue->active = FALSE;
+        }
+        else {
+            g_queue_push_tail(&limiter->active, queue);
+        }
+    }
+
+    if (g_queue_is_empty(&limiter->active)) {
+        limiter->drain_timer = 0;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// Public API -----------------------------------------------------------------------------------------------------
+
+ToxPRPL_RateLimiter* ToxPRPL_RateLimiter_new(PurpleAccount* account, Tox* tox, ToxPRPL_Metrics* metrics) {
+    ToxPRPL_RateLimiter* limiter = g_new0(ToxPRPL_RateLimiter, 1);
+
+    limiter->tox = tox;
+    limiter->account = account;
+    limiter->metrics = metrics;
+
+    limiter->friend_rate = MAX(0, purple_account_get_int(account, TOXPRPL_OPT_SEND_RATE_FRIEND,
+                                                         DEFAULT_SEND_RATE_FRIEND));
+    limiter->burst = MAX(1, purple_account_get_int(account, TOXPRPL_OPT_SEND_BURST, DEFAULT_SEND_BURST));
+    limiter->queue_limit = (guint) MAX(0, purple_account_get_int(account, TOXPRPL_OPT_SEND_QUEUE_SIZE,
+                                                                 DEFAULT_SEND_QUEUE_SIZE));
+
+    gdouble account_rate = MAX(0, purple_account_get_int(account, TOXPRPL_OPT_SEND_RATE_ACCOUNT,
+                                                         DEFAULT_SEND_RATE_ACCOUNT));
+    // the account bucket may burst across several friends at once
+    bucketInit(&limiter->account_bucket, account_rate, MAX(limiter->burst, account_rate));
+
+    limiter->friends = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, freeFriendQueue);
+    g_queue_init(&limiter->active);
+
+    toxprpl_log_info("send rate limits: %.0f/s per friend, %.0f/s per account, burst %.0f, queue %u\n",
+                     limiter->friend_rate, account_rate, limiter->burst, limiter->queue_limit);
+
+    return limiter;
+}
+
+void ToxPRPL_RateLimiter_free(ToxPRPL_RateLimiter* limiter) {
+    toxprpl_return_if_fail(limiter != NULL);
+
+    if (limiter->drain_timer != 0) {
+        purple_timeout_remove(limiter->drain_timer);
+    }
+
+    reportUnsentQueues(limiter);
+
+    g_queue_clear(&limiter->active);
+    g_hash_table_destroy(limiter->friends);
+    g_free(limiter);
+}
+
+int ToxPRPL_RateLimiter_send(ToxPRPL_RateLimiter* limiter, const char* who, int friend_number, const char* message,
+                             gboolean action) {
+    gint64 now = g_get_monotonic_time();
+    ToxPRPL_FriendSendQueue* queue = getFriendQueue(limiter, friend_number);
+
+    bucketRefill(&queue->bucket, now);
+    bucketRefill(&limiter->account_bucket, now);
+
+    // Only bypass the queue when nothing is waiting, so that ordering is preserved
+    if (g_queue_is_empty(&queue->messages) &&
+        bucketHasToken(&queue->bucket) &&
+        bucketHasToken(&limiter->account_bucket)) {
+
+        if (sendToTox(limiter, friend_number, message, action)) {
+            bucketTakeToken(&queue->bucket);
+            bucketTakeToken(&limiter->account_bucket);
+            return 1;
+        }
+
+        if (!isFriendOnline(limiter->tox, friend_number)) {
+            return -999;
+        }
+        // Tox is congested, fall through and queue the message
+    }
+
+    if (g_queue_get_length(&queue->messages) >= limiter->queue_limit) {
+        toxprpl_log_warning("send queue for friend %d is full, rejecting message\n", friend_number);
+        return -EAGAIN;
+    }
+
+    ToxPRPL_QueuedMessage* queued = g_new0(ToxPRPL_QueuedMessage, 1);
+    queued->who = g_strdup(who);
+    queued->message = g_strdup(message);
+    queued->action = action;
+    g_queue_push_tail(&queue->messages, queued);
+
+    ToxPRPL_Metrics_count(limiter->metrics, TOXPRPL_COUNTER_MESSAGES_QUEUED, 1);
+    ToxPRPL_Metrics_record(limiter->metrics, TOXPRPL_HISTOGRAM_SEND_QUEUE_DEPTH, g_queue_get_length(&queue->messages));
+
+    if (!queue->active) {
+        queue->active = TRUE;
+        g_queue_push_tail(&limiter->active, queue);
+    }
+
+    if (limiter->drain_timer == 0) {
+        limiter->drain_timer = purple_timeout_add(TOXPRPL_SEND_DRAIN_INTERVAL, drainQueues, limiter);
+    }
+
+    return 1;
+}
+
+void ToxPRPL_RateLimiter_forgetFriend(ToxPRPL_RateLimiter* limiter, int friend_number) {
+    toxprpl_return_if_fail(limiter != NULL);
+
+    ToxPRPL_FriendSendQueue* queue = g_hash_table_lookup(limiter->friends, GINT_TO_POINTER(friend_number));
+    if (queue == NULL) {
+        return;
+    }
+
+    if (queue->active) {
+        g_queue_remove(&limiter->active, queue);
+    }
+    g_hash_table_remove(limiter->friends, GINT_TO_POINTER(friend_number));
+}
@@ -33,7 +33,7 @@ PurpleXfer* ToxPRPL_findXfer(PurpleConnection* gc, int friendnumber, uint8_t fil
  * Also called by ToxPRPL_Purple_sendFile when seeking to initiate a file transfer
  */
 PurpleXfer* ToxPRPL_newXfer(PurpleConnection* gc, const gchar* who) {
-    purple_debug_info("toxprpl", "new_xfer\n");
+    toxprpl_log_info("new_xfer\n");
 
     toxprpl_return_val_if_fail(gc != NULL, NULL);
     toxprpl_return_val_if_fail(who != NULL, NULL);
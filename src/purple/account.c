@@ -12,6 +12,10 @@
 #include <glib/gstdio.h>
 
 #include <toxprpl/protocol.h>
+#include <toxprpl/metrics.h>
+#include <toxprpl/friend_requests.h>
+#include <toxprpl/buddy_import.h>
+#include <toxprpl/avatars.h>
 
 // Account Overall ----------------------------------------------------------------------------
 
@@ -19,7 +23,7 @@
  * Import a Tox account from `filename` into Purple account `acct`
  */
 void ToxPRPL_importUser(PurpleAccount* acct, const char* filename) {
-    purple_debug_info("toxprpl", "import user account: %s\n", filename);
+    toxprpl_log_info("import user account: %s\n", filename);
 
     PurpleConnection* gc = purple_account_get_connection(acct);
 
@@ -91,7 +95,7 @@ void ToxPRPL_importUser(PurpleAccount* acct, const char* filename) {
  * Export a Tox account to `filename`
  */
 void ToxPRPL_exportUser(PurpleConnection* gc, const char* filename) {
-    purple_debug_info("toxprpl", "export account to %s\n", filename);
+    toxprpl_log_info("export account to %s\n", filename);
 
     ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(gc);
 
@@ -145,6 +149,7 @@ void ToxPRPL_exportUser(PurpleConnection* gc, const char* filename) {
 
 // TODO common/accounts?
 gboolean ToxPRPL_saveAccount(PurpleAccount* account, Tox* tox) {
+    gint64 started = g_get_monotonic_time();
     uint32_t msg_size = tox_size(tox);
     if (msg_size > 0) {
         guchar* msg_data = g_malloc0(msg_size);
@@ -153,6 +158,9 @@ gboolean ToxPRPL_saveAccount(PurpleAccount* account, Tox* tox) {
         purple_account_set_string(account, "messenger", msg64);
         g_free(msg64);
         g_free(msg_data);
+
+        ToxPRPL_Metrics_record(ToxPRPL_Metrics_get(purple_account_get_connection(account)), TOXPRPL_HISTOGRAM_SAVE,
+                               (guint64) (g_get_monotonic_time() - started));
         return TRUE;
     }
 
@@ -186,11 +194,11 @@ void ToxPRPL_Purple_onSetStatus(PurpleAccount* account, PurpleStatus* status) {
     PurpleConnection* gc = purple_account_get_connection(account);
     ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(gc);
 
-    purple_debug_info("toxprpl", "setting status %s\n", status_id);
+    toxprpl_log_info("setting status %s\n", status_id);
 
     TOX_USERSTATUS tox_status = ToxPRPL_getStatusTypeById(status_id);
     if (tox_status == TOX_USERSTATUS_INVALID) {
-        purple_debug_info("toxprpl", "status %s is invalid\n", status_id);
+        toxprpl_log_info("status %s is invalid\n", status_id);
         return;
     }
 
@@ -200,6 +208,25 @@ void ToxPRPL_Purple_onSetStatus(PurpleAccount* account, PurpleStatus* status) {
     }
 }
 
+// Avatar ---------------------------------
+
+/*
+ * LibPurple callback that is invoked when the account's buddy icon changes, `img' is NULL when it was removed
+ */
+void ToxPRPL_Purple_onSetBuddyIcon(PurpleConnection* gc, PurpleStoredImage* img) {
+    ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(gc);
+    if (plugin == NULL) {
+        return;
+    }
+
+    if (img == NULL) {
+        ToxPRPL_Avatars_setOwn(plugin->avatars, NULL, 0);
+    }
+    else {
+        ToxPRPL_Avatars_setOwn(plugin->avatars, purple_imgstore_get_data(img), purple_imgstore_get_size(img));
+    }
+}
+
 // Account Protocol -----------------------------------
 
 // Frontend Glue ---------------------------------
@@ -238,7 +265,7 @@ void ToxPRPL_showSitNicknameDialog(PurplePluginAction* action) {
 }
 
 void ToxPRPL_showExportDialog(PurplePluginAction* action) {
-    purple_debug_info("toxprpl", "ask to export account\n");
+    toxprpl_log_info("ask to export account\n");
 
     PurpleConnection* gc = (PurpleConnection*) action->context;
     PurpleAccount* account = purple_connection_get_account(gc);
@@ -272,9 +299,11 @@ void ToxPRPL_showExportDialog(PurplePluginAction* action) {
  * - toxprpl_acion_show_id_dialog
  * - ToxPRPL_showSitNicknameDialog
  * - ToxPRPL_showExportDialog
+ * - ToxPRPL_showFriendRequestsDialog
+ * - ToxPRPL_showImportBuddiesDialog
  */
 GList* ToxPRPL_Purple_getAccountActions(PurplePlugin* plugin, gpointer context) {
-    purple_debug_info("toxprpl", "setting up account actions\n");
+    toxprpl_log_info("setting up account actions\n");
 
     GList* actions = NULL;
     PurplePluginAction* action;
@@ -290,5 +319,13 @@ GList* ToxPRPL_Purple_getAccountActions(PurplePlugin* plugin, gpointer context)
     action = purple_plugin_action_new(_("Export account data..."),
                                       ToxPRPL_showExportDialog);
     actions = g_list_append(actions, action);
+
+    action = purple_plugin_action_new(_("Pending friend requests..."),
+                                      ToxPRPL_showFriendRequestsDialog);
+    actions = g_list_append(actions, action);
+
+    action = purple_plugin_action_new(_("Import buddies..."),
+                                      ToxPRPL_showImportBuddiesDialog);
+    actions = g_list_append(actions, action);
     return actions;
 }
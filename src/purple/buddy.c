@@ -1,15 +1,57 @@
 #include <toxprpl.h>
 #include <toxprpl/account.h>
+#include <toxprpl/ratelimit.h>
+#include <toxprpl/presence.h>
+#include <toxprpl/buddy_keys.h>
+#include <toxprpl/friend_table.h>
+#include <toxprpl/pool.h>
+#include <toxprpl/buddy.h>
+#include <toxprpl/avatars.h>
 #include <string.h>
 
+/*
+ * Describe an error returned by tox_add_friend()
+ */
+const char* ToxPRPL_getAddFriendError(int ret) {
+    switch (ret) {
+        case TOX_FAERR_TOOLONG:
+            return "Message too long";
+        case TOX_FAERR_NOMESSAGE:
+            return "Missing request message";
+        case TOX_FAERR_OWNKEY:
+            return "You're trying to add yourself as a friend";
+        case TOX_FAERR_ALREADYSENT:
+            return "Friend request already sent";
+        case TOX_FAERR_BADCHECKSUM:
+            return "Can't add friend: bad checksum in ID";
+        case TOX_FAERR_SETNEWNOSPAM:
+            return "Can't add friend: wrong nospam ID";
+        case TOX_FAERR_NOMEM:
+            return "Could not allocate memory for friendlist";
+        case TOX_FAERR_UNKNOWN:
+            return "Error adding friend";
+        default:
+            return "No Error";
+    }
+}
+
 /*
  * LibPurple friend add callback.
  */
 int ToxPRPL_Purple_addFriend(Tox* tox, PurpleConnection* gc, const char* buddy_key, gboolean sendrequest,
                              const char* message) {
-    unsigned char* bin_key = ToxPRPL_hexStringToBin(buddy_key);
+    uint8_t bin_key[TOX_FRIEND_ADDRESS_SIZE];
     int ret;
 
+    // a full address when sending a request, the key alone is enough otherwise
+    size_t key_length = MIN(strlen(buddy_key), sizeof(bin_key) * 2);
+    if ((key_length < TOX_CLIENT_ID_SIZE * 2)
+        || (sendrequest && (key_length != TOX_FRIEND_ADDRESS_SIZE * 2))
+        || !ToxPRPL_hexToBin(buddy_key, key_length, bin_key, sizeof(bin_key))) {
+        purple_notify_error(gc, _("Error"), _("Invalid Tox ID given"), NULL);
+        return TOX_FAERR_UNKNOWN;
+    }
+
     if (sendrequest == TRUE) {
         if ((message == NULL) || (strlen(message) == 0)) {
             message = DEFAULT_REQUEST_MESSAGE;
@@ -21,42 +63,13 @@ int ToxPRPL_Purple_addFriend(Tox* tox, PurpleConnection* gc, const char* buddy_k
         ret = tox_add_friend_norequest(tox, bin_key);
     }
 
-    g_free(bin_key);
-    const char* msg;
-    switch (ret) {
-        case TOX_FAERR_TOOLONG:
-            msg = "Message too long";
-            break;
-        case TOX_FAERR_NOMESSAGE:
-            msg = "Missing request message";
-            break;
-        case TOX_FAERR_OWNKEY:
-            msg = "You're trying to add yourself as a friend";
-            break;
-        case TOX_FAERR_ALREADYSENT:
-            msg = "Friend request already sent";
-            break;
-        case TOX_FAERR_BADCHECKSUM:
-            msg = "Can't add friend: bad checksum in ID";
-            break;
-        case TOX_FAERR_SETNEWNOSPAM:
-            msg = "Can't add friend: wrong nospam ID";
-            break;
-        case TOX_FAERR_NOMEM:
-            msg = "Could not allocate memory for friendlist";
-            break;
-        case TOX_FAERR_UNKNOWN:
-            msg = "Error adding friend";
-            break;
-        default:
-            msg = "No Error";
-            break;
-    }
-
     if (ret < 0) {
-        purple_notify_error(gc, _("Error"), msg, NULL);
+        purple_notify_error(gc, _("Error"), ToxPRPL_getAddFriendError(ret), NULL);
     } else {
-        purple_debug_info("toxprpl", "Friend %s added as %d\n", buddy_key, ret);
+        toxprpl_log_info("Friend %s added as %d\n", buddy_key, ret);
+
+        ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(gc);
+        ToxPRPL_FriendTable_load(plugin->friends, ret);
 
         // save account so buddy is not lost in case pidgin does not exit
         // cleanly
@@ -67,49 +80,168 @@ int ToxPRPL_Purple_addFriend(Tox* tox, PurpleConnection* gc, const char* buddy_k
     return ret;
 }
 
+ToxPRPL_BuddyData* ToxPRPL_Purple_setBuddyData(ToxPRPL_Pools* pools, PurpleBuddy* buddy, int friend_number) {
+    ToxPRPL_BuddyData* buddy_data = purple_buddy_get_protocol_data(buddy);
+    if (buddy_data == NULL) {
+        buddy_data = ToxPRPL_Pools_alloc(pools, TOXPRPL_POOL_BUDDY_DATA);
+        purple_buddy_set_protocol_data(buddy, buddy_data);
+    }
+    buddy_data->tox_friendlist_number = friend_number;
+    return buddy_data;
+}
+
+void ToxPRPL_Purple_clearBuddyData(ToxPRPL_Pools* pools, PurpleAccount* account) {
+    GSList* buddies = purple_find_buddies(account, NULL);
+    GSList* link;
+    for (link = buddies; link != NULL; link = link->next) {
+        ToxPRPL_BuddyData* buddy_data = purple_buddy_get_protocol_data(link->data);
+        if (buddy_data != NULL) {
+            ToxPRPL_Pools_release(pools, TOXPRPL_POOL_BUDDY_DATA, buddy_data);
+            purple_buddy_set_protocol_data(link->data, NULL);
+        }
+    }
+    g_slist_free(buddies);
+}
+
+/*
+ * Freshen a buddy's status and alias from the friend table
+ */
+static void refreshBuddy(ToxPRPL_PluginData* plugin, PurpleBuddy* buddy, int friend_number) {
+    ToxPRPL_Presence_refresh(plugin->presence, friend_number);
+
+    const char* alias = ToxPRPL_FriendTable_getName(plugin->friends, friend_number);
+    // every alias change is a buddy list update, skip the ones that change nothing
+    if ((alias != NULL) && (g_strcmp0(buddy->alias, alias) != 0)) {
+        purple_blist_alias_buddy(buddy, alias);
+    }
+}
+
 /*
  * Retrieve the current status of the given buddy
- * This is called by ``ToxPRPL_Purple_addBuddy'' and ``ToxPRPL_updateClientStatus''
+ * This is called by ``ToxPRPL_Purple_addBuddy''
  */
 void ToxPRPL_Purple_getBuddyInfo(gpointer data, gpointer user_data) {
-    purple_debug_info("toxprpl", "ToxPRPL_Purple_getBuddyInfo\n");
+    toxprpl_log_info("ToxPRPL_Purple_getBuddyInfo\n");
     PurpleBuddy* buddy = (PurpleBuddy*) data;
     PurpleConnection* gc = (PurpleConnection*) user_data;
     ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(gc);
 
     ToxPRPL_BuddyData* buddy_data = purple_buddy_get_protocol_data(buddy);
     if (buddy_data == NULL) {
-        unsigned char* bin_key = ToxPRPL_hexStringToBin(buddy->name);
-        int fnum = tox_get_friend_number(plugin->tox, bin_key);
-        buddy_data = g_new0(ToxPRPL_BuddyData, 1);
-        buddy_data->tox_friendlist_number = fnum;
-        purple_buddy_set_protocol_data(buddy, buddy_data);
-        g_free(bin_key);
+        uint8_t bin_key[TOX_CLIENT_ID_SIZE];
+        int fnum = -1;
+        if ((strlen(buddy->name) >= TOX_CLIENT_ID_SIZE * 2)
+            && ToxPRPL_hexToBin(buddy->name, TOX_CLIENT_ID_SIZE * 2, bin_key, sizeof(bin_key))) {
+            fnum = tox_get_friend_number(plugin->tox, bin_key);
+        }
+        buddy_data = ToxPRPL_Purple_setBuddyData(plugin->pools, buddy, fnum);
     }
 
-    int statusIndex = ToxPRPL_getStatusTypeIndex(plugin->tox, buddy_data->tox_friendlist_number,
-                                                 tox_get_user_status(plugin->tox, buddy_data->tox_friendlist_number));
+    refreshBuddy(plugin, buddy, buddy_data->tox_friendlist_number);
+}
 
-    PurpleAccount* account = purple_connection_get_account(gc);
-    purple_debug_info("toxprpl", "Setting user status for user %s to %s\n",
-                      buddy->name, ToxPRPL_ToxStatuses[statusIndex].id);
-    purple_prpl_got_user_status(account, buddy->name, ToxPRPL_ToxStatuses[statusIndex].id, NULL);
+// Buddy Refresh --------------------------------------------------------------------------------------------------
+
+/*
+ * The refresh walks the friend table rather than the buddy list: friend numbers are its indices,
+ * and the buddy is a single hash lookup away, where going from a buddy to its friend number means
+ * decoding the key and a linear search in Tox.
+ */
+
+static void freeBuddyRefresh(ToxPRPL_BuddyRefresh* refresh) {
+    ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(refresh->gc);
+    if (plugin != NULL) {
+        plugin->buddy_refresh = NULL;
+    }
 
-    uint8_t alias[TOX_MAX_NAME_LENGTH + 1];
-    if (tox_get_name(plugin->tox, buddy_data->tox_friendlist_number, alias) == 0) {
-        alias[TOX_MAX_NAME_LENGTH] = '\0';
-        purple_blist_alias_buddy(buddy, (const char*) alias);
+    if (refresh->timer != 0) {
+        purple_timeout_remove(refresh->timer);
+    }
+    g_free(refresh);
+}
+
+static gboolean onRefreshChunk(gpointer data) {
+    ToxPRPL_BuddyRefresh* refresh = data;
+    ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(refresh->gc);
+    PurpleAccount* account = purple_connection_get_account(refresh->gc);
+
+    // the table only shrinks from the end, friends added since the refresh started are up to date already
+    guint end = MIN(refresh->next + TOXPRPL_BUDDY_REFRESH_CHUNK, MIN(refresh->count, plugin->friends->size));
+    for (; refresh->next < end; refresh->next++) {
+        int friend_number = (int) refresh->next;
+        if (!plugin->friends->used[friend_number]) {
+            continue;
+        }
+
+        const char* buddy_key = ToxPRPL_BuddyKeys_forFriend(plugin->buddy_keys, friend_number);
+        if (buddy_key == NULL) {
+            // removed since the refresh started
+            continue;
+        }
+
+        PurpleBuddy* buddy = purple_find_buddy(account, buddy_key);
+
+        if (buddy == NULL) {
+            continue;
+        }
+
+        ToxPRPL_Purple_setBuddyData(plugin->pools, buddy, friend_number);
+
+        refreshBuddy(plugin, buddy, friend_number);
+    }
+
+    if (refresh->next < MIN(refresh->count, plugin->friends->size)) {
+        return TRUE;
+    }
+
+    toxprpl_log_info("refreshed %u buddies\n", plugin->friends->count);
+    refresh->timer = 0;
+    freeBuddyRefresh(refresh);
+    return FALSE;
+}
+
+void ToxPRPL_Purple_refreshBuddies(PurpleConnection* gc) {
+    ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(gc);
+    toxprpl_return_if_fail(plugin != NULL);
+
+    ToxPRPL_Purple_cancelBuddyRefresh(gc);
+
+    ToxPRPL_BuddyRefresh* refresh = g_new0(ToxPRPL_BuddyRefresh, 1);
+    refresh->gc = gc;
+    refresh->count = plugin->friends->size;
+
+    toxprpl_log_info("refreshing %u buddies, %u friend numbers at a time\n", plugin->friends->count,
+                     TOXPRPL_BUDDY_REFRESH_CHUNK);
+
+    // the first chunk right away, the rest once the main loop has had a go
+    plugin->buddy_refresh = refresh;
+    if (onRefreshChunk(refresh)) {
+        refresh->timer = purple_timeout_add(0, onRefreshChunk, refresh);
+    }
+}
+
+void ToxPRPL_Purple_cancelBuddyRefresh(PurpleConnection* gc) {
+    ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(gc);
+    toxprpl_return_if_fail(plugin != NULL);
+
+    if (plugin->buddy_refresh != NULL) {
+        freeBuddyRefresh(plugin->buddy_refresh);
     }
 }
 
 void ToxPRPL_Purple_removeBuddy(PurpleConnection* gc, PurpleBuddy* buddy, PurpleGroup* group) {
-    purple_debug_info("toxprpl", "removing buddy %s\n", buddy->name);
+    toxprpl_log_info("removing buddy %s\n", buddy->name);
     ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(gc);
     ToxPRPL_BuddyData* buddy_data = purple_buddy_get_protocol_data(buddy);
     if (buddy_data != NULL) {
-        purple_debug_info("toxprpl", "removing tox friend #%d\n",
-                          buddy_data->tox_friendlist_number);
+        toxprpl_log_info("removing tox friend #%d\n",
+                         buddy_data->tox_friendlist_number);
+        ToxPRPL_BuddyKeys_forgetFriend(plugin->buddy_keys, buddy_data->tox_friendlist_number);
         tox_del_friend(plugin->tox, buddy_data->tox_friendlist_number);
+        ToxPRPL_FriendTable_remove(plugin->friends, buddy_data->tox_friendlist_number);
+        ToxPRPL_RateLimiter_forgetFriend(plugin->rate_limiter, buddy_data->tox_friendlist_number);
+        ToxPRPL_Presence_forgetFriend(plugin->presence, buddy_data->tox_friendlist_number);
+        ToxPRPL_Avatars_forgetFriend(plugin->avatars, buddy_data->tox_friendlist_number);
 
         // save account to make sure buddy stays deleted in case pidgin does
         // not exit cleanly
@@ -119,7 +251,7 @@ void ToxPRPL_Purple_removeBuddy(PurpleConnection* gc, PurpleBuddy* buddy, Purple
 }
 
 void ToxPRPL_Purple_addBuddy(PurpleConnection* gc, PurpleBuddy* buddy, PurpleGroup* group, const char* msg) {
-    purple_debug_info("toxprpl", "adding %s to buddy list\n", buddy->name);
+    toxprpl_log_info("adding %s to buddy list\n", buddy->name);
 
     buddy->name = g_strstrip(buddy->name);
     if (strlen(buddy->name) != (TOX_FRIEND_ADDRESS_SIZE * 2)) {
@@ -132,8 +264,8 @@ void ToxPRPL_Purple_addBuddy(PurpleConnection* gc, PurpleBuddy* buddy, PurpleGro
     ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(gc);
     int ret = ToxPRPL_Purple_addFriend(plugin->tox, gc, buddy->name, TRUE, msg);
     if (ret < 0) {
-        purple_debug_info("toxprpl", "adding buddy %s failed (%d)\n",
-                          buddy->name, ret);
+        toxprpl_log_info("adding buddy %s failed (%d)\n",
+                         buddy->name, ret);
         purple_blist_remove_buddy(buddy);
         return;
     }
@@ -144,16 +276,82 @@ void ToxPRPL_Purple_addBuddy(PurpleConnection* gc, PurpleBuddy* buddy, PurpleGro
 
     gchar* cut = g_ascii_strdown(buddy->name, TOX_CLIENT_ID_SIZE * 2 + 1);
     cut[TOX_CLIENT_ID_SIZE * 2] = '\0';
-    purple_debug_info("toxprpl", "converted %s to %s\n", buddy->name, cut);
+    toxprpl_log_info("converted %s to %s\n", buddy->name, cut);
     purple_blist_rename_buddy(buddy, cut);
     g_free(cut);
     // buddy data will be added by the query_buddy_info function
     ToxPRPL_Purple_getBuddyInfo((gpointer) buddy, (gpointer) gc);
 }
 
+// Buddy Details --------------------------------------------------------------------------------------------------
+
+/*
+ * The friend table and friend number of a buddy, FALSE while the account is not connected
+ */
+static gboolean getFriend(PurpleBuddy* buddy, ToxPRPL_FriendTable** friends, int* friend_number) {
+    PurpleConnection* gc = purple_account_get_connection(buddy->account);
+    ToxPRPL_PluginData* plugin = (gc != NULL) ? purple_connection_get_protocol_data(gc) : NULL;
+    ToxPRPL_BuddyData* buddy_data = purple_buddy_get_protocol_data(buddy);
+    if ((plugin == NULL) || (plugin->friends == NULL) || (buddy_data == NULL)) {
+        return FALSE;
+    }
+
+    *friends = plugin->friends;
+    *friend_number = buddy_data->tox_friendlist_number;
+    return ToxPRPL_FriendTable_has(*friends, *friend_number);
+}
+
+/*
+ * LibPurple status text callback, shown below the buddy's name
+ */
+char* ToxPRPL_Purple_getStatusText(PurpleBuddy* buddy) {
+    ToxPRPL_FriendTable* friends;
+    int friend_number;
+    if (!getFriend(buddy, &friends, &friend_number)) {
+        return NULL;
+    }
+
+    const char* message = ToxPRPL_FriendTable_getStatusMessage(friends, friend_number);
+    return (message != NULL) ? g_markup_escape_text(message, -1) : NULL;
+}
+
+/*
+ * LibPurple tooltip callback, everything here comes from the friend table
+ */
+void ToxPRPL_Purple_getTooltipText(PurpleBuddy* buddy, PurpleNotifyUserInfo* user_info, gboolean full) {
+    ToxPRPL_FriendTable* friends;
+    int friend_number;
+    if (!getFriend(buddy, &friends, &friend_number)) {
+        return;
+    }
+
+    const char* name = ToxPRPL_FriendTable_getName(friends, friend_number);
+    if (name != NULL) {
+        gchar* escaped = g_markup_escape_text(name, -1);
+        purple_notify_user_info_add_pair(user_info, _("Nickname"), escaped);
+        g_free(escaped);
+    }
+
+    const char* message = ToxPRPL_FriendTable_getStatusMessage(friends, friend_number);
+    if (message != NULL) {
+        gchar* escaped = g_markup_escape_text(message, -1);
+        purple_notify_user_info_add_pair(user_info, _("Status message"), escaped);
+        g_free(escaped);
+    }
+
+    gint64 last_seen = friends->last_seen[friend_number];
+    gint64 now = (gint64) time(NULL);
+    if (full && !friends->online[friend_number] && (last_seen > 0) && (now > last_seen)) {
+        gchar* ago = purple_str_seconds_to_string((guint) MIN(now - last_seen, G_MAXUINT));
+        gchar* text = g_strdup_printf(_("%s ago"), ago);
+        purple_notify_user_info_add_pair(user_info, _("Last seen"), text);
+        g_free(text);
+        g_free(ago);
+    }
+}
+
 /*
- * TODO Buddy icons
- * Implementation for buddy icons should just return the name of  the buddy in terms of tox
+ * Protocol icon; the buddies' own icons are their avatars, see ``toxprpl/avatars.h''
  */
 const char* ToxPRPL_Purple_getListIconForUser(PurpleAccount* acct, PurpleBuddy* buddy) {
     return "tox";
@@ -0,0 +1,316 @@
+/*
+ * Bulk buddy import, see ``toxprpl/buddy_import.h''
+ */
+
+#include <toxprpl.h>
+#include <toxprpl/account.h>
+#include <toxprpl/buddy.h>
+#include <toxprpl/buddy_import.h>
+#include <toxprpl/friend_table.h>
+#include <toxprpl/pool.h>
+#include <string.h>
+
+typedef struct {
+
+    guint line;
+
+    /*
+     * Lower case public key, as used for buddy names
+     */
+    gchar* buddy_key;
+
+    /*
+     * Full address when a request is to be sent, only the public key otherwise
+     */
+    uint8_t address[TOX_FRIEND_ADDRESS_SIZE];
+    gboolean send_request;
+
+    gchar* alias;
+    gchar* group;
+
+    int friend_number;
+
+} ToxPRPL_BuddyImportEntry;
+
+typedef struct {
+
+    GPtrArray* entries;
+
+    guint skipped;
+    guint failed;
+    GString* errors;
+
+} ToxPRPL_BuddyImport;
+
+static void freeEntry(gpointer data) {
+    ToxPRPL_BuddyImportEntry* entry = data;
+    g_free(entry->buddy_key);
+    g_free(entry->alias);
+    g_free(entry->group);
+    g_free(entry);
+}
+
+static void rejectLine(ToxPRPL_BuddyImport* import, guint line, const char* reason) {
+    if (import->failed < TOXPRPL_BUDDY_IMPORT_MAX_ERRORS) {
+        g_string_append_printf(import->errors, _("line %u: %s\n"), line, reason);
+    }
+    import->failed++;
+}
+
+// Validation -----------------------------------------------------------------------------------------------------
+
+/*
+ * Whether the last two bytes of a Tox address are the checksum over the rest
+ */
+static gboolean isAddressChecksumValid(const uint8_t* address) {
+    uint8_t checksum[2] = {0, 0};
+    guint i;
+    for (i = 0; i < TOX_FRIEND_ADDRESS_SIZE - sizeof(checksum); i++) {
+        checksum[i % 2] ^= address[i];
+    }
+    return memcmp(checksum, address + TOX_FRIEND_ADDRESS_SIZE - sizeof(checksum), sizeof(checksum)) == 0;
+}
+
+/*
+ * Parse and check one line, returns NULL for rejected or empty lines
+ */
+static ToxPRPL_BuddyImportEntry* parseLine(ToxPRPL_BuddyImport* import, guint line, gchar* text,
+                                           const uint8_t* own_key) {
+    g_strstrip(text);
+    if ((*text == '\0') || (*text == '#')) {
+        return NULL;
+    }
+
+    gchar** fields = g_strsplit(text, "\t", 3);
+    gchar* id = g_strstrip(fields[0]);
+    size_t length = strlen(id);
+
+    gboolean send_request;
+    if (length == TOX_FRIEND_ADDRESS_SIZE * 2) {
+        send_request = TRUE;
+    }
+    else if (length == TOX_CLIENT_ID_SIZE * 2) {
+        send_request = FALSE;
+    }
+    else {
+        rejectLine(import, line, _("not a Tox ID (must be 76 or 64 characters long)"));
+        g_strfreev(fields);
+        return NULL;
+    }
+
+    ToxPRPL_BuddyImportEntry* entry = g_new0(ToxPRPL_BuddyImportEntry, 1);
+    entry->line = line;
+    entry->send_request = send_request;
+
+    if (!ToxPRPL_hexToBin(id, length, entry->address, sizeof(entry->address))) {
+        rejectLine(import, line, _("not a Tox ID (invalid characters)"));
+        freeEntry(entry);
+        g_strfreev(fields);
+        return NULL;
+    }
+
+    if (send_request && !isAddressChecksumValid(entry->address)) {
+        rejectLine(import, line, ToxPRPL_getAddFriendError(TOX_FAERR_BADCHECKSUM));
+        freeEntry(entry);
+        g_strfreev(fields);
+        return NULL;
+    }
+
+    if (memcmp(entry->address, own_key, TOX_CLIENT_ID_SIZE) == 0) {
+        rejectLine(import, line, ToxPRPL_getAddFriendError(TOX_FAERR_OWNKEY));
+        freeEntry(entry);
+        g_strfreev(fields);
+        return NULL;
+    }
+
+    entry->buddy_key = g_ascii_strdown(id, TOX_CLIENT_ID_SIZE * 2);
+
+    if ((fields[1] != NULL) && (*g_strstrip(fields[1]) != '\0')) {
+        entry->alias = g_strdup(fields[1]);
+    }
+    if ((fields[1] != NULL) && (fields[2] != NULL) && (*g_strstrip(fields[2]) != '\0')) {
+        entry->group = g_strdup(fields[2]);
+    }
+
+    g_strfreev(fields);
+    return entry;
+}
+
+/*
+ * Check every line of the file before anything is added
+ */
+static void parseFile(ToxPRPL_BuddyImport* import, PurpleConnection* gc, gchar* contents) {
+    ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(gc);
+    PurpleAccount* account = purple_connection_get_account(gc);
+
+    uint8_t own_address[TOX_FRIEND_ADDRESS_SIZE];
+    tox_get_address(plugin->tox, own_address);
+
+    // keys seen earlier in the file, the first line wins
+    GHashTable* seen = g_hash_table_new(g_str_hash, g_str_equal);
+
+    gchar** lines = g_strsplit(contents, "\n", -1);
+    guint i;
+    for (i = 0; lines[i] != NULL; i++) {
+        ToxPRPL_BuddyImportEntry* entry = parseLine(import, i + 1, lines[i], own_address);
+        if (entry == NULL) {
+            continue;
+        }
+
+        if ((g_hash_table_lookup(seen, entry->buddy_key) != NULL)
+            || (purple_find_buddy(account, entry->buddy_key) != NULL)) {
+            import->skipped++;
+            freeEntry(entry);
+            continue;
+        }
+
+        g_hash_table_insert(seen, entry->buddy_key, entry);
+        g_ptr_array_add(import->entries, entry);
+    }
+
+    g_strfreev(lines);
+    g_hash_table_destroy(seen);
+}
+
+// Import ---------------------------------------------------------------------------------------------------------
+
+static void addFriends(ToxPRPL_BuddyImport* import, Tox* tox, ToxPRPL_FriendTable* friends) {
+    const char* message = DEFAULT_REQUEST_MESSAGE;
+    guint i;
+    for (i = 0; i < import->entries->len; i++) {
+        ToxPRPL_BuddyImportEntry* entry = g_ptr_array_index(import->entries, i);
+        if (entry->send_request) {
+            entry->friend_number = tox_add_friend(tox, entry->address, (const uint8_t*) message,
+                                                  (uint16_t) (strlen(message) + 1));
+        }
+        else {
+            entry->friend_number = tox_add_friend_norequest(tox, entry->address);
+        }
+
+        if (entry->friend_number < 0) {
+            rejectLine(import, entry->line, ToxPRPL_getAddFriendError(entry->friend_number));
+        }
+        else {
+            ToxPRPL_FriendTable_load(friends, entry->friend_number);
+        }
+    }
+}
+
+static PurpleGroup* getGroup(GHashTable* groups, const char* name) {
+    PurpleGroup* group = g_hash_table_lookup(groups, name);
+    if (group == NULL) {
+        group = purple_find_group(name);
+        if (group == NULL) {
+            group = purple_group_new(name);
+            purple_blist_add_group(group, NULL);
+        }
+        g_hash_table_insert(groups, (gpointer) name, group);
+    }
+    return group;
+}
+
+static guint addBuddies(ToxPRPL_BuddyImport* import, PurpleAccount* account, ToxPRPL_Pools* pools) {
+    // group name -> PurpleGroup, so that each group is looked up once
+    GHashTable* groups = g_hash_table_new(g_str_hash, g_str_equal);
+    guint added = 0;
+
+    guint i;
+    for (i = 0; i < import->entries->len; i++) {
+        ToxPRPL_BuddyImportEntry* entry = g_ptr_array_index(import->entries, i);
+        if (entry->friend_number < 0) {
+            continue;
+        }
+
+        PurpleBuddy* buddy = purple_buddy_new(account, entry->buddy_key, entry->alias);
+        ToxPRPL_Purple_setBuddyData(pools, buddy, entry->friend_number);
+
+        PurpleGroup* group = (entry->group != NULL) ? getGroup(groups, entry->group) : NULL;
+        purple_blist_add_buddy(buddy, NULL, group, NULL);
+        added++;
+    }
+
+    g_hash_table_destroy(groups);
+    return added;
+}
+
+void ToxPRPL_Purple_importBuddies(PurpleConnection* gc, const char* filename) {
+    ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(gc);
+    if ((plugin == NULL) || (plugin->tox == NULL)) {
+        return;
+    }
+
+    toxprpl_log_info("importing buddies from %s\n", filename);
+
+    PurpleAccount* account = purple_connection_get_account(gc);
+
+    gchar* contents;
+    gsize size;
+    GError* error = NULL;
+    if (!g_file_get_contents(filename, &contents, &size, &error)) {
+        purple_notify_error(gc, _("Error"), _("Could not read buddy list file:"), error->message);
+        g_error_free(error);
+        return;
+    }
+
+    if (size > TOXPRPL_BUDDY_IMPORT_MAX_SIZE) {
+        purple_notify_error(gc, _("Error"), _("Buddy list file is too large"), filename);
+        g_free(contents);
+        return;
+    }
+
+    ToxPRPL_BuddyImport import;
+    import.entries = g_ptr_array_new_with_free_func(freeEntry);
+    import.skipped = 0;
+    import.failed = 0;
+    import.errors = g_string_new(NULL);
+
+    gint64 started = g_get_monotonic_time();
+    parseFile(&import, gc, contents);
+    g_free(contents);
+
+    addFriends(&import, plugin->tox, plugin->friends);
+    guint added = addBuddies(&import, account, plugin->pools);
+
+    // a single save for the whole import, rather than one per friend
+    if (added > 0) {
+        ToxPRPL_saveAccount(account, plugin->tox);
+    }
+
+    toxprpl_log_info("imported %u buddies in %" G_GINT64_FORMAT " ms, %u skipped, %u failed\n",
+                     added, (g_get_monotonic_time() - started) / 1000, import.skipped, import.failed);
+
+    gchar* primary = g_strdup_printf(_("Added %u buddies, skipped %u already on the list, %u failed."),
+                                     added, import.skipped, import.failed);
+    if (import.failed > TOXPRPL_BUDDY_IMPORT_MAX_ERRORS) {
+        g_string_append_printf(import.errors, _("and %u more\n"), import.failed - TOXPRPL_BUDDY_IMPORT_MAX_ERRORS);
+    }
+
+    purple_notify_message(gc,
+                          (import.failed > 0) ? PURPLE_NOTIFY_MSG_WARNING : PURPLE_NOTIFY_MSG_INFO,
+                          _("Import buddies"),
+                          primary,
+                          (import.failed > 0) ? import.errors->str : NULL,
+                          NULL, NULL);
+
+    g_free(primary);
+    g_string_free(import.errors, TRUE);
+    g_ptr_array_free(import.entries, TRUE);
+}
+
+void ToxPRPL_showImportBuddiesDialog(PurplePluginAction* action) {
+    toxprpl_log_info("ask to import buddies\n");
+
+    PurpleConnection* gc = (PurpleConnection*) action->context;
+    PurpleAccount* account = purple_connection_get_account(gc);
+
+    purple_request_file(gc,
+                        _("Import buddies from a list of Tox IDs"),
+                        NULL,
+                        FALSE,
+                        G_CALLBACK(ToxPRPL_Purple_importBuddies),
+                        NULL,
+                        account,
+                        NULL,
+                        NULL,
+                        gc);
+}
@@ -5,6 +5,7 @@
  */
 
 #include <toxprpl.h>
+#include <toxprpl/ratelimit.h>
 #include <string.h>
 
 /**
@@ -15,42 +16,39 @@
 * some other negative value.  You can use one of the valid
 * errno values, or just big something.  If the message should
 * not be echoed to the conversation window, return 0.
+*
+* Messages are subject to the connection's rate limiter, see
+* ``common/ratelimit.c''. When the friend's send queue is full,
+* -EAGAIN is returned so that the caller can back off.
 */
 int ToxPRPL_Purple_sendUserMessage(PurpleConnection* gc, const char* who, const char* message,
                                    PurpleMessageFlags flags) {
     const char* from_username = gc->account->username;
 
-    purple_debug_info("toxprpl", "sending message from %s to %s\n",
-                      from_username, who);
+    toxprpl_log_misc("sending message from %s to %s\n",
+                     from_username, who);
 
     int message_sent = -999;
 
     PurpleAccount* account = purple_connection_get_account(gc);
     PurpleBuddy* buddy = purple_find_buddy(account, who);
     if (buddy == NULL) {
-        purple_debug_info("toxprpl", "Can't send message because buddy %s was not found\n", who);
+        toxprpl_log_info("Can't send message because buddy %s was not found\n", who);
         return message_sent;
     }
     ToxPRPL_BuddyData* buddy_data = purple_buddy_get_protocol_data(buddy);
     if (buddy_data == NULL) {
-        purple_debug_info("toxprpl", "Can't send message because tox friend number is unknown\n");
+        toxprpl_log_info("Can't send message because tox friend number is unknown\n");
         return message_sent;
     }
     ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(gc);
     char* no_html = purple_markup_strip_html(message);
 
-    if (purple_message_meify(no_html, -1)) {
-        if (tox_send_action(plugin->tox, buddy_data->tox_friendlist_number,
-                            (uint8_t*) no_html, strlen(no_html)) != 0) {
-            message_sent = 1;
-        }
-    }
-    else {
-        if (tox_send_message(plugin->tox, buddy_data->tox_friendlist_number,
-                             (uint8_t*) no_html, strlen(no_html)) != 0) {
-            message_sent = 1;
-        }
-    }
+    // the rate limiter either sends right away, or queues the message until tokens are available
+    gboolean action = purple_message_meify(no_html, -1);
+    message_sent = ToxPRPL_RateLimiter_send(plugin->rate_limiter, who, buddy_data->tox_friendlist_number,
+                                            no_html, action);
+
     if (no_html) {
         free(no_html);
     }
@@ -62,7 +60,7 @@ int ToxPRPL_Purple_sendUserMessage(PurpleConnection* gc, const char* who, const
  * LibPurple typing callback
  */
 unsigned int ToxPRPL_Purple_updateTypingState(PurpleConnection* gc, const char* who, PurpleTypingState state) {
-    purple_debug_info("toxprpl", "send_typing\n");
+    toxprpl_log_misc("send_typing\n");
 
     toxprpl_return_val_if_fail(gc != NULL, 0);
     toxprpl_return_val_if_fail(who != NULL, 0);
@@ -81,17 +79,17 @@ unsigned int ToxPRPL_Purple_updateTypingState(PurpleConnection* gc, const char*
 
     switch (state) {
         case PURPLE_TYPING:
-            purple_debug_info("toxprpl", "Send typing state: TYPING\n");
+            toxprpl_log_misc("Send typing state: TYPING\n");
             tox_set_user_is_typing(plugin->tox, buddy_data->tox_friendlist_number, TRUE);
             break;
 
         case PURPLE_TYPED:
-            purple_debug_info("toxprpl", "Send typing state: TYPED\n"); /* typing pause */
+            toxprpl_log_misc("Send typing state: TYPED\n"); /* typing pause */
             tox_set_user_is_typing(plugin->tox, buddy_data->tox_friendlist_number, FALSE);
             break;
 
         default:
-            purple_debug_info("toxprpl", "Send typing state: NOT_TYPING\n");
+            toxprpl_log_misc("Send typing state: NOT_TYPING\n");
             tox_set_user_is_typing(plugin->tox, buddy_data->tox_friendlist_number, FALSE);
             break;
     }
@@ -5,12 +5,14 @@
 
 #include <toxprpl.h>
 #include <toxprpl/account.h>
+#include <toxprpl/metrics.h>
+#include <string.h>
 
 /*
  * /myid command
  */
 PurpleCmdRet ToxPRPL_Command_myId(PurpleConversation* conv, const gchar* cmd, gchar** args, gchar** error, void* data) {
-    purple_debug_info("toxprpl", "/myid command detected\n");
+    toxprpl_log_info("/myid command detected\n");
     PurpleConnection* gc = (PurpleConnection*) data;
     ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(gc);
 
@@ -32,9 +34,46 @@ PurpleCmdRet ToxPRPL_Command_myId(PurpleConversation* conv, const gchar* cmd, gc
  * /nick command
  */
 PurpleCmdRet ToxPRPL_Command_nick(PurpleConversation* conv, const gchar* cmd, gchar** args, gchar** error, void* data) {
-    purple_debug_info("toxprpl", "/nick %s command detected\n", args[0]);
+    toxprpl_log_info("/nick %s command detected\n", args[0]);
     PurpleConnection* gc = (PurpleConnection*) data;
     ToxPRPL_Purple_onSetNickname(gc, args[0]);
     return PURPLE_CMD_RET_OK;
 }
 
+
+/*
+ * /toxstats [file] command
+ * Shows the connection's metrics, or writes them to `file'
+ */
+PurpleCmdRet ToxPRPL_Command_stats(PurpleConversation* conv, const gchar* cmd, gchar** args, gchar** error, void* data) {
+    toxprpl_log_info("/toxstats command detected\n");
+    PurpleConnection* gc = (PurpleConnection*) data;
+
+    gchar* report = ToxPRPL_Metrics_format(gc);
+    if (report == NULL) {
+        *error = g_strdup(_("No statistics available"));
+        return PURPLE_CMD_RET_FAILED;
+    }
+
+    if ((args[0] != NULL) && (strlen(args[0]) > 0)) {
+        if (!purple_util_write_data_to_file_absolute(args[0], report, -1)) {
+            *error = g_strdup_printf(_("Could not write statistics to %s"), args[0]);
+            g_free(report);
+            return PURPLE_CMD_RET_FAILED;
+        }
+
+        gchar* message = g_strdup_printf(_("Statistics written to %s"), args[0]);
+        purple_conversation_write(conv, NULL, message, PURPLE_MESSAGE_SYSTEM, time(NULL));
+        g_free(message);
+    }
+    else {
+        gchar* escaped = g_markup_escape_text(report, -1);
+        gchar* message = purple_strreplace(escaped, "\n", "<br>");
+        purple_conversation_write(conv, NULL, message, PURPLE_MESSAGE_SYSTEM | PURPLE_MESSAGE_NO_LOG, time(NULL));
+        g_free(message);
+        g_free(escaped);
+    }
+
+    g_free(report);
+    return PURPLE_CMD_RET_OK;
+}
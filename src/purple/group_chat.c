@@ -0,0 +1,399 @@
+/*
+ * LibPurple group chat callbacks
+ *
+ * Group state lives in the connection's group table (see ``common/group_chat.c''),
+ * and is kept current by the Tox callbacks in ``tox/group_chat.c''
+ */
+
+#include <toxprpl.h>
+#include <toxprpl/group_chat.h>
+#include <toxprpl/metrics.h>
+#include <errno.h>
+#include <string.h>
+
+static const PurpleConnectionFlags TOX_CONNECTION_FLAGS =
+        PURPLE_CONNECTION_NO_FONTSIZE | PURPLE_CONNECTION_NO_BGCOLOR | PURPLE_CONNECTION_NO_IMAGES;
+
+// Chat Buddies -----------------------------------------------------------------------------------------
+
+/*
+ * Whether `nick` is taken in the conversation by anyone but `peer`, or by a name handed out to `batch`
+ */
+static gboolean isNickTaken(PurpleConvChat* convChat, GHashTable* batch, ToxPRPL_GroupPeer* peer, const char* nick) {
+
+    if (peer->inRoom && g_strcmp0(peer->nick, nick) == 0) {
+        return FALSE;
+    }
+
+    return purple_conv_chat_cb_find(convChat, nick) != NULL ||
+           (batch != NULL && g_hash_table_lookup(batch, nick) != NULL);
+}
+
+/*
+ * The name a peer goes by in the conversation.
+ * Purple keeps one chat buddy per name, but every new Tox client is called ``ToxedPidgin'',
+ * so a name that is taken gets the peer number appended (or the next free number, should that be taken too).
+ */
+static gchar* makeNick(PurpleConvChat* convChat, GHashTable* batch, ToxPRPL_GroupPeer* peer, int peerNumber) {
+
+    gchar* nick = g_strdup(peer->name);
+
+    int suffix = peerNumber;
+    while (isNickTaken(convChat, batch, peer, nick)) {
+        g_free(nick);
+        nick = g_strdup_printf("%s (%i)", peer->name, suffix++);
+    }
+
+    return nick;
+}
+
+/*
+ * Forget which peers are in the conversation, once its user list is gone
+ */
+static void clearRoom(ToxPRPL_GroupChat* chat) {
+
+    guint peerNumber;
+    for (peerNumber = 0; peerNumber < chat->peers->len; peerNumber++) {
+        ToxPRPL_GroupPeer* peer = &g_array_index(chat->peers, ToxPRPL_GroupPeer, peerNumber);
+        peer->inRoom = FALSE;
+        g_free(peer->nick);
+        peer->nick = NULL;
+    }
+}
+
+void ToxPRPL_Purple_addGroupPeer(ToxPRPL_GroupChat* chat, int peerNumber) {
+
+    ToxPRPL_GroupPeer* peer = ToxPRPL_GroupChat_getPeer(chat, peerNumber);
+    toxprpl_return_if_fail(chat->conversation != NULL && peer != NULL && !peer->inRoom);
+
+    PurpleConvChat* convChat = purple_conversation_get_chat_data(chat->conversation);
+
+    g_free(peer->nick);
+    peer->nick = makeNick(convChat, NULL, peer, peerNumber);
+    peer->inRoom = TRUE;
+
+    purple_conv_chat_add_user(convChat, peer->nick, NULL, PURPLE_CBFLAGS_NONE, TRUE);
+}
+
+void ToxPRPL_Purple_removeGroupPeer(ToxPRPL_GroupChat* chat, int peerNumber) {
+
+    ToxPRPL_GroupPeer* peer = ToxPRPL_GroupChat_getPeer(chat, peerNumber);
+    toxprpl_return_if_fail(chat->conversation != NULL && peer != NULL && peer->inRoom);
+
+    purple_conv_chat_remove_user(purple_conversation_get_chat_data(chat->conversation), peer->nick, NULL);
+
+    peer->inRoom = FALSE;
+    g_free(peer->nick);
+    peer->nick = NULL;
+}
+
+/*
+ * Move a peer's chat buddy over to the peer's new name, which has to be cached already
+ */
+void ToxPRPL_Purple_renameGroupPeer(ToxPRPL_GroupChat* chat, int peerNumber) {
+
+    ToxPRPL_GroupPeer* peer = ToxPRPL_GroupChat_getPeer(chat, peerNumber);
+    toxprpl_return_if_fail(chat->conversation != NULL && peer != NULL && peer->inRoom);
+
+    PurpleConvChat* convChat = purple_conversation_get_chat_data(chat->conversation);
+    gchar* nick = makeNick(convChat, NULL, peer, peerNumber);
+
+    // Tox also reports a name change when the name stays the same
+    if (strcmp(nick, peer->nick) != 0) {
+        purple_conv_chat_rename_user(convChat, peer->nick, nick);
+    }
+
+    g_free(peer->nick);
+    peer->nick = nick;
+}
+
+/*
+ * Add every cached peer that is not in the conversation yet.
+ * purple_conv_chat_add_users() only sorts the UI list once, and with `new_arrivals' unset
+ * it does not write a join notice per peer, which matters for groups with hundreds of members.
+ */
+void ToxPRPL_Purple_flushGroupRoster(ToxPRPL_GroupChat* chat) {
+
+    toxprpl_return_if_fail(chat->conversation != NULL);
+
+    PurpleConvChat* convChat = purple_conversation_get_chat_data(chat->conversation);
+    GHashTable* batch = g_hash_table_new(g_str_hash, g_str_equal);
+    GList* names = NULL;
+    GList* flags = NULL;
+
+    guint peerNumber;
+    for (peerNumber = chat->peers->len; peerNumber > 0; peerNumber--) {
+        ToxPRPL_GroupPeer* peer = &g_array_index(chat->peers, ToxPRPL_GroupPeer, peerNumber - 1);
+        if (peer->name && !peer->inRoom) {
+            g_free(peer->nick);
+            peer->nick = makeNick(convChat, batch, peer, (int) peerNumber - 1);
+            peer->inRoom = TRUE;
+            g_hash_table_insert(batch, peer->nick, peer->nick);
+
+            names = g_list_prepend(names, peer->nick);
+            flags = g_list_prepend(flags, GINT_TO_POINTER(PURPLE_CBFLAGS_NONE));
+        }
+    }
+
+    g_hash_table_destroy(batch);
+
+    if (names == NULL) {
+        return;
+    }
+
+    toxprpl_log_info("adding %u peers to group %i\n", g_list_length(names), chat->groupNumber);
+    purple_conv_chat_add_users(convChat, names, NULL, flags, FALSE);
+
+    g_list_free(names);
+    g_list_free(flags);
+}
+
+// Conversations ----------------------------------------------------------------------------------------
+
+static gboolean onGroupRosterSettled(gpointer data) {
+
+    ToxPRPL_GroupChat* chat = data;
+    chat->rosterTimer = 0;
+
+    if (chat->conversation) {
+        ToxPRPL_Purple_flushGroupRoster(chat);
+    }
+
+    return FALSE;
+}
+
+/*
+ * Open (or re-open) the purple conversation for a group, and fill it from the cached group state
+ */
+PurpleConversation* ToxPRPL_Purple_openGroupConversation(PurpleConnection* gc, ToxPRPL_GroupChat* chat) {
+
+    gchar* conversationName = ToxPRPL_GroupChat_getConversationName(chat->groupNumber);
+    PurpleConversation* conversation = serv_got_joined_chat(gc, chat->groupNumber, conversationName);
+    g_free(conversationName);
+
+    toxprpl_return_val_if_fail(conversation != NULL, NULL);
+
+    chat->conversation = conversation;
+    purple_conversation_set_features(conversation, TOX_CONNECTION_FLAGS);
+
+    if (chat->title) {
+        purple_conversation_set_title(conversation, chat->title);
+    }
+
+    PurpleConvChat* convChat = purple_conversation_get_chat_data(conversation);
+    purple_conv_chat_set_nick(convChat, purple_connection_get_display_name(gc));
+    purple_conv_chat_clear_users(convChat);
+    clearRoom(chat);
+
+    ToxPRPL_Purple_flushGroupRoster(chat);
+
+    purple_conversation_present(conversation);
+
+    return conversation;
+}
+
+/*
+ * Forget a group's conversation (and the chat buddies in it) once purple destroys it
+ */
+static void onDeletingConversation(PurpleConversation* conversation, gpointer data) {
+
+    PurpleConnection* gc = data;
+    if (purple_conversation_get_gc(conversation) != gc ||
+        purple_conversation_get_type(conversation) != PURPLE_CONV_TYPE_CHAT) {
+        return;
+    }
+
+    ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(gc);
+    int groupNumber = purple_conv_chat_get_id(purple_conversation_get_chat_data(conversation));
+    ToxPRPL_GroupChat* chat = ToxPRPL_GroupTable_find(plugin->groups, groupNumber);
+
+    if (chat == NULL || chat->conversation != conversation) {
+        return;
+    }
+
+    chat->conversation = NULL;
+    clearRoom(chat);
+}
+
+void ToxPRPL_Purple_watchGroupConversations(PurpleConnection* gc) {
+
+    ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(gc);
+    purple_signal_connect(purple_conversations_get_handle(), "deleting-conversation", plugin,
+                          PURPLE_CALLBACK(onDeletingConversation), gc);
+}
+
+void ToxPRPL_Purple_unwatchGroupConversations(PurpleConnection* gc) {
+
+    ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(gc);
+    purple_signals_disconnect_by_handle(plugin);
+}
+
+/*
+ * Components shown to the user when joining a chat.
+ * Joining without an invite creates a new group, so all we need is an (optional) title.
+ */
+GList* ToxPRPL_Purple_getChatInfo(PurpleConnection* gc) {
+
+    struct proto_chat_entry* entry = g_new0(struct proto_chat_entry, 1);
+    entry->label = _("_Title:");
+    entry->identifier = TOXPRPL_CHAT_TITLE;
+    entry->required = FALSE;
+
+    return g_list_append(NULL, entry);
+}
+
+/*
+ * `chatName` is either a title typed by the user, or the name of a group's conversation,
+ * as purple passes it in when rejoining that conversation. The latter has to re-open the group,
+ * rather than create a new one titled after it.
+ */
+GHashTable* ToxPRPL_Purple_getChatInfoDefaults(PurpleConnection* gc, const char* chatName) {
+
+    GHashTable* defaults = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, g_free);
+
+    int groupNumber;
+    if (ToxPRPL_GroupChat_parseConversationName(chatName, &groupNumber)) {
+        g_hash_table_insert(defaults, (gpointer) TOXPRPL_CHAT_GROUP_NUMBER, g_strdup_printf("%i", groupNumber));
+    } else if (chatName != NULL) {
+        g_hash_table_insert(defaults, (gpointer) TOXPRPL_CHAT_TITLE, g_strdup(chatName));
+    }
+
+    return defaults;
+}
+
+char* ToxPRPL_Purple_getChatName(GHashTable* components) {
+
+    const char* groupNumber = g_hash_table_lookup(components, TOXPRPL_CHAT_GROUP_NUMBER);
+    if (groupNumber != NULL) {
+        return ToxPRPL_GroupChat_getConversationName(atoi(groupNumber));
+    }
+
+    return g_strdup(g_hash_table_lookup(components, TOXPRPL_CHAT_TITLE));
+}
+
+/*
+ * Join a group chat.
+ *
+ * `components` is one of
+ *  - an accepted invite (as built by ``ToxPRPL_Tox_onGroupInvite''), in which case the group is joined
+ *  - a group number (see ``ToxPRPL_Purple_getChatInfoDefaults''), in which case the conversation for that
+ *    group is re-opened
+ *  - the `chat_info` components, in which case a new group is created
+ */
+void ToxPRPL_Purple_joinChat(PurpleConnection* gc, GHashTable* components) {
+
+    ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(gc);
+    toxprpl_return_if_fail(plugin != NULL && plugin->tox != NULL);
+
+    const char* inviteFriend = g_hash_table_lookup(components, TOXPRPL_CHAT_INVITE_FRIEND);
+    const char* inviteData = g_hash_table_lookup(components, TOXPRPL_CHAT_INVITE_DATA);
+    const char* groupNumberString = g_hash_table_lookup(components, TOXPRPL_CHAT_GROUP_NUMBER);
+
+    ToxPRPL_GroupChat* chat = NULL;
+
+    if (groupNumberString != NULL) {
+        chat = ToxPRPL_GroupTable_find(plugin->groups, atoi(groupNumberString));
+    }
+
+    if (chat == NULL && inviteFriend != NULL && inviteData != NULL) {
+
+        gsize dataLength;
+        guchar* data = g_base64_decode(inviteData, &dataLength);
+        int groupNumber = tox_join_groupchat(plugin->tox, atoi(inviteFriend), data, (uint16_t) dataLength);
+        g_free(data);
+
+        if (groupNumber < 0) {
+            toxprpl_log_error("Unable to join group chat (tox API returned failure value)\n");
+            purple_notify_error(gc, _("Error"), _("Unable to join the group chat"), NULL);
+            return;
+        }
+
+        chat = ToxPRPL_GroupTable_add(plugin->groups, plugin->pools, groupNumber, TOX_GROUPCHAT_TYPE_TEXT);
+        ToxPRPL_GroupChat_refresh(chat, plugin->tox);
+
+        // the existing members are about to be announced one by one, batch them up
+        chat->rosterTimer = purple_timeout_add(TOXPRPL_GROUP_ROSTER_SETTLE, onGroupRosterSettled, chat);
+
+    } else if (chat == NULL && groupNumberString == NULL) {
+
+        int groupNumber = tox_add_groupchat(plugin->tox);
+
+        if (groupNumber < 0) {
+            toxprpl_log_error("Unable to create group chat (tox API returned failure value)\n");
+            purple_notify_error(gc, _("Error"), _("Unable to create a group chat"), NULL);
+            return;
+        }
+
+        chat = ToxPRPL_GroupTable_add(plugin->groups, plugin->pools, groupNumber, TOX_GROUPCHAT_TYPE_TEXT);
+
+        const char* title = g_hash_table_lookup(components, TOXPRPL_CHAT_TITLE);
+        if (title != NULL && strlen(title) > 0) {
+            size_t titleLength = MIN(strlen(title), TOX_MAX_NAME_LENGTH);
+            tox_group_set_title(plugin->tox, groupNumber, (const uint8_t*) title, (uint8_t) titleLength);
+        }
+
+        ToxPRPL_GroupChat_refresh(chat, plugin->tox);
+    }
+
+    if (chat == NULL) {
+        // group numbers do not outlive the Tox session
+        purple_notify_error(gc, _("Error"), _("This group chat no longer exists"), NULL);
+        return;
+    }
+
+    ToxPRPL_Purple_openGroupConversation(gc, chat);
+}
+
+void ToxPRPL_Purple_leaveChat(PurpleConnection* gc, int id) {
+
+    ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(gc);
+    toxprpl_return_if_fail(plugin != NULL && plugin->tox != NULL);
+
+    toxprpl_log_info("leaving group chat %i\n", id);
+
+    tox_del_groupchat(plugin->tox, id);
+    ToxPRPL_GroupTable_remove(plugin->groups, id);
+}
+
+/*
+ * Send a message to a group chat.
+ * Tox echoes our own group messages back through the message callback,
+ * which is where they are written to the conversation.
+ */
+int ToxPRPL_Purple_sendChatMessage(PurpleConnection* gc, int id, const char* message, PurpleMessageFlags flags) {
+
+    ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(gc);
+    toxprpl_return_val_if_fail(plugin != NULL && plugin->tox != NULL, -ENOTCONN);
+
+    ToxPRPL_GroupChat* chat = ToxPRPL_GroupTable_find(plugin->groups, id);
+    if (chat == NULL) {
+        toxprpl_log_warning("Can't send message to unknown group %i\n", id);
+        return -EINVAL;
+    }
+
+    char* no_html = purple_markup_strip_html(message);
+    size_t length = strlen(no_html);
+
+    if (length > TOX_MAX_MESSAGE_LENGTH) {
+        g_free(no_html);
+        return -E2BIG;
+    }
+
+    int ret;
+    if (purple_message_meify(no_html, -1)) {
+        ret = tox_group_action_send(plugin->tox, chat->groupNumber, (const uint8_t*) no_html,
+                                    (uint16_t) strlen(no_html));
+    } else {
+        ret = tox_group_message_send(plugin->tox, chat->groupNumber, (const uint8_t*) no_html, (uint16_t) length);
+    }
+
+    g_free(no_html);
+
+    if (ret != 0) {
+        ToxPRPL_Metrics_count(plugin->metrics, TOXPRPL_COUNTER_SEND_FAILURES, 1);
+        return -1;
+    }
+
+    ToxPRPL_Metrics_count(plugin->metrics, TOXPRPL_COUNTER_GROUP_MESSAGES_OUT, 1);
+    return 0;
+}
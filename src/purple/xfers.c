@@ -1,10 +1,11 @@
 #include <toxprpl.h>
 #include <toxprpl/xfers.h>
+#include <toxprpl/metrics.h>
 
 #include <string.h>
 
 void ToxPRPL_Purple_prepareXfer(PurpleXfer* xfer) {
-    purple_debug_info("toxprpl", "xfer_init\n");
+    toxprpl_log_info("xfer_init\n");
     toxprpl_return_if_fail(xfer != NULL);
 
     ToxPRPL_XferData* xfer_data = xfer->data;
@@ -33,8 +34,8 @@ void ToxPRPL_Purple_prepareXfer(PurpleXfer* xfer) {
         size_t filesize = purple_xfer_get_size(xfer);
         const char* filename = purple_xfer_get_filename(xfer);
 
-        purple_debug_info("toxprpl", "sending xfer request for file '%s'.\n",
-                          filename);
+        toxprpl_log_info("sending xfer request for file '%s'.\n",
+                         filename);
         int filenumber = tox_new_file_sender(plugin->tox, friendnumber, filesize,
                                              (uint8_t*) filename, strlen(filename) + 1);
         toxprpl_return_if_fail(filenumber >= 0);
@@ -68,17 +69,17 @@ gboolean ToxPRPL_writeIdleData(ToxPRPL_IdleWriteData* data) {
             }
             return TRUE;
         }
-        purple_debug_info("toxprpl", "ending file transfer\n");
+        toxprpl_log_info("ending file transfer\n");
         purple_xfer_end(data->xfer);
     }
-    purple_debug_info("toxprpl", "freeing buffer\n");
+    toxprpl_log_info("freeing buffer\n");
     g_free(data->buffer);
     g_free(data);
     return FALSE;
 }
 
 void ToxPRPL_Purple_startXfer(PurpleXfer* xfer) {
-    purple_debug_info("toxprpl", "xfer_start\n");
+    toxprpl_log_info("xfer_start\n");
     toxprpl_return_if_fail(xfer != NULL);
     toxprpl_return_if_fail(xfer->data != NULL);
 
@@ -93,14 +94,14 @@ void ToxPRPL_Purple_startXfer(PurpleXfer* xfer) {
         toxprpl_return_if_fail(buffer != NULL);
         size_t read_bytes = fread(buffer, sizeof(uint8_t), bytes_remaining, xfer->dest_fp);
         if (read_bytes != bytes_remaining) {
-            purple_debug_warning("toxprpl", "read_bytes != bytes_remaining\n");
+            toxprpl_log_warning("read_bytes != bytes_remaining\n");
             g_free(buffer);
             return;
         }
 
         ToxPRPL_IdleWriteData* data = g_new0(ToxPRPL_IdleWriteData, 1);
         if (data == NULL) {
-            purple_debug_warning("toxprpl", "data == NULL");
+            toxprpl_log_warning("data == NULL");
             g_free(buffer);
             return;
         }
@@ -136,6 +137,10 @@ gssize ToxPRPL_Purple_writeXfer(const guchar* data, size_t len, PurpleXfer* xfer
         tox_do(xfer_data->tox);
         return -1;
     }
+
+    PurpleConnection* gc = purple_account_get_connection(purple_xfer_get_account(xfer));
+    ToxPRPL_Metrics_count(ToxPRPL_Metrics_get(gc), TOXPRPL_COUNTER_XFER_BYTES_OUT, len);
+
     return len;
 }
 
@@ -152,7 +157,7 @@ gssize ToxPRPL_purpleDummyReadXfer(guchar** data, PurpleXfer* xfer) {
  * Frees up resources used during a file transfer
  */
 void ToxPRPL_freeXfer(PurpleXfer* xfer) {
-    purple_debug_info("toxprpl", "xfer_free\n");
+    toxprpl_log_info("xfer_free\n");
     toxprpl_return_if_fail(xfer != NULL);
     toxprpl_return_if_fail(xfer->data != NULL);
 
@@ -172,7 +177,7 @@ void ToxPRPL_freeXfer(PurpleXfer* xfer) {
  * to receive a file transfer
  */
 void ToxPRPL_Purple_incomingTransferDenied(PurpleXfer* xfer) {
-    purple_debug_info("toxprpl", "xfer_request_denied\n");
+    toxprpl_log_info("xfer_request_denied\n");
     toxprpl_return_if_fail(xfer != NULL);
     toxprpl_return_if_fail(xfer->data != NULL);
 
@@ -189,7 +194,7 @@ void ToxPRPL_Purple_incomingTransferDenied(PurpleXfer* xfer) {
  * transfer
  */
 void ToxPRPL_Purple_cancelIncomingTransfer(PurpleXfer* xfer) {
-    purple_debug_info("toxprpl", "xfer_cancel_recv\n");
+    toxprpl_log_info("xfer_cancel_recv\n");
     toxprpl_return_if_fail(xfer != NULL);
     ToxPRPL_XferData* xfer_data = xfer->data;
 
@@ -205,7 +210,7 @@ void ToxPRPL_Purple_cancelIncomingTransfer(PurpleXfer* xfer) {
  * Invoked when the frontend wishes to cancel an outgoing transfer.
  */
 void ToxPRPL_Purple_cancelOutgoingXfer(PurpleXfer* xfer) {
-    purple_debug_info("toxprpl", "xfer_cancel_send\n");
+    toxprpl_log_info("xfer_cancel_send\n");
     toxprpl_return_if_fail(xfer != NULL);
     toxprpl_return_if_fail(xfer->data != NULL);
 
@@ -222,7 +227,7 @@ void ToxPRPL_Purple_cancelOutgoingXfer(PurpleXfer* xfer) {
  * LibPurple callback that is invoked when a file transfer is completed
  */
 void ToxPRPL_Purple_onTransferCompleted(PurpleXfer* xfer) {
-    purple_debug_info("toxprpl", "xfer_end\n");
+    toxprpl_log_info("xfer_end\n");
     toxprpl_return_if_fail(xfer != NULL);
     ToxPRPL_XferData* xfer_data = xfer->data;
 
@@ -241,7 +246,7 @@ void ToxPRPL_Purple_onTransferCompleted(PurpleXfer* xfer) {
 PurpleXfer* ToxPRPL_Purple_onTransferReceive(PurpleConnection* gc, const char* who, int friendnumber, int filenumber,
                                              const goffset filesize, const char* filename) {
 
-    purple_debug_info("toxprpl", "new_xfer_receive\n");
+    toxprpl_log_info("new_xfer_receive\n");
     toxprpl_return_val_if_fail(gc != NULL, NULL);
     toxprpl_return_val_if_fail(who != NULL, NULL);
 
@@ -281,7 +286,7 @@ PurpleXfer* ToxPRPL_Purple_onTransferReceive(PurpleConnection* gc, const char* w
  * to a given user
  */
 gboolean ToxPRPL_Purple_canReceiveFileCheck(PurpleConnection* gc, const char* who) {
-    purple_debug_info("toxprpl", "can_receive_file\n");
+    toxprpl_log_info("can_receive_file\n");
 
     toxprpl_return_val_if_fail(gc != NULL, FALSE);
     toxprpl_return_val_if_fail(who != NULL, FALSE);
@@ -306,7 +311,7 @@ gboolean ToxPRPL_Purple_canReceiveFileCheck(PurpleConnection* gc, const char* wh
  * LibPurple callback invoked when the frontend wishes to send a file to a user
  */
 void ToxPRPL_Purple_sendFile(PurpleConnection* gc, const char* who, const char* filename) {
-    purple_debug_info("toxprpl", "send_file\n");
+    toxprpl_log_info("send_file\n");
 
     toxprpl_return_if_fail(gc != NULL);
     toxprpl_return_if_fail(who != NULL);
@@ -315,11 +320,11 @@ void ToxPRPL_Purple_sendFile(PurpleConnection* gc, const char* who, const char*
     toxprpl_return_if_fail(xfer != NULL);
 
     if (filename != NULL) {
-        purple_debug_info("toxprpl", "filename != NULL\n");
+        toxprpl_log_info("filename != NULL\n");
         purple_xfer_request_accepted(xfer, filename);
     }
     else {
-        purple_debug_info("toxprpl", "filename == NULL\n");
+        toxprpl_log_info("filename == NULL\n");
         purple_xfer_request(xfer);
     }
 }
@@ -4,28 +4,25 @@
 
 #include <toxprpl.h>
 #include <toxprpl/buddy.h>
-#include <string.h>
+#include <toxprpl/callbacks.h>
+#include <toxprpl/avatars.h>
+#include <toxprpl/metrics.h>
+#include <toxprpl/buddy_keys.h>
+#include <toxprpl/friend_table.h>
+#include <toxprpl/pool.h>
+#include <toxprpl/presence.h>
+#include <toxprpl/friend_requests.h>
 
+/*
+ * Presence changes are coalesced before they reach purple, see ``toxprpl/presence.h''
+ */
 void ToxPRPL_Tox_onUserConnectionStatusChange(Tox* tox, int32_t fnum, uint8_t status, void* user_data) {
+    TOXPRPL_COUNT((PurpleConnection*) user_data, TOXPRPL_COUNTER_CB_CONNECTION_STATUS);
     PurpleConnection* gc = (PurpleConnection*) user_data;
-    int tox_status = TOXPRPL_STATUS_OFFLINE;
-    if (status == 1) {
-        tox_status = TOXPRPL_STATUS_ONLINE;
-    }
-
-    purple_debug_info("toxprpl", "Friend status change: %d\n", status);
-    uint8_t client_id[TOX_CLIENT_ID_SIZE];
-    if (tox_get_client_id(tox, fnum, client_id) < 0) {
-        purple_debug_info("toxprpl", "Could not get id of friend #%d\n",
-                          fnum);
-        return;
-    }
+    ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(gc);
 
-    gchar* buddy_key = ToxPRPL_toxClientIdToString(client_id);
-    PurpleAccount* account = purple_connection_get_account(gc);
-    purple_prpl_got_user_status(account, buddy_key,
-                                ToxPRPL_ToxStatuses[tox_status].id, NULL);
-    g_free(buddy_key);
+    toxprpl_log_misc("Friend status change: %d\n", status);
+    ToxPRPL_Presence_setOnline(plugin->presence, fnum, status == 1);
 }
 
 /*
@@ -38,90 +35,61 @@ void ToxPRPL_Action_acceptFriendRequest(ToxPRPL_FriendAcceptData* data) {
                                        FALSE, NULL);
     if (ret < 0) {
         g_free(data->buddy_key);
-        g_free(data);
+        ToxPRPL_Pools_release(plugin->pools, TOXPRPL_POOL_FRIEND_ACCEPT, data);
         // error dialogs handled in ToxPRPL_Purple_addFriend()
         return;
     }
 
     PurpleAccount* account = purple_connection_get_account(data->gc);
 
-    uint8_t alias[TOX_MAX_NAME_LENGTH + 1];
-
     PurpleBuddy* buddy;
-    int rc = tox_get_name(plugin->tox, ret, alias);
-    alias[TOX_MAX_NAME_LENGTH] = '\0';
-    if ((rc == 0) && (strlen((const char*) alias) > 0)) {
-        purple_debug_info("toxprpl", "Got friend alias %s\n", alias);
-        buddy = purple_buddy_new(account, data->buddy_key, (const char*) alias);
+    const char* alias = ToxPRPL_FriendTable_getName(plugin->friends, ret);
+    if (alias != NULL) {
+        toxprpl_log_info("Got friend alias %s\n", alias);
+        buddy = purple_buddy_new(account, data->buddy_key, alias);
     }
     else {
-        purple_debug_info("toxprpl", "Adding [%s]\n", data->buddy_key);
+        toxprpl_log_info("Adding [%s]\n", data->buddy_key);
         buddy = purple_buddy_new(account, data->buddy_key, NULL);
     }
 
-    ToxPRPL_BuddyData* buddy_data = g_new0(ToxPRPL_BuddyData, 1);
-    buddy_data->tox_friendlist_number = ret;
-    purple_buddy_set_protocol_data(buddy, buddy_data);
+    ToxPRPL_Purple_setBuddyData(plugin->pools, buddy, ret);
     purple_blist_add_buddy(buddy, NULL, NULL, NULL);
-    TOX_USERSTATUS userstatus = (TOX_USERSTATUS) tox_get_user_status(plugin->tox, ret);
-    purple_debug_info("toxprpl", "Friend %s has status %d\n",
-                      data->buddy_key, userstatus);
-    purple_prpl_got_user_status(account, data->buddy_key,
-                                ToxPRPL_ToxStatuses[ToxPRPL_getStatusTypeIndex(plugin->tox, ret, userstatus)].id,
-                                NULL);
+    ToxPRPL_Presence_refresh(plugin->presence, ret);
 
     g_free(data->buddy_key);
-    g_free(data);
-}
-
-/*
- * Tox/Purple glue dialog action that handles rejection (ignore) of a friend request
- */
-void ToxPRPL_Action_rejectFriendRequest(ToxPRPL_FriendAcceptData* data) {
-    g_free(data->buddy_key);
-    g_free(data);
+    ToxPRPL_Pools_release(plugin->pools, TOXPRPL_POOL_FRIEND_ACCEPT, data);
 }
 
 void ToxPRPL_Tox_onFriendRequest(struct Tox* tox, uint8_t const *public_key, uint8_t const *data, uint16_t length,
                                  void* user_data) {
-    purple_debug_info("toxprpl", "incoming friend request!\n");
-    gchar* dialog_message;
+    TOXPRPL_COUNT((PurpleConnection*) user_data, TOXPRPL_COUNTER_CB_FRIEND_REQUEST);
+    toxprpl_log_info("incoming friend request!\n");
     PurpleConnection* gc = (PurpleConnection*) user_data;
+    ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(gc);
 
     gchar* buddy_key = ToxPRPL_toxClientIdToString(public_key);
-    purple_debug_info("toxprpl", "Buddy request from %s: %s\n",
-                      buddy_key, data);
+    toxprpl_log_info("Buddy request from %s: %s\n",
+                     buddy_key, data);
 
     PurpleAccount* account = purple_connection_get_account(gc);
     PurpleBuddy* buddy = purple_find_buddy(account, buddy_key);
     if (buddy != NULL) {
-        purple_debug_info("toxprpl", "Buddy %s already in buddy list!\n",
-                          buddy_key);
+        toxprpl_log_info("Buddy %s already in buddy list!\n",
+                         buddy_key);
         g_free(buddy_key);
         return;
     }
 
-    dialog_message = g_strdup_printf("The user %s has sent you a friend "
-                                             "request, do you want to add them?",
-                                     buddy_key);
-
     gchar* request_msg = NULL;
     if (length > 0) {
         request_msg = g_strndup((const gchar*) data, length);
     }
 
-    ToxPRPL_FriendAcceptData* fdata = g_new0(ToxPRPL_FriendAcceptData, 1);
-    fdata->gc = gc;
-    fdata->buddy_key = buddy_key;
-    purple_request_yes_no(gc, "New friend request", dialog_message,
-                          request_msg,
-                          PURPLE_DEFAULT_ACTION_NONE,
-                          account, NULL,
-                          NULL,
-                          fdata, // buddy key will be freed elsewhere
-                          G_CALLBACK(ToxPRPL_Action_acceptFriendRequest),
-                          G_CALLBACK(ToxPRPL_Action_rejectFriendRequest));
-    g_free(dialog_message);
+    // deduplicated, and presented in batches, see ``toxprpl/friend_requests.h''
+    ToxPRPL_FriendRequests_add(plugin->friend_requests, buddy_key, request_msg);
+
+    g_free(buddy_key);
     g_free(request_msg);
 }
 
@@ -129,75 +97,99 @@ void ToxPRPL_Tox_onFriendRequest(struct Tox* tox, uint8_t const *public_key, uin
  * Tox callback invoked when a friend performs an action, such as an instant message
  */
 void ToxPRPL_Tox_onFriendAction(Tox* tox, int32_t friendnum, uint8_t const *string, uint16_t length, void* user_data) {
-    purple_debug_info("toxprpl", "action received\n");
+    TOXPRPL_COUNT((PurpleConnection*) user_data, TOXPRPL_COUNTER_CB_FRIEND_ACTION);
+    TOXPRPL_COUNT((PurpleConnection*) user_data, TOXPRPL_COUNTER_MESSAGES_IN);
+    toxprpl_log_misc("action received\n");
     PurpleConnection* gc = (PurpleConnection*) user_data;
 
-    uint8_t client_id[TOX_CLIENT_ID_SIZE];
-    if (tox_get_client_id(tox, friendnum, client_id) < 0) {
-        purple_debug_info("toxprpl", "Could not get id of friend %d\n",
-                          friendnum);
+    ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(gc);
+    const char* buddy_key = ToxPRPL_BuddyKeys_forFriend(plugin->buddy_keys, friendnum);
+    if (buddy_key == NULL) {
+        toxprpl_log_info("Could not get id of friend %d\n",
+                         friendnum);
         return;
     }
 
-    gchar* buddy_key = ToxPRPL_toxClientIdToString(client_id);
     gchar* safemsg = g_strndup((const char*) string, length);
     gchar* message = g_strdup_printf("/me %s", safemsg);
     g_free(safemsg);
 
     serv_got_im(gc, buddy_key, message, PURPLE_MESSAGE_RECV,
                 time(NULL));
-    g_free(buddy_key);
     g_free(message);
 }
 
 void ToxPRPL_Tox_onFriendChangeNickname(Tox* tox, int32_t friendnum, uint8_t const *data, uint16_t length,
                                         void* user_data) {
-    purple_debug_info("toxprpl", "Nick change!\n");
+    TOXPRPL_COUNT((PurpleConnection*) user_data, TOXPRPL_COUNTER_CB_NAME_CHANGE);
+    toxprpl_log_misc("Nick change!\n");
 
     PurpleConnection* gc = (PurpleConnection*) user_data;
 
-    uint8_t client_id[TOX_CLIENT_ID_SIZE];
-    if (tox_get_client_id(tox, friendnum, client_id) < 0) {
-        purple_debug_info("toxprpl", "Could not get id of friend %d\n",
-                          friendnum);
+    ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(gc);
+    if (!ToxPRPL_FriendTable_setName(plugin->friends, friendnum, data, length)) {
+        // Tox repeats names, e.g. every time a friend comes online
+        return;
+    }
+
+    const char* buddy_key = ToxPRPL_BuddyKeys_forFriend(plugin->buddy_keys, friendnum);
+    if (buddy_key == NULL) {
+        toxprpl_log_info("Could not get id of friend %d\n",
+                         friendnum);
         return;
     }
 
-    gchar* buddy_key = ToxPRPL_toxClientIdToString(client_id);
     PurpleAccount* account = purple_connection_get_account(gc);
     PurpleBuddy* buddy = purple_find_buddy(account, buddy_key);
     if (buddy == NULL) {
-        purple_debug_info("toxprpl", "Ignoring nick change because buddy %s was not found\n", buddy_key);
-        g_free(buddy_key);
+        toxprpl_log_info("Ignoring nick change because buddy %s was not found\n", buddy_key);
         return;
     }
 
-    g_free(buddy_key);
-    gchar* safedata = g_strndup((const char*) data, length);
-    purple_blist_alias_buddy(buddy, safedata);
-    g_free(safedata);
+    // every alias change is a buddy list write, skip the ones that change nothing
+    const char* alias = ToxPRPL_FriendTable_getName(plugin->friends, friendnum);
+    if (g_strcmp0(buddy->alias, alias) != 0) {
+        purple_blist_alias_buddy(buddy, alias);
+    }
+}
+
+void ToxPRPL_Tox_onFriendChangeStatusMessage(Tox* tox, int32_t friendnum, uint8_t const *data, uint16_t length,
+                                             void* user_data) {
+    TOXPRPL_COUNT((PurpleConnection*) user_data, TOXPRPL_COUNTER_CB_STATUS_MESSAGE);
+
+    PurpleConnection* gc = (PurpleConnection*) user_data;
+    ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(gc);
+
+    toxprpl_log_misc("Status message change: %d\n", friendnum);
+    ToxPRPL_Presence_setStatusMessage(plugin->presence, friendnum, data, length);
 }
 
 void ToxPRPL_Tox_onFriendChangeStatus(struct Tox* tox, int32_t friendnum, uint8_t userstatus, void* user_data) {
+    TOXPRPL_COUNT((PurpleConnection*) user_data, TOXPRPL_COUNTER_CB_USER_STATUS);
 
-    purple_debug_info("toxprpl", "Status change: %d\n", userstatus);
-    uint8_t client_id[TOX_CLIENT_ID_SIZE];
-    if (tox_get_client_id(tox, friendnum, client_id) < 0) {
-        purple_debug_info("toxprpl", "Could not get id of friend %d\n",
-                          friendnum);
-        return;
-    }
+    PurpleConnection* gc = (PurpleConnection*) user_data;
+    ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(gc);
 
-    gchar* buddy_key = ToxPRPL_toxClientIdToString(client_id);
+    toxprpl_log_misc("Status change: %d\n", userstatus);
+    ToxPRPL_Presence_setStatus(plugin->presence, friendnum, (TOX_USERSTATUS) userstatus);
+}
+
+void ToxPRPL_Tox_onAvatarInfo(Tox* tox, int32_t friendnum, uint8_t format, uint8_t* hash, void* user_data) {
+    TOXPRPL_COUNT((PurpleConnection*) user_data, TOXPRPL_COUNTER_CB_AVATAR_INFO);
 
     PurpleConnection* gc = (PurpleConnection*) user_data;
-    PurpleAccount* account = purple_connection_get_account(gc);
-    purple_debug_info("toxprpl", "Setting user status for user %s to %s\n",
-                      buddy_key, ToxPRPL_ToxStatuses[
-                    ToxPRPL_getStatusTypeIndex(tox, friendnum, userstatus)].id);
-    purple_prpl_got_user_status(account, buddy_key,
-                                ToxPRPL_ToxStatuses[
-                                        ToxPRPL_getStatusTypeIndex(tox, friendnum, userstatus)].id,
-                                NULL);
-    g_free(buddy_key);
+    ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(gc);
+
+    // the image itself is only asked for when it is not cached, see ``toxprpl/avatars.h''
+    ToxPRPL_Avatars_onInfo(plugin->avatars, friendnum, format, hash);
+}
+
+void ToxPRPL_Tox_onAvatarData(Tox* tox, int32_t friendnum, uint8_t format, uint8_t* hash, uint8_t* data,
+                              uint32_t length, void* user_data) {
+    TOXPRPL_COUNT((PurpleConnection*) user_data, TOXPRPL_COUNTER_CB_AVATAR_DATA);
+
+    PurpleConnection* gc = (PurpleConnection*) user_data;
+    ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(gc);
+
+    ToxPRPL_Avatars_onData(plugin->avatars, friendnum, format, hash, data, length);
 }
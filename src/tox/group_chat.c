@@ -4,153 +4,105 @@
 
 #include <toxprpl.h>
 #include <toxprpl/group_chat.h>
+#include <toxprpl/metrics.h>
+#include <toxprpl/buddy_keys.h>
 #include <string.h>
 
-
 // Group Invitation Handler -------------------------------------------------------------------------------
 
-static const PurpleConnectionFlags TOX_CONNECTION_FLAGS =
-        PURPLE_CONNECTION_NO_FONTSIZE | PURPLE_CONNECTION_NO_BGCOLOR | PURPLE_CONNECTION_NO_IMAGES;
-
-const char* TOXPRPL_CONV_DATA_KEY = "tox_data";
-
 /*
- * Transactional data type used in invite processing callbacks
+ * Invites are handed to purple as chat components, so that purple can ask the user.
+ * Accepting the invite ends up in ``ToxPRPL_Purple_joinChat''.
  */
-typedef struct _toxprpl_group_invite_data {
-
-    uint8_t groupType;
-    int groupNumber;
-
-    const uint8_t* inviteData;
-    uint16_t dataLength;
-
-    int32_t friend;
-
-    Tox* toxConnection;
-    PurpleConnection* connection;
-
-} ToxPRPL_GroupInviteData;
-
-void ToxPRPL_Tox_onGroupInviteAccepted(ToxPRPL_GroupInviteData* data) {
+void ToxPRPL_Tox_onGroupInvite(Tox* tox, int32_t friendNumber, uint8_t groupType, const uint8_t* data,
+                               uint16_t length, void* userData) {
+    TOXPRPL_COUNT((PurpleConnection*) userData, TOXPRPL_COUNTER_CB_GROUP_INVITE);
 
-    data->groupNumber = tox_join_groupchat(data->toxConnection, data->friend, data->inviteData, data->dataLength);
+    PurpleConnection* purpleConnection = (PurpleConnection*) userData;
 
-    if (data->groupNumber < 0) {
-        purple_debug_error(TOXPRPL_ID, "Unable to join group chat (tox API returned failure value)\n");
-        g_free(data);
+    if (groupType == TOX_GROUPCHAT_TYPE_AV) {
+        toxprpl_log_warning("user was invited to a group chat of the type AV. "
+                                    "the invite was ignored because AV support is not implemented.\n");
         return;
     }
 
-    ToxPRPL_GroupChat* chatData = g_new0(ToxPRPL_GroupChat, 1);
-    chatData->groupNumber = data->groupNumber;
-    chatData->groupType = data->groupType;
-
-    char chatName[TOX_MAX_NAME_LENGTH + 1];
-    tox_group_get_title(data->toxConnection, data->groupNumber, (uint8_t*) chatName, TOX_MAX_NAME_LENGTH);
-
-    PurpleConversation* conversation =
-            purple_conversation_new(PURPLE_CONV_TYPE_CHAT, data->connection->account, (const char*) chatName);
+    ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(purpleConnection);
+    const char* buddy_key = ToxPRPL_BuddyKeys_forFriend(plugin->buddy_keys, friendNumber);
+    if (buddy_key == NULL) {
+        toxprpl_log_info("Could not get id of friend %d\n", friendNumber);
+        return;
+    }
 
-    purple_conversation_set_data(conversation, TOXPRPL_CONV_DATA_KEY, chatData);
-    purple_conversation_set_features(conversation, TOX_CONNECTION_FLAGS);
-    purple_conv_chat_set_id(purple_conversation_get_chat_data(conversation), chatData->groupNumber);
+    toxprpl_log_info("%s invited us to a group chat\n", buddy_key);
 
-    purple_conversation_present(conversation);
+    // the invite data is owned by Tox, so it has to be copied in to the components
+    GHashTable* components = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, g_free);
+    g_hash_table_insert(components, (gpointer) TOXPRPL_CHAT_INVITE_FRIEND, g_strdup_printf("%i", friendNumber));
+    g_hash_table_insert(components, (gpointer) TOXPRPL_CHAT_INVITE_DATA, g_base64_encode(data, length));
 
-    g_free(data);
+    serv_got_chat_invite(purpleConnection, _("Tox group chat"), buddy_key, NULL, components);
 }
 
+// Group Message Handler ----------------------------------------------------------------------------------
 
-void ToxPRPL_Tox_onGroupInviteRejected(ToxPRPL_GroupInviteData* data) {
-
-    g_free(data);
-}
+/*
+ * Write a message to a group's conversation.
+ * This is the hot path for busy groups, so everything comes out of the group table:
+ * one lookup, and no Tox API calls.
+ */
+static void writeGroupMessage(PurpleConnection* purpleConnection, int groupNumber, int peerNumber,
+                              const char* message) {
 
-void ToxPRPL_Tox_onGroupInvite(Tox* tox, int32_t friendNumber, uint8_t groupType, const uint8_t* data,
-                               uint16_t length, void* userData) {
+    ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(purpleConnection);
+    ToxPRPL_GroupChat* chat = ToxPRPL_GroupTable_find(plugin->groups, groupNumber);
 
-    PurpleConnection* purpleConnection = (PurpleConnection*) userData;
+    if (!chat || !chat->conversation) {
+        toxprpl_log_warning("Received a message for group %i, but no such chat exists\n", groupNumber);
+        return;
+    }
 
-    uint8_t buddyName[TOX_MAX_NAME_LENGTH + 1];
-    tox_get_name(tox, friendNumber, buddyName);
+    ToxPRPL_GroupPeer* peer = ToxPRPL_GroupChat_getPeer(chat, peerNumber);
 
-    purple_debug(PURPLE_DEBUG_INFO, TOXPRPL_ID, "%s invited us to a group chat", buddyName);
+    // Tox echoes our own messages, see ``ToxPRPL_Purple_sendChatMessage''
+    PurpleMessageFlags flags = PURPLE_MESSAGE_RECV;
+    if (peer && peer->isOurs) {
+        flags = PURPLE_MESSAGE_SEND;
+    }
 
-    if (groupType == TOX_GROUPCHAT_TYPE_AV) {
-        purple_debug(PURPLE_DEBUG_WARNING, TOXPRPL_ID,
-                     "user was invited to a group chat of the type AV. the invite was ignored because AV support is not implemented.\n");
-        return;
+    // peers sharing a name are told apart by their nick in the conversation
+    const char* who = _("Unknown");
+    if (peer) {
+        who = peer->inRoom ? peer->nick : peer->name;
     }
 
-    ToxPRPL_GroupInviteData* inviteData = g_new0(ToxPRPL_GroupInviteData, 1);
-
-    inviteData->groupType = groupType;
-    inviteData->inviteData = data;
-    inviteData->dataLength = length;
-    inviteData->friend = friendNumber;
-    inviteData->toxConnection = tox;
-    inviteData->connection = purpleConnection;
-
-    char* messageFormatted = g_strdup_printf(_("%s has invited you to a group chat"), buddyName);
-
-    purple_request_accept_cancel(purpleConnection,
-                                 _("You've been invited to a group chat"),
-                                 messageFormatted,
-                                 _("If you wish to join, choose accept."),
-                                 PURPLE_DEFAULT_ACTION_NONE,
-                                 purpleConnection->account,
-                                 (const char*) buddyName,
-                                 NULL,
-                                 &inviteData,
-                                 G_CALLBACK(ToxPRPL_Tox_onGroupInviteAccepted),
-                                 G_CALLBACK(ToxPRPL_Tox_onGroupInviteRejected));
-
-    g_free(messageFormatted);
+    purple_conv_chat_write(purple_conversation_get_chat_data(chat->conversation), who, message, flags, time(NULL));
 }
 
-// Group Message Handler ----------------------------------------------------------------------------------
-
-
 void ToxPRPL_Tox_onGroupMessage(Tox* tox, int groupNumber, int peerNumber, const uint8_t* message,
                                 uint16_t length, void* userData) {
+    TOXPRPL_COUNT((PurpleConnection*) userData, TOXPRPL_COUNTER_CB_GROUP_MESSAGE);
 
-    PurpleConnection* purpleConnection = (PurpleConnection*) userData;
-
-    char chatName[TOX_MAX_NAME_LENGTH + 1];
-    tox_group_get_title(tox, groupNumber, (uint8_t*) chatName, TOX_MAX_NAME_LENGTH);
-
-    char peerName[TOX_MAX_NAME_LENGTH + 1];
-    tox_group_peername(tox, groupNumber, peerNumber, (uint8_t*) peerName);
+    gchar* safeMessage = g_strndup((const char*) message, length);
 
-    PurpleConversation* purpleConvo = purple_find_chat(purpleConnection, groupNumber);
-
-    if (!purpleConvo) {
-        purple_debug_warning(TOXPRPL_ID, "Received a message for chat %s, but no such chat exists\n", chatName);
-        return;
-    }
-
-    PurpleConvChat* purpleChat = purple_conversation_get_chat_data(purpleConvo);
-
-    purple_conv_chat_write(purpleChat, peerName, (const char*) message,
-                           PURPLE_MESSAGE_RECV, time(NULL));
+    writeGroupMessage((PurpleConnection*) userData, groupNumber, peerNumber, safeMessage);
 
+    g_free(safeMessage);
 }
 
 // Group Action Handler -------------------------------------------------------------------------------
 
 /*
  * An ``action'' in Tox seems to refer to ``/me ...''
- * As such, this can pretty much just turn the action in to ``/me ...'' and forward it
- * to the incoming message handler.
+ * As such, this can pretty much just turn the action in to ``/me ...'' and write it
+ * like any other message.
  */
 void ToxPRPL_Tox_onGroupAction(Tox* tox, int groupNumber, int peerNumber, const uint8_t* action,
                                uint16_t length, void* userData) {
+    TOXPRPL_COUNT((PurpleConnection*) userData, TOXPRPL_COUNTER_CB_GROUP_ACTION);
 
-    char* message = g_strdup_printf("/me %s", action);
+    char* message = g_strdup_printf("/me %.*s", (int) length, (const char*) action);
 
-    ToxPRPL_Tox_onGroupMessage(tox, groupNumber, peerNumber, (const uint8_t*) message,
-                               (uint16_t) strlen(message), userData);
+    writeGroupMessage((PurpleConnection*) userData, groupNumber, peerNumber, message);
 
     g_free(message);
 
@@ -162,97 +114,96 @@ static const char* USER_CHANGE_TITLE_ACTION = _("changed the group title");
 
 void ToxPRPL_Tox_onGroupChangeTitle(Tox* tox, int groupNumber, int peerNumber, const uint8_t* newTitle,
                                     uint8_t titleLenght, void* userData) {
+    TOXPRPL_COUNT((PurpleConnection*) userData, TOXPRPL_COUNTER_CB_GROUP_TITLE);
 
     PurpleConnection* purpleConnection = (PurpleConnection*) userData;
+    ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(purpleConnection);
 
-    PurpleConversation* purpleConvo = purple_find_chat(purpleConnection, groupNumber);
+    ToxPRPL_GroupChat* chat = ToxPRPL_GroupTable_find(plugin->groups, groupNumber);
 
-    if(!purpleConvo) {
-        purple_debug_warning(TOXPRPL_ID, "Received title change notification for a nonexistant group\n");
+    if (chat) {
+        ToxPRPL_GroupChat_setTitle(chat, newTitle, titleLenght);
+    }
+
+    if(!chat || !chat->conversation) {
+        toxprpl_log_warning("Received title change notification for a nonexistant group\n");
         return;
     }
 
-    ToxPRPL_Tox_onGroupAction(tox, groupNumber, peerNumber, (const uint8_t*) USER_CHANGE_TITLE_ACTION,
-                              (uint16_t) strlen(USER_CHANGE_TITLE_ACTION), userData);
+    // written like an action, without counting as one
+    char* message = g_strdup_printf("/me %s", USER_CHANGE_TITLE_ACTION);
+    writeGroupMessage(purpleConnection, groupNumber, peerNumber, message);
+    g_free(message);
 
-    purple_conversation_set_title(purpleConvo, (const char*) newTitle);
+    purple_conversation_set_title(chat->conversation, chat->title ? chat->title : "");
 
 }
 
 // Group namelist change handler ----------------------------------------------------------------------
 
-static void groupBuddyAdd(Tox* tox, PurpleConversation* convo, int groupNumber, int peerNumber) {
-
-    char buddyName[TOX_MAX_NAME_LENGTH];
-    tox_group_peername(tox, groupNumber, peerNumber, (uint8_t*) buddyName);
-
-    PurpleConvChat* chat = purple_conversation_get_chat_data(convo);
-
-    purple_conv_chat_add_user(chat, buddyName, NULL, PURPLE_CBFLAGS_NONE, TRUE);
-
-    PurpleConvChatBuddy* buddy = purple_conv_chat_cb_find(chat, buddyName);
-
-    char* peerNumString = g_strdup_printf("%i", peerNumber);
-
-    purple_conv_chat_cb_set_attribute(chat, buddy, TOXPRPL_BUDDY_PEERID, peerNumString);
-
-    g_free(peerNumString);
-}
-
-static void groupBuddyDel(Tox* tox, PurpleConversation* convo, int groupNumber, int peerNumber) {
-
-    char buddyName[TOX_MAX_NAME_LENGTH + 1];
-    tox_group_peername(tox, groupNumber, peerNumber, (uint8_t*) buddyName);
-
-    PurpleConvChat* chat = purple_conversation_get_chat_data(convo);
-
-    purple_conv_chat_remove_user(chat, (const char*) buddyName, NULL);
-}
-
-static void groupBuddyRename(Tox* tox, PurpleConversation* convo, int groupNumber, int peerNumber) {
-
-    PurpleConvChat* chat = purple_conversation_get_chat_data(convo);
-
-    GList* usersWithPeerId = ToxPRPL_Purple_findByPeerId(chat, peerNumber);
-
-    // Iterate through users that match (should be one, but why not comply?)
-    GList* currentLink = usersWithPeerId;
-    do{
-        PurpleConvChatBuddy* buddy = (PurpleConvChatBuddy*) currentLink->data;
-
-        char newName[TOX_MAX_NAME_LENGTH];
-        tox_group_peername(tox, groupNumber, peerNumber, (uint8_t*) newName);
-
-        // The way purple_conv_chat_cb_new() works, name and alias are the same.
-        purple_conv_chat_rename_user(chat, buddy->name, newName);
-
-        currentLink = currentLink->next;
-    } while(currentLink);
-
-    g_list_free(currentLink);
-}
-
+/*
+ * This is O(1) in the size of the group, as the peer table is indexed by peer number,
+ * and purple looks up chat buddies by their nick (see ``ToxPRPL_Purple_addGroupPeer'').
+ * While a freshly joined group settles (see ``ToxPRPL_Purple_flushGroupRoster''), peers are only cached.
+ */
 void ToxPRPL_Tox_onGroupNamelistChange(Tox* tox, int groupNumber, int peerNumber, TOX_CHAT_CHANGE change,
                                        void* userData) {
+    TOXPRPL_COUNT((PurpleConnection*) userData, TOXPRPL_COUNTER_CB_GROUP_NAMELIST);
 
     PurpleConnection* purpleConnection = (PurpleConnection*) userData;
+    ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(purpleConnection);
 
-    PurpleConversation* purpleConvo = purple_find_chat(purpleConnection, groupNumber);
+    ToxPRPL_GroupChat* chat = ToxPRPL_GroupTable_find(plugin->groups, groupNumber);
 
-    if(!purpleConvo) {
-        purple_debug_warning(TOXPRPL_ID, "Received a change notification for a nonexistant group %i\n", groupNumber);
+    if(!chat) {
+        toxprpl_log_warning("Received a change notification for a nonexistant group %i\n", groupNumber);
         return;
     }
 
+    // the roster is cached even while no conversation is open
+    PurpleConversation* purpleConvo = chat->conversation;
+
+    uint8_t peerName[TOX_MAX_NAME_LENGTH];
+    int peerNameLength;
+    ToxPRPL_GroupPeer* peer;
+    gboolean known;
+
     switch(change) {
         case TOX_CHAT_CHANGE_PEER_ADD:
-            groupBuddyAdd(tox, purpleConvo, groupNumber, peerNumber);
+            peerNameLength = tox_group_peername(tox, groupNumber, peerNumber, peerName);
+            peer = ToxPRPL_GroupChat_setPeerName(chat, peerNumber, peerName, peerNameLength);
+            if (peer) {
+                peer->isOurs = tox_group_peernumber_is_ours(tox, groupNumber, peerNumber) != 0;
+            }
+            if (purpleConvo && peer && peer->inRoom) {
+                ToxPRPL_Purple_renameGroupPeer(chat, peerNumber);
+            } else if (purpleConvo && peer && !chat->rosterTimer) {
+                ToxPRPL_Purple_addGroupPeer(chat, peerNumber);
+            }
             break;
         case TOX_CHAT_CHANGE_PEER_DEL:
-            groupBuddyDel(tox, purpleConvo, groupNumber, peerNumber);
+            // Tox has already forgotten about the peer by now, so the peer table is all we have
+            peer = ToxPRPL_GroupChat_getPeer(chat, peerNumber);
+            if (purpleConvo && peer && peer->inRoom) {
+                ToxPRPL_Purple_removeGroupPeer(chat, peerNumber);
+            }
+            ToxPRPL_GroupChat_removePeer(chat, peerNumber);
             break;
         case TOX_CHAT_CHANGE_PEER_NAME:
-            groupBuddyRename(tox, purpleConvo, groupNumber, peerNumber);
+            known = ToxPRPL_GroupChat_getPeer(chat, peerNumber) != NULL;
+
+            peerNameLength = tox_group_peername(tox, groupNumber, peerNumber, peerName);
+            peer = ToxPRPL_GroupChat_setPeerName(chat, peerNumber, peerName, peerNameLength);
+            if (peer && !known) {
+                peer->isOurs = tox_group_peernumber_is_ours(tox, groupNumber, peerNumber) != 0;
+            }
+
+            if (purpleConvo && peer && peer->inRoom) {
+                ToxPRPL_Purple_renameGroupPeer(chat, peerNumber);
+            } else if (purpleConvo && peer && !chat->rosterTimer) {
+                // a rename for a peer we never saw join
+                ToxPRPL_Purple_addGroupPeer(chat, peerNumber);
+            }
             break;
     }
 
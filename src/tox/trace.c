@@ -0,0 +1,140 @@
+/*
+ * Tracing wrappers for the Tox callbacks, see ``toxprpl/trace.h''
+ * These are only registered with Tox when the plugin is built with TOXPRPL_TRACING.
+ */
+
+#include <toxprpl.h>
+#include <toxprpl/trace.h>
+
+#ifdef TOXPRPL_TRACING
+
+#include <toxprpl/callbacks.h>
+#include <toxprpl/group_chat.h>
+#include <toxprpl/xfers.h>
+
+void ToxPRPL_Trace_ToxPRPL_Tox_onUserConnectionStatusChange(Tox* tox, int32_t friendNumber, uint8_t status,
+                                                            void* userData) {
+    TOXPRPL_TRACE_CALLBACK_ENTRY("connection_status", friendNumber, -1, 0);
+    ToxPRPL_Tox_onUserConnectionStatusChange(tox, friendNumber, status, userData);
+    TOXPRPL_TRACE_CALLBACK_RETURN("connection_status", friendNumber, -1, 0);
+}
+
+void ToxPRPL_Trace_ToxPRPL_Tox_onFriendRequest(Tox* tox, uint8_t const *publicKey, uint8_t const *data,
+                                               uint16_t length, void* userData) {
+    TOXPRPL_TRACE_CALLBACK_ENTRY("friend_request", -1, -1, length);
+    ToxPRPL_Tox_onFriendRequest(tox, publicKey, data, length, userData);
+    TOXPRPL_TRACE_CALLBACK_RETURN("friend_request", -1, -1, length);
+}
+
+void ToxPRPL_Trace_ToxPRPL_Tox_onFriendAction(Tox* tox, int32_t friendNumber, uint8_t const *action,
+                                              uint16_t length, void* userData) {
+    TOXPRPL_TRACE_CALLBACK_ENTRY("friend_action", friendNumber, -1, length);
+    ToxPRPL_Tox_onFriendAction(tox, friendNumber, action, length, userData);
+    TOXPRPL_TRACE_CALLBACK_RETURN("friend_action", friendNumber, -1, length);
+}
+
+void ToxPRPL_Trace_ToxPRPL_Tox_onMessageReceived(Tox* tox, int32_t friendNumber, uint8_t const *message,
+                                                 uint16_t length, void* userData) {
+    TOXPRPL_TRACE_CALLBACK_ENTRY("friend_message", friendNumber, -1, length);
+    ToxPRPL_Tox_onMessageReceived(tox, friendNumber, message, length, userData);
+    TOXPRPL_TRACE_CALLBACK_RETURN("friend_message", friendNumber, -1, length);
+}
+
+void ToxPRPL_Trace_ToxPRPL_Tox_onFriendChangeNickname(Tox* tox, int32_t friendNumber, uint8_t const *name,
+                                                      uint16_t length, void* userData) {
+    TOXPRPL_TRACE_CALLBACK_ENTRY("name_change", friendNumber, -1, length);
+    ToxPRPL_Tox_onFriendChangeNickname(tox, friendNumber, name, length, userData);
+    TOXPRPL_TRACE_CALLBACK_RETURN("name_change", friendNumber, -1, length);
+}
+
+void ToxPRPL_Trace_ToxPRPL_Tox_onFriendChangeStatus(Tox* tox, int32_t friendNumber, uint8_t status, void* userData) {
+    TOXPRPL_TRACE_CALLBACK_ENTRY("user_status", friendNumber, -1, 0);
+    ToxPRPL_Tox_onFriendChangeStatus(tox, friendNumber, status, userData);
+    TOXPRPL_TRACE_CALLBACK_RETURN("user_status", friendNumber, -1, 0);
+}
+
+void ToxPRPL_Trace_ToxPRPL_Tox_onFriendChangeStatusMessage(Tox* tox, int32_t friendNumber, uint8_t const *message,
+                                                           uint16_t length, void* userData) {
+    TOXPRPL_TRACE_CALLBACK_ENTRY("status_message", friendNumber, -1, length);
+    ToxPRPL_Tox_onFriendChangeStatusMessage(tox, friendNumber, message, length, userData);
+    TOXPRPL_TRACE_CALLBACK_RETURN("status_message", friendNumber, -1, length);
+}
+
+void ToxPRPL_Trace_ToxPRPL_Tox_onUserTypingChange(Tox* tox, int32_t friendNumber, uint8_t isTyping, void* userData) {
+    TOXPRPL_TRACE_CALLBACK_ENTRY("typing_change", friendNumber, -1, 0);
+    ToxPRPL_Tox_onUserTypingChange(tox, friendNumber, isTyping, userData);
+    TOXPRPL_TRACE_CALLBACK_RETURN("typing_change", friendNumber, -1, 0);
+}
+
+void ToxPRPL_Trace_ToxPRPL_Tox_onAvatarInfo(Tox* tox, int32_t friendNumber, uint8_t format, uint8_t* hash,
+                                            void* userData) {
+    TOXPRPL_TRACE_CALLBACK_ENTRY("avatar_info", friendNumber, -1, 0);
+    ToxPRPL_Tox_onAvatarInfo(tox, friendNumber, format, hash, userData);
+    TOXPRPL_TRACE_CALLBACK_RETURN("avatar_info", friendNumber, -1, 0);
+}
+
+void ToxPRPL_Trace_ToxPRPL_Tox_onAvatarData(Tox* tox, int32_t friendNumber, uint8_t format, uint8_t* hash,
+                                            uint8_t* data, uint32_t length, void* userData) {
+    TOXPRPL_TRACE_CALLBACK_ENTRY("avatar_data", friendNumber, -1, length);
+    ToxPRPL_Tox_onAvatarData(tox, friendNumber, format, hash, data, length, userData);
+    TOXPRPL_TRACE_CALLBACK_RETURN("avatar_data", friendNumber, -1, length);
+}
+
+void ToxPRPL_Trace_ToxPRPL_Tox_onGroupInvite(Tox* tox, int32_t friendNumber, uint8_t groupType, const uint8_t* data,
+                                             uint16_t length, void* userData) {
+    TOXPRPL_TRACE_CALLBACK_ENTRY("group_invite", friendNumber, -1, length);
+    ToxPRPL_Tox_onGroupInvite(tox, friendNumber, groupType, data, length, userData);
+    TOXPRPL_TRACE_CALLBACK_RETURN("group_invite", friendNumber, -1, length);
+}
+
+void ToxPRPL_Trace_ToxPRPL_Tox_onGroupMessage(Tox* tox, int groupNumber, int peerNumber, const uint8_t* message,
+                                              uint16_t length, void* userData) {
+    TOXPRPL_TRACE_CALLBACK_ENTRY("group_message", -1, groupNumber, length);
+    ToxPRPL_Tox_onGroupMessage(tox, groupNumber, peerNumber, message, length, userData);
+    TOXPRPL_TRACE_CALLBACK_RETURN("group_message", -1, groupNumber, length);
+}
+
+void ToxPRPL_Trace_ToxPRPL_Tox_onGroupAction(Tox* tox, int groupNumber, int peerNumber, const uint8_t* action,
+                                             uint16_t length, void* userData) {
+    TOXPRPL_TRACE_CALLBACK_ENTRY("group_action", -1, groupNumber, length);
+    ToxPRPL_Tox_onGroupAction(tox, groupNumber, peerNumber, action, length, userData);
+    TOXPRPL_TRACE_CALLBACK_RETURN("group_action", -1, groupNumber, length);
+}
+
+void ToxPRPL_Trace_ToxPRPL_Tox_onGroupChangeTitle(Tox* tox, int groupNumber, int peerNumber, const uint8_t* title,
+                                                  uint8_t length, void* userData) {
+    TOXPRPL_TRACE_CALLBACK_ENTRY("group_title", -1, groupNumber, length);
+    ToxPRPL_Tox_onGroupChangeTitle(tox, groupNumber, peerNumber, title, length, userData);
+    TOXPRPL_TRACE_CALLBACK_RETURN("group_title", -1, groupNumber, length);
+}
+
+void ToxPRPL_Trace_ToxPRPL_Tox_onGroupNamelistChange(Tox* tox, int groupNumber, int peerNumber,
+                                                     TOX_CHAT_CHANGE change, void* userData) {
+    TOXPRPL_TRACE_CALLBACK_ENTRY("group_namelist", -1, groupNumber, 0);
+    ToxPRPL_Tox_onGroupNamelistChange(tox, groupNumber, peerNumber, change, userData);
+    TOXPRPL_TRACE_CALLBACK_RETURN("group_namelist", -1, groupNumber, 0);
+}
+
+void ToxPRPL_Trace_ToxPRPL_Tox_onFileRequest(Tox* tox, int32_t friendNumber, uint8_t fileNumber, uint64_t fileSize,
+                                             uint8_t const *fileName, uint16_t length, void* userData) {
+    TOXPRPL_TRACE_CALLBACK_ENTRY("file_request", friendNumber, -1, length);
+    ToxPRPL_Tox_onFileRequest(tox, friendNumber, fileNumber, fileSize, fileName, length, userData);
+    TOXPRPL_TRACE_CALLBACK_RETURN("file_request", friendNumber, -1, length);
+}
+
+void ToxPRPL_Trace_ToxPRPL_Tox_onFileControl(Tox* tox, int32_t friendNumber, uint8_t receiveSend,
+                                             uint8_t fileNumber, uint8_t controlType, uint8_t const *data,
+                                             uint16_t length, void* userData) {
+    TOXPRPL_TRACE_CALLBACK_ENTRY("file_control", friendNumber, -1, length);
+    ToxPRPL_Tox_onFileControl(tox, friendNumber, receiveSend, fileNumber, controlType, data, length, userData);
+    TOXPRPL_TRACE_CALLBACK_RETURN("file_control", friendNumber, -1, length);
+}
+
+void ToxPRPL_Trace_ToxPRPL_Tox_onFileDataReceive(Tox* tox, int32_t friendNumber, uint8_t fileNumber,
+                                                 uint8_t const *data, uint16_t length, void* userData) {
+    TOXPRPL_TRACE_CALLBACK_ENTRY("file_data", friendNumber, -1, length);
+    ToxPRPL_Tox_onFileDataReceive(tox, friendNumber, fileNumber, data, length, userData);
+    TOXPRPL_TRACE_CALLBACK_RETURN("file_data", friendNumber, -1, length);
+}
+
+#endif
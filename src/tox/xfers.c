@@ -1,13 +1,16 @@
 #include <toxprpl.h>
 #include <toxprpl/xfers.h>
+#include <toxprpl/metrics.h>
+#include <toxprpl/buddy_keys.h>
 
 /*
  * Tox file transfer progress callback
  */
 void ToxPRPL_Tox_onFileControl(Tox* tox, int32_t friendnumber, uint8_t receive_send, uint8_t filenumber,
                                uint8_t control_type, uint8_t const *data, uint16_t length, void* userdata) {
-    purple_debug_info("toxprpl", "file control: %i (%s) %i\n", friendnumber,
-                      receive_send == 0 ? "rx" : "tx", filenumber);
+    TOXPRPL_COUNT((PurpleConnection*) userdata, TOXPRPL_COUNTER_CB_FILE_CONTROL);
+    toxprpl_log_misc("file control: %i (%s) %i\n", friendnumber,
+                     receive_send == 0 ? "rx" : "tx", filenumber);
     PurpleConnection* gc = userdata;
     toxprpl_return_if_fail(gc != NULL);
 
@@ -44,32 +47,31 @@ void ToxPRPL_Tox_onFileControl(Tox* tox, int32_t friendnumber, uint8_t receive_s
  */
 void ToxPRPL_Tox_onFileRequest(Tox* tox, int32_t friendnumber, uint8_t filenumber, uint64_t filesize,
                                uint8_t const *filename, uint16_t filename_length, void* userdata) {
-    purple_debug_info("toxprpl", "file_send_request: %i %i\n", friendnumber,
-                      filenumber);
+    TOXPRPL_COUNT((PurpleConnection*) userdata, TOXPRPL_COUNTER_CB_FILE_REQUEST);
+    toxprpl_log_info("file_send_request: %i %i\n", friendnumber,
+                     filenumber);
     PurpleConnection* gc = userdata;
 
     toxprpl_return_if_fail(gc != NULL);
     toxprpl_return_if_fail(filename != NULL);
     toxprpl_return_if_fail(tox != NULL);
 
-    uint8_t client_id[TOX_CLIENT_ID_SIZE];
-    if (tox_get_client_id(tox, friendnumber, client_id) < 0) {
-        purple_debug_info("toxprpl", "Could not get id of friend %d\n",
-                          friendnumber);
+    ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(gc);
+    const char* buddy_key = ToxPRPL_BuddyKeys_forFriend(plugin->buddy_keys, friendnumber);
+    if (buddy_key == NULL) {
+        toxprpl_log_info("Could not get id of friend %d\n",
+                         friendnumber);
         return;
     }
-    gchar* buddy_key = ToxPRPL_toxClientIdToString(client_id);
 
     PurpleXfer* xfer = ToxPRPL_Purple_onTransferReceive(gc, buddy_key, friendnumber,
                                                         filenumber, filesize, (const char*) filename);
     if (xfer == NULL) {
-        purple_debug_warning("toxprpl", "could not create xfer\n");
-        g_free(buddy_key);
+        toxprpl_log_warning("could not create xfer\n");
         return;
     }
     toxprpl_return_if_fail(xfer != NULL);
     purple_xfer_request(xfer);
-    g_free(buddy_key);
 }
 
 /*
@@ -77,6 +79,7 @@ void ToxPRPL_Tox_onFileRequest(Tox* tox, int32_t friendnumber, uint8_t filenumbe
  */
 void ToxPRPL_Tox_onFileDataReceive(Tox* tox, int32_t friendnumber, uint8_t filenumber, uint8_t const *data,
                                    uint16_t length, void* userdata) {
+    TOXPRPL_COUNT((PurpleConnection*) userdata, TOXPRPL_COUNTER_CB_FILE_DATA);
     PurpleConnection* gc = userdata;
 
     toxprpl_return_if_fail(gc != NULL);
@@ -87,11 +90,13 @@ void ToxPRPL_Tox_onFileDataReceive(Tox* tox, int32_t friendnumber, uint8_t filen
 
     size_t written = fwrite(data, sizeof(uint8_t), length, xfer->dest_fp);
     if (written != length) {
-        purple_debug_warning("toxprpl", "could not write whole buffer\n");
+        toxprpl_log_warning("could not write whole buffer\n");
         purple_xfer_cancel_local(xfer);
         return;
     }
 
+    ToxPRPL_Metrics_count(ToxPRPL_Metrics_get(gc), TOXPRPL_COUNTER_XFER_BYTES_IN, written);
+
     if (purple_xfer_get_size(xfer) > 0) {
         xfer->bytes_remaining -= written;
         xfer->bytes_sent += written;
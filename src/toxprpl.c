@@ -43,8 +43,19 @@
 #include <toxprpl.h>
 #include <toxprpl/account.h>
 #include <toxprpl/buddy.h>
+#include <toxprpl/callbacks.h>
 #include <toxprpl/xfers.h>
 #include <toxprpl/group_chat.h>
+#include <toxprpl/ratelimit.h>
+#include <toxprpl/presence.h>
+#include <toxprpl/buddy_keys.h>
+#include <toxprpl/pool.h>
+#include <toxprpl/friend_table.h>
+#include <toxprpl/friend_requests.h>
+#include <toxprpl/avatars.h>
+#include <toxprpl/bootstrap.h>
+#include <toxprpl/metrics.h>
+#include <toxprpl/trace.h>
 
 void ToxPRPL_initializePRPL(PurpleAccount* acct);
 
@@ -76,33 +87,12 @@ PurpleCmdRet ToxPRPL_Command_myId(PurpleConversation*, const gchar*, gchar**, gc
  */
 PurpleCmdRet ToxPRPL_Command_nick(PurpleConversation*, const gchar*, gchar**, gchar**, void*);
 
-// End PRPL Commands ---------------------------------------------------------------------------------------------------
-
-// Tox Callbacks -------------------------------------------------------------------------------------------------------
-
-/*
- * In file ``tox/buddy.c''
- */
-
-void ToxPRPL_Tox_onUserConnectionStatusChange(Tox*, int32_t, uint8_t, void*);
-
-void ToxPRPL_Tox_onFriendRequest(struct Tox*, uint8_t const *, uint8_t const *, uint16_t, void*);
-
-void ToxPRPL_Tox_onFriendAction(Tox*, int32_t, uint8_t const *, uint16_t, void*);
-
-void ToxPRPL_Tox_onFriendChangeNickname(Tox*, int32_t, uint8_t const *, uint16_t, void*);
-
-void ToxPRPL_Tox_onFriendChangeStatus(struct Tox*, int32_t, uint8_t, void*);
-
 /*
- * In file ``tox/chat.c''
+ * /toxstats command
  */
+PurpleCmdRet ToxPRPL_Command_stats(PurpleConversation*, const gchar*, gchar**, gchar**, void*);
 
-void ToxPRPL_Tox_onMessageReceived(Tox*, int32_t, uint8_t const *, uint16_t, void*);
-
-void ToxPRPL_Tox_onUserTypingChange(Tox*, int32_t, uint8_t, void*);
-
-// End of Tox Callbacks ------------------------------------------------------------------------------------------------
+// End PRPL Commands ---------------------------------------------------------------------------------------------------
 
 /*
  * Keep Tox active
@@ -111,7 +101,12 @@ static gboolean ToxPRPL_updateConnectionState(gpointer data) {
     PurpleConnection* gc = (PurpleConnection*) data;
     ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(gc);
     if ((plugin != NULL) && (plugin->tox != NULL)) {
+        gint64 started = g_get_monotonic_time();
+        TOXPRPL_TRACE_TOX_DO_ENTRY();
         tox_do(plugin->tox);
+        TOXPRPL_TRACE_TOX_DO_RETURN();
+        ToxPRPL_Metrics_record(plugin->metrics, TOXPRPL_HISTOGRAM_TOX_DO,
+                               (guint64) (g_get_monotonic_time() - started));
     }
     return TRUE;
 }
@@ -131,13 +126,11 @@ gboolean ToxPRPL_updateClientStatus(gpointer gc) {
                                           1,   /* which connection step this is */
                                           2);  /* total number of steps */
         purple_connection_set_state(gc, PURPLE_CONNECTED);
-        purple_debug_info("toxprpl", "DHT connected!\n");
+        toxprpl_log_info("DHT connected!\n");
 
-        // query status of all buddies
+        // query status of all buddies, a chunk per main loop iteration
         PurpleAccount* account = purple_connection_get_account(gc);
-        GSList* buddy_list = purple_find_buddies(account, NULL);
-        g_slist_foreach(buddy_list, ToxPRPL_Purple_getBuddyInfo, gc);
-        g_slist_free(buddy_list);
+        ToxPRPL_Purple_refreshBuddies(gc);
 
         uint8_t our_name[TOX_MAX_NAME_LENGTH + 1];
         uint16_t name_len = tox_get_self_name(plugin->tox, our_name);
@@ -161,15 +154,16 @@ gboolean ToxPRPL_updateClientStatus(gpointer gc) {
 
         PurpleStatus* status = purple_account_get_active_status(account);
         if (status != NULL) {
-            purple_debug_info("toxprpl", "(re)setting status\n");
+            toxprpl_log_info("(re)setting status\n");
             ToxPRPL_Purple_onSetStatus(account, status);
         }
     }
     else if ((plugin->connected == 1) && !tox_isconnected(plugin->tox)) {
         plugin->connected = 0;
-        purple_debug_info("toxprpl", "DHT disconnected!\n");
+        toxprpl_log_info("DHT disconnected!\n");
+        ToxPRPL_Bootstrap_onDisconnected(plugin->bootstrap);
         purple_connection_notice(gc,
-                                 _("Connection to DHT server lost, attempging to reconnect..."));
+                                 _("Connection to DHT server lost, attempting to reconnect..."));
         purple_connection_update_progress(gc, _("Reconnecting..."),
                                           0,   /* which connection step this is */
                                           2);  /* total number of steps */
@@ -189,7 +183,7 @@ static GList* ToxPRPL_getStatusTypes(PurpleAccount* acct) {
     PurpleStatusType* type;
     int i;
 
-    purple_debug_info("toxprpl", "setting up status types\n");
+    toxprpl_log_info("setting up status types\n");
 
     for (i = 0; i < TOXPRPL_MAX_STATUS; i++) {
         type = purple_status_type_new_with_attrs(ToxPRPL_ToxStatuses[i].primitive,
@@ -209,102 +203,77 @@ static GList* ToxPRPL_getStatusTypes(PurpleAccount* acct) {
  * Called by ToxPRPL_synchronizeBuddyList
  * Used to add users not yet present in the libpurple buddy list
  */
-static void ToxPRPL_synchronizeBuddy(PurpleAccount* account, Tox* tox, int friend_number) {
-    uint8_t alias[TOX_MAX_NAME_LENGTH + 1];
-    uint8_t client_id[TOX_CLIENT_ID_SIZE];
-    if (tox_get_client_id(tox, friend_number, client_id) < 0) {
-        purple_debug_info("toxprpl", "Could not get id of friend #%d\n",
-                          friend_number);
-        return;
-    }
-
-    gchar* buddy_key = ToxPRPL_toxClientIdToString(client_id);
-
-
+static void ToxPRPL_synchronizeBuddy(PurpleAccount* account, ToxPRPL_FriendTable* friends, ToxPRPL_Pools* pools,
+                                     int friend_number, const char* buddy_key) {
     PurpleBuddy* buddy;
-    int ret = tox_get_name(tox, friend_number, alias);
-    alias[TOX_MAX_NAME_LENGTH] = '\0';
-    if ((ret == 0) && (strlen((const char*) alias) > 0)) {
-        purple_debug_info("toxprpl", "Got friend alias %s\n", alias);
-        buddy = purple_buddy_new(account, buddy_key, (const char*) alias);
+    const char* alias = ToxPRPL_FriendTable_getName(friends, friend_number);
+    if (alias != NULL) {
+        toxprpl_log_info("Got friend alias %s\n", alias);
+        buddy = purple_buddy_new(account, buddy_key, alias);
     }
     else {
-        purple_debug_info("toxprpl", "Adding [%s]\n", buddy_key);
+        toxprpl_log_info("Adding [%s]\n", buddy_key);
         buddy = purple_buddy_new(account, buddy_key, NULL);
     }
 
-    ToxPRPL_BuddyData* buddy_data = g_new0(ToxPRPL_BuddyData, 1);
-    buddy_data->tox_friendlist_number = friend_number;
-    purple_buddy_set_protocol_data(buddy, buddy_data);
+    ToxPRPL_Purple_setBuddyData(pools, buddy, friend_number);
     purple_blist_add_buddy(buddy, NULL, NULL, NULL);
-    TOX_USERSTATUS userstatus = (TOX_USERSTATUS) tox_get_user_status(tox, friend_number);
-    purple_debug_info("toxprpl", "Friend %s has status %d\n", buddy_key,
-                      userstatus);
-    purple_prpl_got_user_status(account, buddy_key,
-                                ToxPRPL_ToxStatuses[
-                                        ToxPRPL_getStatusTypeIndex(tox, friend_number, userstatus)].id,
-                                NULL);
-    g_free(buddy_key);
+
+    ToxPRPL_FriendTable_showStatus(friends, account, buddy_key, friend_number);
 }
 
 /*
- * Synchronize purple friends with tox friends
+ * Synchronize purple friends with the tox friends in `friends', buddy data comes from `pools'
+ *
+ * Declared in ``toxprpl.h'', so that ``bench/roster_bench.c'' can time it on its own
  */
-static void ToxPRPL_synchronizeBuddyList(PurpleAccount* acct, Tox* tox) {
-    uint32_t i;
-
-    uint32_t fl_len = tox_count_friendlist(tox);
-    int* friendlist = g_malloc0(fl_len * sizeof(int));
+void ToxPRPL_synchronizeBuddyList(PurpleAccount* acct, ToxPRPL_FriendTable* friends, ToxPRPL_Pools* pools) {
+    guint size = friends->size;
+    guint i;
+
+    // the keys of all friends in one block, indexed by friend number like the table
+    char* keys = g_malloc((gsize) MAX(size, 1) * TOXPRPL_CLIENT_ID_HEX_SIZE);
+    guint8* matched = g_malloc0(MAX(size, 1));
+
+    // key -> friend number + 1
+    GHashTable* numbers = g_hash_table_new(g_str_hash, g_str_equal);
+    for (i = 0; i < size; i++) {
+        if (friends->used[i]) {
+            char* key = keys + (gsize) i * TOXPRPL_CLIENT_ID_HEX_SIZE;
+            ToxPRPL_toxClientIdToHex(friends->client_ids + (gsize) i * TOX_CLIENT_ID_SIZE, key);
+            g_hash_table_insert(numbers, key, GUINT_TO_POINTER(i + 1));
+        }
+    }
 
-    fl_len = tox_get_friendlist(tox, friendlist, fl_len);
-    if (fl_len != 0) {
-        purple_debug_info("toxprpl", "got %u friends\n", fl_len);
+    if (friends->count != 0) {
+        toxprpl_log_info("got %u friends\n", friends->count);
         GSList* buddies = purple_find_buddies(acct, NULL);
         GSList* iterator;
-        for (i = 0; i < fl_len; i++) {
-            iterator = buddies;
-            int fnum = friendlist[i];
-            uint8_t bin_id[TOX_CLIENT_ID_SIZE];
-            if (tox_get_client_id(tox, fnum, bin_id) == 0) {
-                gchar* str_id = ToxPRPL_toxClientIdToString(bin_id);
-                while (iterator != NULL) {
-                    PurpleBuddy* buddy = iterator->data;
-                    if (strcmp(buddy->name, str_id) == 0) {
-                        ToxPRPL_BuddyData* buddy_data = g_new0(ToxPRPL_BuddyData, 1);
-                        buddy_data->tox_friendlist_number = fnum;
-                        purple_buddy_set_protocol_data(buddy, buddy_data);
-                        friendlist[i] = -1;
-                    }
-                    iterator = iterator->next;
-                }
-                g_free(str_id);
-            }
-        }
-
-        iterator = buddies;
-        // all left without buddy_data were not present in Tox and must be
-        // removed
-        while (iterator != NULL) {
+        for (iterator = buddies; iterator != NULL; iterator = iterator->next) {
             PurpleBuddy* buddy = iterator->data;
-            ToxPRPL_BuddyData* buddy_data =
-                    purple_buddy_get_protocol_data(buddy);
-            if (buddy_data == NULL) {
+            guint number = GPOINTER_TO_UINT(g_hash_table_lookup(numbers, buddy->name));
+            if (number == 0) {
+                // not present in Tox, must be removed
                 purple_blist_remove_buddy(buddy);
+                continue;
             }
-            iterator = iterator->next;
-        }
 
+            ToxPRPL_Purple_setBuddyData(pools, buddy, (int) (number - 1));
+            matched[number - 1] = TRUE;
+        }
         g_slist_free(buddies);
     }
 
-    // all left in friendlist that were not reset are not yet in blist
-    for (i = 0; i < fl_len; i++) {
-        if (friendlist[i] != -1) {
-            ToxPRPL_synchronizeBuddy(acct, tox, friendlist[i]);
+    // all friends without a buddy are not yet in blist
+    for (i = 0; i < size; i++) {
+        if (friends->used[i] && !matched[i]) {
+            ToxPRPL_synchronizeBuddy(acct, friends, pools, (int) i, keys + (gsize) i * TOXPRPL_CLIENT_ID_HEX_SIZE);
         }
     }
 
-    g_free(friendlist);
+    g_hash_table_destroy(numbers);
+    g_free(matched);
+    g_free(keys);
 }
 
 // ---- end ToxPRPL_synchronizeBuddyList ---------------------------------------------------------------------------------------
@@ -314,7 +283,7 @@ static void ToxPRPL_synchronizeBuddyList(PurpleAccount* acct, Tox* tox) {
  * Opens a dialog prompting the user to import a preexisting tox database
  */
 static void ToxPRPL_promptAccountImport(PurpleAccount* acct) {
-    purple_debug_info("toxprpl", "ask to import user account\n");
+    toxprpl_log_info("ask to import user account\n");
     PurpleConnection* gc = purple_account_get_connection(acct);
 
     purple_request_file(gc,
@@ -335,23 +304,29 @@ static void ToxPRPL_promptAccountImport(PurpleAccount* acct) {
  * Start Tox and register all callbacks
  */
 void ToxPRPL_configureToxAndConnect(PurpleAccount* acct) {
-    purple_debug_info("toxprpl", "logging in...\n");
+    toxprpl_log_info("logging in...\n");
 
     PurpleConnection* gc = purple_account_get_connection(acct);
 
-    Tox* tox = tox_new(0);
+    Tox_Options options;
+    ToxPRPL_getToxOptions(acct, &options);
+
+    Tox* tox = tox_new(&options);
     if (tox == NULL) {
-        purple_debug_info("toxprpl", "Fatal error, could not allocate memory for messenger!\n");
+        toxprpl_log_info("Fatal error, could not allocate memory for messenger!\n");
         return;
     }
 
-    tox_callback_connection_status(tox, ToxPRPL_Tox_onUserConnectionStatusChange, gc);
-    tox_callback_friend_request(tox, ToxPRPL_Tox_onFriendRequest, gc);
-    tox_callback_friend_action(tox, ToxPRPL_Tox_onFriendAction, gc);
-    tox_callback_friend_message(tox, ToxPRPL_Tox_onMessageReceived, gc);
-    tox_callback_name_change(tox, ToxPRPL_Tox_onFriendChangeNickname, gc);
-    tox_callback_user_status(tox, ToxPRPL_Tox_onFriendChangeStatus, gc);
-    tox_callback_typing_change(tox, ToxPRPL_Tox_onUserTypingChange, gc);
+    tox_callback_connection_status(tox, TOXPRPL_TRACED(ToxPRPL_Tox_onUserConnectionStatusChange), gc);
+    tox_callback_friend_request(tox, TOXPRPL_TRACED(ToxPRPL_Tox_onFriendRequest), gc);
+    tox_callback_friend_action(tox, TOXPRPL_TRACED(ToxPRPL_Tox_onFriendAction), gc);
+    tox_callback_friend_message(tox, TOXPRPL_TRACED(ToxPRPL_Tox_onMessageReceived), gc);
+    tox_callback_name_change(tox, TOXPRPL_TRACED(ToxPRPL_Tox_onFriendChangeNickname), gc);
+    tox_callback_user_status(tox, TOXPRPL_TRACED(ToxPRPL_Tox_onFriendChangeStatus), gc);
+    tox_callback_status_message(tox, TOXPRPL_TRACED(ToxPRPL_Tox_onFriendChangeStatusMessage), gc);
+    tox_callback_typing_change(tox, TOXPRPL_TRACED(ToxPRPL_Tox_onUserTypingChange), gc);
+    tox_callback_avatar_info(tox, TOXPRPL_TRACED(ToxPRPL_Tox_onAvatarInfo), gc);
+    tox_callback_avatar_data(tox, TOXPRPL_TRACED(ToxPRPL_Tox_onAvatarData), gc);
 
     /*
      * Implemented in ``tox/group_chat.c''
@@ -369,7 +344,7 @@ void ToxPRPL_configureToxAndConnect(PurpleAccount* acct) {
      *      NOTE: for our purposes, we only want TOX_GROUPCHAT_TYPE_TEXT, as AV is not in the plans
      *
      */
-    tox_callback_group_invite(tox, ToxPRPL_Tox_onGroupInvite, gc);
+    tox_callback_group_invite(tox, TOXPRPL_TRACED(ToxPRPL_Tox_onGroupInvite), gc);
 
     /*
      * callback signature
@@ -377,7 +352,7 @@ void ToxPRPL_configureToxAndConnect(PurpleAccount* acct) {
      *  (Tox* tox, int groupNumber, int peerNumber, const uint8_t* message,
      *   uint16_t length, void* userData) => void
      */
-    tox_callback_group_message(tox, ToxPRPL_Tox_onGroupMessage, gc);
+    tox_callback_group_message(tox, TOXPRPL_TRACED(ToxPRPL_Tox_onGroupMessage), gc);
 
     /*
      * callback signature
@@ -385,7 +360,7 @@ void ToxPRPL_configureToxAndConnect(PurpleAccount* acct) {
      *  (Tox* tox, int groupNumber, int peerNumber, const uint8_t* action,
      *   uint16_t length, void* userData) => void
      */
-    tox_callback_group_action(tox, ToxPRPL_Tox_onGroupAction, gc);
+    tox_callback_group_action(tox, TOXPRPL_TRACED(ToxPRPL_Tox_onGroupAction), gc);
 
     /*
      * callback signature
@@ -393,7 +368,7 @@ void ToxPRPL_configureToxAndConnect(PurpleAccount* acct) {
      *  (Tox* tox, int groupNumber, int peerNumber, uint8_t* title,
      *   uint8_t length, void* userData) => void
      */
-    tox_callback_group_title(tox, ToxPRPL_Tox_onGroupChangeTitle, gc);
+    tox_callback_group_title(tox, TOXPRPL_TRACED(ToxPRPL_Tox_onGroupChangeTitle), gc);
 
     /*
      * callback signature
@@ -401,30 +376,34 @@ void ToxPRPL_configureToxAndConnect(PurpleAccount* acct) {
      *  (Tox* tox, int groupNumber, int peerNumber, TOX_CHAT_CHANGE change,
      *   void* userData) => void
      */
-    tox_callback_group_namelist_change(tox, ToxPRPL_Tox_onGroupNamelistChange, gc);
+    tox_callback_group_namelist_change(tox, TOXPRPL_TRACED(ToxPRPL_Tox_onGroupNamelistChange), gc);
 
     /*
      * Implemented in ``tox/xfers.c''
      */
-    tox_callback_file_send_request(tox, ToxPRPL_Tox_onFileRequest, gc);
-    tox_callback_file_control(tox, ToxPRPL_Tox_onFileControl, gc);
-    tox_callback_file_data(tox, ToxPRPL_Tox_onFileDataReceive, gc);
+    tox_callback_file_send_request(tox, TOXPRPL_TRACED(ToxPRPL_Tox_onFileRequest), gc);
+    tox_callback_file_control(tox, TOXPRPL_TRACED(ToxPRPL_Tox_onFileControl), gc);
+    tox_callback_file_data(tox, TOXPRPL_TRACED(ToxPRPL_Tox_onFileDataReceive), gc);
 
-    purple_debug_info("toxprpl", "initialized tox callbacks\n");
+#ifdef TOXPRPL_TRACING
+    toxprpl_log_info("initialized tox callbacks, with tracing probes\n");
+#else
+    toxprpl_log_info("initialized tox callbacks\n");
+#endif
 
     gc->flags |= PURPLE_CONNECTION_NO_FONTSIZE | PURPLE_CONNECTION_NO_URLDESC;
     gc->flags |= PURPLE_CONNECTION_NO_IMAGES | PURPLE_CONNECTION_NO_NEWLINES;
 
-    purple_debug_info("toxprpl", "logging in %s\n", acct->username);
+    toxprpl_log_info("logging in %s\n", acct->username);
 
     const char* msg64 = purple_account_get_string(acct, "messenger", NULL);
     if ((msg64 != NULL) && (strlen(msg64) > 0)) {
-        purple_debug_info("toxprpl", "found existing account data\n");
+        toxprpl_log_info("found existing account data\n");
         gsize out_len;
         guchar* msg_data = g_base64_decode(msg64, &out_len);
         if (msg_data && (out_len > 0)) {
             if (tox_load(tox, msg_data, (uint32_t) out_len) != 0) {
-                purple_debug_info("toxprpl", "Invalid account data\n");
+                toxprpl_log_info("Invalid account data\n");
                 purple_account_set_string(acct, "messenger", NULL);
             }
             g_free(msg_data);
@@ -440,44 +419,48 @@ void ToxPRPL_configureToxAndConnect(PurpleAccount* acct) {
                                       2);  /* total number of steps */
 
 
-    const char* key = purple_account_get_string(acct, "dht_server_key",
-                                                DEFAULT_SERVER_KEY);
-    /// \todo add limits check to make sure the user did not enter something
-    /// invalid
-    uint16_t port = (uint16_t) purple_account_get_int(acct, "dht_server_port", DEFAULT_SERVER_PORT);
+    ToxPRPL_addTcpRelays(acct, tox);
 
-    const char* ip = purple_account_get_string(acct, "dht_server", DEFAULT_SERVER_IP);
+    ToxPRPL_Bootstrap* bootstrap = ToxPRPL_Bootstrap_new(acct, tox);
 
-    unsigned char* publicKey = ToxPRPL_hexStringToBin(key);
-
-    purple_debug_info("toxprpl", "Will connect to %s:%d (%s)\n", ip, port, key);
-
-    if (tox_bootstrap_from_address(tox, ip, port, publicKey) == 0) {
+    if (!ToxPRPL_Bootstrap_start(bootstrap)) {
         purple_connection_error_reason(gc, PURPLE_CONNECTION_ERROR_NETWORK_ERROR, _("server invalid or not found"));
-        g_free(publicKey);
+        ToxPRPL_Bootstrap_free(bootstrap);
         tox_kill(tox);
         return;
     }
-    g_free(publicKey);
 
-    ToxPRPL_synchronizeBuddyList(acct, tox);
+    ToxPRPL_Pools* pools = ToxPRPL_Pools_new();
+    ToxPRPL_FriendTable* friends = ToxPRPL_FriendTable_new(tox);
+    ToxPRPL_synchronizeBuddyList(acct, friends, pools);
 
     ToxPRPL_PluginData* plugin = g_new0(ToxPRPL_PluginData, 1);
 
     plugin->tox = tox;
+    plugin->pools = pools;
+    plugin->friends = friends;
+    plugin->bootstrap = bootstrap;
+    plugin->metrics = ToxPRPL_Metrics_new();
+    plugin->rate_limiter = ToxPRPL_RateLimiter_new(acct, tox, plugin->metrics);
+    plugin->buddy_keys = ToxPRPL_BuddyKeys_new(friends);
+    plugin->presence = ToxPRPL_Presence_new(acct, friends, plugin->buddy_keys, plugin->metrics);
+    plugin->avatars = ToxPRPL_Avatars_new(gc, tox, friends, plugin->buddy_keys, plugin->metrics);
+    plugin->friend_requests = ToxPRPL_FriendRequests_new(gc, plugin->metrics);
+    plugin->groups = ToxPRPL_GroupTable_new();
     plugin->tox_timer = purple_timeout_add(80, ToxPRPL_updateConnectionState, gc);
-    purple_debug_info("toxprpl", "added messenger timer as %d\n",
-                      plugin->tox_timer);
+    toxprpl_log_info("added messenger timer as %d\n",
+                     plugin->tox_timer);
     plugin->connection_timer = purple_timeout_add_seconds(2,
                                                           ToxPRPL_updateClientStatus,
                                                           gc);
-    purple_debug_info("toxprpl", "added connection timer as %d\n",
-                      plugin->connection_timer);
+    toxprpl_log_info("added connection timer as %d\n",
+                     plugin->connection_timer);
 
 
     gchar* myid_help = "myid  print your tox id which you can give to "
             "your friends";
     gchar* nick_help = "nick &lt;nickname&gt; set your nickname";
+    gchar* stats_help = "toxstats [file]  show connection statistics, or write them to a file";
 
     plugin->myid_command_id = purple_cmd_register("myid", "",
                                                   PURPLE_CMD_P_DEFAULT, PURPLE_CMD_FLAG_IM | PURPLE_CMD_FLAG_CHAT,
@@ -487,6 +470,11 @@ void ToxPRPL_configureToxAndConnect(PurpleAccount* acct) {
                                                   PURPLE_CMD_P_DEFAULT, PURPLE_CMD_FLAG_IM | PURPLE_CMD_FLAG_CHAT,
                                                   TOXPRPL_ID, ToxPRPL_Command_nick, nick_help, gc);
 
+    plugin->stats_command_id = purple_cmd_register("toxstats", "s", PURPLE_CMD_P_DEFAULT,
+                                                   PURPLE_CMD_FLAG_IM | PURPLE_CMD_FLAG_CHAT |
+                                                   PURPLE_CMD_FLAG_ALLOW_WRONG_ARGS,
+                                                   TOXPRPL_ID, ToxPRPL_Command_stats, stats_help, gc);
+
     const char* nick = purple_account_get_string(acct, "nickname", NULL);
     if (!nick || (strlen(nick) == 0)) {
         nick = purple_account_get_username(acct);
@@ -500,7 +488,15 @@ void ToxPRPL_configureToxAndConnect(PurpleAccount* acct) {
     }
 
     purple_connection_set_protocol_data(gc, plugin);
+    ToxPRPL_Purple_watchGroupConversations(gc);
     ToxPRPL_Purple_onSetNickname(gc, nick);
+
+    // Tox does not keep our avatar, it is set again from the account's icon on every login
+    PurpleStoredImage* icon = purple_buddy_icons_find_account_icon(acct);
+    ToxPRPL_Purple_onSetBuddyIcon(gc, icon);
+    if (icon != NULL) {
+        purple_imgstore_unref(icon);
+    }
 }
 
 /*
@@ -547,7 +543,7 @@ void ToxPRPL_initializePRPL(PurpleAccount* acct) {
  */
 void ToxPRPL_shutdownPRPL(PurpleConnection* gc) {
     /* notify other toxprpl accounts */
-    purple_debug_info("toxprpl", "Closing!\n");
+    toxprpl_log_info("Closing!\n");
 
     PurpleAccount* account = purple_connection_get_account(gc);
     ToxPRPL_PluginData* plugin = purple_connection_get_protocol_data(gc);
@@ -561,21 +557,38 @@ void ToxPRPL_shutdownPRPL(PurpleConnection* gc) {
         return;
     }
 
-    purple_debug_info("toxprpl", "removing timers %d and %d\n",
-                      plugin->tox_timer, plugin->connection_timer);
+    toxprpl_log_info("removing timers %d and %d\n",
+                     plugin->tox_timer, plugin->connection_timer);
     purple_timeout_remove(plugin->tox_timer);
     purple_timeout_remove(plugin->connection_timer);
 
     purple_cmd_unregister(plugin->myid_command_id);
     purple_cmd_unregister(plugin->nick_command_id);
+    purple_cmd_unregister(plugin->stats_command_id);
+
+    ToxPRPL_Purple_unwatchGroupConversations(gc);
+    ToxPRPL_Purple_cancelBuddyRefresh(gc);
+    ToxPRPL_Bootstrap_free(plugin->bootstrap);
+    ToxPRPL_RateLimiter_free(plugin->rate_limiter);
+    ToxPRPL_Presence_free(plugin->presence);
+    ToxPRPL_Avatars_free(plugin->avatars);
+    ToxPRPL_FriendRequests_free(plugin->friend_requests);
+    ToxPRPL_BuddyKeys_free(plugin->buddy_keys);
+    ToxPRPL_FriendTable_free(plugin->friends);
+    g_hash_table_destroy(plugin->groups);
+
+    // buddies outlive the connection, their data does not
+    ToxPRPL_Purple_clearBuddyData(plugin->pools, account);
 
     if (!ToxPRPL_saveAccount(account, plugin->tox)) {
         purple_account_set_string(account, "messenger", "");
     }
 
-    purple_debug_info("toxprpl", "shutting down\n");
+    toxprpl_log_info("shutting down\n");
     purple_connection_set_protocol_data(gc, NULL);
     tox_kill(plugin->tox);
+    ToxPRPL_Metrics_free(plugin->metrics);
+    ToxPRPL_Pools_free(plugin->pools);
     g_free(plugin);
 }
 
@@ -586,8 +599,13 @@ void ToxPRPL_shutdownPRPL(PurpleConnection* gc) {
  */
 static void ToxPRPL_destroyBuddy(PurpleBuddy* buddy) {
     if (buddy->proto_data) {
-        ToxPRPL_BuddyData* buddy_data = buddy->proto_data;
-        g_free(buddy_data);
+        // buddies only have data while connected, see ToxPRPL_Purple_clearBuddyData()
+        PurpleConnection* gc = purple_account_get_connection(buddy->account);
+        ToxPRPL_PluginData* plugin = (gc != NULL) ? purple_connection_get_protocol_data(gc) : NULL;
+        if (plugin != NULL) {
+            ToxPRPL_Pools_release(plugin->pools, TOXPRPL_POOL_BUDDY_DATA, buddy->proto_data);
+        }
+        buddy->proto_data = NULL;
     }
 }
 
@@ -611,20 +629,20 @@ static PurplePluginProtocolInfo ToxPRPL_PRPL_Info = {
          */
         .set_status = ToxPRPL_Purple_onSetStatus,
 
+        /*
+         * set_buddy_icon lives inside ``purple/account.c'', it sets our avatar
+         */
+        .set_buddy_icon = ToxPRPL_Purple_onSetBuddyIcon,
+
         // Buddy Icons, status -----------------------------------------------------------------------------------------
 
         /*
-         *  Right now, this is a null implementation of PurpleBuddyIconSpec
-         *  For tox support, this will need to describe
-         *  - format: png
-         *  - width constraints describing least and worst case image sizes from tox
-         *  - largest possible filesize that can be returned by tox
-         *  - scale: preserve ratio
-         *
-         *  How this is handled in reality depends on the frontent implementation.
-         *  Pidgin should be pretty obediant.
+         * Tox avatars are PNG images of at most TOX_AVATAR_MAX_DATA_LENGTH bytes. The frontend scales our
+         * own icon to fit once, when it is set, so it is never scaled or resent afterwards.
          */
-        .icon_spec = NO_BUDDY_ICONS,
+        .icon_spec = {"png", TOXPRPL_AVATAR_MIN_SIZE, TOXPRPL_AVATAR_MIN_SIZE,
+                      TOXPRPL_AVATAR_MAX_SIZE, TOXPRPL_AVATAR_MAX_SIZE,
+                      TOX_AVATAR_MAX_DATA_LENGTH, PURPLE_ICON_SCALE_SEND},
 
         /*
          * If the icon spec is changed to support protocol icons,
@@ -637,7 +655,7 @@ static PurplePluginProtocolInfo ToxPRPL_PRPL_Info = {
         /*
          * Function which will return a buddy/user's status text
          */
-        .status_text = NULL,
+        .status_text = ToxPRPL_Purple_getStatusText,
 
         /*
          * Possible states for any user
@@ -648,7 +666,7 @@ static PurplePluginProtocolInfo ToxPRPL_PRPL_Info = {
          * Buddy tooltip.
          * Perhaps the Tox id could go here, for quick reference
          */
-        .tooltip_text = NULL,
+        .tooltip_text = ToxPRPL_Purple_getTooltipText,
 
         /*
          * Buddy menu additions,
@@ -694,39 +712,35 @@ static PurplePluginProtocolInfo ToxPRPL_PRPL_Info = {
 
         // Group Chats -------------------------------------------------------------------------------------------------
 
+        /*
+         * These functions may be found in ``purple/group_chat.c''
+         */
+
         /*
          * Called when the frontend wants to join a chat
          * Parameter components is as `chat_info` unless the user has accepted an invite,
          * in which case it is as in `serv_got_chat_invite`
          *
-         * TODO: Implement
-         *
          * related tox functions: `tox_add_groupchat`, and `tox_join_groupchat`
          *
          * callback signature: (PurpleConnection*, GHashTable* components) => void
          */
-        .join_chat = NULL,
+        .join_chat = ToxPRPL_Purple_joinChat,
 
         /*
-         * Returns a list of chats in which the user is enrolled
-         *
-         * TODO: Implement
-         *
-         * related tox functions: `tox_count_chatlist`, and `tox_get_chatlist`
+         * Returns the components needed to join (create) a chat
          *
          * callback signature: (PurpleConnection*) => GList* [struct proto_chat_entry]
          */
-        .chat_info = NULL,
+        .chat_info = ToxPRPL_Purple_getChatInfo,
 
         /*
          * Returns a map representing default chat options
          *
-         * TODO: Implement
-         *
          * callback signature: (PurpleConnection*, const char* chatName)
          *                      => GHashTable* [(struct proto_chat_entry) -> char*]
          */
-        .chat_info_defaults = NULL,
+        .chat_info_defaults = ToxPRPL_Purple_getChatInfoDefaults,
 
         /*
          * Called when the frontend rejects a chat invite
@@ -740,15 +754,12 @@ static PurplePluginProtocolInfo ToxPRPL_PRPL_Info = {
         .reject_chat = NULL,
 
         /*
-         * Get the display name of a chat from the internal representation
-         *
-         * TODO: Implement
-         *
-         * related tox function: `tox_group_get_title`
+         * Get the name of a chat from the internal representation
+         * Titles are not unique in Tox, so this is derived from the group number instead
          *
          * callback signature: (GHashTable* components) => char*
          */
-        .get_chat_name = NULL,
+        .get_chat_name = ToxPRPL_Purple_getChatName,
 
         /*
          * Invite a user, `who`, to join chat `id`, with message `message`
@@ -765,19 +776,15 @@ static PurplePluginProtocolInfo ToxPRPL_PRPL_Info = {
         /*
          * Leave chat `id`
          *
-         * TODO: Implement
-         *
          * related tox function: `tox_del_groupchat`
          *
          * callback signature: (PurpleConnection*, int chatId) => void
          */
-        .chat_leave = NULL,
+        .chat_leave = ToxPRPL_Purple_leaveChat,
 
         /*
          * Send a message in a chat, `id`.
          *
-         * TODO: Implement
-         *
          * related tox function: `tox_group_message_send`
          *
          * callback signature: (PurpleConnection*, int chatId, const char* message,
@@ -785,7 +792,7 @@ static PurplePluginProtocolInfo ToxPRPL_PRPL_Info = {
          *
          *                     returns >= 0 if successful
          */
-        .chat_send = NULL,
+        .chat_send = ToxPRPL_Purple_sendChatMessage,
 
         /*
          * Set a group title
@@ -839,7 +846,8 @@ static PurplePluginInfo ToxPRPL_PRPL_Manifest = {
 };
 
 static void ToxPRPL_initPRPL(PurplePlugin* plugin) {
-    purple_debug_info("toxprpl", "starting up\n");
+    ToxPRPL_initLogging(plugin);
+    toxprpl_log_info("starting up\n");
 
     PurpleAccountOption* option = purple_account_option_string_new(
             _("Nickname"), "nickname", "");
@@ -857,7 +865,66 @@ static void ToxPRPL_initPRPL(PurplePlugin* plugin) {
                                               "dht_server_key", DEFAULT_SERVER_KEY);
     ToxPRPL_PRPL_Info.protocol_options = g_list_append(ToxPRPL_PRPL_Info.protocol_options, option);
 
-    purple_debug_info("toxprpl", "initialization complete\n");
+    option = purple_account_option_string_new(_("Bootstrap nodes (host:port:key, ...)"),
+                                              TOXPRPL_OPT_BOOTSTRAP_NODES, DEFAULT_BOOTSTRAP_NODES);
+    ToxPRPL_PRPL_Info.protocol_options = g_list_append(ToxPRPL_PRPL_Info.protocol_options, option);
+
+    option = purple_account_option_string_new(_("TCP relays (host:port:key, ...)"), TOXPRPL_OPT_TCP_RELAYS, "");
+    ToxPRPL_PRPL_Info.protocol_options = g_list_append(ToxPRPL_PRPL_Info.protocol_options, option);
+
+    option = purple_account_option_bool_new(_("Enable IPv6"), TOXPRPL_OPT_IPV6, DEFAULT_IPV6);
+    ToxPRPL_PRPL_Info.protocol_options = g_list_append(ToxPRPL_PRPL_Info.protocol_options, option);
+
+    option = purple_account_option_bool_new(_("Enable UDP (required for LAN discovery)"), TOXPRPL_OPT_UDP,
+                                            DEFAULT_UDP);
+    ToxPRPL_PRPL_Info.protocol_options = g_list_append(ToxPRPL_PRPL_Info.protocol_options, option);
+
+    option = purple_account_option_int_new(_("Messages per second, per friend (0 = unlimited)"),
+                                           TOXPRPL_OPT_SEND_RATE_FRIEND, DEFAULT_SEND_RATE_FRIEND);
+    ToxPRPL_PRPL_Info.protocol_options = g_list_append(ToxPRPL_PRPL_Info.protocol_options, option);
+
+    option = purple_account_option_int_new(_("Messages per second, all friends (0 = unlimited)"),
+                                           TOXPRPL_OPT_SEND_RATE_ACCOUNT, DEFAULT_SEND_RATE_ACCOUNT);
+    ToxPRPL_PRPL_Info.protocol_options = g_list_append(ToxPRPL_PRPL_Info.protocol_options, option);
+
+    option = purple_account_option_int_new(_("Message burst size"),
+                                           TOXPRPL_OPT_SEND_BURST, DEFAULT_SEND_BURST);
+    ToxPRPL_PRPL_Info.protocol_options = g_list_append(ToxPRPL_PRPL_Info.protocol_options, option);
+
+    option = purple_account_option_int_new(_("Queued messages per friend"),
+                                           TOXPRPL_OPT_SEND_QUEUE_SIZE, DEFAULT_SEND_QUEUE_SIZE);
+    ToxPRPL_PRPL_Info.protocol_options = g_list_append(ToxPRPL_PRPL_Info.protocol_options, option);
+
+    GList* policies = NULL;
+    PurpleKeyValuePair* policy = g_new0(PurpleKeyValuePair, 1);
+    policy->key = g_strdup(_("Ask"));
+    policy->value = g_strdup(TOXPRPL_FRIEND_REQUEST_POLICY_ASK);
+    policies = g_list_append(policies, policy);
+    policy = g_new0(PurpleKeyValuePair, 1);
+    policy->key = g_strdup(_("Accept all"));
+    policy->value = g_strdup(TOXPRPL_FRIEND_REQUEST_POLICY_ACCEPT);
+    policies = g_list_append(policies, policy);
+    policy = g_new0(PurpleKeyValuePair, 1);
+    policy->key = g_strdup(_("Reject all"));
+    policy->value = g_strdup(TOXPRPL_FRIEND_REQUEST_POLICY_REJECT);
+    policies = g_list_append(policies, policy);
+
+    option = purple_account_option_list_new(_("Friend requests"), TOXPRPL_OPT_FRIEND_REQUEST_POLICY, policies);
+    ToxPRPL_PRPL_Info.protocol_options = g_list_append(ToxPRPL_PRPL_Info.protocol_options, option);
+
+    option = purple_account_option_int_new(_("Pending friend requests, at most"),
+                                           TOXPRPL_OPT_FRIEND_REQUEST_QUEUE, DEFAULT_FRIEND_REQUEST_QUEUE);
+    ToxPRPL_PRPL_Info.protocol_options = g_list_append(ToxPRPL_PRPL_Info.protocol_options, option);
+
+    option = purple_account_option_int_new(_("Presence update interval in ms (0 = immediate)"),
+                                           TOXPRPL_OPT_PRESENCE_WINDOW, DEFAULT_PRESENCE_WINDOW);
+    ToxPRPL_PRPL_Info.protocol_options = g_list_append(ToxPRPL_PRPL_Info.protocol_options, option);
+
+    option = purple_account_option_bool_new(_("Hold back presence of flapping contacts"),
+                                            TOXPRPL_OPT_PRESENCE_DAMPING, DEFAULT_PRESENCE_DAMPING);
+    ToxPRPL_PRPL_Info.protocol_options = g_list_append(ToxPRPL_PRPL_Info.protocol_options, option);
+
+    toxprpl_log_info("initialization complete\n");
 }
 
 PURPLE_INIT_PLUGIN(tox, ToxPRPL_initPRPL, ToxPRPL_PRPL_Manifest);
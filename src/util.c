@@ -9,53 +9,88 @@
 
 const char* g_HEX_CHARS = "0123456789abcdef";
 
-char* ToxPRPL_binToHexString(const unsigned char* data, const size_t len) {
-    unsigned char* chars;
-    unsigned char hi, lo;
+/*
+ * Nibble value of every character, or -1 for characters that are not hex digits
+ */
+static const gint8 g_HEX_VALUES[256] = {
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+         0,  1,  2,  3,  4,  5,  6,  7,  8,  9, -1, -1, -1, -1, -1, -1, // '0' - '9'
+        -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 'A' - 'F'
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 'a' - 'f'
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+};
+
+gboolean ToxPRPL_binToHex(const unsigned char* data, size_t len, char* out, size_t out_size) {
+    if ((len > (G_MAXSIZE - 1) / 2) || (out_size < (len * 2) + 1)) {
+        return FALSE;
+    }
+
     size_t i;
-    char* buf = malloc((len * 2) + 1);
-    char* p = buf;
-    chars = (unsigned char*) data;
     for (i = 0; i < len; i++) {
-        unsigned char c = chars[i];
-        hi = c >> 4;
-        lo = c & 0xF;
-        *p = g_HEX_CHARS[hi];
-        p++;
-        *p = g_HEX_CHARS[lo];
-        p++;
+        out[i * 2] = g_HEX_CHARS[data[i] >> 4];
+        out[i * 2 + 1] = g_HEX_CHARS[data[i] & 0xF];
     }
-    buf[len * 2] = '\0';
-    return buf;
+    out[len * 2] = '\0';
+    return TRUE;
 }
 
-unsigned char* ToxPRPL_hexStringToBin(const char* s) {
-    size_t len = strlen(s);
-    unsigned char* buf = malloc(len / 2);
-    unsigned char* p = buf;
+gboolean ToxPRPL_hexToBin(const char* s, size_t len, unsigned char* out, size_t out_size) {
+    if ((len % 2 != 0) || (out_size < len / 2)) {
+        return FALSE;
+    }
 
     size_t i;
     for (i = 0; i < len; i += 2) {
-        const char* chi = strchr(g_HEX_CHARS, g_ascii_tolower(s[i]));
-        const char* clo = strchr(g_HEX_CHARS, g_ascii_tolower(s[i + 1]));
-        int hi, lo;
-        if (chi) {
-            hi = chi - g_HEX_CHARS;
-        }
-        else {
-            hi = 0;
+        gint hi = g_HEX_VALUES[(unsigned char) s[i]];
+        gint lo = g_HEX_VALUES[(unsigned char) s[i + 1]];
+        if ((hi | lo) < 0) {
+            return FALSE;
         }
+        out[i / 2] = (unsigned char) ((hi << 4) | lo);
+    }
+    return TRUE;
+}
 
-        if (clo) {
-            lo = clo - g_HEX_CHARS;
-        }
-        else {
-            lo = 0;
-        }
+char* ToxPRPL_binToHexString(const unsigned char* data, const size_t len) {
+    if (len > (G_MAXSIZE - 1) / 2) {
+        return NULL;
+    }
 
-        unsigned char ch = (unsigned char) (hi << 4 | lo);
-        *p = ch;
-        p++;
+    char* buf = malloc((len * 2) + 1);
+    if (buf == NULL) {
+        return NULL;
+    }
+
+    ToxPRPL_binToHex(data, len, buf, (len * 2) + 1);
+    return buf;
+}
+
+unsigned char* ToxPRPL_hexStringToBin(const char* s) {
+    size_t len = strlen(s);
+    if (len % 2 != 0) {
+        return NULL;
+    }
+
+    // one spare byte, so that an empty string still gives a pointer to free
+    unsigned char* buf = malloc((len / 2) + 1);
+    if (buf == NULL) {
+        return NULL;
+    }
+
+    if (!ToxPRPL_hexToBin(s, len, buf, len / 2)) {
+        free(buf);
+        return NULL;
     }
     return buf;
 }
@@ -122,6 +157,14 @@ gchar* ToxPRPL_toxClientIdToString(const uint8_t* bin_id) {
     return ToxPRPL_binToHexString(bin_id, TOX_CLIENT_ID_SIZE);
 }
 
+/*
+ * Writes the Base 16 string representation of the given client ID to `out',
+ * which has room for TOXPRPL_CLIENT_ID_HEX_SIZE characters
+ */
+void ToxPRPL_toxClientIdToHex(const uint8_t* bin_id, char* out) {
+    ToxPRPL_binToHex(bin_id, TOX_CLIENT_ID_SIZE, out, TOXPRPL_CLIENT_ID_HEX_SIZE);
+}
+
 /*
  * Returns a Base 16 string representation of the given friend/user ID
  */
@@ -129,4 +172,46 @@ gchar* ToxPRPL_toxFriendIdToString(uint8_t* bin_id) {
     return ToxPRPL_binToHexString(bin_id, TOX_FRIEND_ADDRESS_SIZE);
 }
 
-// End ID helpers ------------------------------------------------------------------------------------------------------
\ No newline at end of file
+// End ID helpers ------------------------------------------------------------------------------------------------------
+
+// Logging -------------------------------------------------------------------------------------------------------------
+
+/*
+ * Runtime log level, mirrored from TOXPRPL_PREF_LOG_LEVEL so that checking it is just a comparison
+ */
+static PurpleDebugLevel g_LOG_LEVEL = PURPLE_DEBUG_ALL;
+
+static void ToxPRPL_onLogLevelChanged(const char* name, PurplePrefType type, gconstpointer value, gpointer data) {
+    g_LOG_LEVEL = (PurpleDebugLevel) GPOINTER_TO_INT(value);
+}
+
+/*
+ * Register the logging preferences, called once when the plugin is loaded
+ */
+void ToxPRPL_initLogging(PurplePlugin* plugin) {
+    purple_prefs_add_none(TOXPRPL_PREFS_ROOT);
+    purple_prefs_add_int(TOXPRPL_PREF_LOG_LEVEL, PURPLE_DEBUG_ALL);
+
+    g_LOG_LEVEL = (PurpleDebugLevel) purple_prefs_get_int(TOXPRPL_PREF_LOG_LEVEL);
+    purple_prefs_connect_callback(plugin, TOXPRPL_PREF_LOG_LEVEL, ToxPRPL_onLogLevelChanged, NULL);
+}
+
+/*
+ * Whether a message of the given level would end up anywhere.
+ * This mirrors the check purple_debug() does, but before the message is formatted.
+ */
+gboolean ToxPRPL_isLogEnabled(PurpleDebugLevel level) {
+    if (level < g_LOG_LEVEL) {
+        return FALSE;
+    }
+
+    if (purple_debug_is_enabled()) {
+        return TRUE;
+    }
+
+    PurpleDebugUiOps* ops = purple_debug_get_ui_ops();
+    return (ops != NULL) && (ops->print != NULL) &&
+           ((ops->is_enabled == NULL) || ops->is_enabled(level, "toxprpl"));
+}
+
+// End Logging ---------------------------------------------------------------------------------------------------------